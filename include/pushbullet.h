@@ -17,6 +17,7 @@ extern "C" {
 
 #define WARN_UNUSED_RESULT __attribute__((warn_unused_result))
 #define UNUSED __attribute__((unused))
+#define DEPRECATED __attribute__((deprecated))
 #define PB_EXPORT extern
 
 /**
@@ -47,6 +48,26 @@ typedef struct pb_file_s pb_file_t;
 typedef struct pb_push_s pb_push_t;
 
 
+/**
+ * @typedef pb_push_store_t
+ * @brief Type definition of the structure pb_push_store_s
+ */
+typedef struct pb_push_store_s pb_push_store_t;
+
+
+/**
+ * @typedef pb_upload_cache_t
+ * @brief Type definition of the structure pb_upload_cache_s
+ */
+typedef struct pb_upload_cache_s pb_upload_cache_t;
+
+/**
+ * @typedef pb_stream_t
+ * @brief Type definition of the structure pb_stream_s
+ */
+typedef struct pb_stream_s pb_stream_t;
+
+
 /**
  * @typedef pb_phone_t
  * @brief Type definition of the structure pb_phone_s
@@ -89,6 +110,19 @@ typedef struct pb_config_s  pb_config_t;
  */
 typedef struct pb_user_s pb_user_t;
 
+/**
+ * @brief      Hook called before a file is uploaded
+ *
+ * @param      file             The file
+ * @param[in]  size             The size of the file
+ * @param[in]  max_upload_size  The maximum size of a file the user can upload (0 if not known)
+ * @param      userdata         The user data given to \a pb_config_set_upload_hook
+ *
+ * @return     Zero to upload the file, non-zero to cancel its push
+ */
+typedef int (*pb_upload_hook_cb)(pb_file_t *file, size_t size, size_t max_upload_size, void *userdata);
+
+
 /**
  * @brief HTTP codes definition
  */
@@ -211,14 +245,97 @@ int pb_devices_unref(pb_devices_t* p_devices);
 
 /**
  * @brief      Get the devices informations and stores it int a linked list in the user structure
+ * @details    Once a list has been retrieved, the request is conditional (ETag / Last-Modified): when nothing changed,
+ *             the server answers HTTP_NOT_MODIFIED without any body and the current list is kept. Otherwise the new
+ *             list is loaded aside and replaces the current one atomically.
  *
  * @param[in]  user  The user in which we store the devices
  *
- * @return     HTTP status code
+ * @return     HTTP status code (HTTP_OK or HTTP_NOT_MODIFIED on success)
  */
 http_code_t pb_user_retrieve_devices(pb_user_t *user);
 
 
+/**
+ * @brief      Synchronize the devices of the user with the server
+ * @details    Only the devices modified since the last synchronization are downloaded. They are applied to a copy of
+ *             the list of the user, which then replaces it: new devices are added, modified ones are replaced and
+ *             deleted ones are removed. The snapshots taken before keep the previous list.
+ *
+ * @param[in]  user  The user in which we store the devices
+ *
+ * @return     HTTP status code
+ */
+http_code_t pb_user_sync_devices(pb_user_t *user);
+
+
+/**
+ * @brief      Set the lifetime of the devices of the user
+ * @details    The lifetime is used by \a pb_user_refresh_devices and by the refresher of the devices.
+ *
+ * @param      user    The user
+ * @param[in]  ttl_ms  The lifetime in milliseconds (0: the devices are refreshed each time it is asked)
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_user_set_devices_ttl(pb_user_t *user, long ttl_ms);
+
+
+/**
+ * @brief      Set the cache of the devices of the user and load it
+ * @details    After each refresh which changes them, the devices are saved in the cache. If the user has no devices
+ *             yet, the ones of the cache are loaded right away and revalidated in the background: the next
+ *             refresh (\a pb_user_refresh_devices) only asks for the devices modified since the cache was written.
+ *
+ * @param      user  The user
+ * @param[in]  path  The path of the cache (it does not have to exist)
+ *
+ * @return     On success (even if there was no cache to load): zero
+ * @return     On error: non-zero integer
+ */
+int pb_user_set_devices_cache(pb_user_t *user, const char *path);
+
+
+/**
+ * @brief      Refresh the devices of the user if they are older than their lifetime
+ * @details    The refreshes go through a single-flight gate: a caller asking for a refresh while another one is in
+ *             flight sends no request, it waits for the one in flight and gets its result.
+ *
+ * @param[in]  user  The user in which we store the devices
+ *
+ * @return     HTTP status code of the request (HTTP_OK or HTTP_NOT_MODIFIED on success)
+ * @return     HTTP_NOT_MODIFIED without any request if the devices are younger than their lifetime
+ */
+http_code_t pb_user_refresh_devices(pb_user_t *user);
+
+
+/**
+ * @brief      Start the thread refreshing the devices of the user in the background
+ * @details    The devices are refreshed (\a pb_user_refresh_devices) right away, then each time their lifetime
+ *             expires. A failed refresh is retried after a whole lifetime. The thread does not hold any reference
+ *             on the user: it is stopped by the last \a pb_user_unref.
+ *
+ * @param      user  The user, whose lifetime of the devices is set (\a pb_user_set_devices_ttl)
+ *
+ * @return     On success: zero
+ * @return     On error (no lifetime, already started): non-zero integer
+ */
+int pb_user_start_devices_refresher(pb_user_t *user);
+
+
+/**
+ * @brief      Stop the thread refreshing the devices of the user and wait for its end
+ * @details    A refresh in flight is completed first.
+ *
+ * @param      user  The user
+ *
+ * @return     On success (or if the thread was not started): zero
+ * @return     On error: non-zero integer
+ */
+int pb_user_stop_devices_refresher(pb_user_t *user);
+
+
 /**
  * @brief      Clear all the devices list of the given user
  *
@@ -237,6 +354,19 @@ void pb_devices_free_list(const pb_user_t *user);
  */
 WARN_UNUSED_RESULT const char* pb_devices_get_iden_from_name(const pb_devices_t *devices, const char *nickname);
 
+/**
+ * @brief      Get the identification of a device from its name, ignoring the case and the blanks
+ * @details    The ASCII letters are compared without their case and the runs of blanks are compared as a single
+ *             space, so "  pixel\t 7 " finds the device named "Pixel 7". When several devices match, the first one
+ *             indexed is returned, as with \a pb_devices_get_iden_from_name.
+ *
+ * @param[in]  devices   The devices
+ * @param[in]  nickname  The name of the device
+ *
+ * @return     The device's identification
+ */
+WARN_UNUSED_RESULT const char* pb_devices_get_iden_from_normalized_name(const pb_devices_t *devices, const char *nickname);
+
 /**
  * @}
  */
@@ -247,6 +377,18 @@ WARN_UNUSED_RESULT const char* pb_devices_get_iden_from_name(const pb_devices_t
  * @{
  */
 
+/**
+ * @brief      Callback reporting the progress of an upload
+ *
+ * @param[in]  sent      The number of bytes sent
+ * @param[in]  total     The number of bytes to send (0 if not known yet)
+ * @param[in]  rate      The rate since the previous call (in bytes per second)
+ * @param      userdata  The user data given to \a pb_file_set_progress_callback
+ *
+ * @return     Zero to continue, non-zero to abort the upload
+ */
+typedef int (*pb_progress_cb)(size_t sent, size_t total, double rate, void *userdata);
+
 /**
  * @brief      Send a note
  *
@@ -273,16 +415,538 @@ http_code_t pb_push_link(char *result, size_t *result_sz, const pb_link_t link,
 
 /**
  * @brief      Send a file on the server
+ * @details    The upload hook of the configuration runs first. A file over the maximum upload size of the user is
+ *             refused before any request.
  *
  * @param      result           The result
  * @param      file             The file
  * @param[in]  device_nickname  The device nickname
  * @param[in]  user             The user
  *
- * @return      The HTTP status code to the \a pb_requests_post
+ * @return      The HTTP status code to the \a pb_requests_post, HTTP_PAYLOAD_TOO_LARGE for a file too large
  */
 http_code_t pb_push_file(char *result, size_t *result_sz, pb_file_t *file, const char *device_nickname, const pb_user_t* user);
 
+/**
+ * @brief      Send several files
+ * @details    The files go through a pipeline: the MIME detection and upload-request of a file run while the
+ *             previous ones are uploaded or pushed. Each stage runs on a bounded number of threads.
+ *
+ * @param      files            The files
+ * @param[in]  nb_files         The number of files
+ * @param[out] results          The HTTP status code of each file (HTTP_OK when the file has been pushed, otherwise
+ *                              the status code of the stage that failed)
+ * @param[in]  device_nickname  The device nickname
+ * @param[in]  user             The user
+ *
+ * @return     HTTP_OK if every file has been pushed, otherwise the first failed result
+ */
+http_code_t pb_push_files(pb_file_t **files, size_t nb_files, http_code_t *results, const char *device_nickname, const pb_user_t* user);
+
+/**
+ * @brief      Create a file to send
+ *
+ * @param[in]  file_path  The path of the file
+ * @param[in]  title      The push's title (may be NULL)
+ * @param[in]  body       The push's body (may be NULL)
+ *
+ * @return     On success: pointer to the new file
+ * @return     On error: NULL
+ */
+WARN_UNUSED_RESULT pb_file_t* pb_file_new(const char *file_path, const char *title, const char *body);
+
+/**
+ * @brief      Create a file to send from a buffer
+ * @details    The content is neither copied nor written on the filesystem: it is uploaded from the buffer, which
+ *             must stay valid until the file is sent.
+ *
+ * @param[in]  data       The content of the file
+ * @param[in]  size       The size of the content
+ * @param[in]  file_name  The file name
+ * @param[in]  file_type  The MIME type (NULL to detect it from the content)
+ * @param[in]  title      The push's title (may be NULL)
+ * @param[in]  body       The push's body (may be NULL)
+ *
+ * @return     On success: pointer to the new file
+ * @return     On error: NULL
+ */
+WARN_UNUSED_RESULT pb_file_t* pb_file_new_from_buffer(const void *data, size_t size, const char *file_name, const char *file_type, const char *title, const char *body);
+
+/**
+ * @brief      Replace the content of a file with a buffer
+ * @details    The buffer is not copied and must stay valid until the file is sent.
+ *
+ * @param      file       The file
+ * @param[in]  data       The new content
+ * @param[in]  size       The size of the new content
+ * @param[in]  file_type  The MIME type (NULL to detect it from the content)
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_file_set_data(pb_file_t *file, const void *data, size_t size, const char *file_type);
+
+/**
+ * @brief      Free a file
+ *
+ * @param      file  The file
+ */
+void pb_file_free(pb_file_t *file);
+
+/**
+ * @brief      Report the progress of the upload of a file
+ * @details    The callback is called from the thread that uploads the file, at most every few hundred milliseconds
+ *             and once at the end of the upload.
+ *
+ * @param      file      The file
+ * @param[in]  cb        The callback (NULL to remove it)
+ * @param      userdata  The user data given to the callback
+ */
+void pb_file_set_progress_callback(pb_file_t *file, pb_progress_cb cb, void *userdata);
+
+/**
+ * @brief      Get the URL of a sent file
+ *
+ * @param[in]  file  The file
+ *
+ * @return     The URL or NULL if the file has not been uploaded
+ */
+const char* pb_file_get_url(const pb_file_t* file);
+
+/**
+ * @brief      Callback receiving one page of pushes
+ *
+ * @param[in]  pushes     The pushes of the page. They are only valid during the call.
+ * @param[in]  nb_pushes  The number of pushes in the page
+ * @param      userdata   The user data given to \a pb_pushes_retrieve
+ *
+ * @return     Zero to continue with the next page, non-zero to stop the retrieval
+ */
+typedef int (*pb_pushes_cb)(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata);
+
+/**
+ * @brief      Retrieve the push history page by page
+ * @details    The cursor returned by the server is followed until the last page. The next page is downloaded while
+ *             the current one is parsed and given to the callback. When the callback stops the retrieval, that download
+ *             is aborted: the retrieval returns within a second.
+ *
+ * @param[in]  user            The user
+ * @param[in]  modified_after  Only retrieve the pushes modified after this timestamp (0 for the whole history)
+ * @param[in]  limit           Maximum number of pushes per page (0 for the server default)
+ * @param[in]  cb              The callback called for each page
+ * @param      userdata        The user data given to the callback
+ *
+ * @return     The HTTP status code of the last request
+ */
+http_code_t pb_pushes_retrieve(const pb_user_t *user, double modified_after, size_t limit, pb_pushes_cb cb, void *userdata);
+
+/**
+ * @brief      Retrieve the pushes modified since the watermark
+ * @details    Created, modified and deleted (inactive) pushes are given to the callback so it can apply them to the
+ *             local model. Once every page has been retrieved, the watermark is raised to the largest modification
+ *             seen. If the synchronization fails or is stopped, the watermark is left untouched.
+ *
+ * @param[in]  user       The user
+ * @param      watermark  The largest modification timestamp already applied (0 for the whole history)
+ * @param[in]  cb         The callback called for each page
+ * @param      userdata   The user data given to the callback
+ *
+ * @return     The HTTP status code of the last request
+ */
+http_code_t pb_pushes_sync(const pb_user_t *user, double *watermark, pb_pushes_cb cb, void *userdata);
+
+/**
+ * @brief      Check if the push is active (a deleted push is not active)
+ */
+unsigned char pb_push_is_active(const pb_push_t *push);
+
+/**
+ * @brief      Check if the push has been dismissed
+ */
+unsigned char pb_push_is_dismissed(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's identification
+ */
+const char* pb_push_get_iden(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's type (note, link, file)
+ */
+const char* pb_push_get_type(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's title
+ */
+const char* pb_push_get_title(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's body
+ */
+const char* pb_push_get_body(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's direction (self, outgoing, incoming)
+ */
+const char* pb_push_get_direction(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's sender name
+ */
+const char* pb_push_get_sender_name(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's creation timestamp
+ */
+double pb_push_get_created(const pb_push_t *push);
+
+/**
+ * @brief      Get the push's last modification timestamp
+ */
+double pb_push_get_modified(const pb_push_t *push);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup  pb_push_store  Pushbullet local push store
+ * @{
+ */
+
+/**
+ * @brief      Create a new push store
+ * @details    Pushes are indexed by identification and by modification. When the memory used goes over the limit,
+ *             the least recently used pushes are evicted.
+ *
+ * @param[in]  memory_limit  The maximum memory used by the store (0 for no limit)
+ *
+ * @return     On success: pointer to the new store
+ * @return     On error: NULL
+ */
+WARN_UNUSED_RESULT pb_push_store_t* pb_push_store_new(size_t memory_limit);
+
+/**
+ * @brief      Create a push store from a snapshot
+ * @details    The snapshot is mapped in memory and the lookups are served from the mapping. Only the pushes modified
+ *             since the watermark of the snapshot are retrieved by \a pb_push_store_sync. Only the header and the
+ *             hash index are checked here: the pushes are checked block by block on their first read, and those of
+ *             a corrupted block are ignored.
+ *
+ * @param[in]  path          The path of the snapshot written by \a pb_push_store_save
+ * @param[in]  memory_limit  The maximum memory used by the pushes applied after the loading (0 for no limit)
+ *
+ * @return     On success: pointer to the new store
+ * @return     On error (missing, incompatible snapshot or corrupted header or index): NULL
+ */
+WARN_UNUSED_RESULT pb_push_store_t* pb_push_store_new_from_snapshot(const char* path, size_t memory_limit);
+
+/**
+ * @brief      Save the store and its watermark in a snapshot
+ *
+ * @param      store  The store
+ * @param[in]  path   The path of the snapshot
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_push_store_save(pb_push_store_t* store, const char* path);
+
+/**
+ * @brief      Increase the reference counter of the store
+ *
+ * @param      store  The store
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_push_store_ref(pb_push_store_t* store);
+
+/**
+ * @brief      Decrease the reference counter of the store and free it when it reaches zero
+ *
+ * @param      store  The store
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_push_store_unref(pb_push_store_t* store);
+
+/**
+ * @brief      Apply a push to the store
+ * @details    The push is copied. An inactive push removes the stored one; an older version of a stored push is
+ *             ignored.
+ *
+ * @param      store  The store
+ * @param[in]  push   The push
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_push_store_apply(pb_push_store_t* store, const pb_push_t* push);
+
+/**
+ * @brief      Get a push from its identification
+ *
+ * @param      store  The store
+ * @param[in]  iden   The identification
+ *
+ * @return     The push, or NULL if unknown. It stays valid, even if the store replaces, deletes or evicts it meanwhile,
+ *             until it is released with \a pb_push_store_release (before the store is freed).
+ */
+WARN_UNUSED_RESULT const pb_push_t* pb_push_store_lookup(pb_push_store_t* store, const char* iden);
+
+/**
+ * @brief      Release a push given by \a pb_push_store_lookup
+ *
+ * @param      store  The store
+ * @param[in]  push   The push
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_push_store_release(pb_push_store_t* store, const pb_push_t* push);
+
+/**
+ * @brief      Give the pushes modified in a time range, sorted by modification
+ * @details    The range is taken at once, then given to the callback by batches without holding the lock of the
+ *             store: the callback may look up or modify the store. A non-zero return stops the range.
+ *
+ * @param      store            The store
+ * @param[in]  modified_after   Only give the pushes modified after this timestamp
+ * @param[in]  modified_before  Only give the pushes modified before this timestamp (0 for no limit)
+ * @param[in]  cb               The callback
+ * @param      userdata         The user data given to the callback
+ *
+ * @return     The number of pushes given to the callback
+ */
+size_t pb_push_store_range(pb_push_store_t* store, double modified_after, double modified_before, pb_pushes_cb cb, void *userdata);
+
+/**
+ * @brief      Get the number of pushes in the store
+ */
+size_t pb_push_store_get_number(pb_push_store_t* store);
+
+/**
+ * @brief      Get the memory used by the store
+ * @details    The pushes count for the bytes they use, not for the whole chunks of memory holding them.
+ */
+size_t pb_push_store_get_memory(pb_push_store_t* store);
+
+/**
+ * @brief      Get the watermark of the last synchronization of the store
+ */
+double pb_push_store_get_modified_after(pb_push_store_t* store);
+
+/**
+ * @brief      Apply the pushes modified since the last synchronization of the store
+ *
+ * @param      store  The store
+ * @param[in]  user   The user
+ *
+ * @return     The HTTP status code of the last request
+ */
+http_code_t pb_push_store_sync(pb_push_store_t* store, const pb_user_t* user);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup  pb_upload_cache  Pushbullet upload cache
+ * @{
+ */
+
+/**
+ * @brief      Create a cache of the uploaded contents
+ * @details    When the configuration has a cache, a file whose content (SHA-256) has already been uploaded is pushed
+ *             again with the same URL, without any upload-request or upload.
+ *
+ * @param[in]  path  The path of the cache file, read now and appended at each upload (NULL for no persistence)
+ * @param[in]  ttl   The lifetime of an entry in seconds (0 for one day)
+ *
+ * @return     On success: pointer to the new cache
+ * @return     On error: NULL
+ */
+WARN_UNUSED_RESULT pb_upload_cache_t* pb_upload_cache_new(const char *path, long ttl);
+
+/**
+ * @brief      Increase the reference counter of the cache
+ *
+ * @param      cache  The cache
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_upload_cache_ref(pb_upload_cache_t* cache);
+
+/**
+ * @brief      Decrease the reference counter of the cache and free it when it reaches zero
+ *
+ * @param      cache  The cache
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_upload_cache_unref(pb_upload_cache_t* cache);
+
+/**
+ * @brief      Rewrite the cache file without the expired and replaced entries
+ *
+ * The insertions rewrite it as well once the file holds more than twice as many
+ * lines as live entries.
+ *
+ * @param      cache  The cache
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_upload_cache_save(pb_upload_cache_t* cache);
+
+/**
+ * @brief      Get the number of entries of the cache
+ *
+ * The expired entries are dropped when a lookup meets them or before the table grows,
+ * so some of them may still be counted.
+ */
+size_t pb_upload_cache_get_number(pb_upload_cache_t* cache);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup  pb_stream  Pushbullet real-time event stream
+ * @{
+ */
+
+/**
+ * @brief Events received from the stream
+ */
+typedef enum pb_stream_event_e {
+    PB_STREAM_EVENT_NOP = 0,             ///< Heartbeat sent by the server every 30 seconds
+    PB_STREAM_EVENT_TICKLE,             ///< Something changed on the server (subtype "push" or "device")
+    PB_STREAM_EVENT_PUSH,             ///< Ephemeral push (subtype is its type: "mirror", "dismissal", "clip"...)
+    PB_STREAM_EVENT_CONNECTED,             ///< The connection has been (re)established and the catch-up is done
+    PB_STREAM_EVENT_DISCONNECTED,             ///< The connection has been lost, the stream reconnects
+    PB_STREAM_NB_EVENTS             ///< Number of events
+} pb_stream_event_t;
+
+/**
+ * @brief      Callback called on the stream thread for each event received
+ *
+ * @param[in]  event     The event
+ * @param[in]  subtype   The subtype of the event (may be NULL)
+ * @param[in]  data      The JSON object of an ephemeral push (NULL for the other events)
+ * @param      userdata  The user data given to \a pb_stream_set_callback
+ */
+typedef void (*pb_stream_cb)(pb_stream_event_t event, const char *subtype, const char *data, void *userdata);
+
+/**
+ * @brief      Create a stream of the real-time events of the user
+ * @details    The URL, the token key and the proxy are taken from the configuration of the user when the stream starts.
+ *
+ * @param      user  The user (the stream takes a reference)
+ *
+ * @return     On success: pointer to the new stream
+ * @return     On error: NULL
+ */
+WARN_UNUSED_RESULT pb_stream_t* pb_stream_new(pb_user_t *user);
+
+/**
+ * @brief      Increase the reference counter of the stream
+ *
+ * @param      stream  The stream
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_ref(pb_stream_t* stream);
+
+/**
+ * @brief      Decrease the reference counter of the stream and free it when it reaches zero
+ * @details    The last reference stops the stream. When it is dropped by a callback of the stream, the thread stops
+ *             once the callback returns and frees the stream itself: no other event is dispatched.
+ *
+ * @param      stream  The stream
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_unref(pb_stream_t* stream);
+
+/**
+ * @brief      Set the callback of an event
+ *
+ * @param      stream    The stream
+ * @param[in]  event     The event
+ * @param[in]  cb        The callback (NULL to ignore the event)
+ * @param      userdata  The user data given to the callback
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_set_callback(pb_stream_t* stream, pb_stream_event_t event, pb_stream_cb cb, void *userdata);
+
+/**
+ * @brief      Let the stream synchronize the pushes
+ * @details    The pushes modified since the watermark are given to the callback on the stream thread: after each
+ *             connection (the catch-up of what has been missed while disconnected) and on each push tickle, before
+ *             the tickle is dispatched. A push is given once per modification, even when a failed catch-up is retried.
+ *             To be called before \a pb_stream_start.
+ *
+ * @param      stream     The stream
+ * @param[in]  watermark  The largest modification already known (for example \a pb_push_store_get_modified_after)
+ * @param[in]  cb         The callback (NULL to stop the synchronization)
+ * @param      userdata   The user data given to the callback
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_sync_pushes(pb_stream_t* stream, double watermark, pb_pushes_cb cb, void *userdata);
+
+/**
+ * @brief      Let the stream synchronize the devices of the user (\a pb_user_sync_devices)
+ * @details    The devices are synchronized after each connection and on each device tickle, before the tickle is
+ *             dispatched. To be called before \a pb_stream_start.
+ *
+ * @param      stream  The stream
+ * @param[in]  enable  Non-zero to synchronize the devices
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_sync_devices(pb_stream_t* stream, unsigned char enable);
+
+/**
+ * @brief      Get the largest modification of the pushes given to the synchronization callback
+ */
+double pb_stream_get_watermark(pb_stream_t* stream);
+
+/**
+ * @brief      Connect to the stream and start the thread dispatching its events
+ * @details    When the connection is lost, the thread reconnects with an exponential backoff and catches up with
+ *             what has been missed before dispatching the new messages.
+ *
+ * @param      stream  The stream
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_start(pb_stream_t* stream);
+
+/**
+ * @brief      Close the connection and wait for the end of the stream thread
+ * @details    Called from a callback of the stream, it does not wait: the thread stops once the callback returns, and
+ *             is joined by the next call made from another thread (or by the last \a pb_stream_unref).
+ *
+ * @param      stream  The stream
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_stream_stop(pb_stream_t* stream);
+
 /**
  * @}
  */
@@ -356,6 +1020,15 @@ char* pb_user_get_email(const pb_user_t* p_user);
  */
 char* pb_user_get_iden(const pb_user_t* p_user);
 
+/**
+ * @brief      Get the maximum size of a file the user can upload
+ *
+ * @param[in]  p_user  Pointer to the user
+ *
+ * @return     The size in bytes (0 if not known)
+ */
+size_t pb_user_get_max_upload_size(const pb_user_t* p_user);
+
 
 /**
  * @brief      Set the configuration for a user
@@ -380,6 +1053,8 @@ WARN_UNUSED_RESULT pb_config_t* pb_user_get_config(const pb_user_t* p_user);
 
 /**
  * @brief      Get the devices associated to a user
+ * @details    No reference is taken: the list is released by the next refresh of the devices. A thread reading the
+ *             devices while another one refreshes them must use \a pb_user_acquire_devices.
  *
  * @param      p_user    Pointer to the user
  *
@@ -388,6 +1063,18 @@ WARN_UNUSED_RESULT pb_config_t* pb_user_get_config(const pb_user_t* p_user);
  */
 WARN_UNUSED_RESULT pb_devices_t* pb_user_get_devices(const pb_user_t* p_user);
 
+/**
+ * @brief      Take a snapshot of the devices associated to a user
+ * @details    A refresh builds a new list and publishes it with an atomic swap: the snapshot is never modified and
+ *             stays valid until it is released with \a pb_devices_unref. Taking a snapshot never waits for a refresh.
+ *
+ * @param      p_user    Pointer to the user
+ *
+ * @return     On success: the devices, with a reference owned by the caller
+ * @return     If the user has no devices: NULL
+ */
+WARN_UNUSED_RESULT pb_devices_t* pb_user_acquire_devices(const pb_user_t* p_user);
+
 /**
  * @brief      Get the number of devices associated to a user
  *
@@ -398,14 +1085,40 @@ WARN_UNUSED_RESULT pb_devices_t* pb_user_get_devices(const pb_user_t* p_user);
 WARN_UNUSED_RESULT size_t pb_user_get_number_active_devices(const pb_user_t *p_user);
 
 
-const char* pb_user_get_device_iden_from_name(const pb_user_t *p_user, const char* nickname);
+/**
+ * @brief      Get the identification of a device of the user from its nickname
+ * @details    Deprecated: the identification belongs to the current list of devices, a refresh on another thread may
+ *             release it while it is read. Use \a pb_user_dup_device_iden_from_name instead.
+ *
+ * @param      p_user    Pointer to the user
+ * @param[in]  nickname  The nickname of the device
+ *
+ * @return     On success: the identification of the device, valid until the next refresh of the devices
+ * @return     If the device is unknown: NULL
+ */
+DEPRECATED const char* pb_user_get_device_iden_from_name(const pb_user_t *p_user, const char* nickname);
+
+/**
+ * @brief      Copy the identification of a device of the user from its nickname
+ * @details    The copy stays valid when the devices are refreshed. To look up several devices without any copy, use
+ *             a snapshot (\a pb_user_acquire_devices, \a pb_devices_get_iden_from_name).
+ *
+ * @param      p_user    Pointer to the user
+ * @param[in]  nickname  The nickname of the device
+ *
+ * @return     On success: the identification of the device. It has to be freed after.
+ * @return     If the device is unknown or on error: NULL
+ */
+WARN_UNUSED_RESULT char* pb_user_dup_device_iden_from_name(const pb_user_t *p_user, const char* nickname);
 
 /**
  * @brief      Get the user's informations from the Pushbullet servers.
+ * @details    Once the informations have been retrieved, the request is conditional (ETag / Last-Modified): when
+ *             nothing changed, the server answers HTTP_NOT_MODIFIED without any body and the user is kept untouched.
  *
  * @param      p_user    Pointer to the user
  *
- * @return     The HTTP code of the Curl request
+ * @return     The HTTP code of the Curl request (HTTP_OK or HTTP_NOT_MODIFIED on success)
  */
 http_code_t pb_user_get_info(pb_user_t *p_user);
 
@@ -464,6 +1177,58 @@ int pb_config_set_proxy(pb_config_t* p_config, const char* proxy);
  */
 int pb_config_set_timeout(pb_config_t* p_config, const long timeout);
 
+/**
+ * @brief      Set the hook called before a file is uploaded
+ * @details    The hook can replace the content of the file (for example with a compressed version) with
+ *             \a pb_file_set_data before its size is checked against the maximum upload size.
+ *
+ * @param      p_config  Pointer to the configuration
+ * @param[in]  hook      The hook (NULL to remove it)
+ * @param      userdata  The user data given to the hook
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_config_set_upload_hook(pb_config_t* p_config, pb_upload_hook_cb hook, void* userdata);
+
+/**
+ * @brief      Set the cache of the uploaded contents used by the file pushes
+ *
+ * @param      p_config  Pointer to the configuration
+ * @param      cache     The cache (NULL to remove it). The configuration takes a reference.
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_config_set_upload_cache(pb_config_t* p_config, pb_upload_cache_t* cache);
+
+/**
+ * @brief      Set the URL of the real-time event stream
+ * @details    The token key is appended to the URL. Setting a local URL (for example "ws://localhost:8080/websocket/")
+ *             lets a mock server stand in for the Pushbullet one.
+ *
+ * @param      p_config    Pointer to the configuration
+ * @param[in]  stream_url  The URL ("ws://" or "wss://"), NULL for the Pushbullet stream
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_config_set_stream_url(pb_config_t* p_config, const char* stream_url);
+
+/**
+ * @brief      Set the URL of the REST API
+ * @details    Every request to the Pushbullet API ("https://api.pushbullet.com/v2/...") is sent to this URL instead.
+ *             Setting a local URL (for example "http://localhost:8080/v2/") lets a mock server stand in for the
+ *             Pushbullet one. The URLs given by the API itself (the uploads) are kept.
+ *
+ * @param      p_config  Pointer to the configuration
+ * @param[in]  api_url   The URL, ending with a '/', NULL for the Pushbullet API
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_config_set_api_url(pb_config_t* p_config, const char* api_url);
+
 /**
  * @brief      Set the configuration's token_key value
  *
@@ -505,6 +1270,26 @@ WARN_UNUSED_RESULT long pb_config_get_timeout(const pb_config_t* p_config);
  */
 WARN_UNUSED_RESULT char* pb_config_get_token_key(const pb_config_t* p_config);
 
+/**
+ * @brief      Retrieve the URL of the real-time event stream from the configuration
+ *
+ * @param[in]  p_config  Pointer to the configuration
+ *
+ * @return     On success: a copy of the URL. It has to be freed after.
+ * @return     On error or when the Pushbullet stream is used: NULL
+ */
+WARN_UNUSED_RESULT char* pb_config_get_stream_url(const pb_config_t* p_config);
+
+/**
+ * @brief      Retrieve the URL of the REST API from the configuration
+ *
+ * @param[in]  p_config  Pointer to the configuration
+ *
+ * @return     On success: a copy of the URL. It has to be freed after.
+ * @return     On error or when the Pushbullet API is used: NULL
+ */
+WARN_UNUSED_RESULT char* pb_config_get_api_url(const pb_config_t* p_config);
+
 /**
  * @brief      Fill the configuration structure using the given JSON file path
  *
@@ -0,0 +1,250 @@
+/**
+ * @file pb_arena.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdlib.h>          // malloc, free
+#include <string.h>          // memcpy, strlen
+
+#include "pb_utils.h"             // eprintf
+#include "pb_arena_prot.h"        // pb_arena_t, pb_arena_chunk_t, PB_ARENA_CHUNK_SIZE
+
+
+/**
+ * @brief Alignment of the allocations
+ */
+#define ARENA_ALIGN     (sizeof(void *) > sizeof(double) ? sizeof(void *) : sizeof(double))
+
+
+/**
+ * @brief      Allocate a new chunk
+ *
+ * @param      arena  The arena
+ * @param[in]  size   The minimum size of the data of the chunk
+ *
+ * @return     The new chunk or NULL
+ */
+static pb_arena_chunk_t* arena_new_chunk(pb_arena_t *arena, size_t size);
+
+/**
+ * @brief      Unlink a chunk from the arena and free it
+ */
+static void arena_free_chunk(pb_arena_t *arena, pb_arena_chunk_t *chunk);
+
+/**
+ * @brief      Bump an allocation into the arena
+ */
+static void* arena_bump(pb_arena_t *arena, size_t size, size_t align, pb_arena_chunk_t **chunk);
+
+
+void pb_arena_init(pb_arena_t *arena,
+                   size_t     chunk_size
+                   )
+{
+    if ( arena )
+    {
+        memset(arena, 0, sizeof(*arena) );
+        arena->chunk_size = (chunk_size > 0) ? chunk_size : PB_ARENA_CHUNK_SIZE;
+    }
+}
+
+
+void* pb_arena_alloc(pb_arena_t       *arena,
+                     size_t           size,
+                     pb_arena_chunk_t **chunk
+                     )
+{
+    return arena_bump(arena, size, ARENA_ALIGN, chunk);
+}
+
+
+char* pb_arena_strdup(pb_arena_t *arena,
+                      const char *str
+                      )
+{
+    size_t  len = 0;
+    char    *copy = NULL;
+
+    if ( (! arena) || (! str) )
+    {
+        return (NULL);
+    }
+
+    len = strlen(str) + 1;
+
+    // Strings do not need to be aligned
+    if ( (copy = arena_bump(arena, len, 1, NULL)) != NULL )
+    {
+        memcpy(copy, str, len);
+    }
+
+    return (copy);
+}
+
+
+void pb_arena_release(pb_arena_t       *arena,
+                      pb_arena_chunk_t *chunk,
+                      size_t           size
+                      )
+{
+    if ( (! arena) || (! chunk) )
+    {
+        return;
+    }
+
+    chunk->live = (chunk->live > size) ? chunk->live - size : 0;
+    arena->live = (arena->live > size) ? arena->live - size : 0;
+
+    // The current chunk is kept: new allocations are still bumped into it
+    if ( (chunk->live == 0) && (chunk != arena->current) )
+    {
+        arena_free_chunk(arena, chunk);
+    }
+}
+
+
+void pb_arena_clear(pb_arena_t *arena)
+{
+    if ( ! arena )
+    {
+        return;
+    }
+
+    while ( arena->current )
+    {
+        arena_free_chunk(arena, arena->current);
+    }
+
+    arena->allocated = 0;
+    arena->live = 0;
+}
+
+
+static pb_arena_chunk_t* arena_new_chunk(pb_arena_t *arena,
+                                         size_t     size
+                                         )
+{
+    pb_arena_chunk_t *chunk = NULL;
+
+    if ( size < arena->chunk_size )
+    {
+        size = arena->chunk_size;
+    }
+
+    if ( (chunk = malloc(sizeof(pb_arena_chunk_t) + size)) == NULL )
+    {
+        eprintf("Not enough memory to allocate an arena chunk of %zu bytes", size);
+        return (NULL);
+    }
+
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->live = 0;
+    chunk->prev = NULL;
+    chunk->next = NULL;
+
+    arena->allocated += sizeof(pb_arena_chunk_t) + size;
+
+    return (chunk);
+}
+
+
+static void arena_free_chunk(pb_arena_t       *arena,
+                             pb_arena_chunk_t *chunk
+                             )
+{
+    if ( chunk->prev )
+    {
+        chunk->prev->next = chunk->next;
+    }
+
+    if ( chunk->next )
+    {
+        chunk->next->prev = chunk->prev;
+    }
+
+    if ( arena->current == chunk )
+    {
+        arena->current = chunk->next;
+    }
+
+    arena->allocated -= sizeof(pb_arena_chunk_t) + chunk->size;
+    free(chunk);
+}
+
+
+static void* arena_bump(pb_arena_t       *arena,
+                        size_t           size,
+                        size_t           align,
+                        pb_arena_chunk_t **chunk
+                        )
+{
+    pb_arena_chunk_t    *c = NULL;
+    size_t              offset = 0;
+
+    if ( (! arena) || (size == 0) )
+    {
+        return (NULL);
+    }
+
+    if ( (c = arena->current) != NULL )
+    {
+        offset = (c->used + align - 1) & ~(align - 1);
+    }
+
+    if ( (! c) || (offset + size > c->size) )
+    {
+        pb_arena_chunk_t *old = arena->current;
+
+        if ( (c = arena_new_chunk(arena, size)) == NULL )
+        {
+            return (NULL);
+        }
+
+        if ( old && (size * 2 > arena->chunk_size) && (old->size - old->used >= arena->chunk_size / 2) )
+        {
+            // A large allocation gets its own chunk, linked after the current one where we keep bumping
+            c->prev = old;
+            c->next = old->next;
+
+            if ( c->next )
+            {
+                c->next->prev = c;
+            }
+
+            old->next = c;
+        }
+        else
+        {
+            // The new chunk becomes the current one
+            c->next = old;
+
+            if ( old )
+            {
+                old->prev = c;
+            }
+
+            arena->current = c;
+
+            // The previous current chunk is given back as soon as it does not hold any live allocation
+            if ( old && (old->live == 0) )
+            {
+                arena_free_chunk(arena, old);
+            }
+        }
+
+        offset = 0;
+    }
+
+    c->used = offset + size;
+    c->live += size;
+    arena->live += size;
+
+    if ( chunk )
+    {
+        *chunk = c;
+    }
+
+    return (c->data + offset);
+}
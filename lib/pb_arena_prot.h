@@ -0,0 +1,105 @@
+/**
+ * @file pb_arena_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Bump allocator used to store the strings of the library objects
+ */
+
+#ifndef __PB_ARENA_PROT_H__
+#define __PB_ARENA_PROT_H__
+
+#include <stddef.h>     // size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PB_ARENA_CHUNK_SIZE
+ * Default size of an arena chunk (16ko - 16384 - 0x4000)
+ */
+#define PB_ARENA_CHUNK_SIZE     0x4000
+
+
+/**
+ * @struct pb_arena_chunk_s
+ * @brief Chunk of memory in which the arena allocations are bumped
+ */
+typedef struct pb_arena_chunk_s {
+    struct pb_arena_chunk_s *prev;          ///< Previous chunk
+    struct pb_arena_chunk_s *next;          ///< Next chunk
+    size_t size;          ///< Size of the data
+    size_t used;          ///< Number of bytes handed out
+    size_t live;          ///< Number of bytes handed out and not released yet
+    char data[];          ///< Data
+} pb_arena_chunk_t;
+
+
+/**
+ * @struct pb_arena_s
+ * @brief Bump allocator
+ * @details Allocations are bumped into the current chunk. Each chunk counts its live bytes: once every allocation of
+ *          a chunk has been released, the chunk is given back to the system.
+ */
+typedef struct pb_arena_s {
+    pb_arena_chunk_t *current;          ///< Chunk in which the allocations are bumped
+    size_t chunk_size;          ///< Size of a new chunk
+    size_t allocated;          ///< Number of bytes allocated for the chunks
+    size_t live;          ///< Number of bytes handed out and not released yet
+} pb_arena_t;
+
+
+/**
+ * @brief      Initialize an arena
+ *
+ * @param      arena       The arena
+ * @param[in]  chunk_size  The size of the chunks (0 for PB_ARENA_CHUNK_SIZE)
+ */
+void pb_arena_init(pb_arena_t *arena, size_t chunk_size);
+
+/**
+ * @brief      Allocate memory aligned for any type
+ *
+ * @param      arena  The arena
+ * @param[in]  size   The size
+ * @param[out] chunk  The chunk holding the memory (may be NULL if the memory is never released alone)
+ *
+ * @return     On success: pointer to the memory
+ * @return     On error: NULL
+ */
+void* pb_arena_alloc(pb_arena_t *arena, size_t size, pb_arena_chunk_t **chunk);
+
+/**
+ * @brief      Copy a string in the arena
+ *
+ * @param      arena  The arena
+ * @param[in]  str    The string (may be NULL)
+ *
+ * @return     The copy of the string or NULL
+ */
+char* pb_arena_strdup(pb_arena_t *arena, const char *str);
+
+/**
+ * @brief      Release an allocation
+ * @details    The memory is not reused: the chunk is freed when all its allocations are released.
+ *
+ * @param      arena  The arena
+ * @param      chunk  The chunk holding the allocation
+ * @param[in]  size   The size given to pb_arena_alloc
+ */
+void pb_arena_release(pb_arena_t *arena, pb_arena_chunk_t *chunk, size_t size);
+
+/**
+ * @brief      Free all the chunks of the arena
+ *
+ * @param      arena  The arena
+ */
+void pb_arena_clear(pb_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_ARENA_PROT_H__
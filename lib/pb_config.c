@@ -26,7 +26,7 @@ pb_config_t* pb_config_new(void)
         pthread_mutex_init(&p_config->mtx, NULL);
 
         // Increase the reference
-        p_config->ref++;
+        pb_refcount_init(&p_config->ref);
 
         // Check the environment variable https_proxy then http_proxy
         pb_config_set_proxy(p_config, getenv(HTTPS_PROXY_KEY_ENV));
@@ -78,7 +78,7 @@ int pb_config_copy(pb_config_t* p_dst, pb_config_t* p_src)
     }
 
     // Put the destination reference counter to one
-    p_dst->ref = 1;
+    pb_refcount_init(&p_dst->ref);
 
     pthread_mutex_unlock(&p_dst->mtx);
     pthread_mutex_unlock(&p_src->mtx);
@@ -93,11 +93,7 @@ int pb_config_ref(pb_config_t* p_config)
         return -1;
     }
 
-    pthread_mutex_lock(&p_config->mtx);
-
-    p_config->ref++;
-
-    pthread_mutex_unlock(&p_config->mtx);
+    pb_refcount_inc(&p_config->ref);
 
     return 0;
 }
@@ -110,17 +106,18 @@ int pb_config_unref(pb_config_t* p_config)
         return -1;
     }
 
-    pthread_mutex_lock(&p_config->mtx);
-
-    if (--p_config->ref <= 0)
+    // The last reference is released by a single thread: nobody else can lock the mutex anymore
+    if ( pb_refcount_dec(&p_config->ref) )
     {
         pb_free(p_config->proxy);
         pb_free(p_config->token_key);
+        pb_upload_cache_unref(p_config->upload_cache);
+        pb_free(p_config->stream_url);
+        pb_free(p_config->api_url);
+        pthread_mutex_destroy(&p_config->mtx);
         free(p_config);
     }
 
-    pthread_mutex_unlock(&p_config->mtx);
-
     return 0;
 }
 
@@ -190,9 +187,94 @@ int pb_config_set_token_key(pb_config_t* p_config, const char* token_key)
 }
 
 
+int pb_config_set_upload_hook(pb_config_t* p_config, pb_upload_hook_cb hook, void* userdata)
+{
+    if ( ! p_config )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&p_config->mtx);
+
+    p_config->upload_hook = hook;
+    p_config->upload_hook_userdata = userdata;
+
+    pthread_mutex_unlock(&p_config->mtx);
+
+    return 0;
+}
+
+
+int pb_config_set_upload_cache(pb_config_t* p_config, pb_upload_cache_t* cache)
+{
+    if ( ! p_config )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&p_config->mtx);
+
+    pb_upload_cache_ref(cache);
+    pb_upload_cache_unref(p_config->upload_cache);
+    p_config->upload_cache = cache;
+
+    pthread_mutex_unlock(&p_config->mtx);
+
+    return 0;
+}
+
+
+int pb_config_set_stream_url(pb_config_t* p_config, const char* stream_url)
+{
+    if ( ! p_config )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&p_config->mtx);
+
+    // Free the field and put it to NULL
+    pb_free(p_config->stream_url);
+
+    // If there is a new value, we set it
+    if ( stream_url )
+    {
+        p_config->stream_url = strdup(stream_url);
+    }
+
+    pthread_mutex_unlock(&p_config->mtx);
+
+    return 0;
+}
+
+
+int pb_config_set_api_url(pb_config_t* p_config, const char* api_url)
+{
+    if ( ! p_config )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&p_config->mtx);
+
+    // Free the field and put it to NULL
+    pb_free(p_config->api_url);
+
+    // If there is a new value, we set it
+    if ( api_url )
+    {
+        p_config->api_url = strdup(api_url);
+    }
+
+    pthread_mutex_unlock(&p_config->mtx);
+
+    return 0;
+}
+
+
 int pb_config_get_ref(const pb_config_t* p_config)
 {
-    return ( p_config ) ? p_config->ref : 0;
+    return ( p_config ) ? pb_refcount_get(&p_config->ref) : 0;
 }
 
 
@@ -214,6 +296,98 @@ char* pb_config_get_token_key(const pb_config_t* p_config)
 }
 
 
+char* pb_config_get_stream_url(const pb_config_t* p_config)
+{
+    char    *stream_url = NULL;
+
+    if ( ! p_config )
+    {
+        return (NULL);
+    }
+
+    // The setter frees the previous URL: it is copied under the lock
+    pthread_mutex_lock( (pthread_mutex_t *) &p_config->mtx);
+
+    if ( p_config->stream_url && ((stream_url = strdup(p_config->stream_url)) == NULL) )
+    {
+        eprintf("Not enough memory to copy the URL of the stream");
+    }
+
+    pthread_mutex_unlock( (pthread_mutex_t *) &p_config->mtx);
+
+    return (stream_url);
+}
+
+
+char* pb_config_get_api_url(const pb_config_t* p_config)
+{
+    char    *api_url = NULL;
+
+    if ( ! p_config )
+    {
+        return (NULL);
+    }
+
+    // The setter frees the previous URL: it is copied under the lock
+    pthread_mutex_lock( (pthread_mutex_t *) &p_config->mtx);
+
+    if ( p_config->api_url && ((api_url = strdup(p_config->api_url)) == NULL) )
+    {
+        eprintf("Not enough memory to copy the URL of the API");
+    }
+
+    pthread_mutex_unlock( (pthread_mutex_t *) &p_config->mtx);
+
+    return (api_url);
+}
+
+
+pb_upload_hook_cb pb_config_get_upload_hook(const pb_config_t* p_config, void **userdata)
+{
+    pb_upload_hook_cb   hook = NULL;
+
+    if ( ! p_config )
+    {
+        return (NULL);
+    }
+
+    // The hook and its user data are set together: they are read together
+    pthread_mutex_lock( (pthread_mutex_t *) &p_config->mtx);
+
+    if ( (hook = p_config->upload_hook) && userdata )
+    {
+        *userdata = p_config->upload_hook_userdata;
+    }
+
+    pthread_mutex_unlock( (pthread_mutex_t *) &p_config->mtx);
+
+    return (hook);
+}
+
+
+pb_upload_cache_t* pb_config_get_upload_cache(const pb_config_t* p_config)
+{
+    pb_upload_cache_t   *cache = NULL;
+
+    if ( ! p_config )
+    {
+        return (NULL);
+    }
+
+    // The setter releases the previous cache: a reference is taken under the lock
+    pthread_mutex_lock( (pthread_mutex_t *) &p_config->mtx);
+
+    if ( (cache = p_config->upload_cache) != NULL )
+    {
+        pb_upload_cache_ref(cache);
+    }
+
+    pthread_mutex_unlock( (pthread_mutex_t *) &p_config->mtx);
+
+    return (cache);
+}
+
+
 int pb_config_from_json_file(pb_config_t* p_config, const char *json_filepath)
 {
     int ret = -1;
@@ -266,6 +440,16 @@ int pb_config_from_json_file(pb_config_t* p_config, const char *json_filepath)
                         pb_config_set_token_key(p_config, strdup(json_object_get_string_member(obj, "token_key")));
                     }
 
+                    if (json_object_has_member(obj, "stream_url"))
+                    {
+                        pb_config_set_stream_url(p_config, json_object_get_string_member(obj, "stream_url"));
+                    }
+
+                    if (json_object_has_member(obj, "api_url"))
+                    {
+                        pb_config_set_api_url(p_config, json_object_get_string_member(obj, "api_url"));
+                    }
+
                     ret = 0;
                 }
             }
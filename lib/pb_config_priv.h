@@ -7,6 +7,10 @@
 #ifndef __PB_CONFIG_PRIV__
 #define __PB_CONFIG_PRIV__
 
+#include <pthread.h>        // pthread_mutex_t
+
+#include "pushbullet.h"     // pb_upload_hook_cb
+#include "pb_refcount_prot.h"   // pb_refcount_t
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,8 +21,13 @@ typedef struct pb_config_s {
     char* proxy;             ///< HTTP/HTTPS proxy
     long  timeout;             ///< CURL timeout
     char* token_key;             ///< Pushbullet token key
+    pb_upload_hook_cb upload_hook;             ///< Hook called before a file is uploaded (may be NULL)
+    void* upload_hook_userdata;             ///< User data given to upload_hook
+    pb_upload_cache_t* upload_cache;             ///< Cache of the uploaded contents (may be NULL)
+    char* stream_url;             ///< URL of the event stream (NULL for the Pushbullet one)
+    char* api_url;             ///< URL of the REST API (NULL for the Pushbullet one)
     pthread_mutex_t mtx;        /// Muxtex for THREAD-SAFE
-    int   ref;          ///< Reference count
+    pb_refcount_t ref;          ///< Reference count
 } pb_config_t;
 
 
@@ -17,7 +17,7 @@ extern "C" {
 #define PB_TOKEN_KEY_ENV "PB_TOKEN_KEY"
 
 
-typedef struct pb_config_s pb_config_t;
+#include "pushbullet.h"     // pb_config_t, pb_upload_hook_cb, pb_upload_cache_t
 
 
 int pb_config_get_ref(const pb_config_t* p_config);
@@ -28,6 +28,10 @@ int pb_config_unlock(pb_config_t* p_config);
 
 int pb_config_copy(pb_config_t* p_dst, pb_config_t* p_src);
 
+pb_upload_hook_cb pb_config_get_upload_hook(const pb_config_t* p_config, void **userdata);
+
+pb_upload_cache_t* pb_config_get_upload_cache(const pb_config_t* p_config);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,13 +3,15 @@
  * @author hbuyse
  * @date 09/02/2018
  */
-#include <stdlib.h>          // free
-#include <string.h>          // strcmp
+#include <stdlib.h>          // malloc, free
+#include <string.h>          // strcmp, strlen, memset
 #include <json-glib/json-glib.h>          // JsonObject, json_tokener_parse, json_object_object_foreach, json_object_get_array,
                                 // array_list
 
 #include "pb_utils.h"             // iprintf, eprintf, cprintf, gprintf
 #include "pb_device_priv.h"
+#include "pb_device_prot.h"     // pb_device_init_in_block
+#include "pb_schema_prot.h"     // pb_schema_fill, pb_schema_copy, PB_SCHEMA_PHONE, PB_SCHEMA_BROWSER
 
 
 pb_device_t* pb_device_new(void)
@@ -19,7 +21,7 @@ pb_device_t* pb_device_new(void)
     if ( d )
     {
         // Increase the reference
-        d->ref++;
+        pb_refcount_init(&d->ref);
 
         // Unknown type
         d->type = ICON_UNKNOWN;
@@ -29,9 +31,37 @@ pb_device_t* pb_device_new(void)
 }
 
 
+void pb_device_init_in_block(pb_device_t* p_device, pb_arena_t* arena)
+{
+    memset(p_device, 0, sizeof(*p_device) );
+
+    pb_refcount_init(&p_device->ref);
+    p_device->type = ICON_UNKNOWN;
+    p_device->arena = arena;
+}
+
+
+int pb_device_copy(pb_device_t* p_dst, const pb_device_t* p_src)
+{
+    if ( (! p_dst) || (! p_src) )
+    {
+        return -1;
+    }
+
+    p_dst->type = p_src->type;
+
+    if ( p_src->type == ICON_PHONE )
+    {
+        return pb_schema_copy(PB_SCHEMA_PHONE, &p_dst->phone, &p_src->phone, p_dst->arena);
+    }
+
+    return pb_schema_copy(PB_SCHEMA_BROWSER, &p_dst->browser, &p_src->browser, p_dst->arena);
+}
+
+
 int pb_device_get_ref(pb_device_t* p_device)
 {
-    return ( p_device ) ? p_device->ref : 0;
+    return ( p_device ) ? pb_refcount_get(&p_device->ref) : 0;
 }
 
 
@@ -42,7 +72,7 @@ int pb_device_ref(pb_device_t* p_device)
         return -1;
     }
 
-    p_device->ref++;
+    pb_refcount_inc(&p_device->ref);
     return 0;
 }
 
@@ -54,7 +84,8 @@ int pb_device_unref(pb_device_t* p_device)
         return -1;
     }
 
-    if ( --p_device->ref <= 0 )
+    // The device of a list and its strings are released with the list
+    if ( pb_refcount_dec(&p_device->ref) && (! p_device->arena) )
     {
         switch( p_device->type )
         {
@@ -69,18 +100,16 @@ int pb_device_unref(pb_device_t* p_device)
                 pb_free(p_device->phone.remote_files);
                 break;
 
-            case ICON_BROWSER:
+            default:
                 pb_free(p_device->browser.iden);
                 pb_free(p_device->browser.nickname);
                 pb_free(p_device->browser.manufacturer);
                 pb_free(p_device->browser.model);
                 pb_free(p_device->browser.icon);
                 break;
-
-            default:
-                break;
         }
 
+        pb_free(p_device->nickname_key);
         free(p_device);
     }
 
@@ -88,41 +117,93 @@ int pb_device_unref(pb_device_t* p_device)
 }
 
 
-int pb_device_set_type(pb_device_t* p_device, pb_device_icon type)
+size_t pb_device_normalize_nickname(char          *dst,
+                                    const char    *nickname
+                                    )
 {
+    size_t          len = 0;
+    unsigned char   c = 0;
+    unsigned char   space = 0;
+
+    for ( ; (c = (unsigned char) *nickname) != '\0'; nickname++ )
+    {
+        if ( (c == ' ') || ((c >= '\t') && (c <= '\r')) )
+        {
+            space = (len > 0);
+            continue;
+        }
+
+        // A run of blanks between two words becomes one space, the leading and trailing ones are dropped
+        if ( space )
+        {
+            dst[len++] = ' ';
+            space = 0;
+        }
+
+        // Only ASCII is folded: the other bytes (UTF-8) are compared as they are
+        dst[len++] = ((c >= 'A') && (c <= 'Z')) ? (char) (c - 'A' + 'a') : (char) c;
+    }
+
+    dst[len] = '\0';
+
+    return len;
+}
+
+
+int pb_device_set_nickname_key(pb_device_t* p_device)
+{
+    const char  *nickname = pb_device_get_nickname(p_device);
+    char        *key = NULL;
+    size_t      size = 0;
+
     if ( ! p_device )
     {
         return -1;
     }
-    
-    p_device->type = type;
+
+    if ( p_device->nickname_key || (! nickname) )
+    {
+        return 0;
+    }
+
+    // The key is never longer than the nickname
+    size = strlen(nickname) + 1;
+    key = (p_device->arena) ? pb_arena_alloc(p_device->arena, size, NULL) : malloc(size);
+
+    if ( ! key )
+    {
+        return -1;
+    }
+
+    pb_device_normalize_nickname(key, nickname);
+    p_device->nickname_key = key;
 
     return 0;
 }
 
 
-pb_device_icon pb_device_get_type(const pb_device_t* p_device)
+char* pb_device_get_nickname_key(const pb_device_t* p_device)
 {
-    return ( p_device ) ? p_device->type : ICON_UNKNOWN;
+    return ( p_device ) ? p_device->nickname_key : NULL;
 }
 
 
-int pb_device_set_next(pb_device_t* p_device, pb_device_t* p_next)
+int pb_device_set_type(pb_device_t* p_device, pb_device_icon type)
 {
     if ( ! p_device )
     {
         return -1;
     }
     
-    p_device->next = p_next;
+    p_device->type = type;
 
     return 0;
 }
 
 
-pb_device_t* pb_device_get_next(const pb_device_t* p_device)
+pb_device_icon pb_device_get_type(const pb_device_t* p_device)
 {
-    return ( p_device ) ? p_device->next : NULL;
+    return ( p_device ) ? p_device->type : ICON_UNKNOWN;
 }
 
 
@@ -138,11 +219,8 @@ unsigned char pb_device_is_active(pb_device_t* p_device)
                 ret = p_device->phone.active;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.active;
-                break;
-
             default:
+                ret = p_device->browser.active;
                 break;
         }
     }
@@ -163,11 +241,8 @@ char* pb_device_get_iden(const pb_device_t* p_device)
                 ret = p_device->phone.iden;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.iden;
-                break;
-
             default:
+                ret = p_device->browser.iden;
                 break;
         }
     }
@@ -188,11 +263,8 @@ double pb_device_get_created(const pb_device_t* p_device)
                 ret = p_device->phone.created;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.created;
-                break;
-
             default:
+                ret = p_device->browser.created;
                 break;
         }
     }
@@ -213,11 +285,8 @@ double pb_device_get_modified(const pb_device_t* p_device)
                 ret = p_device->phone.modified;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.modified;
-                break;
-
             default:
+                ret = p_device->browser.modified;
                 break;
         }
     }
@@ -238,11 +307,8 @@ char* pb_device_get_nickname(const pb_device_t* p_device)
                 ret = p_device->phone.nickname;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.nickname;
-                break;
-
             default:
+                ret = p_device->browser.nickname;
                 break;
         }
     }
@@ -263,11 +329,8 @@ char* pb_device_get_manufacturer(const pb_device_t* p_device)
                 ret = p_device->phone.manufacturer;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.manufacturer;
-                break;
-
             default:
+                ret = p_device->browser.manufacturer;
                 break;
         }
     }
@@ -288,11 +351,8 @@ char* pb_device_get_model(const pb_device_t* p_device)
                 ret = p_device->phone.model;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.model;
-                break;
-
             default:
+                ret = p_device->browser.model;
                 break;
         }
     }
@@ -313,11 +373,8 @@ short pb_device_get_app_version(const pb_device_t* p_device)
                 ret = p_device->phone.app_version;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.app_version;
-                break;
-
             default:
+                ret = p_device->browser.app_version;
                 break;
         }
     }
@@ -338,11 +395,8 @@ char* pb_device_get_icon(const pb_device_t* p_device)
                 ret = p_device->phone.icon;
                 break;
 
-            case ICON_BROWSER:
-                ret = p_device->browser.icon;
-                break;
-
             default:
+                ret = p_device->browser.icon;
                 break;
         }
     }
@@ -363,45 +417,15 @@ void pb_device_fill_from_json(JsonObject *object __attribute__((unused)),
     {
         return;
     }
-    else if ( ! JSON_NODE_HOLDS_VALUE(member_node) )
+
+    // Every device which is not a phone has the layout of a browser
+    if ( p_device->type == ICON_PHONE )
     {
-        return;
+        pb_schema_fill(PB_SCHEMA_PHONE, &p_device->phone, member_name, member_node, p_device->arena);
     }
     else
     {
-        switch(p_device->type)
-        {
-            case ICON_BROWSER:
-                JSON_ASSOCIATE_BOOL(p_device->browser, active);
-                JSON_ASSOCIATE_STR(p_device->browser, iden);
-                JSON_ASSOCIATE_DOUBLE(p_device->browser, created);
-                JSON_ASSOCIATE_DOUBLE(p_device->browser, modified);
-                JSON_ASSOCIATE_STR(p_device->browser, nickname);
-                JSON_ASSOCIATE_STR(p_device->browser, manufacturer);
-                JSON_ASSOCIATE_STR(p_device->browser, model);
-                JSON_ASSOCIATE_INT(p_device->browser, app_version);
-                JSON_ASSOCIATE_STR(p_device->browser, icon);
-                break;
-            case ICON_PHONE:
-                JSON_ASSOCIATE_BOOL(p_device->phone, active);
-                JSON_ASSOCIATE_STR(p_device->phone, iden);
-                JSON_ASSOCIATE_DOUBLE(p_device->phone, created);
-                JSON_ASSOCIATE_DOUBLE(p_device->phone, modified);
-                JSON_ASSOCIATE_STR(p_device->phone, nickname);
-                JSON_ASSOCIATE_BOOL(p_device->phone, generated_nickname);
-                JSON_ASSOCIATE_STR(p_device->phone, manufacturer);
-                JSON_ASSOCIATE_STR(p_device->phone, model);
-                JSON_ASSOCIATE_INT(p_device->phone, app_version);
-                JSON_ASSOCIATE_STR(p_device->phone, push_token);
-                JSON_ASSOCIATE_BOOL(p_device->phone, has_sms);
-                JSON_ASSOCIATE_BOOL(p_device->phone, has_mms);
-                JSON_ASSOCIATE_STR(p_device->phone, icon);
-                JSON_ASSOCIATE_STR(p_device->phone, remote_files);
-                JSON_ASSOCIATE_STR(p_device->phone, fingerprint);       // JsonObject
-                break;
-            default:
-                break;
-        }
+        pb_schema_fill(PB_SCHEMA_BROWSER, &p_device->browser, member_name, member_node, p_device->arena);
     }
 }
 
@@ -411,15 +435,8 @@ void pb_device_dump_infos(const pb_device_t* p_device)
 {
     switch ( p_device->type )
     {
-        case ICON_BROWSER:
-            iprintf("%c%s - %s", p_device->browser.icon[0] - 32, p_device->browser.icon + 1, p_device->browser.iden);
-            iprintf("\tactive : %u", p_device->browser.active);
-            iprintf("\tcreated : %f", p_device->browser.created);
-            iprintf("\tmodified : %f", p_device->browser.modified);
-            iprintf("\tnickname : %s", p_device->browser.nickname);
-            iprintf("\tmanufacturer : %s", p_device->browser.manufacturer);
-            iprintf("\tmodel : %s", p_device->browser.model);
-            iprintf("\tapp_version : %hd", p_device->browser.app_version);
+        case ICON_UNKNOWN:
+            eprintf("Unknown type...");
             break;
 
         case ICON_PHONE:
@@ -440,7 +457,14 @@ void pb_device_dump_infos(const pb_device_t* p_device)
             break;
 
         default:
-            eprintf("Unknown type...");
+            iprintf("%c%s - %s", p_device->browser.icon[0] - 32, p_device->browser.icon + 1, p_device->browser.iden);
+            iprintf("\tactive : %u", p_device->browser.active);
+            iprintf("\tcreated : %f", p_device->browser.created);
+            iprintf("\tmodified : %f", p_device->browser.modified);
+            iprintf("\tnickname : %s", p_device->browser.nickname);
+            iprintf("\tmanufacturer : %s", p_device->browser.manufacturer);
+            iprintf("\tmodel : %s", p_device->browser.model);
+            iprintf("\tapp_version : %hd", p_device->browser.app_version);
             break;
     }
 }
@@ -2,33 +2,14 @@
 #define __PB_DEVICE_PRIV__
 
 #include "pb_device_prot.h" // pb_device_icon
+#include "pb_arena_prot.h"  // pb_arena_t
+#include "pb_refcount_prot.h"   // pb_refcount_t
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-/**
- * @brief      Macro to associate a key in a structure
- *
- * @param      type  The type
- * @param      var   The pointer we fill
- * @param      k     The JSON key
- */
-#define     JSON_ASSOCIATE_BOOL(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var.k = json_node_get_boolean(member_node); } while(0)
-
-#define     JSON_ASSOCIATE_STR(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var.k = json_node_dup_string(member_node); } while(0)
-
-#define     JSON_ASSOCIATE_INT(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var.k = json_node_get_int(member_node); } while(0)
-
-#define     JSON_ASSOCIATE_DOUBLE(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var.k = json_node_get_double(member_node); } while(0)
-
-
-
 /**
  * @struct pb_phone_s
  * @brief Structure containing all the informations concerning a PushBullet phone
@@ -71,17 +52,19 @@ typedef struct pb_browser_s {
 
 /**
  * @struct pb_device_s
- * @brief Element of a linked list containing either a browser or a phone
+ * @brief Element of a linked list containing either a phone or any other device
  */
 typedef struct pb_device_s {
     pb_device_icon type;            ///< The type of the device
     union {
         pb_phone_t phone;           ///< Phone device if the type is a phone
-        pb_browser_t browser;       ///< Browser device if the type is a browser
+        pb_browser_t browser;       ///< Any other device (the browser holds the fields common to all the devices)
     };
 
-    int ref;                        ///< Reference counter
-    struct pb_device_s *next;              ///< Pointer to the next
+    char *nickname_key;             ///< Normalized nickname, computed once when the device is indexed (NULL before)
+    pb_refcount_t ref;              ///< Reference counter
+    pb_arena_t *arena;              ///< Arena of the list owning the device and its strings (NULL if the device is alone)
+    struct pb_device_s *free_next;              ///< Next free device of the blocks of the list (only while the device is free)
 } pb_device_t;
 
 
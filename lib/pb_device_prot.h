@@ -1,6 +1,8 @@
 #ifndef __PB_DEVICE_PROT__
 #define __PB_DEVICE_PROT__
 
+#include <json-glib/json-glib.h>      // JsonObject, JsonNode
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,15 +27,35 @@ typedef enum {
 
 
 typedef struct pb_device_s pb_device_t;
+typedef struct pb_arena_s pb_arena_t;
 
 
-int pb_device_set_type(pb_device_t* p_device, pb_device_icon type);
+/**
+ * @brief      Initialize a device stored in the block of a list
+ * @details    The device has one reference and an unknown type. Its strings are copied in the arena of the list.
+ *             Dropping its last reference frees nothing: the device and its strings are freed with the list.
+ *
+ * @param      p_device  The device
+ * @param      arena     The arena of the list
+ */
+void pb_device_init_in_block(pb_device_t* p_device, pb_arena_t* arena);
 
-pb_device_icon pb_device_get_type(const pb_device_t* p_device);
+/**
+ * @brief      Copy the type and the informations of a device
+ * @details    The strings are copied in the arena of the destination (or on the heap if it has none).
+ *
+ * @param      p_dst  The destination, freshly initialized
+ * @param[in]  p_src  The source
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_device_copy(pb_device_t* p_dst, const pb_device_t* p_src);
 
-int pb_device_set_next(pb_device_t* p_device, pb_device_t* p_next);
 
-pb_device_t* pb_device_get_next(const pb_device_t* p_device);
+int pb_device_set_type(pb_device_t* p_device, pb_device_icon type);
+
+pb_device_icon pb_device_get_type(const pb_device_t* p_device);
 
 char* pb_device_get_iden(const pb_device_t* p_device);
 
@@ -45,6 +67,31 @@ char* pb_device_get_nickname(const pb_device_t* p_device);
 
 char* pb_device_get_manufacturer(const pb_device_t* p_device);
 
+/**
+ * @brief      Normalize a nickname: ASCII letters are lowered and the blanks are collapsed into single spaces
+ * @details    The leading and trailing blanks are dropped, so "  Pixel\t 7 " and "pixel 7" give the same key.
+ *
+ * @param[out] dst       The normalized nickname (at least strlen(nickname) + 1 bytes)
+ * @param[in]  nickname  The nickname
+ *
+ * @return     The length of the normalized nickname
+ */
+size_t pb_device_normalize_nickname(char *dst, const char *nickname);
+
+/**
+ * @brief      Compute the normalized nickname of the device, if it has not been computed yet
+ * @details    The key is stored in the arena of the device (or on the heap for a device which is not in a list).
+ *
+ * @return     On success (or if the device has no nickname): zero
+ * @return     On error: non-zero integer
+ */
+int pb_device_set_nickname_key(pb_device_t* p_device);
+
+/**
+ * @brief      Get the normalized nickname computed by \a pb_device_set_nickname_key
+ */
+char* pb_device_get_nickname_key(const pb_device_t* p_device);
+
 char* pb_device_get_model(const pb_device_t* p_device);
 
 short pb_device_get_app_version(const pb_device_t* p_device);
@@ -3,18 +3,41 @@
  * @author hbuyse
  * @date 08/05/2016
  */
-#include <stdlib.h>          // free
-#include <string.h>          // strcmp
+#include <stdlib.h>          // calloc, realloc, malloc, free
+#include <string.h>          // strcmp, strlen, memmove
+#include <stdint.h>          // uint32_t
 #include <json-glib/json-glib.h>          // JsonObject, json_tokener_parse, json_object_object_foreach, json_object_get_array,
                                 // array_list
 
 #include "pb_utils.h"             // iprintf, eprintf, cprintf, gprintf
-#include "pb_devices_priv.h"
-#include "pb_device_prot.h"     // pb_device_t, pb_device_new, pb_device_unref, pb_device_set_browser_device, pb_device_set_phone_device
+#include "pb_devices_priv.h"     // pb_devices_t, pb_devices_block_t, pb_devices_index_t, DEVICES_BLOCK_MIN_SIZE
+#include "pb_devices_prot.h"     // pb_devices_add_new_device, pb_devices_get_device_from_iden
+#include "pb_device_priv.h"      // pb_device_t
+#include "pb_arena_prot.h"      // pb_arena_init, pb_arena_clear
+#include "pb_device_prot.h"     // pb_device_init_in_block, pb_device_copy, pb_device_unref, pb_device_get_iden, pb_device_get_nickname,
+                                // pb_device_set_nickname_key, pb_device_get_nickname_key, pb_device_normalize_nickname
 #include "pushbullet.h"
 
 
 
+/**
+ * @brief      Icons of the devices and their types
+ */
+static const struct {
+    const char *icon;          ///< Value of the "icon" key
+    pb_device_icon type;          ///< Type of the device
+} devices_icons[] = {
+    { DESKTOP_ICON, ICON_DESKTOP },
+    { BROWSER_ICON, ICON_BROWSER },
+    { WEBSITE_ICON, ICON_WEBSITE },
+    { LAPTOP_ICON, ICON_LAPTOP },
+    { TABLET_ICON, ICON_TABLET },
+    { PHONE_ICON, ICON_PHONE },
+    { WATCH_ICON, ICON_WATCH },
+    { SYSTEM_ICON, ICON_SYSTEM }
+};
+
+
 static void devices_fill_devices_list(JsonArray *arr __attribute__((unused)),
                                       guint idx,
                                       JsonNode *node_arr,
@@ -22,6 +45,123 @@ static void devices_fill_devices_list(JsonArray *arr __attribute__((unused)),
                                       );
 
 
+/**
+ * @brief      Get the type of a device from its icon (ICON_DEVICE if the icon is not known)
+ */
+static pb_device_icon devices_get_type_from_icon(const char *icon);
+
+
+/**
+ * @brief      FNV-1a hash of a key
+ */
+static uint32_t devices_hash(const char *key);
+
+
+/**
+ * @brief      Get the slot holding the key, or the empty slot where it would be inserted
+ */
+static size_t devices_index_find_slot(const pb_devices_index_t *index, const char *key);
+
+
+/**
+ * @brief      Get the device indexed under the key
+ */
+static pb_device_t* devices_index_lookup(const pb_devices_index_t *index, const char *key);
+
+
+/**
+ * @brief      Index a device (nothing is done if it has no key or if its key is already indexed)
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int devices_index_insert(pb_devices_index_t *index, pb_device_t *p_device);
+
+
+/**
+ * @brief      Remove a device from the index
+ *
+ * @return     1 if the device was indexed, otherwise 0
+ */
+static int devices_index_remove(pb_devices_index_t *index, const pb_device_t *p_device);
+
+
+/**
+ * @brief      Remove a device from an index whose keys are not unique: another device of the list with the same key
+ *             takes its place
+ */
+static void devices_index_remove_shared(pb_devices_t *p_devices, pb_devices_index_t *index, const pb_device_t *p_device);
+
+
+/**
+ * @brief      Index a device on its iden, its nickname and its normalized nickname
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int devices_index_device(pb_devices_t *p_devices, pb_device_t *p_device);
+
+
+/**
+ * @brief      Remove a device from the indexes (the device must not be in the list anymore)
+ */
+static void devices_unindex_device(pb_devices_t *p_devices, const pb_device_t *p_device);
+
+
+/**
+ * @brief      Get the position of a device in the list (-1 if it is not in the list)
+ */
+static ssize_t devices_get_position(const pb_devices_t *p_devices, const pb_device_t *p_device);
+
+
+/**
+ * @brief      Make room for nb new devices, in the list and in the blocks
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int devices_reserve(pb_devices_t *p_devices, size_t nb);
+
+
+/**
+ * @brief      Add a block of size devices in front of the blocks of the list
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int devices_new_block(pb_devices_t *p_devices, size_t size);
+
+
+/**
+ * @brief      Get a new device from the blocks of the list
+ *
+ * @return     The device, or NULL if the memory is exhausted
+ */
+static pb_device_t* devices_new_device(pb_devices_t *p_devices);
+
+
+/**
+ * @brief      Drop the reference of the list on a device (a device of the blocks is reused once it is not used anymore)
+ */
+static void devices_release_device(pb_devices_t *p_devices, pb_device_t *p_device);
+
+
+/**
+ * @brief      Grow the bitmaps of the list so that they cover size devices
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int devices_bitmaps_grow(pb_devices_t *p_devices, size_t size);
+
+
+/**
+ * @brief      Set the bits of the device at a position of the list (and clear the ones of its previous device)
+ */
+static void devices_bitmaps_set(pb_devices_t *p_devices, size_t pos, const pb_device_t *p_device);
+
+
+/**
+ * @brief      Remove the bits of a position of the list, the bits of the following devices move down by one
+ */
+static void devices_bitmaps_remove(pb_devices_t *p_devices, size_t pos);
+
+
 #ifdef __TRACES__
 
 
@@ -41,8 +181,13 @@ pb_devices_t* pb_devices_new()
 
     if ( d )
     {
+        pb_arena_init(&d->arena, 0);
+        d->by_iden.key = pb_device_get_iden;
+        d->by_nickname.key = pb_device_get_nickname;
+        d->by_nickname_key.key = pb_device_get_nickname_key;
+
         // Increase the reference
-        d->ref++;
+        pb_refcount_init(&d->ref);
     }
 
     return d;
@@ -56,36 +201,46 @@ int pb_devices_ref(pb_devices_t* p_devices)
         return -1;
     }
 
-    p_devices->ref++;
+    pb_refcount_inc(&p_devices->ref);
     return 0;
 }
 
 
 int pb_devices_unref(pb_devices_t* p_devices)
 {
-    pb_device_t* list = NULL;
+    pb_devices_block_t  *block = NULL;
+    ssize_t             i = 0;
 
     if (!p_devices)
     {
         return -1;
     }
 
-    if (--p_devices->ref <= 0)
+    if ( pb_refcount_dec(&p_devices->ref) )
     {
-        // Pass through the list
-        for ( list = p_devices->list; list != NULL; )
+        for ( i = 0; i < p_devices->nb_active; i++ )
         {
-            // Get the pointer
-            pb_device_t* current_device = list;
+            pb_device_unref(p_devices->devices[i]);
+        }
 
+        // The devices of the blocks and their strings go away with their blocks and the arena
+        pb_arena_clear(&p_devices->arena);
 
-            // Pass to the next pointer
-            list   = pb_device_get_next(list);
+        while ( (block = p_devices->blocks) != NULL )
+        {
+            p_devices->blocks = block->next;
+            free(block->devices);
+            free(block);
+        }
 
+        pb_free(p_devices->devices);
+        pb_free(p_devices->by_iden.slots);
+        pb_free(p_devices->by_nickname.slots);
+        pb_free(p_devices->by_nickname_key.slots);
 
-            // Free the temporary pointer
-            pb_device_unref(current_device);
-            p_devices->nb_active--;
+        for ( i = 0; i < DEVICES_NB_BITMAPS; i++ )
+        {
+            pb_free(p_devices->bitmaps[i]);
         }
 
         free(p_devices);
@@ -97,7 +252,141 @@ int pb_devices_unref(pb_devices_t* p_devices)
 
 int pb_devices_get_ref(const pb_devices_t* p_devices)
 {
-    return (p_devices) ? p_devices->ref : 0;
+    return (p_devices) ? pb_refcount_get(&p_devices->ref) : 0;
+}
+
+
+size_t pb_devices_query(const pb_devices_t*    p_devices,
+                        unsigned int           types,
+                        unsigned int           capabilities,
+                        pb_device_t**          matches,
+                        size_t                 max
+                        )
+{
+    size_t      nb_words = 0;
+    size_t      nb = 0;
+    size_t      w = 0;
+    int         t = 0;
+    uint64_t    word = 0;
+
+    if ( (! p_devices) || (p_devices->nb_active <= 0) )
+    {
+        return 0;
+    }
+
+    nb_words = ((size_t) p_devices->nb_active + 63) / 64;
+
+    for ( w = 0; w < nb_words; w++ )
+    {
+        // One of the types...
+        if ( types )
+        {
+            for ( t = ICON_DESKTOP, word = 0; t <= ICON_DEVICE; t++ )
+            {
+                if ( types & PB_DEVICES_TYPE(t) )
+                {
+                    word |= p_devices->bitmaps[t][w];
+                }
+            }
+        }
+        else
+        {
+            word = ~(uint64_t) 0;
+        }
+
+        // ... and all the capabilities
+        if ( capabilities & PB_DEVICES_ACTIVE )
+        {
+            word &= p_devices->bitmaps[DEVICES_BITMAP_ACTIVE][w];
+        }
+
+        if ( capabilities & PB_DEVICES_HAS_SMS )
+        {
+            word &= p_devices->bitmaps[DEVICES_BITMAP_HAS_SMS][w];
+        }
+
+        if ( capabilities & PB_DEVICES_HAS_MMS )
+        {
+            word &= p_devices->bitmaps[DEVICES_BITMAP_HAS_MMS][w];
+        }
+
+        // The bits after the last device are not significant
+        if ( (w == nb_words - 1) && ((size_t) p_devices->nb_active % 64) )
+        {
+            word &= ((uint64_t) 1 << ((size_t) p_devices->nb_active % 64)) - 1;
+        }
+
+        for ( ; word; word &= word - 1, nb++ )
+        {
+            if ( matches && (nb < max) )
+            {
+                matches[nb] = p_devices->devices[w * 64 + (size_t) __builtin_ctzll(word)];
+            }
+        }
+    }
+
+    return nb;
+}
+
+
+pb_devices_t* pb_devices_dup(const pb_devices_t* p_devices)
+{
+    pb_devices_t    *copy = NULL;
+    ssize_t         i = 0;
+
+    if ( (! p_devices) || ((copy = pb_devices_new()) == NULL) )
+    {
+        return (NULL);
+    }
+
+    copy->modified_after = p_devices->modified_after;
+
+    if ( devices_reserve(copy, (size_t) p_devices->nb_active) != 0 )
+    {
+        pb_devices_unref(copy);
+        return (NULL);
+    }
+
+    for ( i = 0; i < p_devices->nb_active; i++ )
+    {
+        if ( pb_devices_add_copy(copy, p_devices->devices[i]) != 0 )
+        {
+            pb_devices_unref(copy);
+            return (NULL);
+        }
+    }
+
+    return copy;
+}
+
+
+int pb_devices_reserve(pb_devices_t  *p_devices,
+                       size_t        nb
+                       )
+{
+    return (p_devices) ? devices_reserve(p_devices, nb) : -1;
+}
+
+
+int pb_devices_add_copy(pb_devices_t         *p_devices,
+                        const pb_device_t    *p_device
+                        )
+{
+    pb_device_t *device = NULL;
+
+    if ( (! p_devices) || (! p_device) || ((device = devices_new_device(p_devices)) == NULL) )
+    {
+        return -1;
+    }
+
+    // The strings of the copy are stored in the arena of the list
+    if ( (pb_device_copy(device, p_device) != 0) || (pb_devices_add_new_device(p_devices, device) != 0) )
+    {
+        devices_release_device(p_devices, device);
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -130,6 +419,12 @@ int pb_devices_load_devices_from_data(pb_devices_t* p_devices, char* result, siz
                 devices_node = json_object_get_member(obj, DEVICES_JSON_KEY);
                 devices_arr = json_node_get_array(devices_node);
 
+                // Presize the storage: the devices are appended without any reallocation
+                if ( devices_reserve(p_devices, json_array_get_length(devices_arr)) != 0 )
+                {
+                    eprintf("Impossible to reserve %u devices", json_array_get_length(devices_arr) );
+                }
+
                 json_array_foreach_element(devices_arr, devices_fill_devices_list, p_devices);
 
                 #ifdef __TRACES__
@@ -152,9 +447,11 @@ int pb_devices_load_devices_from_data(pb_devices_t* p_devices, char* result, siz
 }
 
 
-pb_device_t* pb_devices_get_list(const pb_devices_t* p_devices)
+pb_device_t* pb_devices_get_device_at(const pb_devices_t* p_devices,
+                                      size_t              idx
+                                      )
 {
-    return (p_devices) ? p_devices->list : NULL;
+    return ( p_devices && (idx < (size_t) p_devices->nb_active) ) ? p_devices->devices[idx] : NULL;
 }
 
 
@@ -166,77 +463,169 @@ ssize_t pb_devices_get_number_active(const pb_devices_t *p_devices)
 
 int pb_devices_add_new_device(pb_devices_t* p_devices, pb_device_t* p_new_device)
 {
-    pb_device_t     *device = NULL;
-
     if ( (! p_devices) || (! p_new_device))
     {
         return -1;
     }
 
-    // Add the device to the linked list
-    if ( p_devices->list == NULL )
+    if ( ((size_t) p_devices->nb_active == p_devices->devices_size) && (devices_reserve(p_devices, 1) != 0) )
     {
-        p_devices->list = p_new_device;
+        return -1;
     }
-    else
+
+    if ( devices_index_device(p_devices, p_new_device) != 0 )
     {
-        for ( device = p_devices->list; pb_device_get_next(device) != NULL; device = pb_device_get_next(device) )
-        {
-            ;
-        }
+        return -1;
+    }
+
+    devices_bitmaps_set(p_devices, (size_t) p_devices->nb_active, p_new_device);
+    p_devices->devices[p_devices->nb_active++] = p_new_device;
+
+    return 0;
+}
+
+
+pb_device_t* pb_devices_get_device_from_iden(const pb_devices_t* p_devices,
+                                             const char*         iden
+                                             )
+{
+    if ( (! p_devices) || (! iden) )
+    {
+        return (NULL);
+    }
+
+    return devices_index_lookup(&p_devices->by_iden, iden);
+}
 
-        pb_device_set_next(device, p_new_device);
+
+int pb_devices_put_device(pb_devices_t* p_devices,
+                          pb_device_t*  p_device
+                          )
+{
+    pb_device_t     *node = NULL;
+    ssize_t         pos = 0;
+
+    if ( (! p_devices) || (! p_device) )
+    {
+        return -1;
+    }
+
+    if ( (node = pb_devices_get_device_from_iden(p_devices, pb_device_get_iden(p_device))) == NULL )
+    {
+        return pb_devices_add_new_device(p_devices, p_device);
     }
 
-    p_devices->nb_active++;
+    // Replace the device in place so the order of the list does not change
+    pos = devices_get_position(p_devices, node);
+    p_devices->devices[pos] = p_device;
+    devices_bitmaps_set(p_devices, (size_t) pos, p_device);
+
+    devices_unindex_device(p_devices, node);
+    devices_release_device(p_devices, node);
+
+    // The device is in the list now: failing to index it (out of memory) only makes it unreachable by the lookups
+    if ( devices_index_device(p_devices, p_device) != 0 )
+    {
+        eprintf("Impossible to index the device %s", pb_device_get_iden(p_device) );
+    }
 
     return 0;
 }
 
 
-const char* pb_devices_get_iden_from_name(const pb_devices_t *p_devices,
-                                          const char         *nickname
-                                          )
+int pb_devices_remove_device(pb_devices_t* p_devices,
+                             const char*   iden
+                             )
 {
     pb_device_t     *node = NULL;
+    ssize_t         pos = 0;
 
+    if ( (! p_devices) || (! iden) )
+    {
+        return -1;
+    }
 
-    if ( ! nickname )
+    if ( (node = pb_devices_get_device_from_iden(p_devices, iden)) == NULL )
     {
-        return (NULL);
+        return 1;
     }
 
-    for ( node = p_devices->list; node != NULL; node = pb_device_get_next(node) )
+    pos = devices_get_position(p_devices, node);
+    memmove(&p_devices->devices[pos], &p_devices->devices[pos + 1], (size_t) (p_devices->nb_active - pos - 1) * sizeof(pb_device_t *) );
+    devices_bitmaps_remove(p_devices, (size_t) pos);
+    p_devices->nb_active--;
+
+    devices_unindex_device(p_devices, node);
+    devices_release_device(p_devices, node);
+
+    return 0;
+}
+
+
+double pb_devices_get_modified_after(const pb_devices_t* p_devices)
+{
+    return (p_devices) ? p_devices->modified_after : 0;
+}
+
+
+int pb_devices_set_modified_after(pb_devices_t* p_devices,
+                                  double        modified_after
+                                  )
+{
+    if ( ! p_devices )
     {
-        switch ( pb_device_get_type(node) )
-        {
-            case ICON_PHONE:
+        return -1;
+    }
 
-                if ( strcmp(pb_device_get_nickname(node), nickname) == 0 )
-                {
-                    return ( pb_device_get_iden(node) );
-                }
+    p_devices->modified_after = modified_after;
+    return 0;
+}
 
-                break;
 
-            case ICON_BROWSER:
+const char* pb_devices_get_iden_from_name(const pb_devices_t *p_devices,
+                                          const char         *nickname
+                                          )
+{
+    if ( (! p_devices) || (! nickname) )
+    {
+        return (NULL);
+    }
+
+    return pb_device_get_iden(devices_index_lookup(&p_devices->by_nickname, nickname) );
+}
 
-                if ( strcmp(pb_device_get_nickname(node), nickname) == 0 )
-                {
-                    return ( pb_device_get_iden(node) );
-                }
 
-                break;
+const char* pb_devices_get_iden_from_normalized_name(const pb_devices_t  *p_devices,
+                                                     const char          *nickname
+                                                     )
+{
+    char        buf[0x100];
+    char        *key = buf;
+    size_t      size = 0;
+    const char  *iden = NULL;
 
-            default:
-                #ifdef __TRACES__
-                eprintf("Unknown type...");
-                #endif
-                break;
-        }
+    if ( (! p_devices) || (! nickname) )
+    {
+        return (NULL);
     }
 
-    return (NULL);
+    // Only the nickname asked is normalized: the keys of the devices were computed when they were indexed
+    size = strlen(nickname) + 1;
+
+    if ( (size > sizeof(buf)) && ((key = malloc(size)) == NULL) )
+    {
+        return (NULL);
+    }
+
+    pb_device_normalize_nickname(key, nickname);
+    iden = pb_device_get_iden(devices_index_lookup(&p_devices->by_nickname_key, key) );
+
+    if ( key != buf )
+    {
+        pb_free(key);
+    }
+
+    return iden;
 }
 
 
@@ -246,25 +635,47 @@ static void devices_fill_devices_list(JsonArray *arr __attribute__((unused)),
                                       gpointer userdata)
 {
     pb_devices_t* p_devices = (pb_devices_t*) userdata;
+    pb_device_t* new_device = NULL;
     JsonObject* node_obj = NULL;
     const char* device_type = NULL;
+    const char* iden = NULL;
+    double modified = 0;
 
     if ( ! JSON_NODE_HOLDS_OBJECT(node_arr) )
     {
         eprintf("devices[%d] : The node does not contain an JsonObject", idx);
+        return;
     }
     else if ( (node_obj = json_node_get_object(node_arr) ) == NULL)
     {
         eprintf("devices[%d] : Impossible to get the object from the node", idx);
+        return;
     }
-    else if ( ! json_object_has_member(node_obj, ACTIVE_JSON_KEY) )
+
+    // Raise the watermark with every device seen, even the deleted ones
+    if ( json_object_has_member(node_obj, MODIFIED_JSON_KEY) )
+    {
+        modified = json_object_get_double_member(node_obj, MODIFIED_JSON_KEY);
+
+        if ( modified > p_devices->modified_after )
+        {
+            p_devices->modified_after = modified;
+        }
+    }
+
+    if ( json_object_has_member(node_obj, IDEN_JSON_KEY) )
+    {
+        iden = json_object_get_string_member(node_obj, IDEN_JSON_KEY);
+    }
+
+    if ( ! json_object_has_member(node_obj, ACTIVE_JSON_KEY) )
     {
         eprintf("devices[%d] : The obj does not have the member \"%s\"", idx, ACTIVE_JSON_KEY);
     }
     else if ( ! json_object_get_boolean_member(node_obj, ACTIVE_JSON_KEY) )
     {
-        // Active: false
-        return;
+        // Active: false, the device has been deleted
+        pb_devices_remove_device(p_devices, iden);
     }
     else if ( ! json_object_has_member(node_obj, JSON_KEY_ICON) )
     {
@@ -274,22 +685,455 @@ static void devices_fill_devices_list(JsonArray *arr __attribute__((unused)),
     {
         eprintf("devices[%d] : Impossible to get the string member \"%s\" from object", idx, JSON_KEY_ICON);
     }
+    else if ( (new_device = devices_new_device(p_devices)) == NULL )
+    {
+        eprintf("devices[%d] : Impossible to allocate the device", idx);
+    }
     else
     {
-        pb_device_t* new_device = pb_device_new();
+        pb_device_set_type(new_device, devices_get_type_from_icon(device_type) );
+        json_object_foreach_member(node_obj, pb_device_fill_from_json, new_device);
 
-        if ( strcmp(device_type, PHONE_ICON) == 0 )
+        if ( pb_devices_put_device(p_devices, new_device) != 0 )
         {
-            pb_device_set_type(new_device, ICON_PHONE);
+            eprintf("devices[%d] : Impossible to index the device", idx);
+            devices_release_device(p_devices, new_device);
         }
-        else if ( strcmp(device_type, BROWSER_ICON) == 0 )
+    }
+}
+
+
+static pb_device_icon devices_get_type_from_icon(const char *icon)
+{
+    size_t  i = 0;
+
+    for ( i = 0; i < sizeof(devices_icons) / sizeof(devices_icons[0]); i++ )
+    {
+        if ( strcmp(icon, devices_icons[i].icon) == 0 )
         {
-            pb_device_set_type(new_device, ICON_BROWSER);
+            return devices_icons[i].type;
         }
-            
-        json_object_foreach_member(node_obj, pb_device_fill_from_json, new_device);
+    }
+
+    return ICON_DEVICE;
+}
+
+
+static uint32_t devices_hash(const char *key)
+{
+    uint32_t    hash = 2166136261u;
+
+    for ( ; *key; key++ )
+    {
+        hash ^= (unsigned char) *key;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+static size_t devices_index_find_slot(const pb_devices_index_t   *index,
+                                      const char                 *key
+                                      )
+{
+    size_t  mask = index->nb_slots - 1;
+    size_t  i = 0;
+
+    for ( i = devices_hash(key) & mask; index->slots[i]; i = (i + 1) & mask )
+    {
+        if ( strcmp(index->key(index->slots[i]), key) == 0 )
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+
+static pb_device_t* devices_index_lookup(const pb_devices_index_t    *index,
+                                         const char                  *key
+                                         )
+{
+    return ( index->nb_entries ) ? index->slots[devices_index_find_slot(index, key)] : NULL;
+}
+
+
+static int devices_index_insert(pb_devices_index_t   *index,
+                                pb_device_t          *p_device
+                                )
+{
+    pb_device_t     **old = index->slots;
+    size_t          old_nb = index->nb_slots;
+    const char      *key = index->key(p_device);
+    size_t          slot = 0;
+    size_t          i = 0;
+
+    if ( ! key )
+    {
+        return 0;
+    }
 
-        pb_devices_add_new_device(p_devices, new_device);
+    // Keep the load factor under one half
+    if ( (index->nb_entries + 1) * 2 > index->nb_slots )
+    {
+        index->nb_slots = ( old_nb ) ? old_nb * 2 : DEVICES_INDEX_MIN_SLOTS;
+
+        if ( (index->slots = calloc(index->nb_slots, sizeof(pb_device_t *))) == NULL )
+        {
+            index->slots = old;
+            index->nb_slots = old_nb;
+            return -1;
+        }
+
+        for ( i = 0; i < old_nb; i++ )
+        {
+            if ( old[i] )
+            {
+                index->slots[devices_index_find_slot(index, index->key(old[i]))] = old[i];
+            }
+        }
+
+        pb_free(old);
+    }
+
+    slot = devices_index_find_slot(index, key);
+
+    if ( ! index->slots[slot] )
+    {
+        index->slots[slot] = p_device;
+        index->nb_entries++;
+    }
+
+    return 0;
+}
+
+
+static int devices_index_remove(pb_devices_index_t   *index,
+                                const pb_device_t    *p_device
+                                )
+{
+    size_t          mask = index->nb_slots - 1;
+    const char      *key = index->key(p_device);
+    size_t          i = 0;
+    size_t          j = 0;
+    size_t          home = 0;
+
+    if ( (! key) || (! index->nb_entries) )
+    {
+        return 0;
+    }
+
+    i = devices_index_find_slot(index, key);
+
+    if ( index->slots[i] != p_device )
+    {
+        return 0;
+    }
+
+    // Shift back the following entries of the cluster so that no probe sequence is broken
+    for ( j = (i + 1) & mask; index->slots[j]; j = (j + 1) & mask )
+    {
+        home = devices_hash(index->key(index->slots[j]) ) & mask;
+
+        if ( ((j > i) && ((home <= i) || (home > j))) || ((j < i) && (home <= i) && (home > j)) )
+        {
+            index->slots[i] = index->slots[j];
+            i = j;
+        }
+    }
+
+    index->slots[i] = NULL;
+    index->nb_entries--;
+
+    return 1;
+}
+
+
+static void devices_index_remove_shared(pb_devices_t          *p_devices,
+                                        pb_devices_index_t    *index,
+                                        const pb_device_t     *p_device
+                                        )
+{
+    const char      *key = index->key(p_device);
+    const char      *other = NULL;
+    ssize_t         i = 0;
+
+    if ( devices_index_remove(index, p_device) )
+    {
+        // Another device with the same key takes its place
+        for ( i = 0; i < p_devices->nb_active; i++ )
+        {
+            if ( ((other = index->key(p_devices->devices[i])) != NULL) && (strcmp(other, key) == 0) )
+            {
+                devices_index_insert(index, p_devices->devices[i]);
+                break;
+            }
+        }
+    }
+}
+
+
+static int devices_index_device(pb_devices_t     *p_devices,
+                                pb_device_t      *p_device
+                                )
+{
+    // The normalized nickname is computed once, the lookups only normalize the nickname asked
+    if ( pb_device_set_nickname_key(p_device) != 0 )
+    {
+        return -1;
+    }
+
+    if ( devices_index_insert(&p_devices->by_iden, p_device) != 0 )
+    {
+        return -1;
+    }
+
+    if ( devices_index_insert(&p_devices->by_nickname, p_device) != 0 )
+    {
+        devices_index_remove(&p_devices->by_iden, p_device);
+        return -1;
+    }
+
+    if ( devices_index_insert(&p_devices->by_nickname_key, p_device) != 0 )
+    {
+        devices_index_remove(&p_devices->by_iden, p_device);
+        devices_index_remove_shared(p_devices, &p_devices->by_nickname, p_device);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void devices_unindex_device(pb_devices_t          *p_devices,
+                                   const pb_device_t     *p_device
+                                   )
+{
+    devices_index_remove(&p_devices->by_iden, p_device);
+    devices_index_remove_shared(p_devices, &p_devices->by_nickname, p_device);
+    devices_index_remove_shared(p_devices, &p_devices->by_nickname_key, p_device);
+}
+
+
+static ssize_t devices_get_position(const pb_devices_t    *p_devices,
+                                    const pb_device_t     *p_device
+                                    )
+{
+    ssize_t     i = 0;
+
+    for ( i = 0; i < p_devices->nb_active; i++ )
+    {
+        if ( p_devices->devices[i] == p_device )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+static int devices_reserve(pb_devices_t  *p_devices,
+                           size_t        nb
+                           )
+{
+    pb_device_t         **devices = NULL;
+    pb_devices_block_t  *block = p_devices->blocks;
+    size_t              size = p_devices->devices_size;
+    size_t              needed = (size_t) p_devices->nb_active + nb;
+
+    if ( needed > size )
+    {
+        // Grow geometrically so that appending one by one stays linear
+        for ( size = (size) ? size : DEVICES_BLOCK_MIN_SIZE; size < needed; size *= 2 )
+        {
+            ;
+        }
+
+        if ( (devices = realloc(p_devices->devices, size * sizeof(pb_device_t *))) == NULL )
+        {
+            return -1;
+        }
+
+        p_devices->devices = devices;
+
+        if ( devices_bitmaps_grow(p_devices, size) != 0 )
+        {
+            return -1;
+        }
+
+        p_devices->devices_size = size;
+    }
+
+    // The devices of the response are stored together in one block
+    if ( (nb > 1) && ((! block) || (block->size - block->nb_used < nb)) )
+    {
+        return devices_new_block(p_devices, (nb > DEVICES_BLOCK_MIN_SIZE) ? nb : DEVICES_BLOCK_MIN_SIZE);
+    }
+
+    return 0;
+}
+
+
+static int devices_new_block(pb_devices_t    *p_devices,
+                             size_t          size
+                             )
+{
+    pb_devices_block_t  *block = calloc(1, sizeof(pb_devices_block_t) );
+
+    if ( (! block) || ((block->devices = calloc(size, sizeof(pb_device_t))) == NULL) )
+    {
+        pb_free(block);
+        return -1;
+    }
+
+    block->size = size;
+    block->next = p_devices->blocks;
+    p_devices->blocks = block;
+
+    return 0;
+}
+
+
+static pb_device_t* devices_new_device(pb_devices_t *p_devices)
+{
+    pb_devices_block_t  *block = p_devices->blocks;
+    pb_device_t         *device = NULL;
+
+    if ( (device = p_devices->free_devices) != NULL )
+    {
+        p_devices->free_devices = device->free_next;
+    }
+    else
+    {
+        if ( ((! block) || (block->nb_used == block->size)) &&
+             (devices_new_block(p_devices, (block) ? 2 * block->size : DEVICES_BLOCK_MIN_SIZE) != 0) )
+        {
+            return (NULL);
+        }
+
+        block = p_devices->blocks;
+        device = &block->devices[block->nb_used++];
+    }
+
+    pb_device_init_in_block(device, &p_devices->arena);
+
+    return device;
+}
+
+
+static void devices_release_device(pb_devices_t  *p_devices,
+                                   pb_device_t   *p_device
+                                   )
+{
+    unsigned char   reusable = p_device->arena && (pb_refcount_get(&p_device->ref) == 1);
+
+    pb_device_unref(p_device);
+
+    // Nobody else holds the device of the block: it can be handed out again
+    if ( reusable )
+    {
+        p_device->free_next = p_devices->free_devices;
+        p_devices->free_devices = p_device;
+    }
+}
+
+
+static int devices_bitmaps_grow(pb_devices_t    *p_devices,
+                                size_t          size
+                                )
+{
+    size_t      nb_words = (size + 63) / 64;
+    uint64_t    *bitmap = NULL;
+    size_t      i = 0;
+
+    if ( nb_words <= p_devices->bitmap_words )
+    {
+        return 0;
+    }
+
+    for ( i = 0; i < DEVICES_NB_BITMAPS; i++ )
+    {
+        if ( (bitmap = realloc(p_devices->bitmaps[i], nb_words * sizeof(uint64_t))) == NULL )
+        {
+            return -1;
+        }
+
+        memset(bitmap + p_devices->bitmap_words, 0, (nb_words - p_devices->bitmap_words) * sizeof(uint64_t) );
+        p_devices->bitmaps[i] = bitmap;
+    }
+
+    p_devices->bitmap_words = nb_words;
+
+    return 0;
+}
+
+
+static void devices_bitmaps_set(pb_devices_t         *p_devices,
+                                size_t               pos,
+                                const pb_device_t    *p_device
+                                )
+{
+    size_t      w = pos / 64;
+    uint64_t    bit = (uint64_t) 1 << (pos % 64);
+    size_t      i = 0;
+    int         active = 0;
+    int         has_sms = 0;
+    int         has_mms = 0;
+
+    for ( i = 0; i < DEVICES_NB_BITMAPS; i++ )
+    {
+        p_devices->bitmaps[i][w] &= ~bit;
+    }
+
+    if ( p_device->type == ICON_PHONE )
+    {
+        active = p_device->phone.active;
+        has_sms = p_device->phone.has_sms;
+        has_mms = p_device->phone.has_mms;
+    }
+    else
+    {
+        active = p_device->browser.active;
+    }
+
+    // A device of an unknown type is only found by the queries on any type
+    if ( (p_device->type >= ICON_DESKTOP) && (p_device->type <= ICON_DEVICE) )
+    {
+        p_devices->bitmaps[p_device->type][w] |= bit;
+    }
+
+    p_devices->bitmaps[DEVICES_BITMAP_ACTIVE][w] |= (active) ? bit : 0;
+    p_devices->bitmaps[DEVICES_BITMAP_HAS_SMS][w] |= (has_sms) ? bit : 0;
+    p_devices->bitmaps[DEVICES_BITMAP_HAS_MMS][w] |= (has_mms) ? bit : 0;
+}
+
+
+static void devices_bitmaps_remove(pb_devices_t  *p_devices,
+                                   size_t        pos
+                                   )
+{
+    size_t      nb_words = ((size_t) p_devices->nb_active + 63) / 64;
+    size_t      first = pos / 64;
+    uint64_t    low = ((uint64_t) 1 << (pos % 64)) - 1;
+    uint64_t    *bitmap = NULL;
+    size_t      i = 0;
+    size_t      w = 0;
+
+    for ( i = 0; i < DEVICES_NB_BITMAPS; i++ )
+    {
+        bitmap = p_devices->bitmaps[i];
+
+        // The bits before pos stay, the ones after move down by one, across the words
+        bitmap[first] = (bitmap[first] & low) | ((bitmap[first] >> 1) & ~low);
+
+        for ( w = first; w + 1 < nb_words; w++ )
+        {
+            bitmap[w] |= (bitmap[w + 1] & 1) << 63;
+            bitmap[w + 1] >>= 1;
+        }
     }
 }
 
@@ -297,12 +1141,12 @@ static void devices_fill_devices_list(JsonArray *arr __attribute__((unused)),
 #ifdef __TRACES__
 static void devices_dump_devices_list(const pb_devices_t *p_devices)
 {
-    pb_device_t     *node = NULL;
+    ssize_t     i = 0;
 
 
-    for ( node = p_devices->list; node != NULL; node = pb_device_get_next(node) )
+    for ( i = 0; i < p_devices->nb_active; i++ )
     {
-        pb_device_dump_infos(node);
+        pb_device_dump_infos(p_devices->devices[i]);
     }
 }
 #endif
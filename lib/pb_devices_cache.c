@@ -0,0 +1,417 @@
+/**
+ * @file pb_devices_cache.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdio.h>           // fopen, fread, fwrite, fclose, rename, remove, snprintf
+#include <stdlib.h>          // calloc, malloc, free
+#include <string.h>          // memcpy, memcmp, memset, strlen
+#include <stddef.h>          // offsetof
+#include <unistd.h>          // fsync
+#include <sys/stat.h>        // fstat
+#include <json-glib/json-glib.h>    // JsonObject, JsonNode (prototypes of pb_device_prot.h)
+
+#include "pb_utils.h"                 // iprintf, eprintf
+#include "pb_device_priv.h"           // pb_device_t, pb_phone_t, pb_browser_t
+#include "pb_devices_prot.h"          // pb_devices_get_device_at, pb_devices_add_copy, pb_devices_reserve
+#include "pb_devices_cache_priv.h"    // pb_devices_cache_header_t, pb_devices_cache_record_t, DEVICES_CACHE_*
+#include "pb_devices_cache_prot.h"    // pb_devices_cache_write, pb_devices_cache_read
+#include "pushbullet.h"               // pb_devices_new, pb_devices_unref
+
+
+/**
+ * @brief Position of the strings of a phone in a record (the identification first)
+ */
+static const size_t cache_phone_strings[DEVICES_CACHE_NB_STRINGS] = {
+    offsetof(pb_phone_t, iden),
+    offsetof(pb_phone_t, nickname),
+    offsetof(pb_phone_t, manufacturer),
+    offsetof(pb_phone_t, model),
+    offsetof(pb_phone_t, icon),
+    offsetof(pb_phone_t, fingerprint),
+    offsetof(pb_phone_t, push_token),
+    offsetof(pb_phone_t, remote_files)
+};
+
+
+/**
+ * @brief Position of the strings of any other device in a record (in the same order as the phones)
+ */
+static const size_t cache_browser_strings[DEVICES_CACHE_NB_BROWSER_STRINGS] = {
+    offsetof(pb_browser_t, iden),
+    offsetof(pb_browser_t, nickname),
+    offsetof(pb_browser_t, manufacturer),
+    offsetof(pb_browser_t, model),
+    offsetof(pb_browser_t, icon)
+};
+
+
+/**
+ * @brief      Get the address of a string of a device
+ */
+#define DEVICE_STRING(device, i)    ( (device)->type == ICON_PHONE ?                                                  \
+                                      (char **) ((char *) &(device)->phone + cache_phone_strings[i]) :                \
+                                      (char **) ((char *) &(device)->browser + cache_browser_strings[i]) )
+
+
+/**
+ * @brief      Get the number of strings of a device
+ */
+#define DEVICE_NB_STRINGS(device)   ( (device)->type == ICON_PHONE ? DEVICES_CACHE_NB_STRINGS :                       \
+                                      DEVICES_CACHE_NB_BROWSER_STRINGS)
+
+
+/**
+ * @brief      Compute the checksum of a buffer (FNV-1a)
+ */
+static uint64_t cache_checksum(const unsigned char *data, size_t size);
+
+/**
+ * @brief      Check the sizes, the offsets and the records of a cache read in memory
+ *
+ * @return     0 if the cache can be used, otherwise there is an error
+ */
+static int cache_check(const unsigned char *data, size_t size);
+
+/**
+ * @brief      Decode a record into a device whose strings point into the heap of the cache
+ */
+static void cache_decode(const pb_devices_cache_record_t *record, const char *strings, pb_device_t *device);
+
+
+int pb_devices_cache_write(const char            *path,
+                           const pb_devices_t    *devices
+                           )
+{
+    pb_devices_cache_header_t   *header = NULL;
+    pb_devices_cache_record_t   *records = NULL;
+    char                        *strings = NULL;
+    unsigned char               *data = NULL;
+    char                        *tmp_path = NULL;
+    FILE                        *f = NULL;
+    pb_device_t                 *device = NULL;
+    size_t                      nb_devices = 0;
+    size_t                      strings_size = 0;
+    size_t                      size = 0;
+    size_t                      len = 0;
+    size_t                      i = 0;
+    size_t                      j = 0;
+    const char                  *str = NULL;
+    int                         ret = -1;
+
+    if ( (! path) || (! devices) )
+    {
+        return -1;
+    }
+
+    nb_devices = (size_t) pb_devices_get_number_active(devices);
+
+    for ( i = 0; i < nb_devices; i++ )
+    {
+        device = pb_devices_get_device_at(devices, i);
+
+        for ( j = 0; j < (size_t) DEVICE_NB_STRINGS(device); j++ )
+        {
+            if ( (str = *DEVICE_STRING(device, j)) != NULL )
+            {
+                strings_size += strlen(str) + 1;
+            }
+        }
+    }
+
+    // Offsets are stored on 32 bits
+    if ( strings_size >= UINT32_MAX )
+    {
+        eprintf("Too many strings to write a devices cache");
+        return -1;
+    }
+
+    size = sizeof(*header) + (nb_devices * sizeof(*records)) + strings_size;
+
+    if ( (data = calloc(1, size)) == NULL )
+    {
+        eprintf("Not enough memory to write a devices cache of %zu bytes", size);
+        return -1;
+    }
+
+    header = (pb_devices_cache_header_t *) data;
+    records = (pb_devices_cache_record_t *) (header + 1);
+    strings = (char *) (records + nb_devices);
+
+    memcpy(header->magic, DEVICES_CACHE_MAGIC, sizeof(header->magic) );
+    header->version = DEVICES_CACHE_VERSION;
+    header->record_size = sizeof(*records);
+    header->nb_records = nb_devices;
+    header->strings_size = strings_size;
+    header->modified_after = pb_devices_get_modified_after(devices);
+
+    for ( i = 0, strings_size = 0; i < nb_devices; i++ )
+    {
+        device = pb_devices_get_device_at(devices, i);
+
+        records[i].type = device->type;
+
+        if ( device->type == ICON_PHONE )
+        {
+            records[i].active = device->phone.active;
+            records[i].created = device->phone.created;
+            records[i].modified = device->phone.modified;
+            records[i].app_version = device->phone.app_version;
+            records[i].generated_nickname = device->phone.generated_nickname;
+            records[i].has_sms = device->phone.has_sms;
+            records[i].has_mms = device->phone.has_mms;
+        }
+        else
+        {
+            records[i].active = device->browser.active;
+            records[i].created = device->browser.created;
+            records[i].modified = device->browser.modified;
+            records[i].app_version = device->browser.app_version;
+        }
+
+        for ( j = 0; j < (size_t) DEVICE_NB_STRINGS(device); j++ )
+        {
+            if ( (str = *DEVICE_STRING(device, j)) != NULL )
+            {
+                len = strlen(str) + 1;
+                memcpy(strings + strings_size, str, len);
+                records[i].strings[j] = (uint32_t) strings_size + 1;
+                strings_size += len;
+            }
+        }
+    }
+
+    header->checksum = cache_checksum(data + sizeof(*header), size - sizeof(*header) );
+
+    // Write next to the cache then rename: a reader never sees a partial cache
+    len = strlen(path) + sizeof(".tmp");
+
+    if ( (tmp_path = malloc(len)) == NULL )
+    {
+        free(data);
+        return -1;
+    }
+
+    snprintf(tmp_path, len, "%s.tmp", path);
+
+    if ( (f = fopen(tmp_path, "wb")) == NULL )
+    {
+        eprintf("Cannot open %s", tmp_path);
+    }
+    else
+    {
+        if ( (fwrite(data, 1, size, f) == size) && (fflush(f) == 0) && (fsync(fileno(f)) == 0) )
+        {
+            ret = 0;
+        }
+
+        if ( (fclose(f) != 0) || (ret != 0) || (rename(tmp_path, path) != 0) )
+        {
+            eprintf("Cannot write devices cache %s", path);
+            remove(tmp_path);
+            ret = -1;
+        }
+    }
+
+    free(tmp_path);
+    free(data);
+
+    return ret;
+}
+
+
+pb_devices_t* pb_devices_cache_read(const char *path)
+{
+    FILE                                *f = NULL;
+    struct stat                         st;
+    unsigned char                       *data = NULL;
+    size_t                              size = 0;
+    const pb_devices_cache_header_t     *header = NULL;
+    const pb_devices_cache_record_t     *records = NULL;
+    const char                          *strings = NULL;
+    pb_devices_t                        *devices = NULL;
+    pb_device_t                         device;
+    size_t                              i = 0;
+
+    if ( ! path )
+    {
+        return (NULL);
+    }
+
+    if ( (f = fopen(path, "rb")) == NULL )
+    {
+        #ifdef __TRACES__
+        iprintf("No devices cache at %s", path);
+        #endif
+        return (NULL);
+    }
+
+    if ( (fstat(fileno(f), &st) != 0) || ((size_t) st.st_size < sizeof(pb_devices_cache_header_t)) )
+    {
+        eprintf("Devices cache %s is truncated", path);
+        fclose(f);
+        return (NULL);
+    }
+
+    size = (size_t) st.st_size;
+
+    if ( ((data = malloc(size)) == NULL) || (fread(data, 1, size, f) != size) )
+    {
+        eprintf("Cannot read devices cache %s", path);
+        pb_free(data);
+        fclose(f);
+        return (NULL);
+    }
+
+    fclose(f);
+
+    if ( cache_check(data, size) != 0 )
+    {
+        eprintf("Devices cache %s is not valid", path);
+        free(data);
+        return (NULL);
+    }
+
+    header = (const pb_devices_cache_header_t *) data;
+    records = (const pb_devices_cache_record_t *) (header + 1);
+    strings = (const char *) (records + header->nb_records);
+
+    if ( ((devices = pb_devices_new()) == NULL) || (pb_devices_reserve(devices, header->nb_records) != 0) )
+    {
+        pb_devices_unref(devices);
+        free(data);
+        return (NULL);
+    }
+
+    pb_devices_set_modified_after(devices, header->modified_after);
+
+    // The strings are copied in the arena of the list: the cache can be freed right after
+    for ( i = 0; i < header->nb_records; i++ )
+    {
+        cache_decode(&records[i], strings, &device);
+
+        if ( pb_devices_add_copy(devices, &device) != 0 )
+        {
+            eprintf("Cannot load device %zu of devices cache %s", i, path);
+            pb_devices_unref(devices);
+            free(data);
+            return (NULL);
+        }
+    }
+
+    free(data);
+
+    return (devices);
+}
+
+
+static uint64_t cache_checksum(const unsigned char   *data,
+                               size_t                size
+                               )
+{
+    uint64_t    hash = 14695981039346656037ull;
+    size_t      i = 0;
+
+    for ( i = 0; i < size; i++ )
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+static int cache_check(const unsigned char   *data,
+                       size_t                size
+                       )
+{
+    const pb_devices_cache_header_t *header = (const pb_devices_cache_header_t *) data;
+    const pb_devices_cache_record_t *records = (const pb_devices_cache_record_t *) (header + 1);
+    const char                      *strings = NULL;
+    size_t                          i = 0;
+    size_t                          j = 0;
+
+    if ( (memcmp(header->magic, DEVICES_CACHE_MAGIC, sizeof(header->magic)) != 0) ||
+         (header->version != DEVICES_CACHE_VERSION) ||
+         (header->record_size != sizeof(pb_devices_cache_record_t)) )
+    {
+        return -1;
+    }
+
+    // Sections must fit exactly in the file, without overflow
+    if ( (header->nb_records > (size - sizeof(*header)) / sizeof(pb_devices_cache_record_t)) ||
+         (header->strings_size != size - sizeof(*header) - (header->nb_records * sizeof(pb_devices_cache_record_t))) )
+    {
+        return -1;
+    }
+
+    if ( header->checksum != cache_checksum(data + sizeof(*header), size - sizeof(*header)) )
+    {
+        return -1;
+    }
+
+    strings = (const char *) (records + header->nb_records);
+
+    // Every string ends in the heap
+    if ( (header->strings_size > 0) && (strings[header->strings_size - 1] != '\0') )
+    {
+        return -1;
+    }
+
+    for ( i = 0; i < header->nb_records; i++ )
+    {
+        if ( (records[i].strings[DEVICES_CACHE_IDEN] == 0) ||
+             (records[i].type < ICON_DESKTOP) || (records[i].type > ICON_DEVICE) )
+        {
+            return -1;
+        }
+
+        for ( j = 0; j < DEVICES_CACHE_NB_STRINGS; j++ )
+        {
+            if ( records[i].strings[j] > header->strings_size )
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static void cache_decode(const pb_devices_cache_record_t *record,
+                         const char                      *strings,
+                         pb_device_t                     *device
+                         )
+{
+    size_t  j = 0;
+
+    memset(device, 0, sizeof(*device) );
+    device->type = (pb_device_icon) record->type;
+
+    if ( device->type == ICON_PHONE )
+    {
+        device->phone.active = record->active;
+        device->phone.created = record->created;
+        device->phone.modified = record->modified;
+        device->phone.app_version = record->app_version;
+        device->phone.generated_nickname = record->generated_nickname;
+        device->phone.has_sms = record->has_sms;
+        device->phone.has_mms = record->has_mms;
+    }
+    else
+    {
+        device->browser.active = record->active;
+        device->browser.created = record->created;
+        device->browser.modified = record->modified;
+        device->browser.app_version = record->app_version;
+    }
+
+    // The device is only read by pb_devices_add_copy: the strings are not modified
+    for ( j = 0; j < (size_t) DEVICE_NB_STRINGS(device); j++ )
+    {
+        *DEVICE_STRING(device, j) = (record->strings[j] != 0) ? (char *) strings + record->strings[j] - 1 : NULL;
+    }
+}
@@ -0,0 +1,94 @@
+/**
+ * @file pb_devices_cache_priv.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  On-disk format of the devices caches
+ *
+ * A cache is made of:
+ *  - a header;
+ *  - the fixed-size records, in the order of the list;
+ *  - the string heap.
+ *
+ * Values are stored in the byte order of the host that wrote the cache.
+ */
+
+#ifndef __PB_DEVICES_CACHE_PRIV_H__
+#define __PB_DEVICES_CACHE_PRIV_H__
+
+#include <stdint.h>         // uint8_t, int16_t, int32_t, uint32_t, uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def DEVICES_CACHE_MAGIC
+ * Magic of a cache (8 bytes with the null character)
+ */
+#define DEVICES_CACHE_MAGIC         "PBDEVCS"
+
+/**
+ * @def DEVICES_CACHE_VERSION
+ * Version of the format, increased at each incompatible change
+ */
+#define DEVICES_CACHE_VERSION       1
+
+/**
+ * @def DEVICES_CACHE_NB_STRINGS
+ * Number of strings of a record (a browser only uses the first DEVICES_CACHE_NB_BROWSER_STRINGS ones)
+ */
+#define DEVICES_CACHE_NB_STRINGS    8
+
+/**
+ * @def DEVICES_CACHE_NB_BROWSER_STRINGS
+ * Number of strings of a device which is not a phone
+ */
+#define DEVICES_CACHE_NB_BROWSER_STRINGS    5
+
+/**
+ * @def DEVICES_CACHE_IDEN
+ * Position of the identification in the strings of a record
+ */
+#define DEVICES_CACHE_IDEN          0
+
+
+/**
+ * @struct pb_devices_cache_header_s
+ * @brief Header of a cache
+ */
+typedef struct pb_devices_cache_header_s {
+    char magic[8];          ///< DEVICES_CACHE_MAGIC
+    uint32_t version;          ///< DEVICES_CACHE_VERSION
+    uint32_t record_size;          ///< Size of a record
+    uint64_t nb_records;          ///< Number of records
+    uint64_t strings_size;          ///< Size of the string heap
+    double modified_after;          ///< Watermark of the synchronization
+    uint64_t checksum;          ///< FNV-1a of everything after the header
+} pb_devices_cache_header_t;
+
+
+/**
+ * @struct pb_devices_cache_record_s
+ * @brief Device stored in a cache
+ */
+typedef struct pb_devices_cache_record_s {
+    double created;          ///< Device's creation
+    double modified;          ///< Device's last modification
+    int32_t type;          ///< Type of the device (pb_device_icon)
+    int16_t app_version;          ///< Device's application version
+    uint8_t active;          ///< Device's activity
+    uint8_t generated_nickname;          ///< Has the nickname been generated automatically? (phones only)
+    uint8_t has_sms;          ///< Can we send SMS? (phones only)
+    uint8_t has_mms;          ///< Can we send MMS? (phones only)
+    uint8_t reserved[2];          ///< Padding, always 0
+    uint32_t strings[DEVICES_CACHE_NB_STRINGS];          ///< Offset + 1 of the strings in the heap (0 for NULL)
+} pb_devices_cache_record_t;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_DEVICES_CACHE_PRIV_H__
@@ -0,0 +1,45 @@
+/**
+ * @file pb_devices_cache_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Lists of devices persisted between two runs
+ */
+
+#ifndef __PB_DEVICES_CACHE_PROT_H__
+#define __PB_DEVICES_CACHE_PROT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pb_devices_s pb_devices_t;
+
+
+/**
+ * @brief      Write a list of devices and its watermark in a cache
+ * @details    The cache is written next to the path then renamed, so a reader never sees a partial cache.
+ *
+ * @param[in]  path     The path of the cache
+ * @param[in]  devices  The devices list
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_devices_cache_write(const char *path, const pb_devices_t *devices);
+
+/**
+ * @brief      Read a list of devices from a cache
+ *
+ * @param[in]  path  The path of the cache
+ *
+ * @return     On success: the devices list, with one reference, and the watermark of the cache
+ * @return     On error (missing, truncated, corrupted or other version): NULL
+ */
+pb_devices_t* pb_devices_cache_read(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_DEVICES_CACHE_PROT_H__
@@ -1,6 +1,13 @@
 #ifndef __PB_DEVICES_PRIV__
 #define __PB_DEVICES_PRIV__
 
+
+#include <stdint.h>         // uint64_t
+
+#include "pb_arena_prot.h"  // pb_arena_t
+#include "pb_refcount_prot.h"   // pb_refcount_t
+#include "pb_device_prot.h"     // ICON_DEVICE
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +34,20 @@ extern "C" {
 #define ACTIVE_JSON_KEY     "active"
 
 
+/**
+ * @def IDEN_JSON_KEY
+ * String defining the "iden" key
+ */
+#define IDEN_JSON_KEY       "iden"
+
+
+/**
+ * @def MODIFIED_JSON_KEY
+ * String defining the "modified" key
+ */
+#define MODIFIED_JSON_KEY   "modified"
+
+
 /**
  * @def JSON_KEY_ICON
  * String defining the "icon" key
@@ -89,12 +110,97 @@ extern "C" {
  */
 #define SYSTEM_ICON         "system"
 
+
+/**
+ * @def DEVICES_INDEX_MIN_SLOTS
+ * Initial number of slots of an index (power of two)
+ */
+#define DEVICES_INDEX_MIN_SLOTS 16
+
+
+/**
+ * @def DEVICES_BLOCK_MIN_SIZE
+ * Minimum number of devices of a block
+ */
+#define DEVICES_BLOCK_MIN_SIZE  16
+
+
+/**
+ * @def DEVICES_BITMAP_ACTIVE
+ * Bitmap of the active devices (the bitmaps of the types come first, indexed by pb_device_icon)
+ */
+#define DEVICES_BITMAP_ACTIVE   (ICON_DEVICE + 1)
+
+/**
+ * @def DEVICES_BITMAP_HAS_SMS
+ * Bitmap of the devices which can send SMS
+ */
+#define DEVICES_BITMAP_HAS_SMS  (ICON_DEVICE + 2)
+
+/**
+ * @def DEVICES_BITMAP_HAS_MMS
+ * Bitmap of the devices which can send MMS
+ */
+#define DEVICES_BITMAP_HAS_MMS  (ICON_DEVICE + 3)
+
+/**
+ * @def DEVICES_NB_BITMAPS
+ * Number of bitmaps of a list
+ */
+#define DEVICES_NB_BITMAPS      (ICON_DEVICE + 4)
+
+
 typedef struct pb_device_s pb_device_t;
 
+
+/**
+ * @brief Get the key under which a device is indexed (NULL if it has none)
+ */
+typedef char* (*pb_devices_key_cb)(const pb_device_t* p_device);
+
+
+/**
+ * @struct pb_devices_index_s
+ * @brief Hash index of the devices (open addressing with linear probing)
+ *
+ * When several devices have the same key, the first one indexed is kept.
+ */
+typedef struct pb_devices_index_s {
+    pb_device_t **slots;          ///< Devices indexed (NULL if the slot is empty)
+    size_t nb_slots;          ///< Number of slots (power of two)
+    size_t nb_entries;          ///< Number of devices indexed
+    pb_devices_key_cb key;          ///< Key of a device
+} pb_devices_index_t;
+
+
+/**
+ * @struct pb_devices_block_s
+ * @brief Contiguous storage of the devices created by a list
+ *
+ * The blocks never move, so the devices keep their address as long as the list lives.
+ */
+typedef struct pb_devices_block_s {
+    pb_device_t *devices;          ///< Devices of the block
+    size_t nb_used;          ///< Number of devices handed out
+    size_t size;          ///< Number of devices of the block
+    struct pb_devices_block_s *next;          ///< Previous block (the newest block is the first one)
+} pb_devices_block_t;
+
+
 typedef struct pb_devices_s {
     ssize_t nb_active;                  ///< Active devices' list  size
-    pb_device_t* list;       ///< Devices' list
-    int ref;                    ///< Reference counter
+    pb_device_t **devices;          ///< Devices of the list, in order (contiguous array of handles)
+    size_t devices_size;          ///< Size of devices
+    pb_devices_block_t *blocks;          ///< Blocks storing the devices created by the list
+    pb_device_t *free_devices;          ///< Released devices of the blocks, ready to be reused (chained by next)
+    pb_arena_t arena;          ///< Arena holding the strings of the devices of the blocks
+    pb_devices_index_t by_iden;          ///< Index of the devices on their iden
+    pb_devices_index_t by_nickname;          ///< Index of the devices on their nickname
+    pb_devices_index_t by_nickname_key;          ///< Index of the devices on their normalized nickname
+    uint64_t *bitmaps[DEVICES_NB_BITMAPS];          ///< Bit i of a bitmap is set if devices[i] has its type or capability
+    size_t bitmap_words;          ///< Number of words of each bitmap (enough for devices_size devices)
+    double modified_after;          ///< Largest modification seen (watermark of the synchronization)
+    pb_refcount_t ref;                    ///< Reference counter (a snapshot of the user may be released by any thread)
 } pb_devices_t;
 
 
@@ -9,6 +9,31 @@ typedef struct pb_device_s pb_device_t;
 typedef struct pb_devices_s pb_devices_t;
 
 
+/**
+ * @def PB_DEVICES_TYPE
+ * Mask of a type of device (pb_device_icon) in a query
+ */
+#define PB_DEVICES_TYPE(type)   (1u << (type))
+
+/**
+ * @def PB_DEVICES_ACTIVE
+ * Capability of the active devices
+ */
+#define PB_DEVICES_ACTIVE       0x1
+
+/**
+ * @def PB_DEVICES_HAS_SMS
+ * Capability of the devices which can send SMS
+ */
+#define PB_DEVICES_HAS_SMS      0x2
+
+/**
+ * @def PB_DEVICES_HAS_MMS
+ * Capability of the devices which can send MMS
+ */
+#define PB_DEVICES_HAS_MMS      0x4
+
+
 
 /**
  * @brief      Get the number of active devices of the given user
@@ -19,14 +44,125 @@ typedef struct pb_devices_s pb_devices_t;
  */
 ssize_t pb_devices_get_number_active(const pb_devices_t *p_devices);
 
-pb_device_t* pb_devices_get_list(const pb_devices_t* p_devices);
+/**
+ * @brief      Get a device from its position in the list
+ *
+ * @return     On success: the device
+ * @return     If idx is out of the list: NULL
+ */
+pb_device_t* pb_devices_get_device_at(const pb_devices_t* p_devices, size_t idx);
 
 int pb_devices_get_ref(const pb_devices_t* p_devices);
 
+/**
+ * @brief      Get the devices having one of some types and all of some capabilities
+ * @details    The query is answered from the bitmaps of the list, 64 devices at a time: the devices which do not
+ *             match are never read. The devices are given in the order of the list.
+ *
+ * @param[in]  p_devices     The devices list
+ * @param[in]  types         The types (PB_DEVICES_TYPE masks, 0 for any type)
+ * @param[in]  capabilities  The capabilities (PB_DEVICES_ACTIVE, PB_DEVICES_HAS_SMS, PB_DEVICES_HAS_MMS)
+ * @param      matches       Where the devices are stored (may be NULL to count them)
+ * @param[in]  max           The maximum number of devices stored in matches
+ *
+ * @return     The number of devices matching (it may be greater than max)
+ */
+size_t pb_devices_query(const pb_devices_t* p_devices, unsigned int types, unsigned int capabilities, pb_device_t** matches, size_t max);
+
+/**
+ * @brief      Copy a list of devices
+ * @details    The copy has its own devices, blocks and arena: it can be modified and outlive the original.
+ *
+ * @param[in]  p_devices  The devices list
+ *
+ * @return     On success: the copy, with one reference
+ * @return     On error: NULL
+ */
+pb_devices_t* pb_devices_dup(const pb_devices_t* p_devices);
+
+/**
+ * @brief      Apply the devices contained in a JSON response to the list
+ * @details    Inactive devices are removed, known devices are replaced and new devices are appended. The watermark
+ *             of the list is raised to the largest modification seen.
+ *
+ * @param      p_devices  The devices list
+ * @param      result     The JSON response
+ * @param[in]  result_sz  The JSON response size
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
 int pb_devices_load_devices_from_data(pb_devices_t* p_devices, char* result, size_t result_sz);
 
+/**
+ * @brief      Make room in the list for some devices
+ * @details    The devices added next are stored together in one block.
+ *
+ * @param      p_devices  The devices list
+ * @param[in]  nb         The number of devices
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_devices_reserve(pb_devices_t* p_devices, size_t nb);
+
+/**
+ * @brief      Append a copy of a device to the list
+ * @details    The copy is stored in the blocks of the list and its strings in the arena of the list.
+ *
+ * @param      p_devices  The devices list
+ * @param[in]  p_device   The device (its identification must not be in the list yet)
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_devices_add_copy(pb_devices_t* p_devices, const pb_device_t* p_device);
+
 int pb_devices_add_new_device(pb_devices_t* p_devices, pb_device_t* p_new_device);
 
+/**
+ * @brief      Get a device from its identification
+ *
+ * @return     On success: the device
+ * @return     On error: NULL
+ */
+pb_device_t* pb_devices_get_device_from_iden(const pb_devices_t* p_devices, const char* iden);
+
+/**
+ * @brief      Put a device in the list, replacing the device having the same identification
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_devices_put_device(pb_devices_t* p_devices, pb_device_t* p_device);
+
+/**
+ * @brief      Remove the device having the given identification from the list
+ *
+ * @return     On success: zero
+ * @return     If the device is unknown: 1
+ * @return     On error: -1
+ */
+int pb_devices_remove_device(pb_devices_t* p_devices, const char* iden);
+
+/**
+ * @brief      Get the largest modification timestamp seen by the list
+ *
+ * @return     The watermark to give to modified_after
+ */
+double pb_devices_get_modified_after(const pb_devices_t* p_devices);
+
+/**
+ * @brief      Set the watermark of the synchronization of the list
+ *
+ * @param      p_devices       The devices list
+ * @param[in]  modified_after  The largest modification seen
+ *
+ * @return     On success: zero
+ * @return     On error: non-zero integer
+ */
+int pb_devices_set_modified_after(pb_devices_t* p_devices, double modified_after);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,238 @@
+/**
+ * @file pb_json.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdlib.h>          // malloc, realloc, free
+#include <string.h>          // memcpy, strlen
+
+#include "pb_utils.h"             // eprintf
+#include "pb_json_prot.h"         // pb_json_writer_t, PB_JSON_TLS_BUF_SIZE
+
+
+/**
+ * @brief Per-thread buffer used by the writers that are not given one
+ */
+static __thread char tls_buf[PB_JSON_TLS_BUF_SIZE];
+
+
+/**
+ * @brief Characters that have to be escaped: 0 means the byte is copied as is, 'u' means \u00XX, others are the
+ *        character following the backslash.
+ */
+static const char json_escape[256] = {
+    ['\0'] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', [0x0B] = 'u', ['\f'] = 'f', ['\r'] = 'r', [0x0E] = 'u', [0x0F] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u', [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1A] = 'u', [0x1B] = 'u', [0x1C] = 'u', [0x1D] = 'u', [0x1E] = 'u', [0x1F] = 'u',
+    ['"'] = '"', ['\\'] = '\\',
+};
+
+
+/**
+ * @brief      Make sure there is enough room for n more bytes (and the trailing NUL)
+ *
+ * @param      w     The writer
+ * @param[in]  n     The number of bytes we are about to write
+ *
+ * @return     0 if there is enough room, -1 otherwise
+ */
+static int json_reserve(pb_json_writer_t *w, size_t n);
+
+/**
+ * @brief      Append raw bytes to the writer
+ */
+static void json_put(pb_json_writer_t *w, const char *s, size_t n);
+
+/**
+ * @brief      Append an escaped and quoted string to the writer
+ */
+static void json_put_escaped(pb_json_writer_t *w, const char *s);
+
+
+void pb_json_writer_init(pb_json_writer_t *w,
+                         char             *buf,
+                         size_t           size
+                         )
+{
+    if ( ! w )
+    {
+        return;
+    }
+
+    if ( (! buf) || (size == 0) )
+    {
+        buf  = tls_buf;
+        size = sizeof(tls_buf);
+    }
+
+    w->data    = buf;
+    w->size    = size;
+    w->len     = 0;
+    w->heap    = 0;
+    w->first   = 1;
+    w->error   = 0;
+    w->data[0] = '\0';
+}
+
+
+void pb_json_object_begin(pb_json_writer_t *w)
+{
+    json_put(w, "{", 1);
+    w->first = 1;
+}
+
+
+void pb_json_add_string(pb_json_writer_t *w,
+                        const char       *key,
+                        const char       *value
+                        )
+{
+    if ( (! key) || (! value) )
+    {
+        return;
+    }
+
+    if ( ! w->first )
+    {
+        json_put(w, ",", 1);
+    }
+    w->first = 0;
+
+    json_put(w, "\"", 1);
+    json_put(w, key, strlen(key) );
+    json_put(w, "\":", 2);
+    json_put_escaped(w, value);
+}
+
+
+void pb_json_object_end(pb_json_writer_t *w)
+{
+    json_put(w, "}", 1);
+}
+
+
+const char* pb_json_writer_get_data(const pb_json_writer_t *w)
+{
+    return ( w && (! w->error) ) ? w->data : NULL;
+}
+
+
+size_t pb_json_writer_get_length(const pb_json_writer_t *w)
+{
+    return ( w && (! w->error) ) ? w->len : 0;
+}
+
+
+void pb_json_writer_release(pb_json_writer_t *w)
+{
+    if ( w && w->heap )
+    {
+        free(w->data);
+        w->data = NULL;
+        w->heap = 0;
+    }
+}
+
+
+static int json_reserve(pb_json_writer_t *w,
+                        size_t           n
+                        )
+{
+    size_t needed = w->len + n + 1;
+    size_t new_size = 0;
+    char *new_data = NULL;
+
+    if ( w->error )
+    {
+        return -1;
+    }
+    else if ( needed <= w->size )
+    {
+        return 0;
+    }
+
+    for ( new_size = w->size * 2; new_size < needed; new_size *= 2 )
+    {
+        ;
+    }
+
+    // Spill to the heap: the first time, the content of the initial buffer has to be copied
+    if ( w->heap )
+    {
+        new_data = realloc(w->data, new_size);
+    }
+    else if ( (new_data = malloc(new_size)) != NULL )
+    {
+        memcpy(new_data, w->data, w->len + 1);
+    }
+
+    if ( ! new_data )
+    {
+        eprintf("Not enough memory to serialize the JSON object");
+        w->error = 1;
+        return -1;
+    }
+
+    w->data = new_data;
+    w->size = new_size;
+    w->heap = 1;
+
+    return 0;
+}
+
+
+static void json_put(pb_json_writer_t *w,
+                     const char       *s,
+                     size_t           n
+                     )
+{
+    if ( json_reserve(w, n) == 0 )
+    {
+        memcpy(w->data + w->len, s, n);
+        w->len += n;
+        w->data[w->len] = '\0';
+    }
+}
+
+
+static void json_put_escaped(pb_json_writer_t *w,
+                             const char       *s
+                             )
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *) s;
+    const unsigned char *run = p;
+    char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+    json_put(w, "\"", 1);
+
+    for ( ; *p; p++ )
+    {
+        if ( json_escape[*p] == 0 )
+        {
+            continue;
+        }
+
+        // Flush the bytes that do not need any escaping in one go
+        json_put(w, (const char *) run, p - run);
+        run = p + 1;
+
+        if ( json_escape[*p] == 'u' )
+        {
+            esc[4] = hex[*p >> 4];
+            esc[5] = hex[*p & 0x0F];
+            json_put(w, esc, 6);
+        }
+        else
+        {
+            esc[1] = json_escape[*p];
+            json_put(w, esc, 2);
+            esc[1] = 'u';
+        }
+    }
+
+    json_put(w, (const char *) run, p - run);
+    json_put(w, "\"", 1);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file pb_json_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Flat JSON object serializer used to build the request bodies
+ */
+
+#ifndef __PB_JSON_PROT_H__
+#define __PB_JSON_PROT_H__
+
+#include <stddef.h>     // size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PB_JSON_TLS_BUF_SIZE
+ * Size of the per-thread buffer used when no buffer is given to the writer (16ko - 16384 - 0x4000)
+ */
+#define PB_JSON_TLS_BUF_SIZE    0x4000
+
+
+/**
+ * @struct pb_json_writer_s
+ * @brief Writer emitting a flat JSON object directly into a buffer
+ * @details The writer starts on a caller-provided (or thread-local) buffer and only spills to the heap when the
+ *          object does not fit into it.
+ */
+typedef struct pb_json_writer_s {
+    char *data;          ///< Buffer currently written
+    size_t size;          ///< Capacity of the buffer
+    size_t len;          ///< Number of bytes written (without the trailing NUL)
+    unsigned char heap;          ///< Has the buffer been allocated by the writer?
+    unsigned char first;          ///< Is the next member the first one of the object?
+    unsigned char error;          ///< Did an allocation fail?
+} pb_json_writer_t;
+
+
+/**
+ * @brief      Initialize a writer
+ *
+ * @param      w     The writer
+ * @param      buf   The buffer to write in. If NULL, the thread-local buffer is used.
+ * @param[in]  size  The buffer size
+ */
+void pb_json_writer_init(pb_json_writer_t *w, char *buf, size_t size);
+
+/**
+ * @brief      Open the JSON object
+ *
+ * @param      w     The writer
+ */
+void pb_json_object_begin(pb_json_writer_t *w);
+
+/**
+ * @brief      Add a string member to the object
+ * @details    Nothing is written if the value is NULL.
+ *
+ * @param      w      The writer
+ * @param[in]  key    The member name (written as is, it is not escaped)
+ * @param[in]  value  The member value (escaped)
+ */
+void pb_json_add_string(pb_json_writer_t *w, const char *key, const char *value);
+
+/**
+ * @brief      Close the JSON object
+ *
+ * @param      w     The writer
+ */
+void pb_json_object_end(pb_json_writer_t *w);
+
+/**
+ * @brief      Get the NUL-terminated JSON string
+ *
+ * @param[in]  w     The writer
+ *
+ * @return     On success: pointer to the JSON string, valid until pb_json_writer_release
+ * @return     On error: NULL
+ */
+const char* pb_json_writer_get_data(const pb_json_writer_t *w);
+
+/**
+ * @brief      Get the length of the JSON string
+ *
+ * @param[in]  w     The writer
+ *
+ * @return     The length of the JSON string (without the trailing NUL)
+ */
+size_t pb_json_writer_get_length(const pb_json_writer_t *w);
+
+/**
+ * @brief      Release the memory that may have been allocated by the writer
+ *
+ * @param      w     The writer
+ */
+void pb_json_writer_release(pb_json_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_JSON_PROT_H__
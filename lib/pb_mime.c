@@ -0,0 +1,162 @@
+/**
+ * @file pb_mime.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdlib.h>          // NULL
+#include <string.h>          // strdup
+#include <pthread.h>         // pthread_mutex_t, pthread_mutex_lock, pthread_mutex_unlock
+#include <magic.h>           // magic_t, magic_open, magic_close, magic_load, magic_file, magic_buffer, magic_error
+
+#include "pb_utils.h"             // eprintf, gprintf
+#include "pb_mime_prot.h"         // PB_MIME_POOL_SIZE
+
+
+/**
+ * @brief Idle libmagic cookies, with their database already loaded
+ */
+static struct {
+    pthread_mutex_t mtx;          ///< Mutex of the pool
+    magic_t cookies[PB_MIME_POOL_SIZE];          ///< Idle cookies
+    size_t nb_cookies;          ///< Number of idle cookies
+} mime_pool = { PTHREAD_MUTEX_INITIALIZER, { NULL }, 0 };
+
+
+/**
+ * @brief      Take an idle cookie or create a new one
+ *
+ * @return     The cookie or NULL
+ */
+static magic_t mime_acquire(void);
+
+/**
+ * @brief      Give a cookie back to the pool (it is closed if the pool is full)
+ */
+static void mime_release(magic_t cookie);
+
+
+char* pb_mime_get_file_type(const char *file_path)
+{
+    magic_t     cookie = NULL;
+    const char  *type = NULL;
+    char        *copy = NULL;
+
+    if ( (! file_path) || ((cookie = mime_acquire()) == NULL) )
+    {
+        return (NULL);
+    }
+
+    if ( (type = magic_file(cookie, file_path)) == NULL )
+    {
+        eprintf("Unable to detect the MIME type of %s - %s", file_path, magic_error(cookie) );
+    }
+    else
+    {
+        copy = strdup(type);
+        #ifdef __TRACES__
+        gprintf("%s", copy);
+        #endif
+    }
+
+    mime_release(cookie);
+
+    return (copy);
+}
+
+
+char* pb_mime_get_buffer_type(const void   *data,
+                              size_t       size
+                              )
+{
+    magic_t     cookie = NULL;
+    const char  *type = NULL;
+    char        *copy = NULL;
+
+    if ( (! data) || ((cookie = mime_acquire()) == NULL) )
+    {
+        return (NULL);
+    }
+
+    if ( (type = magic_buffer(cookie, data, size)) == NULL )
+    {
+        eprintf("Unable to detect the MIME type of a buffer - %s", magic_error(cookie) );
+    }
+    else
+    {
+        copy = strdup(type);
+        #ifdef __TRACES__
+        gprintf("%s", copy);
+        #endif
+    }
+
+    mime_release(cookie);
+
+    return (copy);
+}
+
+
+void pb_mime_term(void)
+{
+    pthread_mutex_lock(&mime_pool.mtx);
+
+    while ( mime_pool.nb_cookies > 0 )
+    {
+        magic_close(mime_pool.cookies[--mime_pool.nb_cookies]);
+    }
+
+    pthread_mutex_unlock(&mime_pool.mtx);
+}
+
+
+static magic_t mime_acquire(void)
+{
+    magic_t cookie = NULL;
+
+    pthread_mutex_lock(&mime_pool.mtx);
+
+    if ( mime_pool.nb_cookies > 0 )
+    {
+        cookie = mime_pool.cookies[--mime_pool.nb_cookies];
+    }
+
+    pthread_mutex_unlock(&mime_pool.mtx);
+
+    if ( cookie )
+    {
+        return (cookie);
+    }
+
+    // MAGIC_MIME_TYPE tells magic to return a mime of the file
+    if ( (cookie = magic_open(MAGIC_MIME_TYPE)) == NULL )
+    {
+        eprintf("Unable to initialize magic library");
+    }
+    else if ( magic_load(cookie, NULL) != 0 )
+    {
+        eprintf("Impossible to load magic database - %s", magic_error(cookie) );
+        magic_close(cookie);
+        cookie = NULL;
+    }
+
+    return (cookie);
+}
+
+
+static void mime_release(magic_t cookie)
+{
+    pthread_mutex_lock(&mime_pool.mtx);
+
+    if ( mime_pool.nb_cookies < PB_MIME_POOL_SIZE )
+    {
+        mime_pool.cookies[mime_pool.nb_cookies++] = cookie;
+        cookie = NULL;
+    }
+
+    pthread_mutex_unlock(&mime_pool.mtx);
+
+    if ( cookie )
+    {
+        magic_close(cookie);
+    }
+}
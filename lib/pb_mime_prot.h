@@ -0,0 +1,58 @@
+/**
+ * @file pb_mime_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  MIME type detection with a pool of libmagic cookies
+ */
+
+#ifndef __PB_MIME_PROT_H__
+#define __PB_MIME_PROT_H__
+
+#include <stddef.h>     // size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PB_MIME_POOL_SIZE
+ * Maximum number of idle libmagic cookies kept by the pool
+ */
+#define PB_MIME_POOL_SIZE   4
+
+
+/**
+ * @brief      Get the MIME type of a file
+ * @details    A libmagic cookie is not thread-safe: each detection borrows a cookie from the pool. A cookie loads the
+ *             magic database once, when it is created.
+ *
+ * @param[in]  file_path  The path of the file
+ *
+ * @return     On success: the MIME type (to free)
+ * @return     On error: NULL
+ */
+char* pb_mime_get_file_type(const char *file_path);
+
+/**
+ * @brief      Get the MIME type of a buffer
+ *
+ * @param[in]  data  The content
+ * @param[in]  size  The size of the content
+ *
+ * @return     On success: the MIME type (to free)
+ * @return     On error: NULL
+ */
+char* pb_mime_get_buffer_type(const void *data, size_t size);
+
+/**
+ * @brief      Close the libmagic cookies of the pool
+ */
+void pb_mime_term(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_MIME_PROT_H__
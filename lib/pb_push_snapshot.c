@@ -0,0 +1,630 @@
+/**
+ * @file pb_push_snapshot.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdio.h>           // fopen, fwrite, fclose, rename, remove, snprintf
+#include <stdlib.h>          // calloc, malloc, free
+#include <string.h>          // memcpy, memcmp, memchr, strcmp, strlen
+#include <stddef.h>          // offsetof
+#include <fcntl.h>           // open, O_RDONLY
+#include <unistd.h>          // close, fsync
+#include <sys/mman.h>        // mmap, munmap
+#include <sys/stat.h>        // fstat
+
+#include "pb_utils.h"                 // iprintf, eprintf
+#include "pb_pushes_priv.h"           // pb_push_t
+#include "pb_push_snapshot_priv.h"    // pb_push_snapshot_t, pb_push_snapshot_header_t, pb_push_snapshot_record_t
+#include "pb_push_snapshot_prot.h"    // pb_push_hash
+
+
+/**
+ * @brief Position of the strings of a push in a record (the identification first)
+ */
+static const size_t snapshot_strings[PUSH_SNAPSHOT_NB_STRINGS] = {
+    offsetof(pb_push_t, iden),
+    offsetof(pb_push_t, type),
+    offsetof(pb_push_t, title),
+    offsetof(pb_push_t, body),
+    offsetof(pb_push_t, direction),
+    offsetof(pb_push_t, sender_name),
+    offsetof(pb_push_t, sender_iden),
+    offsetof(pb_push_t, sender_email),
+    offsetof(pb_push_t, sender_email_normalized),
+    offsetof(pb_push_t, receiver_iden),
+    offsetof(pb_push_t, receiver_email),
+    offsetof(pb_push_t, receiver_email_normalized)
+};
+
+
+/**
+ * @brief      Get a string of a push
+ */
+#define PUSH_STRING(push, i)    (*(const char * const *) ((const char *) (push) + snapshot_strings[i]) )
+
+
+/**
+ * @brief Initial value of the checksums (FNV-1a offset basis)
+ */
+#define SNAPSHOT_CHECKSUM_INIT  14695981039346656037ull
+
+
+/**
+ * @brief      Continue the checksum of a buffer (FNV-1a)
+ */
+static uint64_t snapshot_checksum(uint64_t hash, const unsigned char *data, size_t size);
+
+/**
+ * @brief      Check the sections, the header checksum and the hash index of a mapped snapshot
+ *
+ * @return     0 if the snapshot can be used, otherwise there is an error
+ */
+static int snapshot_check(pb_push_snapshot_t *snapshot);
+
+/**
+ * @brief      Check the blocks holding a part of the records and of the string heap
+ *
+ * @param[in]  offset  The offset of the part in the snapshot
+ * @param[in]  size    The size of the part
+ *
+ * @return     0 if the blocks are valid, otherwise they are corrupted
+ */
+static int snapshot_check_range(const pb_push_snapshot_t *snapshot, size_t offset, size_t size);
+
+/**
+ * @brief      Check a record, the blocks holding it and its strings
+ *
+ * @return     0 if the record can be decoded, otherwise it is corrupted
+ */
+static int snapshot_check_record(const pb_push_snapshot_t *snapshot, size_t i);
+
+
+uint32_t pb_push_hash(const char *iden)
+{
+    uint32_t hash = 2166136261u;
+
+    for ( ; *iden; iden++ )
+    {
+        hash ^= (unsigned char) *iden;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+pb_push_snapshot_t* pb_push_snapshot_open(const char *path)
+{
+    int                 fd = -1;
+    struct stat         st;
+    void                *map = NULL;
+    pb_push_snapshot_t  *snapshot = NULL;
+
+    if ( ! path )
+    {
+        return (NULL);
+    }
+
+    if ( (fd = open(path, O_RDONLY) ) < 0 )
+    {
+        #ifdef __TRACES__
+        iprintf("No snapshot at %s", path);
+        #endif
+        return (NULL);
+    }
+
+    if ( (fstat(fd, &st) != 0) || ((size_t) st.st_size < sizeof(pb_push_snapshot_header_t)) )
+    {
+        eprintf("Snapshot %s is truncated", path);
+        close(fd);
+        return (NULL);
+    }
+
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid without the file descriptor
+    close(fd);
+
+    if ( map == MAP_FAILED )
+    {
+        eprintf("Cannot map snapshot %s", path);
+        return (NULL);
+    }
+
+    if ( (snapshot = calloc(1, sizeof(pb_push_snapshot_t))) == NULL )
+    {
+        munmap(map, (size_t) st.st_size);
+        return (NULL);
+    }
+
+    snapshot->map = map;
+    snapshot->size = (size_t) st.st_size;
+    snapshot->header = map;
+
+    if ( snapshot_check(snapshot) != 0 )
+    {
+        eprintf("Snapshot %s is not valid", path);
+        pb_push_snapshot_close(snapshot);
+        return (NULL);
+    }
+
+    return (snapshot);
+}
+
+
+void pb_push_snapshot_close(pb_push_snapshot_t *snapshot)
+{
+    if ( snapshot )
+    {
+        munmap(snapshot->map, snapshot->size);
+        free(snapshot->checked);
+        free(snapshot);
+    }
+}
+
+
+int pb_push_snapshot_write(const char              *path,
+                           const pb_push_t *const  *pushes,
+                           size_t                  nb_pushes,
+                           double                  modified_after
+                           )
+{
+    pb_push_snapshot_header_t   *header = NULL;
+    pb_push_snapshot_record_t   *records = NULL;
+    uint32_t                    *index = NULL;
+    uint64_t                    *blocks = NULL;
+    char                        *strings = NULL;
+    unsigned char               *data = NULL;
+    char                        *tmp_path = NULL;
+    FILE                        *f = NULL;
+    size_t                      strings_size = 0;
+    size_t                      nb_slots = PUSH_SNAPSHOT_MIN_SLOTS;
+    size_t                      nb_blocks = 0;
+    size_t                      size = 0;
+    size_t                      len = 0;
+    size_t                      i = 0;
+    size_t                      j = 0;
+    const char                  *str = NULL;
+    int                         ret = -1;
+
+    if ( (! path) || ((! pushes) && (nb_pushes > 0)) )
+    {
+        return -1;
+    }
+
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        for ( j = 0; j < PUSH_SNAPSHOT_NB_STRINGS; j++ )
+        {
+            if ( (str = PUSH_STRING(pushes[i], j)) != NULL )
+            {
+                strings_size += strlen(str) + 1;
+            }
+        }
+    }
+
+    // Offsets are stored on 32 bits
+    if ( strings_size >= UINT32_MAX )
+    {
+        eprintf("Too many strings to write a snapshot");
+        return -1;
+    }
+
+    // Keep the load factor of the hash index under one half
+    while ( nb_slots < nb_pushes * 2 )
+    {
+        nb_slots *= 2;
+    }
+
+    nb_blocks = ((nb_pushes * sizeof(*records)) + strings_size + PUSH_SNAPSHOT_BLOCK_SIZE - 1) / PUSH_SNAPSHOT_BLOCK_SIZE;
+    size = sizeof(*header) + (nb_slots * sizeof(*index)) + (nb_blocks * sizeof(*blocks)) +
+           (nb_pushes * sizeof(*records)) + strings_size;
+
+    if ( (data = calloc(1, size)) == NULL )
+    {
+        eprintf("Not enough memory to write a snapshot of %zu bytes", size);
+        return -1;
+    }
+
+    header = (pb_push_snapshot_header_t *) data;
+    index = (uint32_t *) (header + 1);
+    blocks = (uint64_t *) (index + nb_slots);
+    records = (pb_push_snapshot_record_t *) (blocks + nb_blocks);
+    strings = (char *) (records + nb_pushes);
+
+    memcpy(header->magic, PUSH_SNAPSHOT_MAGIC, sizeof(header->magic) );
+    header->version = PUSH_SNAPSHOT_VERSION;
+    header->record_size = sizeof(*records);
+    header->nb_records = nb_pushes;
+    header->nb_slots = nb_slots;
+    header->index_offset = (unsigned char *) index - data;
+    header->blocks_offset = (unsigned char *) blocks - data;
+    header->nb_blocks = nb_blocks;
+    header->records_offset = (unsigned char *) records - data;
+    header->strings_offset = (unsigned char *) strings - data;
+    header->strings_size = strings_size;
+    header->modified_after = modified_after;
+
+    for ( i = 0, strings_size = 0; i < nb_pushes; i++ )
+    {
+        records[i].created = pushes[i]->created;
+        records[i].modified = pushes[i]->modified;
+        records[i].active = pushes[i]->active;
+        records[i].dismissed = pushes[i]->dismissed;
+        records[i].hash = pb_push_hash(pushes[i]->iden);
+
+        for ( j = 0; j < PUSH_SNAPSHOT_NB_STRINGS; j++ )
+        {
+            if ( (str = PUSH_STRING(pushes[i], j)) != NULL )
+            {
+                len = strlen(str) + 1;
+                memcpy(strings + strings_size, str, len);
+                records[i].strings[j] = (uint32_t) strings_size + 1;
+                strings_size += len;
+            }
+        }
+
+        for ( j = records[i].hash & (nb_slots - 1); index[j] != 0; j = (j + 1) & (nb_slots - 1) )
+        {
+            ;
+        }
+
+        index[j] = (uint32_t) i + 1;
+    }
+
+    for ( i = 0; i < nb_blocks; i++ )
+    {
+        len = size - header->records_offset - (i * PUSH_SNAPSHOT_BLOCK_SIZE);
+        blocks[i] = snapshot_checksum(SNAPSHOT_CHECKSUM_INIT, data + header->records_offset + (i * PUSH_SNAPSHOT_BLOCK_SIZE),
+                                      (len < PUSH_SNAPSHOT_BLOCK_SIZE) ? len : PUSH_SNAPSHOT_BLOCK_SIZE);
+    }
+
+    header->checksum = snapshot_checksum(SNAPSHOT_CHECKSUM_INIT, data, offsetof(pb_push_snapshot_header_t, checksum) );
+    header->checksum = snapshot_checksum(header->checksum, data + header->index_offset,
+                                         header->records_offset - header->index_offset);
+
+    // Write next to the snapshot then rename: a reader never sees a partial snapshot
+    len = strlen(path) + sizeof(".tmp");
+
+    if ( (tmp_path = malloc(len)) == NULL )
+    {
+        free(data);
+        return -1;
+    }
+
+    snprintf(tmp_path, len, "%s.tmp", path);
+
+    if ( (f = fopen(tmp_path, "wb")) == NULL )
+    {
+        eprintf("Cannot open %s", tmp_path);
+    }
+    else
+    {
+        if ( (fwrite(data, 1, size, f) == size) && (fflush(f) == 0) && (fsync(fileno(f)) == 0) )
+        {
+            ret = 0;
+        }
+
+        if ( (fclose(f) != 0) || (ret != 0) || (rename(tmp_path, path) != 0) )
+        {
+            eprintf("Cannot write snapshot %s", path);
+            remove(tmp_path);
+            ret = -1;
+        }
+    }
+
+    free(tmp_path);
+    free(data);
+
+    return ret;
+}
+
+
+size_t pb_push_snapshot_get_number(const pb_push_snapshot_t *snapshot)
+{
+    return (snapshot) ? snapshot->header->nb_records : 0;
+}
+
+
+double pb_push_snapshot_get_modified_after(const pb_push_snapshot_t *snapshot)
+{
+    return (snapshot) ? snapshot->header->modified_after : 0;
+}
+
+
+double pb_push_snapshot_get_modified(const pb_push_snapshot_t    *snapshot,
+                                     size_t                      i
+                                     )
+{
+    return snapshot->records[i].modified;
+}
+
+
+ssize_t pb_push_snapshot_find(const pb_push_snapshot_t   *snapshot,
+                              const char                 *iden,
+                              uint32_t                   hash
+                              )
+{
+    size_t                          mask = 0;
+    size_t                          i = 0;
+    const pb_push_snapshot_record_t *record = NULL;
+
+    if ( (! snapshot) || (! iden) || (snapshot->header->nb_records == 0) )
+    {
+        return -1;
+    }
+
+    mask = snapshot->header->nb_slots - 1;
+
+    for ( i = hash & mask; snapshot->index[i] != 0; i = (i + 1) & mask )
+    {
+        record = &snapshot->records[snapshot->index[i] - 1];
+
+        // A corrupted record is skipped as if it was missing
+        if ( (record->hash == hash) && (snapshot_check_record(snapshot, snapshot->index[i] - 1) == 0) &&
+             (strcmp(snapshot->strings + record->strings[PUSH_SNAPSHOT_IDEN] - 1, iden) == 0) )
+        {
+            return (ssize_t) (snapshot->index[i] - 1);
+        }
+    }
+
+    return -1;
+}
+
+
+size_t pb_push_snapshot_upper_bound(const pb_push_snapshot_t *snapshot,
+                                    double                   modified
+                                    )
+{
+    size_t  lo = 0;
+    size_t  hi = pb_push_snapshot_get_number(snapshot);
+    size_t  mid = 0;
+
+    while ( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if ( snapshot->records[mid].modified <= modified )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+size_t pb_push_snapshot_lower_bound(const pb_push_snapshot_t *snapshot,
+                                    double                   modified
+                                    )
+{
+    size_t  lo = 0;
+    size_t  hi = pb_push_snapshot_get_number(snapshot);
+    size_t  mid = 0;
+
+    while ( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if ( snapshot->records[mid].modified < modified )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+int pb_push_snapshot_decode(const pb_push_snapshot_t *snapshot,
+                            size_t                   i,
+                            pb_push_t                *push
+                            )
+{
+    const pb_push_snapshot_record_t *record = &snapshot->records[i];
+    size_t                          j = 0;
+
+    if ( snapshot_check_record(snapshot, i) != 0 )
+    {
+        return -1;
+    }
+
+    push->active = record->active;
+    push->created = record->created;
+    push->dismissed = record->dismissed;
+    push->modified = record->modified;
+
+    for ( j = 0; j < PUSH_SNAPSHOT_NB_STRINGS; j++ )
+    {
+        *(const char **) ((char *) push + snapshot_strings[j]) = (record->strings[j] != 0) ?
+                                                                 snapshot->strings + record->strings[j] - 1 :
+                                                                 NULL;
+    }
+
+    return 0;
+}
+
+
+static uint64_t snapshot_checksum(uint64_t               hash,
+                                  const unsigned char    *data,
+                                  size_t                 size
+                                  )
+{
+    size_t  i = 0;
+
+    for ( i = 0; i < size; i++ )
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+static int snapshot_check(pb_push_snapshot_t *snapshot)
+{
+    const pb_push_snapshot_header_t *header = snapshot->header;
+    const unsigned char             *data = snapshot->map;
+    uint64_t                        checksum = 0;
+    size_t                          i = 0;
+    size_t                          used = 0;
+
+    if ( (memcmp(header->magic, PUSH_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) ||
+         (header->version != PUSH_SNAPSHOT_VERSION) ||
+         (header->record_size != sizeof(pb_push_snapshot_record_t)) )
+    {
+        return -1;
+    }
+
+    // Sections must fit in the file, in order and without overflow
+    if ( (header->nb_slots < PUSH_SNAPSHOT_MIN_SLOTS) || ((header->nb_slots & (header->nb_slots - 1)) != 0) ||
+         (header->nb_slots > snapshot->size / sizeof(uint32_t)) || (header->nb_records >= header->nb_slots) ||
+         (header->nb_blocks > snapshot->size / sizeof(uint64_t)) ||
+         (header->nb_records > snapshot->size / sizeof(pb_push_snapshot_record_t)) ||
+         (header->index_offset != sizeof(pb_push_snapshot_header_t)) ||
+         (header->blocks_offset != header->index_offset + (header->nb_slots * sizeof(uint32_t))) ||
+         (header->records_offset != header->blocks_offset + (header->nb_blocks * sizeof(uint64_t))) ||
+         (header->strings_offset != header->records_offset + (header->nb_records * sizeof(pb_push_snapshot_record_t))) ||
+         (header->strings_offset > snapshot->size) ||
+         (header->strings_size != snapshot->size - header->strings_offset) ||
+         (header->nb_blocks != (snapshot->size - header->records_offset + PUSH_SNAPSHOT_BLOCK_SIZE - 1) / PUSH_SNAPSHOT_BLOCK_SIZE) )
+    {
+        return -1;
+    }
+
+    // The records and the strings are checked block by block when they are read
+    checksum = snapshot_checksum(SNAPSHOT_CHECKSUM_INIT, data, offsetof(pb_push_snapshot_header_t, checksum) );
+    checksum = snapshot_checksum(checksum, data + header->index_offset, header->records_offset - header->index_offset);
+
+    if ( header->checksum != checksum )
+    {
+        return -1;
+    }
+
+    snapshot->index = (const uint32_t *) (data + header->index_offset);
+    snapshot->blocks = (const uint64_t *) (data + header->blocks_offset);
+    snapshot->records = (const pb_push_snapshot_record_t *) (data + header->records_offset);
+    snapshot->strings = (const char *) (data + header->strings_offset);
+
+    if ( (snapshot->checked = calloc(header->nb_blocks + 1, 1)) == NULL )
+    {
+        return -1;
+    }
+
+    // Every string ends in the heap
+    if ( (header->strings_size > 0) && (snapshot->strings[header->strings_size - 1] != '\0') )
+    {
+        return -1;
+    }
+
+    // At least one slot of the hash index is empty, so a probe always ends
+    for ( i = 0; i < header->nb_slots; i++ )
+    {
+        if ( snapshot->index[i] > header->nb_records )
+        {
+            return -1;
+        }
+
+        used += (snapshot->index[i] != 0);
+    }
+
+    return (used == header->nb_records) ? 0 : -1;
+}
+
+
+static int snapshot_check_range(const pb_push_snapshot_t *snapshot,
+                                size_t                   offset,
+                                size_t                   size
+                                )
+{
+    const pb_push_snapshot_header_t *header = snapshot->header;
+    size_t                          block = (offset - header->records_offset) / PUSH_SNAPSHOT_BLOCK_SIZE;
+    size_t                          last = (offset + size - 1 - header->records_offset) / PUSH_SNAPSHOT_BLOCK_SIZE;
+    size_t                          start = 0;
+    size_t                          len = 0;
+
+    for ( ; block <= last; block++ )
+    {
+        if ( snapshot->checked[block] == PUSH_SNAPSHOT_BLOCK_UNCHECKED )
+        {
+            start = header->records_offset + (block * PUSH_SNAPSHOT_BLOCK_SIZE);
+            len = snapshot->size - start;
+            len = (len < PUSH_SNAPSHOT_BLOCK_SIZE) ? len : PUSH_SNAPSHOT_BLOCK_SIZE;
+
+            if ( snapshot_checksum(SNAPSHOT_CHECKSUM_INIT, (const unsigned char *) snapshot->map + start, len) == snapshot->blocks[block] )
+            {
+                snapshot->checked[block] = PUSH_SNAPSHOT_BLOCK_VALID;
+            }
+            else
+            {
+                eprintf("Block %zu of the snapshot is corrupted", block);
+                snapshot->checked[block] = PUSH_SNAPSHOT_BLOCK_CORRUPTED;
+            }
+        }
+
+        if ( snapshot->checked[block] != PUSH_SNAPSHOT_BLOCK_VALID )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int snapshot_check_record(const pb_push_snapshot_t    *snapshot,
+                                 size_t                      i
+                                 )
+{
+    const pb_push_snapshot_header_t *header = snapshot->header;
+    const pb_push_snapshot_record_t *record = &snapshot->records[i];
+    const char                      *str = NULL;
+    size_t                          offset = 0;
+    size_t                          len = 0;
+    size_t                          j = 0;
+
+    if ( (snapshot_check_range(snapshot, header->records_offset + (i * sizeof(*record)), sizeof(*record)) != 0) ||
+         (record->strings[PUSH_SNAPSHOT_IDEN] == 0) )
+    {
+        return -1;
+    }
+
+    for ( j = 0; j < PUSH_SNAPSHOT_NB_STRINGS; j++ )
+    {
+        if ( record->strings[j] == 0 )
+        {
+            continue;
+        }
+
+        if ( record->strings[j] > header->strings_size )
+        {
+            return -1;
+        }
+
+        // Check the blocks up to the end of the string (the last byte of the heap is a null character)
+        for ( offset = header->strings_offset + record->strings[j] - 1, str = NULL; str == NULL; )
+        {
+            if ( snapshot_check_range(snapshot, offset, 1) != 0 )
+            {
+                return -1;
+            }
+
+            len = PUSH_SNAPSHOT_BLOCK_SIZE - ((offset - header->records_offset) % PUSH_SNAPSHOT_BLOCK_SIZE);
+            len = (len < snapshot->size - offset) ? len : snapshot->size - offset;
+            str = memchr( (const char *) snapshot->map + offset, '\0', len);
+            offset += len;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file pb_push_snapshot_priv.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  On-disk format of the push snapshots
+ *
+ * A snapshot is made of:
+ *  - a header;
+ *  - the hash index on the identification (open addressing, record number + 1, 0 for an empty slot);
+ *  - the checksums of the blocks of the records and of the string heap;
+ *  - the fixed-size records, sorted by modification;
+ *  - the string heap.
+ *
+ * The header, the index and the block checksums are checked at the opening. A block is checked the first time it
+ * is read, so opening a large snapshot does not read it all.
+ *
+ * Values are stored in the byte order of the host that wrote the snapshot.
+ */
+
+#ifndef __PB_PUSH_SNAPSHOT_PRIV_H__
+#define __PB_PUSH_SNAPSHOT_PRIV_H__
+
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint8_t, uint32_t, uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PUSH_SNAPSHOT_MAGIC
+ * Magic of a snapshot (8 bytes with the null character)
+ */
+#define PUSH_SNAPSHOT_MAGIC         "PBPUSHS"
+
+/**
+ * @def PUSH_SNAPSHOT_VERSION
+ * Version of the format, increased at each incompatible change
+ */
+#define PUSH_SNAPSHOT_VERSION       2
+
+/**
+ * @def PUSH_SNAPSHOT_MIN_SLOTS
+ * Minimum number of slots of the hash index (power of two)
+ */
+#define PUSH_SNAPSHOT_MIN_SLOTS     16
+
+/**
+ * @def PUSH_SNAPSHOT_BLOCK_SIZE
+ * Size of the blocks of the records and of the string heap checked on their own
+ */
+#define PUSH_SNAPSHOT_BLOCK_SIZE    0x1000
+
+/**
+ * @def PUSH_SNAPSHOT_BLOCK_UNCHECKED
+ * The block has not been read yet
+ */
+#define PUSH_SNAPSHOT_BLOCK_UNCHECKED   0
+
+/**
+ * @def PUSH_SNAPSHOT_BLOCK_VALID
+ * The checksum of the block is right
+ */
+#define PUSH_SNAPSHOT_BLOCK_VALID       1
+
+/**
+ * @def PUSH_SNAPSHOT_BLOCK_CORRUPTED
+ * The checksum of the block is wrong: its records and strings are not used
+ */
+#define PUSH_SNAPSHOT_BLOCK_CORRUPTED   2
+
+/**
+ * @def PUSH_SNAPSHOT_NB_STRINGS
+ * Number of strings of a record
+ */
+#define PUSH_SNAPSHOT_NB_STRINGS    12
+
+/**
+ * @def PUSH_SNAPSHOT_IDEN
+ * Position of the identification in the strings of a record
+ */
+#define PUSH_SNAPSHOT_IDEN          0
+
+
+/**
+ * @struct pb_push_snapshot_header_s
+ * @brief Header of a snapshot
+ */
+typedef struct pb_push_snapshot_header_s {
+    char magic[8];          ///< PUSH_SNAPSHOT_MAGIC
+    uint32_t version;          ///< PUSH_SNAPSHOT_VERSION
+    uint32_t record_size;          ///< Size of a record
+    uint64_t nb_records;          ///< Number of records
+    uint64_t nb_slots;          ///< Number of slots of the hash index (power of two)
+    uint64_t index_offset;          ///< Offset of the hash index
+    uint64_t blocks_offset;          ///< Offset of the checksums of the blocks
+    uint64_t nb_blocks;          ///< Number of blocks of the records and of the string heap
+    uint64_t records_offset;          ///< Offset of the records
+    uint64_t strings_offset;          ///< Offset of the string heap
+    uint64_t strings_size;          ///< Size of the string heap
+    double modified_after;          ///< Watermark of the synchronization
+    uint64_t checksum;          ///< FNV-1a of the header before it, of the hash index and of the checksums of the blocks
+} pb_push_snapshot_header_t;
+
+
+/**
+ * @struct pb_push_snapshot_record_s
+ * @brief Push stored in a snapshot
+ */
+typedef struct pb_push_snapshot_record_s {
+    double created;          ///< Push's creation
+    double modified;          ///< Push's last modification
+    uint32_t hash;          ///< Hash of the identification
+    uint8_t active;          ///< Push's activity
+    uint8_t dismissed;          ///< Is the push dismissed?
+    uint8_t reserved[2];          ///< Padding, always 0
+    uint32_t strings[PUSH_SNAPSHOT_NB_STRINGS];          ///< Offset + 1 of the strings in the heap (0 for NULL)
+} pb_push_snapshot_record_t;
+
+
+/**
+ * @struct pb_push_snapshot_s
+ * @brief Snapshot mapped in memory
+ */
+typedef struct pb_push_snapshot_s {
+    void *map;          ///< Mapping of the file
+    size_t size;          ///< Size of the mapping
+    const pb_push_snapshot_header_t *header;          ///< Header
+    const pb_push_snapshot_record_t *records;          ///< Records
+    const uint32_t *index;          ///< Hash index
+    const uint64_t *blocks;          ///< Checksums of the blocks (FNV-1a)
+    unsigned char *checked;          ///< State of each block (PUSH_SNAPSHOT_BLOCK_*)
+    const char *strings;          ///< String heap
+} pb_push_snapshot_t;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_PUSH_SNAPSHOT_PRIV_H__
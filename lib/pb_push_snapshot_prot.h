@@ -0,0 +1,119 @@
+/**
+ * @file pb_push_snapshot_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Memory-mapped snapshots of pushes
+ */
+
+#ifndef __PB_PUSH_SNAPSHOT_PROT_H__
+#define __PB_PUSH_SNAPSHOT_PROT_H__
+
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint32_t
+#include <sys/types.h>      // ssize_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pb_push_s pb_push_t;
+typedef struct pb_push_snapshot_s pb_push_snapshot_t;
+
+
+/**
+ * @brief      Hash a push identification (FNV-1a)
+ *
+ * @param[in]  iden  The identification
+ *
+ * @return     The hash
+ */
+uint32_t pb_push_hash(const char *iden);
+
+/**
+ * @brief      Map a snapshot and check its header and its hash index
+ * @details    The records and the strings are checked block by block the first time they are read: the calls on a
+ *             snapshot have to be serialized.
+ *
+ * @param[in]  path  The path of the snapshot
+ *
+ * @return     On success: the snapshot
+ * @return     On error (missing, truncated, corrupted header or index, or other version): NULL
+ */
+pb_push_snapshot_t* pb_push_snapshot_open(const char *path);
+
+/**
+ * @brief      Unmap a snapshot
+ *
+ * @param      snapshot  The snapshot
+ */
+void pb_push_snapshot_close(pb_push_snapshot_t *snapshot);
+
+/**
+ * @brief      Write a snapshot
+ * @details    The snapshot is written next to the path then renamed, so a mapped snapshot is never modified.
+ *
+ * @param[in]  path            The path of the snapshot
+ * @param[in]  pushes          The pushes, sorted by modification, with distinct identifications
+ * @param[in]  nb_pushes       The number of pushes
+ * @param[in]  modified_after  The watermark of the synchronization
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_push_snapshot_write(const char *path, const pb_push_t *const *pushes, size_t nb_pushes, double modified_after);
+
+/**
+ * @brief      Get the number of records of the snapshot
+ */
+size_t pb_push_snapshot_get_number(const pb_push_snapshot_t *snapshot);
+
+/**
+ * @brief      Get the watermark of the synchronization stored in the snapshot
+ */
+double pb_push_snapshot_get_modified_after(const pb_push_snapshot_t *snapshot);
+
+/**
+ * @brief      Get the last modification of a record
+ */
+double pb_push_snapshot_get_modified(const pb_push_snapshot_t *snapshot, size_t i);
+
+/**
+ * @brief      Find a record from its identification
+ *
+ * @param[in]  snapshot  The snapshot
+ * @param[in]  iden      The identification
+ * @param[in]  hash      The hash of the identification (pb_push_hash)
+ *
+ * @return     The number of the record or -1 if unknown or corrupted
+ */
+ssize_t pb_push_snapshot_find(const pb_push_snapshot_t *snapshot, const char *iden, uint32_t hash);
+
+/**
+ * @brief      Get the number of the first record modified after the given timestamp
+ */
+size_t pb_push_snapshot_upper_bound(const pb_push_snapshot_t *snapshot, double modified);
+
+/**
+ * @brief      Get the number of the first record not modified before the given timestamp
+ */
+size_t pb_push_snapshot_lower_bound(const pb_push_snapshot_t *snapshot, double modified);
+
+/**
+ * @brief      Decode a record
+ * @details    The strings of the push point into the mapping: they are valid until the snapshot is closed.
+ *
+ * @param[in]  snapshot  The snapshot
+ * @param[in]  i         The number of the record
+ * @param[out] push      The push
+ *
+ * @return     On success: 0
+ * @return     On error (corrupted record): non-zero integer
+ */
+int pb_push_snapshot_decode(const pb_push_snapshot_t *snapshot, size_t i, pb_push_t *push);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_PUSH_SNAPSHOT_PROT_H__
@@ -0,0 +1,1003 @@
+/**
+ * @file pb_push_store.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdlib.h>          // calloc, malloc, realloc, free
+#include <string.h>          // memcpy, memmove, strcmp, strlen
+#include <pthread.h>         // pthread_mutex_init, pthread_mutex_lock, pthread_mutex_unlock, pthread_mutex_destroy
+
+#include "pb_utils.h"             // eprintf
+#include "pb_push_store_priv.h"   // pb_push_store_t, pb_push_record_t, pb_push_store_cursor_t, PUSH_STORE_MIN_SLOTS
+#include "pb_push_snapshot_prot.h"  // pb_push_hash, pb_push_snapshot_open, pb_push_snapshot_find, pb_push_snapshot_decode
+#include "pushbullet.h"           // pb_pushes_sync
+
+
+/**
+ * @brief      Check if a record of the snapshot has been replaced or deleted
+ */
+static int store_is_shadowed(const pb_push_store_t *store, size_t i);
+
+/**
+ * @brief      Mark a record of the snapshot as replaced or deleted
+ */
+static void store_shadow(pb_push_store_t *store, size_t i);
+
+/**
+ * @brief      Get the number of pushes of the store and of its snapshot
+ */
+static size_t store_count(const pb_push_store_t *store);
+
+/**
+ * @brief      Start a merge of the pushes modified in a time range
+ */
+static void store_cursor_init(const pb_push_store_t *store, pb_push_store_cursor_t *cursor, double modified_after, double modified_before);
+
+/**
+ * @brief      Get the next push of a merge
+ *
+ * @param      decoded  Where a push of the snapshot is decoded
+ *
+ * @return     The push (decoded or stored) or NULL at the end
+ */
+static const pb_push_t* store_cursor_next(const pb_push_store_t *store, pb_push_store_cursor_t *cursor, pb_push_t *decoded);
+
+/**
+ * @brief      Get the slot holding the identification, or the empty slot where it would be inserted
+ */
+static size_t store_find_slot(const pb_push_store_t *store, const char *iden, uint32_t hash);
+
+/**
+ * @brief      Double the number of slots of the hash index
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int store_grow_slots(pb_push_store_t *store);
+
+/**
+ * @brief      Get the position of the first push modified after the given timestamp
+ */
+static size_t store_upper_bound(const pb_push_store_t *store, double modified);
+
+/**
+ * @brief      Get the position of the first push not modified before the given timestamp
+ */
+static size_t store_lower_bound(const pb_push_store_t *store, double modified);
+
+/**
+ * @brief      Copy a push into a new record
+ *
+ * @return     The new record or NULL
+ */
+static pb_push_record_t* store_new_record(pb_push_store_t *store, const pb_push_t *push, uint32_t hash);
+
+/**
+ * @brief      Insert a record in the indexes
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int store_insert_record(pb_push_store_t *store, pb_push_record_t *record, size_t slot);
+
+/**
+ * @brief      Remove a record from the indexes and release its memory
+ */
+static void store_remove_record(pb_push_store_t *store, pb_push_record_t *record);
+
+/**
+ * @brief      Release a reference to a record, freed with the last one once it has left the indexes
+ */
+static void store_release_record(pb_push_store_t *store, pb_push_record_t *record);
+
+/**
+ * @brief      Move a record to the head of the LRU list
+ */
+static void store_touch_record(pb_push_store_t *store, pb_push_record_t *record);
+
+/**
+ * @brief      Get the memory used by the store
+ */
+static size_t store_memory(const pb_push_store_t *store);
+
+/**
+ * @brief      Evict the least recently used records until the memory limit is respected
+ */
+static void store_evict(pb_push_store_t *store, const pb_push_record_t *keep);
+
+/**
+ * @brief      Apply a page of pushes to the store (pb_pushes_sync callback)
+ */
+static int store_apply_page(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata);
+
+
+pb_push_store_t* pb_push_store_new(size_t memory_limit)
+{
+    pb_push_store_t* store = calloc(1, sizeof(*store));
+
+    if ( store )
+    {
+        store->slots = calloc(PUSH_STORE_MIN_SLOTS, sizeof(pb_push_record_t *) );
+
+        if ( ! store->slots )
+        {
+            free(store);
+            return (NULL);
+        }
+
+        store->nb_slots = PUSH_STORE_MIN_SLOTS;
+        store->memory_limit = memory_limit;
+        pb_arena_init(&store->arena, 0);
+        pthread_mutex_init(&store->mtx, NULL);
+
+        // Increase the reference
+        pb_refcount_init(&store->ref);
+    }
+
+    return store;
+}
+
+
+int pb_push_store_ref(pb_push_store_t* store)
+{
+    if ( ! store )
+    {
+        return -1;
+    }
+
+    pb_refcount_inc(&store->ref);
+    return 0;
+}
+
+
+int pb_push_store_unref(pb_push_store_t* store)
+{
+    if ( ! store )
+    {
+        return -1;
+    }
+
+    if ( pb_refcount_dec(&store->ref) )
+    {
+        pb_arena_clear(&store->arena);
+        pb_push_snapshot_close(store->snapshot);
+        pb_free(store->shadowed);
+        pb_free(store->slots);
+        pb_free(store->by_modified);
+        pthread_mutex_destroy(&store->mtx);
+        free(store);
+    }
+
+    return 0;
+}
+
+
+int pb_push_store_apply(pb_push_store_t* store,
+                        const pb_push_t* push
+                        )
+{
+    int                 ret = 0;
+    uint32_t            hash = 0;
+    size_t              slot = 0;
+    ssize_t             i = -1;
+    pb_push_record_t    *record = NULL;
+
+    if ( (! store) || (! push) || (! push->iden) )
+    {
+        return -1;
+    }
+
+    hash = pb_push_hash(push->iden);
+
+    pthread_mutex_lock(&store->mtx);
+
+    slot = store_find_slot(store, push->iden, hash);
+
+    if ( (record = store->slots[slot]) != NULL )
+    {
+        // Never go back in time: an older version of a known push is ignored
+        if ( record->push.modified > push->modified )
+        {
+            pthread_mutex_unlock(&store->mtx);
+            return 0;
+        }
+
+        store_remove_record(store, record);
+        slot = store_find_slot(store, push->iden, hash);
+    }
+    else if ( ((i = pb_push_snapshot_find(store->snapshot, push->iden, hash)) >= 0) && (! store_is_shadowed(store, i)) )
+    {
+        if ( pb_push_snapshot_get_modified(store->snapshot, i) > push->modified )
+        {
+            pthread_mutex_unlock(&store->mtx);
+            return 0;
+        }
+
+        // The mapping is read-only: the snapshot record is hidden behind the new version or deleted
+        store_shadow(store, i);
+    }
+
+    // Inactive pushes are deleted pushes: there is nothing more to do
+    if ( push->active )
+    {
+        if ( (record = store_new_record(store, push, hash)) == NULL )
+        {
+            ret = -1;
+        }
+        else if ( store_insert_record(store, record, slot) != 0 )
+        {
+            pb_arena_release(&store->arena, record->chunk, record->footprint);
+            ret = -1;
+        }
+        else
+        {
+            store_evict(store, record);
+        }
+    }
+
+    pthread_mutex_unlock(&store->mtx);
+
+    return ret;
+}
+
+
+const pb_push_t* pb_push_store_lookup(pb_push_store_t* store,
+                                      const char*      iden
+                                      )
+{
+    uint32_t            hash = 0;
+    ssize_t             i = -1;
+    pb_push_record_t    *record = NULL;
+    pb_arena_chunk_t    *chunk = NULL;
+
+    if ( (! store) || (! iden) )
+    {
+        return (NULL);
+    }
+
+    hash = pb_push_hash(iden);
+
+    pthread_mutex_lock(&store->mtx);
+
+    if ( (record = store->slots[store_find_slot(store, iden, hash)]) != NULL )
+    {
+        store_touch_record(store, record);
+    }
+    else if ( ((i = pb_push_snapshot_find(store->snapshot, iden, hash)) >= 0) && (! store_is_shadowed(store, i)) &&
+              ((record = pb_arena_alloc(&store->arena, sizeof(*record), &chunk)) != NULL) )
+    {
+        // Served from the mapping: the strings stay in it, only the fixed part is copied in a record out of the indexes
+        // (the record has been checked by the search)
+        memset(record, 0, sizeof(*record) );
+        (void) pb_push_snapshot_decode(store->snapshot, i, &record->push);
+        record->chunk = chunk;
+        record->footprint = sizeof(*record);
+        record->hash = hash;
+    }
+
+    // The record outlives a replacement or an eviction until it is released
+    if ( record )
+    {
+        record->refs++;
+    }
+
+    pthread_mutex_unlock(&store->mtx);
+
+    return (record) ? &record->push : NULL;
+}
+
+
+int pb_push_store_release(pb_push_store_t* store,
+                          const pb_push_t* push
+                          )
+{
+    if ( (! store) || (! push) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&store->mtx);
+
+    // The push is the first member of its record
+    store_release_record(store, (pb_push_record_t *) push);
+
+    pthread_mutex_unlock(&store->mtx);
+
+    return 0;
+}
+
+
+size_t pb_push_store_range(pb_push_store_t* store,
+                           double           modified_after,
+                           double           modified_before,
+                           pb_pushes_cb     cb,
+                           void             *userdata
+                           )
+{
+    pb_push_store_cursor_t  cursor;
+    const pb_push_t         **pushes = NULL;
+    pb_push_t               *decoded = NULL;
+    size_t                  nb = 0;
+    size_t                  nb_decoded = 0;
+    size_t                  i = 0;
+    size_t                  j = 0;
+    size_t                  len = 0;
+    size_t                  total = 0;
+    int                     stop = 0;
+
+    if ( (! store) || (! cb) )
+    {
+        return 0;
+    }
+
+    // The range is taken under the lock and given without it: the callback may use the store
+    pthread_mutex_lock(&store->mtx);
+
+    store_cursor_init(store, &cursor, modified_after, modified_before);
+    pushes = malloc( (cursor.end - cursor.pos + cursor.snapshot_end - cursor.snapshot_pos + 1) * sizeof(pb_push_t *) );
+    decoded = malloc( (cursor.snapshot_end - cursor.snapshot_pos + 1) * sizeof(pb_push_t) );
+
+    if ( pushes && decoded )
+    {
+        while ( (pushes[nb] = store_cursor_next(store, &cursor, &decoded[nb_decoded])) != NULL )
+        {
+            // The strings of a decoded push stay in the mapping, a record is held until the end of the range
+            if ( pushes[nb] == &decoded[nb_decoded] )
+            {
+                nb_decoded++;
+            }
+            else
+            {
+                ((pb_push_record_t *) pushes[nb])->refs++;
+            }
+
+            nb++;
+        }
+    }
+    else
+    {
+        eprintf("Not enough memory to give a range of the push store");
+    }
+
+    pthread_mutex_unlock(&store->mtx);
+
+    for ( i = 0; (i < nb) && (! stop); i += len )
+    {
+        len = (nb - i < PUSH_STORE_BATCH) ? nb - i : PUSH_STORE_BATCH;
+        stop = cb(&pushes[i], len, userdata);
+        total += len;
+    }
+
+    pthread_mutex_lock(&store->mtx);
+
+    // The decoded pushes are in the same order in both arrays
+    for ( i = 0; i < nb; i++ )
+    {
+        if ( (j < nb_decoded) && (pushes[i] == &decoded[j]) )
+        {
+            j++;
+        }
+        else
+        {
+            store_release_record(store, (pb_push_record_t *) pushes[i]);
+        }
+    }
+
+    pthread_mutex_unlock(&store->mtx);
+
+    pb_free(pushes);
+    pb_free(decoded);
+
+    return total;
+}
+
+
+size_t pb_push_store_get_number(pb_push_store_t* store)
+{
+    size_t  nb = 0;
+
+    if ( store )
+    {
+        pthread_mutex_lock(&store->mtx);
+        nb = store_count(store);
+        pthread_mutex_unlock(&store->mtx);
+    }
+
+    return nb;
+}
+
+
+size_t pb_push_store_get_memory(pb_push_store_t* store)
+{
+    size_t  memory = 0;
+
+    if ( store )
+    {
+        pthread_mutex_lock(&store->mtx);
+        memory = store_memory(store);
+        pthread_mutex_unlock(&store->mtx);
+    }
+
+    return memory;
+}
+
+
+double pb_push_store_get_modified_after(pb_push_store_t* store)
+{
+    double  modified_after = 0;
+
+    if ( store )
+    {
+        pthread_mutex_lock(&store->mtx);
+        modified_after = store->modified_after;
+        pthread_mutex_unlock(&store->mtx);
+    }
+
+    return modified_after;
+}
+
+
+pb_push_store_t* pb_push_store_new_from_snapshot(const char*  path,
+                                                 size_t       memory_limit
+                                                 )
+{
+    pb_push_snapshot_t  *snapshot = pb_push_snapshot_open(path);
+    pb_push_store_t     *store = NULL;
+
+    if ( ! snapshot )
+    {
+        return (NULL);
+    }
+
+    if ( (store = pb_push_store_new(memory_limit)) == NULL )
+    {
+        pb_push_snapshot_close(snapshot);
+        return (NULL);
+    }
+
+    store->snapshot = snapshot;
+    store->modified_after = pb_push_snapshot_get_modified_after(snapshot);
+
+    if ( (store->shadowed = calloc(pb_push_snapshot_get_number(snapshot) / 8 + 1, 1)) == NULL )
+    {
+        pb_push_store_unref(store);
+        return (NULL);
+    }
+
+    return (store);
+}
+
+
+int pb_push_store_save(pb_push_store_t*  store,
+                       const char*       path
+                       )
+{
+    pb_push_store_cursor_t  cursor;
+    const pb_push_t         **pushes = NULL;
+    pb_push_t               *decoded = NULL;
+    size_t                  nb = 0;
+    size_t                  nb_decoded = 0;
+    int                     ret = -1;
+
+    if ( (! store) || (! path) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&store->mtx);
+
+    pushes = malloc( (store_count(store) + 1) * sizeof(pb_push_t *) );
+    decoded = malloc( (pb_push_snapshot_get_number(store->snapshot) - store->nb_shadowed + 1) * sizeof(pb_push_t) );
+
+    if ( pushes && decoded )
+    {
+        store_cursor_init(store, &cursor, -1, 0);
+
+        while ( (pushes[nb] = store_cursor_next(store, &cursor, &decoded[nb_decoded])) != NULL )
+        {
+            if ( pushes[nb++] == &decoded[nb_decoded] )
+            {
+                nb_decoded++;
+            }
+        }
+
+        ret = pb_push_snapshot_write(path, pushes, nb, store->modified_after);
+    }
+    else
+    {
+        eprintf("Not enough memory to save the push store");
+    }
+
+    pthread_mutex_unlock(&store->mtx);
+
+    pb_free(pushes);
+    pb_free(decoded);
+
+    return ret;
+}
+
+
+http_code_t pb_push_store_sync(pb_push_store_t* store,
+                               const pb_user_t* user
+                               )
+{
+    http_code_t     res = HTTP_UNKNOWN_CODE;
+    double          watermark = 0;
+
+    if ( ! store )
+    {
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    pthread_mutex_lock(&store->mtx);
+    watermark = store->modified_after;
+    pthread_mutex_unlock(&store->mtx);
+
+    res = pb_pushes_sync(user, &watermark, store_apply_page, store);
+
+    if ( res == HTTP_OK )
+    {
+        pthread_mutex_lock(&store->mtx);
+
+        if ( watermark > store->modified_after )
+        {
+            store->modified_after = watermark;
+        }
+
+        pthread_mutex_unlock(&store->mtx);
+    }
+
+    return (res);
+}
+
+
+static size_t store_find_slot(const pb_push_store_t  *store,
+                              const char             *iden,
+                              uint32_t               hash
+                              )
+{
+    size_t  mask = store->nb_slots - 1;
+    size_t  i = hash & mask;
+
+    // There is always an empty slot: the load factor is kept under one half
+    while ( store->slots[i] &&
+            ((store->slots[i]->hash != hash) || (strcmp(store->slots[i]->push.iden, iden) != 0)) )
+    {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+
+static int store_grow_slots(pb_push_store_t *store)
+{
+    pb_push_record_t    **old = store->slots;
+    size_t              old_nb = store->nb_slots;
+    size_t              i = 0;
+    size_t              j = 0;
+    size_t              mask = 0;
+
+    if ( (store->slots = calloc(old_nb * 2, sizeof(pb_push_record_t *))) == NULL )
+    {
+        eprintf("Not enough memory to grow the push index");
+        store->slots = old;
+        return -1;
+    }
+
+    store->nb_slots = old_nb * 2;
+    mask = store->nb_slots - 1;
+
+    for ( i = 0; i < old_nb; i++ )
+    {
+        if ( old[i] )
+        {
+            for ( j = old[i]->hash & mask; store->slots[j]; j = (j + 1) & mask )
+            {
+                ;
+            }
+
+            store->slots[j] = old[i];
+        }
+    }
+
+    free(old);
+
+    return 0;
+}
+
+
+static size_t store_upper_bound(const pb_push_store_t    *store,
+                                double                   modified
+                                )
+{
+    size_t  lo = 0;
+    size_t  hi = store->nb_pushes;
+    size_t  mid = 0;
+
+    while ( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if ( store->by_modified[mid]->modified <= modified )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+static size_t store_lower_bound(const pb_push_store_t    *store,
+                                double                   modified
+                                )
+{
+    size_t  lo = 0;
+    size_t  hi = store->nb_pushes;
+    size_t  mid = 0;
+
+    while ( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if ( store->by_modified[mid]->modified < modified )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+static pb_push_record_t* store_new_record(pb_push_store_t    *store,
+                                          const pb_push_t    *push,
+                                          uint32_t           hash
+                                          )
+{
+    const char          **src[] = {
+        (const char **) &push->body, (const char **) &push->direction, (const char **) &push->iden,
+        (const char **) &push->receiver_email, (const char **) &push->receiver_email_normalized,
+        (const char **) &push->receiver_iden, (const char **) &push->sender_email,
+        (const char **) &push->sender_email_normalized, (const char **) &push->sender_iden,
+        (const char **) &push->sender_name, (const char **) &push->title, (const char **) &push->type
+    };
+    size_t              lens[sizeof(src) / sizeof(src[0])];
+    size_t              footprint = sizeof(pb_push_record_t);
+    size_t              i = 0;
+    pb_push_record_t    *record = NULL;
+    pb_arena_chunk_t    *chunk = NULL;
+    char                *strings = NULL;
+    const char          **dst = NULL;
+
+    for ( i = 0; i < sizeof(src) / sizeof(src[0]); i++ )
+    {
+        lens[i] = (*src[i]) ? strlen(*src[i]) + 1 : 0;
+        footprint += lens[i];
+    }
+
+    // The record and its strings are a single allocation
+    if ( (record = pb_arena_alloc(&store->arena, footprint, &chunk)) == NULL )
+    {
+        return (NULL);
+    }
+
+    memset(record, 0, sizeof(*record) );
+    record->push.active = push->active;
+    record->push.created = push->created;
+    record->push.dismissed = push->dismissed;
+    record->push.modified = push->modified;
+    record->chunk = chunk;
+    record->footprint = footprint;
+    record->hash = hash;
+
+    strings = (char *) (record + 1);
+
+    for ( i = 0; i < sizeof(src) / sizeof(src[0]); i++ )
+    {
+        if ( lens[i] > 0 )
+        {
+            // Same field in the record
+            dst = (const char **) ((char *) &record->push + ((const char *) src[i] - (const char *) push));
+            memcpy(strings, *src[i], lens[i]);
+            *dst = strings;
+            strings += lens[i];
+        }
+    }
+
+    return (record);
+}
+
+
+static int store_insert_record(pb_push_store_t   *store,
+                               pb_push_record_t  *record,
+                               size_t            slot
+                               )
+{
+    size_t      pos = 0;
+    pb_push_t   **by_modified = NULL;
+
+    // Keep the load factor of the hash index under one half
+    if ( (store->nb_pushes + 1) * 2 > store->nb_slots )
+    {
+        if ( store_grow_slots(store) != 0 )
+        {
+            return -1;
+        }
+
+        slot = store_find_slot(store, record->push.iden, record->hash);
+    }
+
+    if ( store->nb_pushes == store->capacity )
+    {
+        by_modified = realloc(store->by_modified, (store->capacity ? store->capacity * 2 : 64) * sizeof(pb_push_t *) );
+
+        if ( ! by_modified )
+        {
+            eprintf("Not enough memory to grow the push index");
+            return -1;
+        }
+
+        store->by_modified = by_modified;
+        store->capacity = (store->capacity ? store->capacity * 2 : 64);
+    }
+
+    // Pushes mostly come in order: check the tail before searching
+    if ( (store->nb_pushes == 0) || (store->by_modified[store->nb_pushes - 1]->modified <= record->push.modified) )
+    {
+        pos = store->nb_pushes;
+    }
+    else
+    {
+        pos = store_upper_bound(store, record->push.modified);
+        memmove(&store->by_modified[pos + 1], &store->by_modified[pos], (store->nb_pushes - pos) * sizeof(pb_push_t *) );
+    }
+
+    store->by_modified[pos] = &record->push;
+    store->slots[slot] = record;
+    store->nb_pushes++;
+    record->linked = 1;
+
+    // Most recently used
+    record->lru_prev = NULL;
+    record->lru_next = store->lru_head;
+
+    if ( store->lru_head )
+    {
+        store->lru_head->lru_prev = record;
+    }
+    else
+    {
+        store->lru_tail = record;
+    }
+
+    store->lru_head = record;
+
+    return 0;
+}
+
+
+static void store_remove_record(pb_push_store_t  *store,
+                                pb_push_record_t *record
+                                )
+{
+    size_t  mask = store->nb_slots - 1;
+    size_t  i = store_find_slot(store, record->push.iden, record->hash);
+    size_t  j = i;
+    size_t  k = 0;
+    size_t  pos = 0;
+
+    // Backward-shift deletion: no tombstone is left in the hash index
+    store->slots[i] = NULL;
+
+    for ( j = (i + 1) & mask; store->slots[j]; j = (j + 1) & mask )
+    {
+        k = store->slots[j]->hash & mask;
+
+        if ( (j > i) ? ((k <= i) || (k > j)) : ((k <= i) && (k > j)) )
+        {
+            store->slots[i] = store->slots[j];
+            store->slots[j] = NULL;
+            i = j;
+        }
+    }
+
+    // Sorted index
+    for ( pos = store_lower_bound(store, record->push.modified); pos < store->nb_pushes; pos++ )
+    {
+        if ( store->by_modified[pos] == &record->push )
+        {
+            memmove(&store->by_modified[pos], &store->by_modified[pos + 1], (store->nb_pushes - pos - 1) * sizeof(pb_push_t *) );
+            break;
+        }
+    }
+
+    store->nb_pushes--;
+
+    // LRU list
+    if ( record->lru_prev )
+    {
+        record->lru_prev->lru_next = record->lru_next;
+    }
+    else
+    {
+        store->lru_head = record->lru_next;
+    }
+
+    if ( record->lru_next )
+    {
+        record->lru_next->lru_prev = record->lru_prev;
+    }
+    else
+    {
+        store->lru_tail = record->lru_prev;
+    }
+
+    record->linked = 0;
+
+    // A record still referenced is freed by its last release
+    if ( record->refs == 0 )
+    {
+        pb_arena_release(&store->arena, record->chunk, record->footprint);
+    }
+}
+
+
+static void store_release_record(pb_push_store_t  *store,
+                                 pb_push_record_t *record
+                                 )
+{
+    if ( (--record->refs == 0) && (! record->linked) )
+    {
+        pb_arena_release(&store->arena, record->chunk, record->footprint);
+    }
+}
+
+
+static void store_touch_record(pb_push_store_t   *store,
+                               pb_push_record_t  *record
+                               )
+{
+    if ( store->lru_head == record )
+    {
+        return;
+    }
+
+    // Unlink (the record is not the head, so it has a previous one)
+    record->lru_prev->lru_next = record->lru_next;
+
+    if ( record->lru_next )
+    {
+        record->lru_next->lru_prev = record->lru_prev;
+    }
+    else
+    {
+        store->lru_tail = record->lru_prev;
+    }
+
+    // Link at the head
+    record->lru_prev = NULL;
+    record->lru_next = store->lru_head;
+    store->lru_head->lru_prev = record;
+    store->lru_head = record;
+}
+
+
+static size_t store_memory(const pb_push_store_t *store)
+{
+    // The live bytes of the records are counted: counting whole chunks, a few records kept in use in each chunk would
+    // make the eviction empty the store
+    size_t  memory = store->arena.live + (store->nb_slots * sizeof(pb_push_record_t *)) + (store->capacity * sizeof(pb_push_t *));
+
+    // The mapping is backed by the file: only the bitmap is counted
+    if ( store->snapshot )
+    {
+        memory += pb_push_snapshot_get_number(store->snapshot) / 8 + 1;
+    }
+
+    return memory;
+}
+
+
+static void store_evict(pb_push_store_t          *store,
+                        const pb_push_record_t   *keep
+                        )
+{
+    if ( store->memory_limit == 0 )
+    {
+        return;
+    }
+
+    while ( (store_memory(store) > store->memory_limit) && store->lru_tail && (store->lru_tail != keep) )
+    {
+        store_remove_record(store, store->lru_tail);
+    }
+}
+
+
+static int store_is_shadowed(const pb_push_store_t    *store,
+                             size_t                   i
+                             )
+{
+    return (store->shadowed[i >> 3] & (1 << (i & 7)) ) != 0;
+}
+
+
+static void store_shadow(pb_push_store_t  *store,
+                         size_t           i
+                         )
+{
+    store->shadowed[i >> 3] |= (unsigned char) (1 << (i & 7));
+    store->nb_shadowed++;
+}
+
+
+static size_t store_count(const pb_push_store_t *store)
+{
+    return store->nb_pushes + pb_push_snapshot_get_number(store->snapshot) - store->nb_shadowed;
+}
+
+
+static void store_cursor_init(const pb_push_store_t  *store,
+                              pb_push_store_cursor_t *cursor,
+                              double                 modified_after,
+                              double                 modified_before
+                              )
+{
+    cursor->pos = store_upper_bound(store, modified_after);
+    cursor->end = (modified_before > 0) ? store_lower_bound(store, modified_before) : store->nb_pushes;
+    cursor->snapshot_pos = pb_push_snapshot_upper_bound(store->snapshot, modified_after);
+    cursor->snapshot_end = (modified_before > 0) ? pb_push_snapshot_lower_bound(store->snapshot, modified_before) :
+                                                   pb_push_snapshot_get_number(store->snapshot);
+}
+
+
+static const pb_push_t* store_cursor_next(const pb_push_store_t  *store,
+                                          pb_push_store_cursor_t *cursor,
+                                          pb_push_t              *decoded
+                                          )
+{
+    while ( cursor->snapshot_pos < cursor->snapshot_end )
+    {
+        // Skip the snapshot records replaced, deleted or corrupted
+        if ( store_is_shadowed(store, cursor->snapshot_pos) )
+        {
+            cursor->snapshot_pos++;
+        }
+        else if ( (cursor->pos < cursor->end) &&
+                  (pb_push_snapshot_get_modified(store->snapshot, cursor->snapshot_pos) > store->by_modified[cursor->pos]->modified) )
+        {
+            break;
+        }
+        else if ( pb_push_snapshot_decode(store->snapshot, cursor->snapshot_pos++, decoded) == 0 )
+        {
+            return (decoded);
+        }
+    }
+
+    return (cursor->pos < cursor->end) ? store->by_modified[cursor->pos++] : NULL;
+}
+
+
+static int store_apply_page(const pb_push_t *const   *pushes,
+                            size_t                   nb_pushes,
+                            void                     *userdata
+                            )
+{
+    size_t  i = 0;
+
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        pb_push_store_apply( (pb_push_store_t *) userdata, pushes[i]);
+    }
+
+    return 0;
+}
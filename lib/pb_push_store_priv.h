@@ -0,0 +1,92 @@
+/**
+ * @file pb_push_store_priv.h
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#ifndef __PB_PUSH_STORE_PRIV__
+#define __PB_PUSH_STORE_PRIV__
+
+#include <stdint.h>         // uint32_t
+#include <pthread.h>        // pthread_mutex_t
+
+#include "pb_arena_prot.h"      // pb_arena_t, pb_arena_chunk_t
+#include "pb_refcount_prot.h"   // pb_refcount_t
+#include "pb_push_snapshot_prot.h"  // pb_push_snapshot_t
+#include "pb_pushes_priv.h"     // pb_push_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PUSH_STORE_MIN_SLOTS
+ * Initial number of slots of the iden hash index (power of two)
+ */
+#define PUSH_STORE_MIN_SLOTS    64
+
+/**
+ * @def PUSH_STORE_BATCH
+ * Number of pushes given at once to a range callback
+ */
+#define PUSH_STORE_BATCH        64
+
+
+/**
+ * @struct pb_push_record_s
+ * @brief Push kept by the store
+ * @details The record and all its strings are a single arena allocation.
+ */
+typedef struct pb_push_record_s {
+    pb_push_t push;          ///< The push, its strings point right after the record
+    pb_arena_chunk_t *chunk;          ///< Arena chunk holding the record
+    size_t footprint;          ///< Size of the arena allocation
+    uint32_t hash;          ///< Hash of the identification
+    unsigned int refs;          ///< References given by the lookups and the ranges
+    unsigned char linked;          ///< Is the record in the indexes? An unlinked record is freed with its last reference
+    struct pb_push_record_s *lru_prev;          ///< More recently used record
+    struct pb_push_record_s *lru_next;          ///< Less recently used record
+} pb_push_record_t;
+
+
+/**
+ * @struct pb_push_store_s
+ * @brief In-memory store of pushes
+ */
+typedef struct pb_push_store_s {
+    pb_arena_t arena;          ///< Arena holding the records
+    pb_push_record_t **slots;          ///< Open-addressing hash index on the identification
+    size_t nb_slots;          ///< Number of slots (power of two)
+    pb_push_t **by_modified;          ///< Pushes sorted by modification
+    size_t capacity;          ///< Capacity of by_modified
+    size_t nb_pushes;          ///< Number of pushes stored
+    pb_push_record_t *lru_head;          ///< Most recently used record
+    pb_push_record_t *lru_tail;          ///< Least recently used record
+    size_t memory_limit;          ///< Maximum memory used by the store (0 for no limit)
+    double modified_after;          ///< Largest modification applied (watermark of the synchronization)
+    pb_push_snapshot_t *snapshot;          ///< Snapshot the store has been loaded from (may be NULL)
+    unsigned char *shadowed;          ///< Bitmap of the snapshot records replaced or deleted since the loading
+    size_t nb_shadowed;          ///< Number of bits set in shadowed
+    pthread_mutex_t mtx;          ///< Mutex for THREAD-SAFE
+    pb_refcount_t ref;          ///< Reference counter
+} pb_push_store_t;
+
+
+/**
+ * @struct pb_push_store_cursor_s
+ * @brief Merge of the pushes of the store and of its snapshot, sorted by modification
+ */
+typedef struct pb_push_store_cursor_s {
+    size_t pos;          ///< Next position in by_modified
+    size_t end;          ///< End position in by_modified
+    size_t snapshot_pos;          ///< Next record of the snapshot
+    size_t snapshot_end;          ///< End record of the snapshot
+} pb_push_store_cursor_t;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PB_PUSH_STORE_PRIV__
@@ -4,15 +4,25 @@
  * @date 12/05/2016
  */
 
-#include <string.h>             // strlen, strdup
-#include <json-glib/json-glib.h>          // JsonObject, json_object_new, json_object_new_string, json_object_object_add,
-                                // json_object_to_json_string
+#include <stdio.h>              // snprintf
+#include <string.h>             // strlen, strdup, strcmp
+#include <pthread.h>            // pthread_t, pthread_create, pthread_join
+#include <stdatomic.h>          // atomic_uchar, atomic_init, atomic_store
+#include <sys/stat.h>           // stat
+#include <curl/curl.h>          // curl_easy_escape, curl_free
+#include <json-glib/json-glib.h>          // JsonParser, JsonNode, JsonObject, json_parser_new, json_parser_load_from_data
 #include <libgen.h>          // basename
-#include <magic.h>          // magic_t, magic_open, magic_close, magic_load, magic_file
 
 #include "pb_utils.h"             // iprintf, eprintf, cprintf, gprintf
 #include "pb_pushes_priv.h"         // pb_note_t, pb_link_t, pb_file_t, pb_push_t
-#include "pb_requests_prot.h"     // pb_requests_post, pb_requests_get, pb_requests_delete, pb_requests_post_multipart
+#include "pb_json_prot.h"         // pb_json_writer_t, pb_json_writer_init, pb_json_add_string
+#include "pb_schema_prot.h"       // pb_schema_fill, PB_SCHEMA_PUSH
+#include "pb_mime_prot.h"         // pb_mime_get_file_type, pb_mime_get_buffer_type
+#include "pb_config_prot.h"       // pb_config_get_upload_hook, pb_config_get_upload_cache
+#include "pb_sha256_prot.h"       // pb_sha256, pb_sha256_file
+#include "pb_upload_cache_prot.h" // pb_upload_cache_lookup, pb_upload_cache_insert
+#include "pb_requests_prot.h"     // pb_requests_post, pb_requests_get, pb_requests_get_abortable, pb_requests_delete,
+                                  // pb_requests_post_multipart
 #include "pushbullet.h"
 
 /**
@@ -29,61 +39,59 @@ typedef struct pb_user_s pb_user_t;
 
 
 /**
- * @brief      Get a JSON note to send with \a pb_requests_post
+ * @brief      Write a JSON note to send with \a pb_requests_post
  *
+ * @param      w            The JSON writer
  * @param[in]  title        The title
  * @param[in]  body         The body
  * @param[in]  device_iden  The device identification
- *
- * @return     A string containing the JSON note
  */
-static const char* _create_note(const char *title, const char *body, const char *device_iden);
+static void _create_note(pb_json_writer_t *w, const char *title, const char *body, const char *device_iden);
 
 
 
 /**
- * @brief      Get a JSON link to send with \a pb_requests_post
+ * @brief      Write a JSON link to send with \a pb_requests_post
  *
+ * @param      w            The JSON writer
  * @param[in]  title        The title
  * @param[in]  body         The body
+ * @param[in]  url          The url
  * @param[in]  device_iden  The device identification
- *
- * @return     A string containing the JSON link
  */
-static const char* _create_link(const char *title, const char *body, const char *url, const char *device_iden);
+static void _create_link(pb_json_writer_t *w, const char *title, const char *body, const char *url, const char *device_iden);
 
 
 
 /**
- * @brief      Get a JSON file to send with \a pb_requests_post
+ * @brief      Write a JSON file to send with \a pb_requests_post
  *
+ * @param      w            The JSON writer
  * @param[in]  title        The title
  * @param[in]  body         The body
  * @param[in]  file_name    The file name
  * @param[in]  file_type    The file type
  * @param[in]  file_url     The file url
  * @param[in]  device_iden  The device identification
- *
- * @return     A newly allocated string containing the JSON link. This string has to be freed after.
  */
-static const char* _create_file(const char  *title,
-                                const char  *body,
-                                const char  *file_name,
-                                const char  *file_type,
-                                const char  *file_url,
-                                const char  *device_iden);
+static void _create_file(pb_json_writer_t *w,
+                         const char  *title,
+                         const char  *body,
+                         const char  *file_name,
+                         const char  *file_type,
+                         const char  *file_url,
+                         const char  *device_iden);
 
 
 
 /**
- * \brief      Creates a JSON upload request to send with \a pb_requests_post
+ * \brief      Write a JSON upload request to send with \a pb_requests_post
  *
+ * \param      w          The JSON writer
  * \param[in]  file_name  The file name
  * \param[in]  file_type  The file type
- *
- * \return     A string containing the JSON upload request
  */
-static const char* _pre_upload_request(const char *file_name, const char *file_type);
+static void _pre_upload_request(pb_json_writer_t *w, const char *file_name, const char *file_type);
 
 
 /**
@@ -98,6 +106,46 @@ static const char* _pre_upload_request(const char *file_name, const char *file_t
 static int _post_upload_request(char **file_url, char **upload_url, const char *ur_res);
 
 
+/**
+ * \brief      Get the size of the content of a file
+ *
+ * \return     0 if went well, otherwise there is an error
+ */
+static int _get_upload_size(const pb_file_t *file, size_t *size);
+
+
+/**
+ * \brief      Run the upload hook and check the size of a file before any request
+ *
+ * \param      file  The file informations structure
+ * \param[in]  user  The user
+ *
+ * \return     HTTP_OK if the file can be uploaded, HTTP_PAYLOAD_TOO_LARGE if it is over the maximum upload size,
+ *             otherwise HTTP_UNKNOWN_CODE
+ */
+static http_code_t _check_upload(pb_file_t *file, const pb_user_t *user);
+
+
+/**
+ * \brief      Hash the content of a file and reuse the URL of a previous upload of the same content
+ *
+ * \param      file  The file informations structure
+ * \param[in]  user  The user
+ *
+ * \return     1 if the URL has been reused, otherwise 0
+ */
+static int _lookup_upload_cache(pb_file_t *file, const pb_user_t *user);
+
+
+/**
+ * \brief      Remember the URL of an uploaded file
+ *
+ * \param[in]  file  The file informations structure
+ * \param[in]  user  The user
+ */
+static void _store_upload_cache(const pb_file_t *file, const pb_user_t *user);
+
+
 /**
  * \brief      Prepare an upload request structure
  *
@@ -132,6 +180,20 @@ static http_code_t _upload_request(char *result, pb_file_t *ur, const pb_user_t
 static http_code_t _send_request(char *result, const pb_file_t *ur, const pb_user_t *user);
 
 
+/**
+ * \brief      Push an uploaded file
+ *
+ * \param      result       The result
+ * \param      result_sz    The size of the result
+ * \param[in]  file         The file informations structure
+ * \param[in]  device_iden  The device identification (NULL for all the devices)
+ * \param[in]  user         The user
+ *
+ * \return     The HTTP status code to the \a pb_requests_post
+ */
+static http_code_t _push_uploaded_file(char *result, size_t *result_sz, const pb_file_t *file, const char *device_iden, const pb_user_t *user);
+
+
 /**
  * \brief      Free a file structure
  *
@@ -140,6 +202,162 @@ static http_code_t _send_request(char *result, const pb_file_t *ur, const pb_use
 static void _free_pb_file_t(pb_file_t *file);
 
 
+/**
+ * \brief      Run a stage of the multi-file push on a file
+ *
+ * \return     The HTTP status code of the stage
+ */
+static http_code_t _run_push_files_stage(pb_push_files_t *pipeline, size_t stage, size_t i);
+
+
+/**
+ * \brief      Worker of a stage of the multi-file push
+ *
+ * \param      arg   The stage (pb_push_files_stage_t)
+ */
+static void* _push_files_worker(void *arg);
+
+
+/**
+ * @struct pb_pushes_page_s
+ * @brief Download of one page of the push history
+ */
+typedef struct pb_pushes_page_s {
+    const pb_config_t *config;          ///< Configuration of the request
+    char url[MAX_SIZE_URL];          ///< Request URL of the page
+    char *result;          ///< Body of the response
+    size_t result_sz;          ///< Size of the body of the response
+    http_code_t code;          ///< HTTP status code of the response
+    pthread_t thread;          ///< Thread downloading the page
+    unsigned char started;          ///< Is the thread downloading the page?
+    atomic_uchar stop;          ///< Set when nobody waits for the page anymore: the download is aborted
+} pb_pushes_page_t;
+
+
+/**
+ * \brief      Allocate a page
+ *
+ * \param      config  The configuration of the requests
+ *
+ * \return     On success: the page. It has to be freed after.
+ * \return     On error: NULL
+ */
+static pb_pushes_page_t* _new_pushes_page(const pb_config_t *config);
+
+
+/**
+ * \brief      Free a page
+ *
+ * \param      page  The page (its download is over)
+ */
+static void _free_pushes_page(pb_pushes_page_t *page);
+
+
+/**
+ * \brief      Build the URL of a page of the push history
+ *
+ * \param      page            The page
+ * \param[in]  modified_after  The modified_after filter
+ * \param[in]  limit           The page size (0 for the server default)
+ * \param[in]  cursor          The cursor of the page (NULL for the first one)
+ *
+ * \return     0 if went well, otherwise there is an error
+ */
+static int _build_pushes_url(pb_pushes_page_t *page, double modified_after, size_t limit, const char *cursor);
+
+
+/**
+ * \brief      Download a page
+ *
+ * \param      page  The page
+ */
+static void _fetch_pushes_page(pb_pushes_page_t *page);
+
+
+/**
+ * \brief      Download a page (thread entry point)
+ *
+ * \param      arg   The page
+ *
+ * \return     NULL
+ */
+static void* _prefetch_pushes_thread(void *arg);
+
+
+/**
+ * \brief      Start the download of a page in the background
+ * \details    If the thread cannot be created, the page is downloaded synchronously.
+ *
+ * \param      page  The page
+ */
+static void _prefetch_pushes_page(pb_pushes_page_t *page);
+
+
+/**
+ * \brief      Wait for the download of a page
+ *
+ * \param      page  The page
+ */
+static void _wait_pushes_page(pb_pushes_page_t *page);
+
+
+/**
+ * \brief      Free a page nobody waits for
+ * \details    A download still running is aborted, and its thread joined, before the page is freed.
+ *
+ * \param      page  The page
+ */
+static void _discard_pushes_page(pb_pushes_page_t *page);
+
+
+/**
+ * \brief      Fill a push structure from a JSON member (json_object_foreach_member callback)
+ */
+static void _push_fill_from_json(JsonObject *object, const gchar *member_name, JsonNode *member_node, gpointer userdata);
+
+
+/**
+ * \brief      Parse a page and extract the cursor of the next one
+ *
+ * \param[in]  data      The page body
+ * \param[in]  data_sz   The page body size
+ * \param      cursor    The cursor of the next page (NULL if it is the last one). It has to be freed after.
+ *
+ * \return     On success: the parser holding the page. It has to be unreffed after.
+ * \return     On error: NULL
+ */
+static JsonParser* _parse_pushes_page(const char *data, size_t data_sz, char **cursor);
+
+
+/**
+ * \brief      Give the pushes of a parsed page to the callback
+ *
+ * \param      parser    The parser holding the page
+ * \param[in]  cb        The callback
+ * \param      userdata  The user data given to the callback
+ *
+ * \return     0 to continue, 1 if the callback asked to stop, -1 on error
+ */
+static int _dispatch_pushes_page(JsonParser *parser, pb_pushes_cb cb, void *userdata);
+
+
+/**
+ * @struct pb_pushes_sync_s
+ * @brief State of a synchronization of the pushes
+ */
+typedef struct pb_pushes_sync_s {
+    pb_pushes_cb cb;          ///< Callback of the caller
+    void *userdata;          ///< User data of the caller
+    double modified;          ///< Largest modification seen
+} pb_pushes_sync_t;
+
+
+/**
+ * \brief      Track the largest modification and forward the page to the caller
+ */
+static int _sync_pushes_page(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata);
+
+
 
 const char* pb_file_get_filepath(const pb_file_t* file)
 {
@@ -147,6 +365,90 @@ const char* pb_file_get_filepath(const pb_file_t* file)
 }
 
 
+const char* pb_file_get_filename(const pb_file_t* file)
+{
+    return (file) ? file->file_name : NULL;
+}
+
+
+const char* pb_file_get_filetype(const pb_file_t* file)
+{
+    return (file) ? file->file_type : NULL;
+}
+
+
+int pb_file_set_data(pb_file_t   *file,
+                     const void  *data,
+                     size_t      size,
+                     const char  *file_type
+                     )
+{
+    char    *type = NULL;
+
+    if ( (! file) || (! data) || (file_type && ((type = strdup(file_type)) == NULL)) )
+    {
+        return -1;
+    }
+
+    // The previous MIME type does not describe the new content
+    pb_free(file->file_type);
+    file->file_type = type;
+    file->data = data;
+    file->data_size = size;
+
+    return 0;
+}
+
+
+void pb_file_set_progress_callback(pb_file_t       *file,
+                                   pb_progress_cb  cb,
+                                   void            *userdata
+                                   )
+{
+    if ( file )
+    {
+        file->progress_cb = cb;
+        file->progress_userdata = userdata;
+    }
+}
+
+
+pb_progress_cb pb_file_get_progress_callback(const pb_file_t*  file,
+                                             void              **userdata
+                                             )
+{
+    if ( (! file) || (! file->progress_cb) )
+    {
+        return (NULL);
+    }
+
+    if ( userdata )
+    {
+        *userdata = file->progress_userdata;
+    }
+
+    return (file->progress_cb);
+}
+
+
+const void* pb_file_get_data(const pb_file_t*  file,
+                             size_t            *size
+                             )
+{
+    if ( (! file) || (! file->data) )
+    {
+        return (NULL);
+    }
+
+    if ( size )
+    {
+        *size = file->data_size;
+    }
+
+    return (file->data);
+}
+
+
 http_code_t pb_push_note(char            *result,
                          size_t          *result_sz,
                          const pb_note_t note,
@@ -154,12 +456,22 @@ http_code_t pb_push_note(char            *result,
                          const pb_user_t *user
                          )
 {
+    pb_json_writer_t    w;
     const char          *data   = NULL;
     unsigned short      res     = 0;
+    pb_devices_t        *devices = pb_user_acquire_devices(user);
 
 
-    // Create the JSON data
-    data    = _create_note(note.title, note.body, pb_user_get_device_iden_from_name(user, device_nickname) );
+    // Create the JSON data (the identification is copied by the writer)
+    pb_json_writer_init(&w, NULL, 0);
+    _create_note(&w, note.title, note.body, pb_devices_get_iden_from_name(devices, device_nickname) );
+    pb_devices_unref(devices);
+
+    if ( (data = pb_json_writer_get_data(&w)) == NULL )
+    {
+        pb_json_writer_release(&w);
+        return (HTTP_UNKNOWN_CODE);
+    }
 
 #ifdef __TRACES__
     iprintf("%s", data);
@@ -167,7 +479,9 @@ http_code_t pb_push_note(char            *result,
 
 
     // Send the datas
-    res     = pb_requests_post(result, result_sz, API_URL_PUSHES, pb_user_get_config(user), (char *) data);
+    res     = pb_requests_post(result, result_sz, API_URL_PUSHES, pb_user_get_config(user), data);
+
+    pb_json_writer_release(&w);
 
     if ( res != HTTP_OK )
     {
@@ -194,12 +508,22 @@ http_code_t pb_push_link(char            *result,
                             const pb_user_t *user
                             )
 {
+    pb_json_writer_t    w;
     const char          *data   = NULL;
     unsigned short      res     = 0;
+    pb_devices_t        *devices = pb_user_acquire_devices(user);
 
 
-    // Create the JSON data
-    data    = _create_link(link.title, link.body, link.url, pb_user_get_device_iden_from_name(user, device_nickname) );
+    // Create the JSON data (the identification is copied by the writer)
+    pb_json_writer_init(&w, NULL, 0);
+    _create_link(&w, link.title, link.body, link.url, pb_devices_get_iden_from_name(devices, device_nickname) );
+    pb_devices_unref(devices);
+
+    if ( (data = pb_json_writer_get_data(&w)) == NULL )
+    {
+        pb_json_writer_release(&w);
+        return (HTTP_UNKNOWN_CODE);
+    }
 
 #ifdef __TRACES__
     iprintf("%s", data);
@@ -207,7 +531,9 @@ http_code_t pb_push_link(char            *result,
 
 
     // Send the datas
-    res     = pb_requests_post(result, result_sz, API_URL_PUSHES, pb_user_get_config(user), (char *) data);
+    res     = pb_requests_post(result, result_sz, API_URL_PUSHES, pb_user_get_config(user), data);
+
+    pb_json_writer_release(&w);
 
     if ( res != HTTP_OK )
     {
@@ -233,285 +559,525 @@ http_code_t pb_push_file(char            *result,
                          const pb_user_t *user
                          )
 {
-    const char     *data = NULL;
-    unsigned short      res     = 0;
-
-
-    if ( _prepare_upload_request(file) != 0 )
-    {
-        return (1);
-    }
+    http_code_t     res = _check_upload(file, user);
+    pb_devices_t    *devices = NULL;
 
-    if ( _upload_request(result, file, user) != HTTP_OK )
+    // Nothing is sent for a file that the server would refuse
+    if ( res != HTTP_OK )
     {
-        return (3);
+        return (res);
     }
 
-    if ( _send_request(result, file, user) != HTTP_NO_CONTENT )
+    // The same content has already been uploaded: its URL is reused
+    if ( _lookup_upload_cache(file, user) == 0 )
     {
-        return (3);
-    }
-
-    data = _create_file(file->title,
-                        file->body,
-                        file->file_name,
-                        file->file_type,
-                        file->file_url,
-                        pb_user_get_device_iden_from_name(user, device_nickname) );
-
-#ifdef __TRACES__
-    iprintf("%s", data);
-#endif
+        if ( _prepare_upload_request(file) != 0 )
+        {
+            return (1);
+        }
 
+        if ( _upload_request(result, file, user) != HTTP_OK )
+        {
+            return (3);
+        }
 
-    // Send the datas
-    res     = pb_requests_post(result, result_sz, API_URL_PUSHES, pb_user_get_config(user), (char *) data);
+        if ( _send_request(result, file, user) != HTTP_NO_CONTENT )
+        {
+            return (3);
+        }
 
-    if ( res != HTTP_OK )
-    {
-        eprintf("An error occured when sending the note (HTTP status code : %d)", res);
-        eprintf("%s", result);
-    }
-#ifdef __TRACES__
-    else
-    {
-        gprintf("\e[1;37m%u\e[0m %s", res, result);
+        _store_upload_cache(file, user);
     }
-#endif
+
+    // The snapshot keeps the identification alive while the file is pushed
+    devices = pb_user_acquire_devices(user);
+    res = _push_uploaded_file(result, result_sz, file, pb_devices_get_iden_from_name(devices, device_nickname), user);
+    pb_devices_unref(devices);
 
     return (res);
 }
 
 
 
-static const char* _create_note(const char  *title,
-                                const char  *body,
-                                const char  *device_iden
-                                )
+http_code_t pb_push_files(pb_file_t       **files,
+                          size_t          nb_files,
+                          http_code_t     *results,
+                          const char      *device_nickname,
+                          const pb_user_t *user
+                          )
 {
-    JsonGenerator* parser = json_generator_new();
-    JsonNode       *root = NULL;
-    JsonObject     *obj       = json_object_new();
-    char* res = NULL;
-
+    const size_t        nb_workers[PUSH_FILES_NB_STAGES] = {
+        PUSH_FILES_REQUEST_WORKERS, PUSH_FILES_UPLOAD_WORKERS, PUSH_FILES_PUSH_WORKERS
+    };
+    pb_push_files_t     pipeline;
+    http_code_t         res = HTTP_OK;
+    size_t              i = 0;
+    size_t              k = 0;
+
+    if ( (! files) || (! results) || (nb_files == 0) )
+    {
+        return (HTTP_UNKNOWN_CODE);
+    }
 
-    // Add type
-    json_object_set_string_member(obj, "type", "note");
+    memset(&pipeline, 0, sizeof(pipeline) );
+    pipeline.files = files;
+    pipeline.results = results;
+    pipeline.nb_files = nb_files;
+    pipeline.user = user;
+    pipeline.devices = pb_user_acquire_devices(user);
+    pipeline.device_iden = pb_devices_get_iden_from_name(pipeline.devices, device_nickname);
+    pthread_mutex_init(&pipeline.mtx, NULL);
 
-    // Add title
-    if ( title )
+    for ( i = 0; i < nb_files; i++ )
     {
-        json_object_set_string_member(obj, "title", title);
+        results[i] = HTTP_UNKNOWN_CODE;
     }
 
-    // Add body
-    if ( body )
+    for ( k = 0; k < PUSH_FILES_NB_STAGES; k++ )
     {
-        json_object_set_string_member(obj, "body", body);
+        pipeline.stages[k].pipeline = &pipeline;
+        pipeline.stages[k].index = k;
+        pipeline.stages[k].nb_expected = nb_files;
+        pthread_cond_init(&pipeline.stages[k].cond, NULL);
+
+        if ( (pipeline.stages[k].queue = calloc(nb_files, sizeof(size_t))) == NULL )
+        {
+            eprintf("Not enough memory to push %zu files", nb_files);
+            res = HTTP_UNKNOWN_CODE;
+        }
     }
 
-    // Add device_iden
-    if ( device_iden )
+    if ( res == HTTP_OK )
     {
-        json_object_set_string_member(obj, "device_iden", device_iden);
-    }
+        // Every file starts at the first stage
+        for ( i = 0; i < nb_files; i++ )
+        {
+            pipeline.stages[0].queue[i] = i;
+        }
+
+        pipeline.stages[0].nb_queued = nb_files;
+
+        for ( k = 0; k < PUSH_FILES_NB_STAGES; k++ )
+        {
+            for ( i = 0; (i < nb_workers[k]) && (i < nb_files); i++ )
+            {
+                if ( pthread_create(&pipeline.stages[k].threads[i], NULL, _push_files_worker, &pipeline.stages[k]) != 0 )
+                {
+                    break;
+                }
+
+                pipeline.stages[k].nb_threads++;
+            }
+        }
 
-    root = json_node_init_object(json_node_alloc (), obj);
+        // A stage without any thread runs in the calling thread, once the previous stages are started or done
+        for ( k = 0; k < PUSH_FILES_NB_STAGES; k++ )
+        {
+            if ( pipeline.stages[k].nb_threads == 0 )
+            {
+                _push_files_worker(&pipeline.stages[k]);
+            }
+        }
 
-    // The node is copied by the generator object, so it can be safely freed after calling this function.
-    json_generator_set_root(parser, root);
+        for ( k = 0; k < PUSH_FILES_NB_STAGES; k++ )
+        {
+            for ( i = 0; i < pipeline.stages[k].nb_threads; i++ )
+            {
+                pthread_join(pipeline.stages[k].threads[i], NULL);
+            }
+        }
 
-    // So, free the node
-    json_node_free(root);
+        for ( i = 0; (i < nb_files) && (res == HTTP_OK); i++ )
+        {
+            res = results[i];
+        }
+    }
 
-    // Returns : a newly allocated buffer holding a JSON data stream. Use g_free() to free the allocated resources.
-    res = json_generator_to_data(parser, NULL);
+    for ( k = 0; k < PUSH_FILES_NB_STAGES; k++ )
+    {
+        pb_free(pipeline.stages[k].queue);
+        pthread_cond_destroy(&pipeline.stages[k].cond);
+    }
 
-    g_free(parser);
+    pthread_mutex_destroy(&pipeline.mtx);
+    pb_devices_unref(pipeline.devices);
 
-    // Return the JSON as a string
     return (res);
 }
 
 
 
-static const char* _create_link(const char  *title,
-                                const char  *body,
-                                const char  *url,
-                                const char  *device_iden
-                                )
+pb_file_t* pb_file_new(const char *file_path,
+                       const char *title,
+                       const char *body
+                       )
 {
-    JsonGenerator* parser = json_generator_new();
-    JsonNode       *root = NULL;
-    JsonObject     *obj       = json_object_new();
-    const char* res = NULL;
+    pb_file_t   *file = NULL;
+    char        *path = NULL;
 
+    if ( ! file_path )
+    {
+        return (NULL);
+    }
 
-    // If we do not have an URL, it is simply a note, so we send one
-    if ( url == NULL )
+    if ( (file = calloc(1, sizeof(pb_file_t))) == NULL )
     {
-        res = _create_note(title, body, device_iden);
+        return (NULL);
     }
-    else
+
+    file->file_path = strdup(file_path);
+    file->title = (title) ? strdup(title) : NULL;
+    file->body = (body) ? strdup(body) : NULL;
+
+    // basename may modify its argument
+    if ( (path = strdup(file_path)) != NULL )
     {
-        // Add type
-        json_object_set_string_member(obj, "type", "link");
+        file->file_name = strdup(basename(path) );
+        free(path);
+    }
 
-        // Add title
-        if ( title )
-        {
-            json_object_set_string_member(obj, "title", title);
-        }
+    if ( (! file->file_path) || (! file->file_name) || (title && (! file->title)) || (body && (! file->body)) )
+    {
+        pb_file_free(file);
+        return (NULL);
+    }
 
-        // Add body
-        if ( body )
-        {
-            json_object_set_string_member(obj, "body", body);
-        }
+    return (file);
+}
 
-        // Add url
-        if ( url )
-        {
-            json_object_set_string_member(obj, "url", url);
-        }
 
-        // Add device_iden
-        if ( device_iden )
-        {
-            json_object_set_string_member(obj, "device_iden", device_iden);
-        }
 
-        root = json_node_init_object(json_node_alloc (), obj);
+pb_file_t* pb_file_new_from_buffer(const void *data,
+                                   size_t     size,
+                                   const char *file_name,
+                                   const char *file_type,
+                                   const char *title,
+                                   const char *body
+                                   )
+{
+    pb_file_t   *file = NULL;
 
-        // The node is copied by the generator object, so it can be safely freed after calling this function.
-        json_generator_set_root(parser, root);
+    if ( (! data) || (! file_name) )
+    {
+        return (NULL);
+    }
 
-        // So, free the node
-        json_node_free(root);
+    if ( (file = calloc(1, sizeof(pb_file_t))) == NULL )
+    {
+        return (NULL);
+    }
 
-        // Returns : a newly allocated buffer holding a JSON data stream. Use g_free() to free the allocated resources.
-        res = json_generator_to_data(parser, NULL);
+    // The content is not copied: it is read from the caller memory during the upload
+    file->data = data;
+    file->data_size = size;
+    file->file_name = strdup(file_name);
+    file->file_type = (file_type) ? strdup(file_type) : NULL;
+    file->title = (title) ? strdup(title) : NULL;
+    file->body = (body) ? strdup(body) : NULL;
 
-        g_free(parser);
+    if ( (! file->file_name) || (file_type && (! file->file_type)) || (title && (! file->title)) || (body && (! file->body)) )
+    {
+        pb_file_free(file);
+        return (NULL);
     }
 
-    // Return the JSON as a string
-    return (res);
+    return (file);
 }
 
 
 
-static const char* _create_file(const char  *title,
-                                const char  *body,
-                                const char  *file_name,
-                                const char  *file_type,
-                                const char  *file_url,
-                                const char  *device_iden
-                                )
+void pb_file_free(pb_file_t *file)
 {
-    JsonGenerator* parser = json_generator_new();
-    JsonNode       *root = NULL;
-    JsonObject     *obj       = json_object_new();
-    const char* res = NULL;
-
-
-    // If we do not have an URL, it is simply a note, so we send one
-    if ( (! file_name) && (! file_type) )
+    if ( file )
     {
-        res =_create_note(title, body, device_iden);
+        _free_pb_file_t(file);
+        free(file);
     }
+}
+
+
+
+const char* pb_file_get_url(const pb_file_t* file)
+{
+    return (file) ? file->file_url : NULL;
+}
+
+
+
+static http_code_t _push_uploaded_file(char            *result,
+                                       size_t          *result_sz,
+                                       const pb_file_t *file,
+                                       const char      *device_iden,
+                                       const pb_user_t *user
+                                       )
+{
+    pb_json_writer_t    w;
+    const char          *data = NULL;
+    unsigned short      res     = 0;
+
+
+    pb_json_writer_init(&w, NULL, 0);
+    _create_file(&w,
+                 file->title,
+                 file->body,
+                 file->file_name,
+                 file->file_type,
+                 file->file_url,
+                 device_iden);
+
+    if ( (data = pb_json_writer_get_data(&w)) == NULL )
+    {
+        pb_json_writer_release(&w);
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+#ifdef __TRACES__
+    iprintf("%s", data);
+#endif
+
+
+    // Send the datas
+    res     = pb_requests_post(result, result_sz, API_URL_PUSHES, pb_user_get_config(user), data);
+
+    pb_json_writer_release(&w);
+
+    if ( res != HTTP_OK )
+    {
+        eprintf("An error occured when sending the note (HTTP status code : %d)", res);
+        eprintf("%s", result);
+    }
+#ifdef __TRACES__
     else
     {
-        // Add type
-        json_object_set_string_member(obj, "type", "link");
+        gprintf("\e[1;37m%u\e[0m %s", res, result);
+    }
+#endif
 
-        // Add title
-        if ( title )
-        {
-            json_object_set_string_member(obj, "title", title);
-        }
+    return (res);
+}
+
+
+
+static http_code_t _run_push_files_stage(pb_push_files_t *pipeline,
+                                         size_t          stage,
+                                         size_t          i
+                                         )
+{
+    char            result[PUSH_FILES_RESULT_SIZE] = {0};
+    size_t          result_sz = 0;
+    pb_file_t       *file = pipeline->files[i];
+    http_code_t     res = HTTP_UNKNOWN_CODE;
+
+    switch ( stage )
+    {
+        case PUSH_FILES_STAGE_REQUEST:
+            if ( (res = _check_upload(file, pipeline->user)) != HTTP_OK )
+            {
+                break;
+            }
+
+            // The upload stage is skipped by a file already uploaded
+            if ( _lookup_upload_cache(file, pipeline->user) == 1 )
+            {
+                break;
+            }
+
+            res = HTTP_UNKNOWN_CODE;
+
+            if ( _prepare_upload_request(file) == 0 )
+            {
+                res = _upload_request(result, file, pipeline->user);
+                res = ((res == HTTP_OK) && (! file->upload_url)) ? HTTP_UNKNOWN_CODE : res;
+            }
+            break;
+
+        case PUSH_FILES_STAGE_UPLOAD:
+            res = _send_request(result, file, pipeline->user);
+
+            if ( res == HTTP_NO_CONTENT )
+            {
+                _store_upload_cache(file, pipeline->user);
+                res = HTTP_OK;
+            }
+            break;
+
+        case PUSH_FILES_STAGE_PUSH:
+            res = _push_uploaded_file(result, &result_sz, file, pipeline->device_iden, pipeline->user);
+            break;
+
+        default:
+            break;
+    }
+
+    return (res);
+}
 
-        // Add body
-        if ( body )
-        {
-            json_object_set_string_member(obj, "body", body);
-        }
 
-        // Add file_name
-        if ( file_name )
+
+static void* _push_files_worker(void *arg)
+{
+    pb_push_files_stage_t   *stage = (pb_push_files_stage_t *) arg;
+    pb_push_files_t         *pipeline = stage->pipeline;
+    pb_push_files_stage_t   *next = NULL;
+    http_code_t             res = HTTP_UNKNOWN_CODE;
+    size_t                  i = 0;
+    size_t                  k = 0;
+
+    pthread_mutex_lock(&pipeline->mtx);
+
+    for ( ; ; )
+    {
+        while ( (stage->nb_queued == 0) && (stage->nb_expected > 0) )
         {
-            json_object_set_string_member(obj, "file_name", file_name);
+            pthread_cond_wait(&stage->cond, &pipeline->mtx);
         }
 
-        // Add file_type
-        if ( file_type )
+        if ( stage->nb_queued == 0 )
         {
-            json_object_set_string_member(obj, "file_type", file_type);
+            break;
         }
 
-        // Add file_url
-        if ( file_url )
+        i = stage->queue[stage->head];
+        stage->head = (stage->head + 1) % pipeline->nb_files;
+        stage->nb_queued--;
+        stage->nb_expected--;
+
+        pthread_mutex_unlock(&pipeline->mtx);
+
+        res = _run_push_files_stage(pipeline, stage->index, i);
+
+        pthread_mutex_lock(&pipeline->mtx);
+
+        if ( (res == HTTP_OK) && (stage->index + 1 < PUSH_FILES_NB_STAGES) )
         {
-            json_object_set_string_member(obj, "file_url", file_url);
+            next = &pipeline->stages[stage->index + 1];
+
+            if ( (next->index == PUSH_FILES_STAGE_UPLOAD) && pipeline->files[i]->upload_cached )
+            {
+                next->nb_expected--;
+                pthread_cond_broadcast(&next->cond);
+                next = &pipeline->stages[PUSH_FILES_STAGE_PUSH];
+            }
+
+            // Hand the file over to the next stage
+            next->queue[(next->head + next->nb_queued) % pipeline->nb_files] = i;
+            next->nb_queued++;
+            pthread_cond_signal(&next->cond);
         }
-
-        // Add device_iden
-        if ( device_iden )
+        else
         {
-            json_object_set_string_member(obj, "device_iden", device_iden);
+            pipeline->results[i] = res;
+
+            // A failed file never reaches the next stages
+            for ( k = stage->index + 1; k < PUSH_FILES_NB_STAGES; k++ )
+            {
+                pipeline->stages[k].nb_expected--;
+                pthread_cond_broadcast(&pipeline->stages[k].cond);
+            }
         }
+    }
+
+    // Wake up the other workers of the stage so they can end too
+    pthread_cond_broadcast(&stage->cond);
 
-        root = json_node_init_object(json_node_alloc (), obj);
+    pthread_mutex_unlock(&pipeline->mtx);
 
-        // The node is copied by the generator object, so it can be safely freed after calling this function.
-        json_generator_set_root(parser, root);
+    return (NULL);
+}
 
-        // So, free the node
-        json_node_free(root);
 
-        // Returns : a newly allocated buffer holding a JSON data stream. Use g_free() to free the allocated resources.
-        res = json_generator_to_data(parser, NULL);
 
-        g_free(parser);
-    }
+static void _create_note(pb_json_writer_t *w,
+                         const char       *title,
+                         const char       *body,
+                         const char       *device_iden
+                         )
+{
+    pb_json_object_begin(w);
 
-    // Return the JSON as a string
-    return res;
+    // Add type, title, body and device_iden (NULL values are skipped)
+    pb_json_add_string(w, "type", "note");
+    pb_json_add_string(w, "title", title);
+    pb_json_add_string(w, "body", body);
+    pb_json_add_string(w, "device_iden", device_iden);
+
+    pb_json_object_end(w);
 }
 
 
 
-static const char* _pre_upload_request(const char   *file_name,
-                                       const char   *file_type
-                                       )
+static void _create_link(pb_json_writer_t *w,
+                         const char       *title,
+                         const char       *body,
+                         const char       *url,
+                         const char       *device_iden
+                         )
 {
-    JsonGenerator* parser = json_generator_new();
-    JsonNode       *root = NULL;
-    JsonObject     *obj       = json_object_new();
-    char* res = NULL;
+    // If we do not have an URL, it is simply a note, so we send one
+    if ( url == NULL )
+    {
+        _create_note(w, title, body, device_iden);
+        return;
+    }
 
-    // Add title
-    if ( file_name && file_type )
+    pb_json_object_begin(w);
+
+    pb_json_add_string(w, "type", "link");
+    pb_json_add_string(w, "title", title);
+    pb_json_add_string(w, "body", body);
+    pb_json_add_string(w, "url", url);
+    pb_json_add_string(w, "device_iden", device_iden);
+
+    pb_json_object_end(w);
+}
+
+
+
+static void _create_file(pb_json_writer_t *w,
+                         const char       *title,
+                         const char       *body,
+                         const char       *file_name,
+                         const char       *file_type,
+                         const char       *file_url,
+                         const char       *device_iden
+                         )
+{
+    // If we do not have a file, it is simply a note, so we send one
+    if ( (! file_name) && (! file_type) )
     {
-        json_object_set_string_member(obj, "file_name", file_name);
-        json_object_set_string_member(obj, "file_type", file_type);
+        _create_note(w, title, body, device_iden);
+        return;
+    }
+
+    pb_json_object_begin(w);
 
-        root = json_node_init_object(json_node_alloc (), obj);
+    pb_json_add_string(w, "type", "file");
+    pb_json_add_string(w, "title", title);
+    pb_json_add_string(w, "body", body);
+    pb_json_add_string(w, "file_name", file_name);
+    pb_json_add_string(w, "file_type", file_type);
+    pb_json_add_string(w, "file_url", file_url);
+    pb_json_add_string(w, "device_iden", device_iden);
 
-        // The node is copied by the generator object, so it can be safely freed after calling this function.
-        json_generator_set_root(parser, root);
+    pb_json_object_end(w);
+}
 
-        // So, free the node
-        json_node_free(root);
 
-        // Returns : a newly allocated buffer holding a JSON data stream. Use g_free() to free the allocated resources.
-        res = json_generator_to_data(parser, NULL);
 
-        g_free(parser);
+static void _pre_upload_request(pb_json_writer_t *w,
+                                const char       *file_name,
+                                const char       *file_type
+                                )
+{
+    pb_json_object_begin(w);
+
+    if ( file_name && file_type )
+    {
+        pb_json_add_string(w, "file_name", file_name);
+        pb_json_add_string(w, "file_type", file_type);
     }
 
-    // Return the JSON as a string
-    return (res);
+    pb_json_object_end(w);
 }
 
 
@@ -552,34 +1118,165 @@ static int _post_upload_request(char          **file_url,
     return ret;
 }
 
-static int _prepare_upload_request(pb_file_t *file)
+static int _get_upload_size(const pb_file_t   *file,
+                            size_t            *size
+                            )
 {
-    int ret = -1;
-    magic_t magic_cookie;
+    struct stat st;
 
-    // MAGIC_MIME_TYPE tells magic to return a mime of the file
-    if ((magic_cookie = magic_open(MAGIC_MIME_TYPE)) == NULL)
+    if ( file->data )
     {
-        eprintf("Unable to initialize magic library");
+        *size = file->data_size;
+        return 0;
     }
-    else
+
+    if ( (! file->file_path) || (stat(file->file_path, &st) != 0) )
+    {
+        eprintf("Cannot get the size of %s", (file->file_path) ? file->file_path : "(null)");
+        return -1;
+    }
+
+    *size = (size_t) st.st_size;
+    return 0;
+}
+
+
+
+static http_code_t _check_upload(pb_file_t       *file,
+                                 const pb_user_t *user
+                                 )
+{
+    size_t              size = 0;
+    size_t              max_size = pb_user_get_max_upload_size(user);
+    void                *userdata = NULL;
+    pb_upload_hook_cb   hook = pb_config_get_upload_hook(pb_user_get_config(user), &userdata);
+
+    if ( _get_upload_size(file, &size) != 0 )
     {
-        if ( magic_load(magic_cookie, NULL) != 0 )
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    if ( hook )
+    {
+        if ( hook(file, size, max_size, userdata) != 0 )
         {
-            eprintf("Impossible to load magic database - %s", magic_error(magic_cookie));
+            eprintf("The push of %s has been cancelled by the upload hook", file->file_name);
+            return (HTTP_UNKNOWN_CODE);
         }
-        else
+
+        // The hook may have replaced the content
+        if ( _get_upload_size(file, &size) != 0 )
         {
-            file->file_type = strdup(magic_file(magic_cookie, file->file_path));
-            ret = 0;
-            #ifdef __TRACES__
-            gprintf("%s", file->file_type);
-            #endif
+            return (HTTP_UNKNOWN_CODE);
         }
-        magic_close(magic_cookie);
     }
 
-    return ret;
+    if ( (max_size > 0) && (size > max_size) )
+    {
+        eprintf("%s is too large: %zu bytes for a maximum of %zu bytes", file->file_name, size, max_size);
+        return (HTTP_PAYLOAD_TOO_LARGE);
+    }
+
+    return (HTTP_OK);
+}
+
+
+
+static int _lookup_upload_cache(pb_file_t       *file,
+                                const pb_user_t *user
+                                )
+{
+    pb_upload_cache_t   *cache = pb_config_get_upload_cache(pb_user_get_config(user) );
+    char                *file_url = NULL;
+    char                *file_type = NULL;
+
+    file->has_digest = 0;
+    file->upload_cached = 0;
+
+    if ( ! cache )
+    {
+        return 0;
+    }
+
+    // A single pass over the content: the upload reads it again from memory or from the page cache
+    if ( file->data )
+    {
+        pb_sha256(file->data, file->data_size, file->digest);
+    }
+    else if ( pb_sha256_file(file->file_path, file->digest) != 0 )
+    {
+        pb_upload_cache_unref(cache);
+        return 0;
+    }
+
+    file->has_digest = 1;
+
+    if ( pb_upload_cache_lookup(cache, file->digest, &file_url, &file_type) != 0 )
+    {
+        pb_upload_cache_unref(cache);
+        return 0;
+    }
+
+    pb_upload_cache_unref(cache);
+
+    pb_free(file->file_url);
+    file->file_url = file_url;
+
+    if ( file->file_type )
+    {
+        pb_free(file_type);
+    }
+    else
+    {
+        file->file_type = file_type;
+    }
+
+    #ifdef __TRACES__
+    gprintf("%s already uploaded: %s", file->file_name, file->file_url);
+    #endif
+
+    file->upload_cached = 1;
+
+    return 1;
+}
+
+
+
+static void _store_upload_cache(const pb_file_t *file,
+                                const pb_user_t *user
+                                )
+{
+    pb_upload_cache_t   *cache = pb_config_get_upload_cache(pb_user_get_config(user) );
+
+    if ( cache && file->has_digest && file->file_url )
+    {
+        pb_upload_cache_insert(cache, file->digest, file->file_url, file->file_type);
+    }
+
+    pb_upload_cache_unref(cache);
+}
+
+
+
+static int _prepare_upload_request(pb_file_t *file)
+{
+    // The MIME type given by the caller or detected by a previous push is kept
+    if ( file->file_type )
+    {
+        return 0;
+    }
+
+    // The magic database is only loaded when a cookie is created, not for each file
+    if ( file->data )
+    {
+        file->file_type = pb_mime_get_buffer_type(file->data, file->data_size);
+    }
+    else
+    {
+        file->file_type = pb_mime_get_file_type(file->file_path);
+    }
+
+    return (file->file_type) ? 0 : -1;
 }
 
 
@@ -589,16 +1286,26 @@ static http_code_t _upload_request(char              *result,
                                    const pb_user_t   *user
                                    )
 {
+    pb_json_writer_t    w;
     const char      *data   = NULL;
     short           res     = 0;
     size_t          result_sz = 0;
 
 
     // JSON objects
-    data    = _pre_upload_request(file->file_name, file->file_type);
+    pb_json_writer_init(&w, NULL, 0);
+    _pre_upload_request(&w, file->file_name, file->file_type);
+
+    if ( (data = pb_json_writer_get_data(&w)) == NULL )
+    {
+        pb_json_writer_release(&w);
+        return (HTTP_UNKNOWN_CODE);
+    }
 
     res     = pb_requests_post(result, &result_sz, API_URL_FILE_REQUEST, pb_user_get_config(user), data);
 
+    pb_json_writer_release(&w);
+
     if ( res != HTTP_OK )
     {
         eprintf("An error occured when sending the upload-request (HTTP status code : %d)", res);
@@ -656,6 +1363,462 @@ static void _free_pb_file_t(pb_file_t *file)
     pb_free(file->body);
     pb_free(file->file_path);
     pb_free(file->file_name);
+    pb_free(file->file_type);
     pb_free(file->file_url);
     pb_free(file->upload_url);
 }
+
+
+
+unsigned char pb_push_is_active(const pb_push_t *push)
+{
+    return (push) ? push->active : 0;
+}
+
+
+unsigned char pb_push_is_dismissed(const pb_push_t *push)
+{
+    return (push) ? push->dismissed : 0;
+}
+
+
+const char* pb_push_get_iden(const pb_push_t *push)
+{
+    return (push) ? push->iden : NULL;
+}
+
+
+const char* pb_push_get_type(const pb_push_t *push)
+{
+    return (push) ? push->type : NULL;
+}
+
+
+const char* pb_push_get_title(const pb_push_t *push)
+{
+    return (push) ? push->title : NULL;
+}
+
+
+const char* pb_push_get_body(const pb_push_t *push)
+{
+    return (push) ? push->body : NULL;
+}
+
+
+const char* pb_push_get_direction(const pb_push_t *push)
+{
+    return (push) ? push->direction : NULL;
+}
+
+
+const char* pb_push_get_sender_name(const pb_push_t *push)
+{
+    return (push) ? push->sender_name : NULL;
+}
+
+
+double pb_push_get_created(const pb_push_t *push)
+{
+    return (push) ? push->created : 0;
+}
+
+
+double pb_push_get_modified(const pb_push_t *push)
+{
+    return (push) ? push->modified : 0;
+}
+
+
+http_code_t pb_pushes_retrieve(const pb_user_t *user,
+                               double          modified_after,
+                               size_t          limit,
+                               pb_pushes_cb    cb,
+                               void            *userdata
+                               )
+{
+    pb_pushes_page_t    *cur = NULL;
+    pb_pushes_page_t    *next = NULL;
+    pb_pushes_page_t    *tmp = NULL;
+    JsonParser          *parser = NULL;
+    char                *cursor = NULL;
+    http_code_t         res = HTTP_UNKNOWN_CODE;
+    int                 stop = 0;
+
+    if ( (! user) || (! cb) )
+    {
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    cur = _new_pushes_page(pb_user_get_config(user) );
+    next = _new_pushes_page(pb_user_get_config(user) );
+
+    if ( (! cur) || (! next) )
+    {
+        res = HTTP_INSUFFICIENT_STORAGE;
+        stop = 1;
+    }
+    else if ( _build_pushes_url(cur, modified_after, limit, NULL) != 0 )
+    {
+        res = HTTP_URI_TOO_LONG;
+        stop = 1;
+    }
+    else
+    {
+        _fetch_pushes_page(cur);
+    }
+
+    while ( stop == 0 )
+    {
+        if ( (res = cur->code) != HTTP_OK )
+        {
+            eprintf("An error occured when retrieving the pushes (HTTP status code : %d)", res);
+            break;
+        }
+
+        parser = _parse_pushes_page(cur->result, cur->result_sz, &cursor);
+        pb_free(cur->result);
+
+        if ( ! parser )
+        {
+            res = HTTP_UNPROCESSABLE_ENTITY;
+            break;
+        }
+
+        // The cursor is known as soon as the page is parsed: the next page is downloaded while the pushes of the
+        // current one are given to the callback.
+        if ( cursor )
+        {
+            if ( _build_pushes_url(next, modified_after, limit, cursor) == 0 )
+            {
+                _prefetch_pushes_page(next);
+            }
+            else
+            {
+                res = HTTP_URI_TOO_LONG;
+                stop = 1;
+            }
+            pb_free(cursor);
+        }
+        else
+        {
+            stop = 1;
+        }
+
+        switch ( _dispatch_pushes_page(parser, cb, userdata) )
+        {
+            case 0:
+                break;
+
+            case 1:
+                stop = 1;
+                break;
+
+            default:
+                res = HTTP_INSUFFICIENT_STORAGE;
+                stop = 1;
+                break;
+        }
+
+        g_object_unref(parser);
+
+        // Nothing more is given to the callback: the page being downloaded is aborted
+        if ( stop )
+        {
+            break;
+        }
+
+        _wait_pushes_page(next);
+
+        tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+
+    _free_pushes_page(cur);
+    _discard_pushes_page(next);
+
+    return (res);
+}
+
+
+
+http_code_t pb_pushes_sync(const pb_user_t *user,
+                           double          *watermark,
+                           pb_pushes_cb    cb,
+                           void            *userdata
+                           )
+{
+    http_code_t         res = HTTP_UNKNOWN_CODE;
+    pb_pushes_sync_t    sync = { .cb = cb, .userdata = userdata, .modified = 0 };
+
+    if ( (! watermark) || (! cb) )
+    {
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    sync.modified = *watermark;
+
+    // The pages come from the most recent modification to the oldest one: the watermark can only be raised once
+    // everything has been applied.
+    res = pb_pushes_retrieve(user, *watermark, 0, _sync_pushes_page, &sync);
+
+    if ( (res == HTTP_OK) && (sync.cb != NULL) )
+    {
+        *watermark = sync.modified;
+    }
+
+    return (res);
+}
+
+
+
+static int _sync_pushes_page(const pb_push_t *const *pushes,
+                             size_t                 nb_pushes,
+                             void                   *userdata
+                             )
+{
+    pb_pushes_sync_t    *sync = (pb_pushes_sync_t *) userdata;
+    size_t              i = 0;
+
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        if ( pushes[i]->modified > sync->modified )
+        {
+            sync->modified = pushes[i]->modified;
+        }
+    }
+
+    if ( sync->cb(pushes, nb_pushes, sync->userdata) != 0 )
+    {
+        // Stopped by the caller: do not raise the watermark
+        sync->cb = NULL;
+        return (1);
+    }
+
+    return (0);
+}
+
+
+
+static int _build_pushes_url(pb_pushes_page_t *page,
+                             double           modified_after,
+                             size_t           limit,
+                             const char       *cursor
+                             )
+{
+    char    *escaped = NULL;
+    int     len = 0;
+
+    len = snprintf(page->url, sizeof(page->url), "%s?modified_after=%.17g", API_URL_PUSHES, modified_after);
+
+    if ( (len > 0) && ((size_t) len < sizeof(page->url)) && (limit > 0) )
+    {
+        len += snprintf(page->url + len, sizeof(page->url) - len, "&limit=%zu", limit);
+    }
+
+    if ( (len > 0) && ((size_t) len < sizeof(page->url)) && cursor )
+    {
+        if ( (escaped = curl_easy_escape(NULL, cursor, 0)) == NULL )
+        {
+            return (-1);
+        }
+
+        len += snprintf(page->url + len, sizeof(page->url) - len, "&cursor=%s", escaped);
+        curl_free(escaped);
+    }
+
+    return ( (len > 0) && ((size_t) len < sizeof(page->url)) ) ? 0 : -1;
+}
+
+
+
+static pb_pushes_page_t* _new_pushes_page(const pb_config_t *config)
+{
+    pb_pushes_page_t *page = calloc(1, sizeof(pb_pushes_page_t));
+
+    if ( ! page )
+    {
+        eprintf("Not enough memory to download a page of pushes");
+        return (NULL);
+    }
+
+    page->config = config;
+    atomic_init(&page->stop, 0);
+
+    return (page);
+}
+
+
+
+static void _free_pushes_page(pb_pushes_page_t *page)
+{
+    if ( page )
+    {
+        pb_free(page->result);
+        free(page);
+    }
+}
+
+
+
+static void _fetch_pushes_page(pb_pushes_page_t *page)
+{
+    page->result_sz = 0;
+    page->code = pb_requests_get_abortable(&page->result, &page->result_sz, page->url, page->config, &page->stop);
+}
+
+
+
+static void* _prefetch_pushes_thread(void *arg)
+{
+    _fetch_pushes_page( (pb_pushes_page_t *) arg);
+
+    return (NULL);
+}
+
+
+
+static void _prefetch_pushes_page(pb_pushes_page_t *page)
+{
+    page->started = (pthread_create(&page->thread, NULL, _prefetch_pushes_thread, page) == 0);
+
+    if ( ! page->started )
+    {
+        _fetch_pushes_page(page);
+    }
+}
+
+
+
+static void _wait_pushes_page(pb_pushes_page_t *page)
+{
+    if ( page->started )
+    {
+        pthread_join(page->thread, NULL);
+        page->started = 0;
+    }
+}
+
+
+
+static void _discard_pushes_page(pb_pushes_page_t *page)
+{
+    if ( page )
+    {
+        // The download ends at the next progress call of libcurl
+        atomic_store(&page->stop, 1);
+        _wait_pushes_page(page);
+    }
+
+    _free_pushes_page(page);
+}
+
+
+
+static void _push_fill_from_json(JsonObject *object __attribute__((unused)),
+                                 const gchar *member_name,
+                                 JsonNode *member_node,
+                                 gpointer userdata
+                                 )
+{
+    // The strings stay owned by the JSON nodes
+    pb_schema_fill(PB_SCHEMA_PUSH, userdata, member_name, member_node, NULL);
+}
+
+
+
+static JsonParser* _parse_pushes_page(const char  *data,
+                                      size_t      data_sz,
+                                      char        **cursor
+                                      )
+{
+    JsonParser      *parser = json_parser_new();
+    JsonNode        *root = NULL;
+    JsonObject      *obj = NULL;
+    const char      *next = NULL;
+
+    *cursor = NULL;
+
+    if ( (! data) || (! json_parser_load_from_data(parser, data, data_sz, NULL)) )
+    {
+        eprintf("Impossible to parse the pushes page");
+    }
+    else if ( ((root = json_parser_get_root(parser)) == NULL) || (! JSON_NODE_HOLDS_OBJECT(root)) )
+    {
+        eprintf("The pushes page does not contain a JsonObject");
+    }
+    else
+    {
+        obj = json_node_get_object(root);
+
+        if ( json_object_has_member(obj, JSON_KEY_CURSOR) &&
+             ((next = json_object_get_string_member(obj, JSON_KEY_CURSOR)) != NULL) &&
+             (next[0] != '\0') )
+        {
+            *cursor = strdup(next);
+        }
+
+        return (parser);
+    }
+
+    g_object_unref(parser);
+
+    return (NULL);
+}
+
+
+
+static int _dispatch_pushes_page(JsonParser      *parser,
+                                 pb_pushes_cb    cb,
+                                 void            *userdata
+                                 )
+{
+    int             ret = -1;
+    guint           i = 0;
+    guint           nb = 0;
+    JsonObject      *obj = json_node_get_object(json_parser_get_root(parser) );
+    JsonArray       *arr = NULL;
+    JsonNode        *elt = NULL;
+    pb_push_t       *pushes = NULL;
+    const pb_push_t **ptrs = NULL;
+
+    if ( json_object_has_member(obj, JSON_KEY_PUSHES) &&
+         JSON_NODE_HOLDS_ARRAY(json_object_get_member(obj, JSON_KEY_PUSHES)) )
+    {
+        arr = json_object_get_array_member(obj, JSON_KEY_PUSHES);
+        nb = json_array_get_length(arr);
+    }
+
+    if ( nb == 0 )
+    {
+        ret = 0;
+    }
+    else if ( (pushes = calloc(nb, sizeof(pb_push_t) + sizeof(pb_push_t *))) == NULL )
+    {
+        eprintf("Not enough memory to store %u pushes", nb);
+    }
+    else
+    {
+        // One allocation for the pushes and the array of pointers given to the callback
+        ptrs = (const pb_push_t **) (pushes + nb);
+
+        for ( i = 0; i < nb; i++ )
+        {
+            elt = json_array_get_element(arr, i);
+
+            if ( JSON_NODE_HOLDS_OBJECT(elt) )
+            {
+                json_object_foreach_member(json_node_get_object(elt), _push_fill_from_json, &pushes[i]);
+            }
+
+            ptrs[i] = &pushes[i];
+        }
+
+        ret = ( cb(ptrs, nb, userdata) != 0 ) ? 1 : 0;
+
+        free(pushes);
+    }
+
+    return (ret);
+}
@@ -7,6 +7,12 @@
 #ifndef __PB_PUSHES_PRIV_H__
 #define __PB_PUSHES_PRIV_H__
 
+#include <pthread.h>        // pthread_t, pthread_mutex_t, pthread_cond_t
+
+#include "pushbullet.h"     // http_code_t, pb_user_t
+#include "pb_sha256_prot.h"     // PB_SHA256_DIGEST_SIZE
+#include "pb_requests_prot.h"   // MAX_SIZE_URL
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -63,6 +69,49 @@ extern "C" {
 #define     JSON_KEY_UPLOAD_URL         "upload_url"
 
 
+/**
+ * \brief    JSON key to get the pushes of a page
+ */
+#define     JSON_KEY_PUSHES             "pushes"
+
+
+/**
+ * \brief    JSON key to get the cursor of the next page
+ */
+#define     JSON_KEY_CURSOR             "cursor"
+
+
+/**
+ * @def PUSH_FILES_RESULT_SIZE
+ * Size of the buffer receiving the response of each request of a multi-file push
+ */
+#define     PUSH_FILES_RESULT_SIZE      0x1000
+
+
+/**
+ * @def PUSH_FILES_REQUEST_WORKERS
+ * @def PUSH_FILES_UPLOAD_WORKERS
+ * @def PUSH_FILES_PUSH_WORKERS
+ * @brief Number of threads of each stage of a multi-file push
+ */
+#define     PUSH_FILES_REQUEST_WORKERS  2
+#define     PUSH_FILES_UPLOAD_WORKERS   2
+#define     PUSH_FILES_PUSH_WORKERS     2
+
+/**
+ * @def PUSH_FILES_MAX
+ * Maximum of two values, usable in a constant expression
+ */
+#define     PUSH_FILES_MAX(a, b)        (((a) > (b)) ? (a) : (b))
+
+/**
+ * @def PUSH_FILES_MAX_WORKERS
+ * Maximum number of threads of a stage (size of the threads of each stage)
+ */
+#define     PUSH_FILES_MAX_WORKERS      PUSH_FILES_MAX(PUSH_FILES_REQUEST_WORKERS, \
+                                                       PUSH_FILES_MAX(PUSH_FILES_UPLOAD_WORKERS, PUSH_FILES_PUSH_WORKERS))
+
+
 /**
  * @struct pb_note_s
  * @brief Structure containing all the informations concerning a PushBullet note
@@ -96,9 +145,64 @@ typedef struct pb_file_s {
     char *file_type;          ///< File's MIME type
     char *file_url;          ///< File url
     char *upload_url;          ///< File upload url
+    const void *data;          ///< Content of a buffer-backed file (owned by the caller, NULL for a file path)
+    size_t data_size;          ///< Size of the content of a buffer-backed file
+    pb_progress_cb progress_cb;          ///< Callback reporting the progress of the upload (may be NULL)
+    void *progress_userdata;          ///< User data given to progress_cb
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];          ///< SHA-256 of the content (when an upload cache is used)
+    unsigned char has_digest;          ///< Has the digest been computed?
+    unsigned char upload_cached;          ///< Has the URL been reused from the upload cache?
 } pb_file_t;
 
 
+/**
+ * @enum pb_push_files_stage_e
+ * @brief Stages of a multi-file push
+ */
+enum pb_push_files_stage_e {
+    PUSH_FILES_STAGE_REQUEST = 0,          ///< MIME detection and upload-request
+    PUSH_FILES_STAGE_UPLOAD,          ///< Upload of the file
+    PUSH_FILES_STAGE_PUSH,          ///< Push of the uploaded file
+    PUSH_FILES_NB_STAGES          ///< Number of stages
+};
+
+
+typedef struct pb_push_files_s pb_push_files_t;
+
+
+/**
+ * @struct pb_push_files_stage_s
+ * @brief Stage of a multi-file push: a queue of files and its threads
+ */
+typedef struct pb_push_files_stage_s {
+    pb_push_files_t *pipeline;          ///< The multi-file push
+    size_t index;          ///< Index of the stage
+    size_t *queue;          ///< Circular queue of the files waiting for the stage
+    size_t head;          ///< First file of the queue
+    size_t nb_queued;          ///< Number of files in the queue
+    size_t nb_expected;          ///< Number of files still to be run by the stage
+    pthread_cond_t cond;          ///< Signaled when a file is queued or will never come
+    pthread_t threads[PUSH_FILES_MAX_WORKERS];          ///< Threads of the stage
+    size_t nb_threads;          ///< Number of threads started
+} pb_push_files_stage_t;
+
+
+/**
+ * @struct pb_push_files_s
+ * @brief Multi-file push: each stage runs on its own threads while the files go through them
+ */
+struct pb_push_files_s {
+    pb_file_t **files;          ///< The files
+    http_code_t *results;          ///< The result of each file
+    size_t nb_files;          ///< The number of files
+    const pb_user_t *user;          ///< The user
+    pb_devices_t *devices;          ///< Snapshot of the devices of the user, owning device_iden
+    const char *device_iden;          ///< The device identification
+    pthread_mutex_t mtx;          ///< Mutex of the queues
+    pb_push_files_stage_t stages[PUSH_FILES_NB_STAGES];          ///< The stages
+};
+
+
 /**
  * @struct pb_push_s
  * @brief Structure containing all the informations concerning a PushBullet push
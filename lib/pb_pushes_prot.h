@@ -10,14 +10,19 @@
 #ifndef __PB_PUSHES_PROT_H__
 #define __PB_PUSHES_PROT_H__
 
+#include <stddef.h>     // size_t
+
+#include "pushbullet.h"     // pb_progress_cb
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct pb_file_s pb_file_t;
-
 const char* pb_file_get_filepath(const pb_file_t* file);
+const char* pb_file_get_filename(const pb_file_t* file);
+const char* pb_file_get_filetype(const pb_file_t* file);
+const void* pb_file_get_data(const pb_file_t* file, size_t *size);
+pb_progress_cb pb_file_get_progress_callback(const pb_file_t* file, void **userdata);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,85 @@
+/**
+ * @file pb_refcount_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Reference counters of the library objects, shared between threads
+ */
+
+#ifndef __PB_REFCOUNT_PROT_H__
+#define __PB_REFCOUNT_PROT_H__
+
+#include <stdatomic.h>      // atomic_int, atomic_init, atomic_load_explicit, atomic_fetch_add_explicit,
+                            // atomic_fetch_sub_explicit, atomic_thread_fence
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Reference counter
+ */
+typedef atomic_int pb_refcount_t;
+
+
+/**
+ * @brief      Initialize a reference counter to one
+ *
+ * @param      ref   The reference counter
+ */
+static inline void pb_refcount_init(pb_refcount_t *ref)
+{
+    atomic_init(ref, 1);
+}
+
+
+/**
+ * @brief      Get the value of a reference counter
+ *
+ * @param[in]  ref   The reference counter
+ *
+ * @return     The number of references
+ */
+static inline int pb_refcount_get(const pb_refcount_t *ref)
+{
+    return atomic_load_explicit( (pb_refcount_t *) ref, memory_order_relaxed);
+}
+
+
+/**
+ * @brief      Take a reference
+ * @details    The caller already holds a reference: nothing has to be ordered.
+ *
+ * @param      ref   The reference counter
+ */
+static inline void pb_refcount_inc(pb_refcount_t *ref)
+{
+    atomic_fetch_add_explicit(ref, 1, memory_order_relaxed);
+}
+
+
+/**
+ * @brief      Release a reference
+ * @details    The writes of every thread releasing its reference happen before the object is freed by the last one.
+ *
+ * @param      ref   The reference counter
+ *
+ * @return     Non-zero integer if it was the last reference (the object has to be freed)
+ */
+static inline int pb_refcount_dec(pb_refcount_t *ref)
+{
+    if ( atomic_fetch_sub_explicit(ref, 1, memory_order_release) <= 1 )
+    {
+        atomic_thread_fence(memory_order_acquire);
+        return 1;
+    }
+
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_REFCOUNT_PROT_H__
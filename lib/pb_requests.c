@@ -5,13 +5,21 @@
  */
 
 #include <stdlib.h>          // realloc, free
-#include <string.h>          // memcpy
+#include <string.h>          // memcpy, strrchr, strndup
+#include <strings.h>         // strncasecmp
+#include <stdio.h>           // SEEK_SET, SEEK_CUR, SEEK_END
+#include <fcntl.h>           // open, O_RDONLY
+#include <unistd.h>          // close
+#include <sys/mman.h>        // mmap, munmap, madvise
+#include <sys/stat.h>        // fstat
+#include <time.h>            // clock_gettime, CLOCK_MONOTONIC
 #include <curl/curl.h>          // CURL, CURLcode, struct curl_slist, curl_slist_append, curl_easy_init,
                                 // curl_easy_setopt, curl_easy_perform, curl_easy_cleanup, curl_slist_free_all
 
 #include "pb_utils.h"             // iprintf, eprintf, cprintf, gprintf
-#include "pb_requests_priv.h"             // pb_file_get_filepath
-#include "pb_pushes_prot.h"             // pb_file_get_filepath
+#include "pb_requests_priv.h"             // memory_struct_s, upload_struct_s, progress_struct_s
+#include "pb_requests_prot.h"             // pb_validators_t, pb_requests_get_conditional, MAX_SIZE_VALIDATOR_HEADER, REQUESTS_MAX_URL
+#include "pb_pushes_prot.h"             // pb_file_get_filepath, pb_file_get_filename, pb_file_get_filetype, pb_file_get_data, pb_file_get_progress_callback
 #include "pushbullet.h"          // NUMBER_PROXIES, PROXY_MAX_LENGTH, HTTPS_PROXY
 
 
@@ -27,15 +35,139 @@
  */
 static size_t write_memory_callback(void *contents, size_t size, size_t nmemb, void *userp);
 
+/**
+ * @brief Keep the validators (ETag and Last-Modified) of a response
+ *
+ * @param buffer The header line (not NUL-terminated)
+ * @param size Size of an element of that buffer
+ * @param nitems Number of elements of that buffer
+ * @param userdata The pointer to the validators
+ *
+ * @return Return the number of bytes handled
+ */
+static size_t header_validators_callback(char *buffer, size_t size, size_t nitems, void *userdata);
+
+/**
+ * @brief Read the next part of an uploaded file
+ *
+ * @param buffer Buffer of libcurl to fill
+ * @param size Size of an element of that buffer
+ * @param nitems Number of elements of that buffer
+ * @param arg The pointer to the upload
+ *
+ * @return Return the number of bytes copied (0 at the end of the file)
+ */
+static size_t read_upload_callback(char *buffer, size_t size, size_t nitems, void *arg);
+
+/**
+ * @brief Send a request of the Pushbullet API to the API URL of the configuration
+ *
+ * @param url_request The requested URL
+ * @param p_config The configuration
+ * @param buffer Buffer for the URL resolved
+ * @param size Size of that buffer
+ *
+ * @return Return the URL to request (url_request itself when it is kept, NULL when it is too long)
+ */
+static const char* resolve_api_url(const char *url_request, const pb_config_t *p_config, char *buffer, size_t size);
+
+/**
+ * @brief GET request, with validators and a flag stopping it (both optional)
+ *
+ * @param result The result buffer
+ * @param length The length of the result
+ * @param url_request The url request
+ * @param p_config The configuration
+ * @param validators The validators of the representation the caller holds (may be NULL)
+ * @param stop The flag stopping the request (may be NULL)
+ *
+ * @return HTTP status code
+ */
+static http_code_t requests_get(char **result, size_t *length, const char *url_request, const pb_config_t *p_config,
+                                pb_validators_t *validators, const atomic_uchar *stop);
+
+/**
+ * @brief Stop a request once its flag is set
+ *
+ * @param clientp The flag (atomic_uchar)
+ *
+ * @return Return non-zero to abort the request
+ */
+static int abort_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+/**
+ * @brief Report the progress of an upload (at most every PROGRESS_INTERVAL_MS)
+ *
+ * @param clientp The pointer to the progress
+ * @param dltotal Number of bytes to download
+ * @param dlnow Number of bytes downloaded
+ * @param ultotal Number of bytes to upload
+ * @param ulnow Number of bytes uploaded
+ *
+ * @return 0 to continue, non-zero to abort the upload
+ */
+static int xferinfo_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+/**
+ * @brief Move in an uploaded file (when libcurl has to send it again)
+ *
+ * @param arg The pointer to the upload
+ * @param offset The offset
+ * @param origin SEEK_SET, SEEK_CUR or SEEK_END
+ *
+ * @return CURL_SEEKFUNC_OK or CURL_SEEKFUNC_FAIL
+ */
+static int seek_upload_callback(void *arg, curl_off_t offset, int origin);
+
 
 http_code_t pb_requests_get(char              **result,
                             size_t            *length,
                             const char        *url_request,
                             const pb_config_t *p_config
                             )
+{
+    return pb_requests_get_conditional(result, length, url_request, p_config, NULL);
+}
+
+
+
+http_code_t pb_requests_get_conditional(char              **result,
+                                        size_t            *length,
+                                        const char        *url_request,
+                                        const pb_config_t *p_config,
+                                        pb_validators_t   *validators
+                                        )
+{
+    return requests_get(result, length, url_request, p_config, validators, NULL);
+}
+
+
+
+http_code_t pb_requests_get_abortable(char                **result,
+                                      size_t              *length,
+                                      const char          *url_request,
+                                      const pb_config_t   *p_config,
+                                      const atomic_uchar  *stop
+                                      )
+{
+    return requests_get(result, length, url_request, p_config, NULL, stop);
+}
+
+
+
+static http_code_t requests_get(char                **result,
+                                size_t              *length,
+                                const char          *url_request,
+                                const pb_config_t   *p_config,
+                                pb_validators_t     *validators,
+                                const atomic_uchar  *stop
+                                )
 {
     http_code_t http_code = HTTP_UNKNOWN_CODE;
     struct memory_struct_s ms = { .data = 0, .size = 0};
+    char url[REQUESTS_MAX_URL];
+    pb_validators_t received = { .etag = NULL, .last_modified = NULL };
+    char header[MAX_SIZE_VALIDATOR_HEADER];
 
 
     /*  Start a libcurl easy session
@@ -54,6 +186,33 @@ http_code_t pb_requests_get(char              **result,
 
         http_headers = curl_slist_append(http_headers, CONTENT_TYPE_JSON);
 
+        // Send back the validators of the previous response: the server answers 304 without any body if nothing changed
+        if ( validators )
+        {
+            if ( validators->etag &&
+                 ((size_t) snprintf(header, sizeof(header), "If-None-Match: %s", validators->etag) < sizeof(header)) )
+            {
+                http_headers = curl_slist_append(http_headers, header);
+            }
+
+            if ( validators->last_modified &&
+                 ((size_t) snprintf(header, sizeof(header), "If-Modified-Since: %s", validators->last_modified) < sizeof(header)) )
+            {
+                http_headers = curl_slist_append(http_headers, header);
+            }
+
+            curl_easy_setopt(s, CURLOPT_HEADERFUNCTION, header_validators_callback);
+            curl_easy_setopt(s, CURLOPT_HEADERDATA, (void*) &received);
+        }
+
+        // libcurl calls the progress callback at least once a second, even while nothing is received
+        if ( stop )
+        {
+            curl_easy_setopt(s, CURLOPT_XFERINFOFUNCTION, abort_callback);
+            curl_easy_setopt(s, CURLOPT_XFERINFODATA, (void*) stop);
+            curl_easy_setopt(s, CURLOPT_NOPROGRESS, 0L);
+        }
+
 
         /*  Specify URL to get
          *  Specify the user using the token key
@@ -65,7 +224,7 @@ http_code_t pb_requests_get(char              **result,
          */
         curl_easy_setopt(s, CURLOPT_USERAGENT, CURL_USERAGENT);
         curl_easy_setopt(s, CURLOPT_HTTPHEADER, http_headers);
-        curl_easy_setopt(s, CURLOPT_URL, url_request);
+        curl_easy_setopt(s, CURLOPT_URL, resolve_api_url(url_request, p_config, url, sizeof(url)));
         curl_easy_setopt(s, CURLOPT_USERPWD, pb_config_get_token_key(p_config));
         curl_easy_setopt(s, CURLOPT_PROXY, pb_config_get_proxy(p_config) );
         curl_easy_setopt(s, CURLOPT_TIMEOUT, pb_config_get_timeout(p_config) );
@@ -80,26 +239,42 @@ http_code_t pb_requests_get(char              **result,
          */
         if ( r != CURLE_OK )
         {
-            eprintf("curl_easy_perform() failed: %s", curl_easy_strerror(r) );
+            // A request stopped by its flag is not an error
+            if ( r != CURLE_ABORTED_BY_CALLBACK )
+            {
+                eprintf("curl_easy_perform() failed: %s", curl_easy_strerror(r) );
+            }
         }
         else
         {
+            // The buffer is already NUL-terminated by write_memory_callback: hand it over instead of copying it
             if (result && ms.data)
             {
-                *result = (char*) calloc(ms.size + 1, sizeof(char));
-                memcpy(*result, ms.data, ms.size);
+                *result = ms.data;
+                ms.data = NULL;
             }
 
             if (length)
             {
                 *length = ms.size;
             }
-            
-            pb_free(ms.data);
         }
 
+        pb_free(ms.data);
+
         curl_easy_getinfo(s, CURLINFO_RESPONSE_CODE, &http_code);
 
+        // The validators of a new representation replace the old ones, a 304 keeps them
+        if ( validators && (r == CURLE_OK) && (http_code == HTTP_OK) )
+        {
+            pb_validators_clear(validators);
+            *validators = received;
+            received.etag = NULL;
+            received.last_modified = NULL;
+        }
+
+        pb_validators_clear(&received);
+
         #ifdef __TRACES__
         if (length && result)
         {
@@ -134,6 +309,7 @@ http_code_t pb_requests_post(char              *result,
      */
     unsigned short http_code  = HTTP_UNKNOWN_CODE;
     struct memory_struct_s ms = {0};
+    char url[REQUESTS_MAX_URL];
 
 
     /*  Start a libcurl easy session
@@ -160,7 +336,7 @@ http_code_t pb_requests_post(char              *result,
          *  Specify the HTTP header
          *  Send all data to the WriteMemoryCallback method
          */
-        curl_easy_setopt(s, CURLOPT_URL, url_request);
+        curl_easy_setopt(s, CURLOPT_URL, resolve_api_url(url_request, p_config, url, sizeof(url)));
         curl_easy_setopt(s, CURLOPT_USERPWD, pb_config_get_token_key(p_config));
         curl_easy_setopt(s, CURLOPT_PROXY, pb_config_get_proxy(p_config) );
         curl_easy_setopt(s, CURLOPT_TIMEOUT, pb_config_get_timeout(p_config) );
@@ -218,50 +394,114 @@ http_code_t pb_requests_post_multipart(char              *result,
                         )
 {
     /*  Documentation on CURL for C can be found at http://curl.haxx.se/libcurl/c/
+     *  libcurl has to be initialized once with pb_init, not for each upload.
      */
-
-
-    unsigned short              http_code   = 0;
+    unsigned short              http_code   = HTTP_UNKNOWN_CODE;
     struct memory_struct_s      ms          = {0};
+    struct upload_struct_s      us          = {0};
+    struct progress_struct_s    ps          = {0};
+    const char                  *file_path  = pb_file_get_filepath(file);
+    const char                  *file_name  = NULL;
+    struct stat                 st;
+    int                         fd          = -1;
+    CURL                        *s          = NULL;
+    CURLcode                    r           = CURLE_OK;
+    curl_mime                   *mime       = NULL;
+    curl_mimepart               *part       = NULL;
+    char                        url[REQUESTS_MAX_URL];
+
+
+    /* A buffer-backed file is sent straight from the caller memory
+     */
+    if ( (us.data = pb_file_get_data(file, &us.size)) != NULL )
+    {
+        #ifdef __TRACES__
+        iprintf("Upload of %zu bytes from memory", us.size);
+        #endif
+    }
+    else if ( ! file_path )
+    {
+        return (http_code);
+    }
 
-
-    /*  Start a libcurl easy session
+    /* Map the file: the upload reads it straight from the page cache, in constant memory
      */
-    CURL            *s;
-    CURLcode        r = CURLE_OK;
+    else if ( ((fd = open(file_path, O_RDONLY)) < 0) || (fstat(fd, &st) != 0) )
+    {
+        eprintf("Cannot open %s", file_path);
 
-    struct curl_httppost        *formpost       = NULL;
-    struct curl_httppost        *lastptr        = NULL;
-    struct curl_slist           *http_headers   = NULL;
+        if ( fd >= 0 )
+        {
+            close(fd);
+        }
 
+        return (http_code);
+    }
+    else
+    {
+        us.size = (size_t) st.st_size;
 
-    curl_global_init(CURL_GLOBAL_ALL);
+        if ( us.size > 0 )
+        {
+            us.data = mmap(NULL, us.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if ( us.data == MAP_FAILED )
+            {
+                eprintf("Cannot map %s", file_path);
+                close(fd);
+                return (http_code);
+            }
 
+            madvise( (void *) us.data, us.size, MADV_SEQUENTIAL);
+            us.mapped = 1;
+        }
 
-    /* Fill in the file upload field
-     */
-    curl_formadd(&formpost, &lastptr, CURLFORM_COPYNAME, "file", CURLFORM_FILE, pb_file_get_filepath(file), CURLFORM_END);
+        close(fd);
+    }
+
+    if ( ((file_name = pb_file_get_filename(file)) == NULL) && file_path )
+    {
+        file_name = strrchr(file_path, '/');
+        file_name = (file_name) ? file_name + 1 : file_path;
+    }
 
 
     /* Initialize the session
      */
-    s = curl_easy_init();
-
-    if ( ! s )
+    if ( (s = curl_easy_init()) == NULL )
     {
         eprintf("curl_easy_init() could not be initiated.\n");
     }
     else
     {
-        http_headers = curl_slist_append(http_headers, CONTENT_TYPE_MULTIPART);
+        /* Fill in the file upload field
+         */
+        mime = curl_mime_init(s);
+        part = curl_mime_addpart(mime);
+        curl_mime_name(part, "file");
+        curl_mime_filename(part, file_name);
+        curl_mime_type(part, pb_file_get_filetype(file) );
+        curl_mime_data_cb(part, (curl_off_t) us.size, read_upload_callback, seek_upload_callback, NULL, &us);
+
+        curl_easy_setopt(s, CURLOPT_USERAGENT, CURL_USERAGENT);
         curl_easy_setopt(s, CURLOPT_USERPWD, pb_config_get_token_key(p_config));
         curl_easy_setopt(s, CURLOPT_PROXY, pb_config_get_proxy(p_config) );
         curl_easy_setopt(s, CURLOPT_TIMEOUT, pb_config_get_timeout(p_config) );
-        curl_easy_setopt(s, CURLOPT_URL, url_request);
-        curl_easy_setopt(s, CURLOPT_HTTPPOST, formpost);
+        curl_easy_setopt(s, CURLOPT_URL, resolve_api_url(url_request, p_config, url, sizeof(url)));
+        curl_easy_setopt(s, CURLOPT_MIMEPOST, mime);
         curl_easy_setopt(s, CURLOPT_WRITEFUNCTION, write_memory_callback);
         curl_easy_setopt(s, CURLOPT_WRITEDATA, (void *) &ms);
 
+        /* Report the progress of the upload to the caller
+         */
+        if ( (ps.cb = pb_file_get_progress_callback(file, &ps.userdata)) != NULL )
+        {
+            clock_gettime(CLOCK_MONOTONIC, &ps.last_time);
+            curl_easy_setopt(s, CURLOPT_XFERINFOFUNCTION, xferinfo_callback);
+            curl_easy_setopt(s, CURLOPT_XFERINFODATA, (void *) &ps);
+            curl_easy_setopt(s, CURLOPT_NOPROGRESS, 0L);
+        }
+
 
         /* Get data
          */
@@ -274,20 +514,12 @@ http_code_t pb_requests_post_multipart(char              *result,
         if ( r != CURLE_OK )
         {
             eprintf("curl_easy_perform() failed: %s", curl_easy_strerror(r) );
-
-            return (http_code);
         }
-
-        curl_easy_cleanup(s);
-        curl_formfree(formpost);
-        curl_slist_free_all(http_headers);
-
-        // Copy the data before removing them.
-        if ( ms.data )
+        else if ( ms.data )
         {
+            // Copy the data before removing them.
             *length = ms.size;
             memcpy(result, ms.data, ms.size);
-            free(ms.data);
         }
 
         #ifdef __TRACES__
@@ -302,6 +534,17 @@ http_code_t pb_requests_post_multipart(char              *result,
         #endif
     }
 
+    /* Everything is released whatever the result of the upload
+     */
+    pb_free(ms.data);
+    curl_mime_free(mime);
+    curl_easy_cleanup(s);
+
+    if ( us.mapped )
+    {
+        munmap( (void *) us.data, us.size);
+    }
+
     return (http_code);
 }
 
@@ -316,6 +559,7 @@ http_code_t pb_requests_delete(char               *result,
      */
     unsigned short              http_code   = HTTP_UNKNOWN_CODE;
     struct memory_struct_s      ms          = {0};
+    char                        url[REQUESTS_MAX_URL];
 
 
     /*  Start a libcurl easy session
@@ -339,7 +583,7 @@ http_code_t pb_requests_delete(char               *result,
          *  Specify the user using the token key
          *  Specify the HTTP header
          */
-        curl_easy_setopt(s, CURLOPT_URL, url_request);
+        curl_easy_setopt(s, CURLOPT_URL, resolve_api_url(url_request, p_config, url, sizeof(url)));
         curl_easy_setopt(s, CURLOPT_USERPWD, pb_config_get_token_key(p_config));
         curl_easy_setopt(s, CURLOPT_PROXY, pb_config_get_proxy(p_config) );
         curl_easy_setopt(s, CURLOPT_TIMEOUT, pb_config_get_timeout(p_config) );
@@ -394,6 +638,61 @@ http_code_t pb_requests_delete(char               *result,
 
 
 
+void pb_validators_clear(pb_validators_t *validators)
+{
+    if ( validators )
+    {
+        pb_free(validators->etag);
+        pb_free(validators->last_modified);
+    }
+}
+
+
+
+static size_t header_validators_callback(char    *buffer,
+                                         size_t  size,
+                                         size_t  nitems,
+                                         void    *userdata
+                                         )
+{
+    size_t              len = size * nitems;
+    pb_validators_t     *validators = (pb_validators_t *) userdata;
+    char                **field = NULL;
+    size_t              name = 0;
+
+    if ( (len > 5) && (strncasecmp(buffer, "ETag:", 5) == 0) )
+    {
+        field = &validators->etag;
+        name = 5;
+    }
+    else if ( (len > 14) && (strncasecmp(buffer, "Last-Modified:", 14) == 0) )
+    {
+        field = &validators->last_modified;
+        name = 14;
+    }
+
+    if ( field )
+    {
+        // Trim the spaces and the CRLF around the value
+        while ( (name < len) && ((buffer[name] == ' ') || (buffer[name] == '\t')) )
+        {
+            name++;
+        }
+
+        while ( (len > name) && ((buffer[len - 1] == '\r') || (buffer[len - 1] == '\n') || (buffer[len - 1] == ' ')) )
+        {
+            len--;
+        }
+
+        pb_free(*field);
+        *field = strndup(buffer + name, len - name);
+    }
+
+    return (size * nitems);
+}
+
+
+
 /**
  * @brief Write a downloaded element in the memory
  *
@@ -438,3 +737,162 @@ static size_t write_memory_callback(void    *contents,
 
     return (realsize);
 }
+
+
+static size_t read_upload_callback(char   *buffer,
+                                   size_t size,
+                                   size_t nitems,
+                                   void   *arg
+                                   )
+{
+    struct upload_struct_s *us = (struct upload_struct_s *) arg;
+    size_t len = size * nitems;
+
+    if ( len > us->size - us->offset )
+    {
+        len = us->size - us->offset;
+    }
+
+    memcpy(buffer, us->data + us->offset, len);
+    us->offset += len;
+
+    return (len);
+}
+
+
+static int xferinfo_callback(void       *clientp,
+                             curl_off_t dltotal,
+                             curl_off_t dlnow,
+                             curl_off_t ultotal,
+                             curl_off_t ulnow
+                             )
+{
+    struct timespec now;
+
+    (void) dltotal;
+    (void) dlnow;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return pb_requests_report_progress( (struct progress_struct_s *) clientp, (size_t) ulnow, (size_t) ultotal, &now);
+}
+
+
+static int abort_callback(void       *clientp,
+                          curl_off_t dltotal,
+                          curl_off_t dlnow,
+                          curl_off_t ultotal,
+                          curl_off_t ulnow
+                          )
+{
+    (void) dltotal;
+    (void) dlnow;
+    (void) ultotal;
+    (void) ulnow;
+
+    return atomic_load( (const atomic_uchar *) clientp) != 0;
+}
+
+
+int pb_requests_report_progress(struct progress_struct_s    *ps,
+                                size_t                      sent,
+                                size_t                      total,
+                                const struct timespec       *now
+                                )
+{
+    double elapsed = 0;
+    int done = (total > 0) && (sent >= total);
+
+    // The last call is always reported, once
+    if ( ps->done )
+    {
+        return 0;
+    }
+
+    elapsed = (double) (now->tv_sec - ps->last_time.tv_sec) + (double) (now->tv_nsec - ps->last_time.tv_nsec) / 1e9;
+
+    if ( (! done) && (elapsed * 1000 < PROGRESS_INTERVAL_MS) )
+    {
+        return 0;
+    }
+
+    // The upload has been rewound (seek_upload_callback): the new attempt starts from zero
+    if ( sent < ps->last_sent )
+    {
+        ps->last_sent = 0;
+    }
+
+    // Rate since the previous report
+    ps->rate = (elapsed > 0) ? (double) ((long long) sent - (long long) ps->last_sent) / elapsed : ps->rate;
+    ps->last_sent = sent;
+    ps->last_time = *now;
+    ps->done = done;
+
+    return ps->cb(sent, total, ps->rate, ps->userdata);
+}
+
+
+static int seek_upload_callback(void       *arg,
+                                curl_off_t offset,
+                                int        origin
+                                )
+{
+    struct upload_struct_s *us = (struct upload_struct_s *) arg;
+
+    switch ( origin )
+    {
+        case SEEK_CUR:
+            offset += (curl_off_t) us->offset;
+            break;
+
+        case SEEK_END:
+            offset += (curl_off_t) us->size;
+            break;
+
+        default:
+            break;
+    }
+
+    if ( (offset < 0) || ((size_t) offset > us->size) )
+    {
+        return (CURL_SEEKFUNC_FAIL);
+    }
+
+    us->offset = (size_t) offset;
+
+    return (CURL_SEEKFUNC_OK);
+}
+
+
+static const char* resolve_api_url(const char           *url_request,
+                                   const pb_config_t    *p_config,
+                                   char                 *buffer,
+                                   size_t               size
+                                   )
+{
+    char        *api_url = NULL;
+    const char  *url = url_request;
+    size_t      prefix = sizeof(API_URL) - 1;
+
+    // Only the requests of the Pushbullet API are redirected, not the URLs it gives (the uploads)
+    if ( (! url_request) || (strncmp(url_request, API_URL, prefix) != 0) ||
+         ((api_url = pb_config_get_api_url(p_config)) == NULL) )
+    {
+        return (url_request);
+    }
+
+    if ( (size_t) snprintf(buffer, size, "%s%s", api_url, url_request + prefix) < size )
+    {
+        url = buffer;
+    }
+    else
+    {
+        // Never fall back to the Pushbullet API: the request fails instead
+        eprintf("The URL of the request is too long for %s", api_url);
+        url = NULL;
+    }
+
+    pb_free(api_url);
+
+    return (url);
+}
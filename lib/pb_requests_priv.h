@@ -10,6 +10,8 @@
 #ifndef __REQUESTS_H__
 #define __REQUESTS_H__
 
+#include <time.h>           // struct timespec
+
 #include "pushbullet.h"
 
 #ifdef __cplusplus
@@ -20,10 +22,14 @@ extern "C" {
 #define CONTENT_TYPE_JSON       "Content-Type: application/json"
 
 
-#define CONTENT_TYPE_MULTIPART  "Content-Type: multipart/form-data"
+#define CURL_USERAGENT "libcurl-agent/1.0"
 
 
-#define CURL_USERAGENT "libcurl-agent/1.0"
+/**
+ * @def PROGRESS_INTERVAL_MS
+ * Minimum delay between two reports of the progress of an upload (in milliseconds)
+ */
+#define PROGRESS_INTERVAL_MS    200
 
 
 /**
@@ -36,6 +42,33 @@ struct memory_struct_s {
     size_t size;          ///< Size of the memory allocated
 };
 
+
+/**
+ * @struct upload_struct_s
+ * @brief      File uploaded by read_upload_callback.
+ * @details    The file is mapped in memory (or given as a buffer) and sent from its offset.
+ */
+struct upload_struct_s {
+    const char *data;          ///< Pointer to the mapping of the file or to the buffer
+    size_t size;          ///< Size of the file
+    size_t offset;          ///< Offset of the next byte to send
+    unsigned char mapped;          ///< Is data a mapping to release?
+};
+
+
+/**
+ * @struct progress_struct_s
+ * @brief      Progress of an upload reported by xferinfo_callback.
+ */
+struct progress_struct_s {
+    pb_progress_cb cb;          ///< Callback of the caller
+    void *userdata;          ///< User data of the callback
+    struct timespec last_time;          ///< Time of the previous report
+    size_t last_sent;          ///< Number of bytes sent at the previous report
+    double rate;          ///< Rate between the two last reports (in bytes per second)
+    unsigned char done;          ///< Has the end of the upload been reported?
+};
+
 #ifdef __cplusplus
 }
 #endif
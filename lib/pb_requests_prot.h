@@ -11,6 +11,8 @@
 #define __PB_REQUESTS_PROT_H__
 
 
+#include <stdatomic.h>      // atomic_uchar
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -53,6 +55,20 @@ extern "C" {
 #define API_URL_FILE_REQUEST    API_URL "upload-request"
 
 
+/**
+ * @def REQUESTS_MAX_URL
+ * Maximum size of a request URL resolved against the API URL of the configuration
+ */
+#define REQUESTS_MAX_URL        0x400
+
+
+/**
+ * @def MAX_SIZE_URL
+ * Maximum size of a request URL with its query string
+ */
+#define MAX_SIZE_URL            REQUESTS_MAX_URL
+
+
 /**
  * @typedef pb_file_t
  * @brief Type definition of the structure pb_file_s
@@ -72,6 +88,25 @@ typedef struct pb_config_s  pb_config_t;
  */
 typedef enum http_code_e http_code_t;
 
+struct progress_struct_s;
+struct timespec;
+
+/**
+ * @def MAX_SIZE_VALIDATOR_HEADER
+ * Maximum size of a conditional request header (If-None-Match or If-Modified-Since)
+ */
+#define MAX_SIZE_VALIDATOR_HEADER   0x200
+
+
+/**
+ * @struct pb_validators_s
+ * @brief Validators of the last representation of a resource, sent back by a conditional request
+ */
+typedef struct pb_validators_s {
+    char *etag;          ///< Value of the ETag header (may be NULL)
+    char *last_modified;          ///< Value of the Last-Modified header (may be NULL)
+} pb_validators_t;
+
 /**
  * @brief      GET request for the PushBullet API
  *
@@ -84,6 +119,41 @@ typedef enum http_code_e http_code_t;
 http_code_t pb_requests_get(char **result, size_t* length, const char *url_request, const pb_config_t* p_config);
 
 
+/**
+ * @brief      Conditional GET request for the PushBullet API
+ * @details    The validators are sent as If-None-Match and If-Modified-Since. They are replaced by the ones of the
+ *             response on 200, and kept on 304 (the response has no body then).
+ *
+ * @param[out] result       The result buffer
+ * @param[in]  url_request  The url request
+ * @param[in]  config       The user informations
+ * @param      validators   The validators of the representation the caller holds (NULL for a plain GET)
+ *
+ * @return     HTTP status code
+ */
+http_code_t pb_requests_get_conditional(char **result, size_t* length, const char *url_request, const pb_config_t* p_config, pb_validators_t *validators);
+
+
+/**
+ * @brief      GET request for the PushBullet API, stopped once a flag is set
+ * @details    The flag is checked by the progress callback of libcurl: the request ends at its next progress call (at
+ *             most a second later) once the flag is set.
+ *
+ * @param[out] result       The result buffer
+ * @param[in]  url_request  The url request
+ * @param[in]  config       The user informations
+ * @param[in]  stop         The flag stopping the request
+ *
+ * @return     HTTP status code
+ */
+http_code_t pb_requests_get_abortable(char **result, size_t* length, const char *url_request, const pb_config_t* p_config, const atomic_uchar *stop);
+
+/**
+ * @brief      Free the validators
+ */
+void pb_validators_clear(pb_validators_t *validators);
+
+
 /**
  * @brief      POST request for the PushBullet API
  *
@@ -110,6 +180,22 @@ http_code_t pb_requests_post(char *result, size_t* length, const char *url_reque
 http_code_t pb_requests_post_multipart(char *result, size_t *length,  const char *url_request, const pb_config_t *p_config, const pb_file_t *file);
 
 
+/**
+ * @brief      Report the progress of an upload to the callback of the file
+ * @details    The progress is reported at most every PROGRESS_INTERVAL_MS, and always once at the end of the upload.
+ *             When libcurl sends the file again, the number of bytes sent goes back: the rate is then computed from the
+ *             beginning of the new attempt.
+ *
+ * @param      ps     The progress of the upload
+ * @param[in]  sent   The number of bytes sent
+ * @param[in]  total  The number of bytes to send (0 if not known yet)
+ * @param[in]  now    The current time (CLOCK_MONOTONIC)
+ *
+ * @return     0 to continue, non-zero to abort the upload
+ */
+int pb_requests_report_progress(struct progress_struct_s *ps, size_t sent, size_t total, const struct timespec *now);
+
+
 /**
  * @brief      DELETE request for the PushBullet API
  *
@@ -0,0 +1,346 @@
+/**
+ * @file pb_schema.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stddef.h>          // offsetof
+#include <string.h>          // strcmp, strdup, memset
+#include <pthread.h>         // pthread_once, pthread_once_t, PTHREAD_ONCE_INIT
+#include <json-glib/json-glib.h>          // JsonNode, json_node_get_boolean, json_node_get_int, json_node_get_double,
+                                          // json_node_get_string, json_node_dup_string
+
+#include "pb_utils.h"             // eprintf
+#include "pb_schema_prot.h"       // pb_schema_t, pb_schema_field_t, pb_schema_model_t, PB_SCHEMA_MAX_SLOTS
+#include "pb_arena_prot.h"        // pb_arena_strdup
+#include "pb_user_priv.h"         // pb_user_t
+#include "pb_device_priv.h"       // pb_phone_t, pb_browser_t
+#include "pb_pushes_priv.h"       // pb_push_t
+
+
+/**
+ * @brief      Field k of the structure s, filled from the member of the same name
+ */
+#define SCHEMA_FIELD(s, k, t)       { # k, offsetof(s, k), t }
+
+/**
+ * @brief      Number of fields of a table
+ */
+#define SCHEMA_NB_FIELDS(f)         (sizeof(f) / sizeof((f)[0]))
+
+/**
+ * @brief      Number of seeds tried for a number of slots before doubling it
+ */
+#define SCHEMA_MAX_SEEDS            0x10000
+
+
+static const pb_schema_field_t schema_user_fields[] = {
+    SCHEMA_FIELD(pb_user_t, active, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_user_t, created, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_user_t, modified, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_user_t, email, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_user_t, email_normalized, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_user_t, iden, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_user_t, image_url, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_user_t, name, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_user_t, max_upload_size, PB_SCHEMA_INT)
+};
+
+static const pb_schema_field_t schema_phone_fields[] = {
+    SCHEMA_FIELD(pb_phone_t, active, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_phone_t, iden, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, created, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_phone_t, modified, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_phone_t, nickname, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, generated_nickname, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_phone_t, manufacturer, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, model, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, app_version, PB_SCHEMA_SHORT),
+    SCHEMA_FIELD(pb_phone_t, fingerprint, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, push_token, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, has_sms, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_phone_t, has_mms, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_phone_t, icon, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_phone_t, remote_files, PB_SCHEMA_STR)
+};
+
+static const pb_schema_field_t schema_browser_fields[] = {
+    SCHEMA_FIELD(pb_browser_t, active, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_browser_t, iden, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_browser_t, created, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_browser_t, modified, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_browser_t, nickname, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_browser_t, manufacturer, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_browser_t, model, PB_SCHEMA_STR),
+    SCHEMA_FIELD(pb_browser_t, app_version, PB_SCHEMA_SHORT),
+    SCHEMA_FIELD(pb_browser_t, icon, PB_SCHEMA_STR)
+};
+
+static const pb_schema_field_t schema_push_fields[] = {
+    SCHEMA_FIELD(pb_push_t, active, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_push_t, body, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, created, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_push_t, direction, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, dismissed, PB_SCHEMA_BOOL),
+    SCHEMA_FIELD(pb_push_t, iden, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, modified, PB_SCHEMA_DOUBLE),
+    SCHEMA_FIELD(pb_push_t, receiver_email, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, receiver_email_normalized, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, receiver_iden, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, sender_email, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, sender_email_normalized, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, sender_iden, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, sender_name, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, title, PB_SCHEMA_CONST_STR),
+    SCHEMA_FIELD(pb_push_t, type, PB_SCHEMA_CONST_STR)
+};
+
+
+/**
+ * @brief Schema of each model (the perfect hashes are built once, by schema_build_all)
+ */
+static pb_schema_t schemas[PB_SCHEMA_NB_MODELS] = {
+    [PB_SCHEMA_USER] = { .fields = schema_user_fields, .nb_fields = SCHEMA_NB_FIELDS(schema_user_fields) },
+    [PB_SCHEMA_PHONE] = { .fields = schema_phone_fields, .nb_fields = SCHEMA_NB_FIELDS(schema_phone_fields) },
+    [PB_SCHEMA_BROWSER] = { .fields = schema_browser_fields, .nb_fields = SCHEMA_NB_FIELDS(schema_browser_fields) },
+    [PB_SCHEMA_PUSH] = { .fields = schema_push_fields, .nb_fields = SCHEMA_NB_FIELDS(schema_push_fields) }
+};
+
+static pthread_once_t schemas_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * @brief      Seeded FNV-1a hash of a name
+ */
+static uint32_t schema_hash(const char *name, uint32_t seed);
+
+/**
+ * @brief      Find a seed and a number of slots for which every field of the schema has its own slot
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int schema_build(pb_schema_t *schema);
+
+/**
+ * @brief      Build the perfect hash of every schema
+ */
+static void schema_build_all(void);
+
+
+const pb_schema_field_t* pb_schema_lookup(pb_schema_model_t     model,
+                                          const char            *name
+                                          )
+{
+    const pb_schema_t   *schema = NULL;
+    unsigned char       slot = 0;
+
+    if ( (model >= PB_SCHEMA_NB_MODELS) || (! name) )
+    {
+        return (NULL);
+    }
+
+    pthread_once(&schemas_once, schema_build_all);
+
+    schema = &schemas[model];
+
+    // A member unknown to the model may land on the slot of a field: the name is checked once
+    if ( ((slot = schema->slots[schema_hash(name, schema->seed) & schema->mask]) == 0) ||
+         (strcmp(schema->fields[slot - 1].name, name) != 0) )
+    {
+        return (NULL);
+    }
+
+    return &schema->fields[slot - 1];
+}
+
+
+void pb_schema_fill(pb_schema_model_t    model,
+                    void                 *object,
+                    const char           *member_name,
+                    JsonNode             *member_node,
+                    pb_arena_t           *arena
+                    )
+{
+    const pb_schema_field_t *field = NULL;
+    char                    *ptr = (char *) object;
+
+    if ( (! object) || (! JSON_NODE_HOLDS_VALUE(member_node)) || ((field = pb_schema_lookup(model, member_name)) == NULL) )
+    {
+        return;
+    }
+
+    ptr += field->offset;
+
+    switch ( field->type )
+    {
+        case PB_SCHEMA_BOOL:
+            *(unsigned char *) ptr = json_node_get_boolean(member_node);
+            break;
+
+        case PB_SCHEMA_SHORT:
+            *(short *) ptr = json_node_get_int(member_node);
+            break;
+
+        case PB_SCHEMA_INT:
+            *(int *) ptr = json_node_get_int(member_node);
+            break;
+
+        case PB_SCHEMA_DOUBLE:
+            *(double *) ptr = json_node_get_double(member_node);
+            break;
+
+        case PB_SCHEMA_STR:
+            *(char **) ptr = (arena) ? pb_arena_strdup(arena, json_node_get_string(member_node)) : json_node_dup_string(member_node);
+            break;
+
+        case PB_SCHEMA_CONST_STR:
+            *(const char **) ptr = json_node_get_string(member_node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+int pb_schema_copy(pb_schema_model_t    model,
+                   void                 *dst,
+                   const void           *src,
+                   pb_arena_t           *arena
+                   )
+{
+    const pb_schema_t   *schema = NULL;
+    const char          *from = NULL;
+    char                *to = NULL;
+    const char          *str = NULL;
+    size_t              i = 0;
+
+    if ( (model >= PB_SCHEMA_NB_MODELS) || (! dst) || (! src) )
+    {
+        return -1;
+    }
+
+    schema = &schemas[model];
+
+    for ( i = 0; i < schema->nb_fields; i++ )
+    {
+        from = (const char *) src + schema->fields[i].offset;
+        to = (char *) dst + schema->fields[i].offset;
+
+        switch ( schema->fields[i].type )
+        {
+            case PB_SCHEMA_BOOL:
+                *(unsigned char *) to = *(const unsigned char *) from;
+                break;
+
+            case PB_SCHEMA_SHORT:
+                *(short *) to = *(const short *) from;
+                break;
+
+            case PB_SCHEMA_INT:
+                *(int *) to = *(const int *) from;
+                break;
+
+            case PB_SCHEMA_DOUBLE:
+                *(double *) to = *(const double *) from;
+                break;
+
+            case PB_SCHEMA_STR:
+                str = *(char * const *) from;
+                *(char **) to = (! str) ? NULL : (arena) ? pb_arena_strdup(arena, str) : strdup(str);
+
+                if ( str && (! *(char **) to) )
+                {
+                    return -1;
+                }
+
+                break;
+
+            case PB_SCHEMA_CONST_STR:
+                *(const char **) to = *(const char * const *) from;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return 0;
+}
+
+
+static uint32_t schema_hash(const char   *name,
+                            uint32_t     seed
+                            )
+{
+    uint32_t    hash = 2166136261u ^ seed;
+
+    for ( ; *name; name++ )
+    {
+        hash ^= (unsigned char) *name;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+static int schema_build(pb_schema_t *schema)
+{
+    size_t      nb_slots = 0;
+    size_t      slot = 0;
+    size_t      i = 0;
+    uint32_t    seed = 0;
+
+    // Start with four slots per field: a seed without any collision is found after a few tries
+    for ( nb_slots = 4; nb_slots < 4 * schema->nb_fields; nb_slots *= 2 )
+    {
+        ;
+    }
+
+    for ( ; nb_slots <= PB_SCHEMA_MAX_SLOTS; nb_slots *= 2 )
+    {
+        for ( seed = 0; seed < SCHEMA_MAX_SEEDS; seed++ )
+        {
+            memset(schema->slots, 0, sizeof(schema->slots) );
+
+            for ( i = 0; i < schema->nb_fields; i++ )
+            {
+                slot = schema_hash(schema->fields[i].name, seed) & (nb_slots - 1);
+
+                if ( schema->slots[slot] )
+                {
+                    break;
+                }
+
+                schema->slots[slot] = (unsigned char) (i + 1);
+            }
+
+            if ( i == schema->nb_fields )
+            {
+                schema->seed = seed;
+                schema->mask = nb_slots - 1;
+                return 0;
+            }
+        }
+    }
+
+    // Every member would be unknown: the slots are left empty
+    memset(schema->slots, 0, sizeof(schema->slots) );
+
+    return -1;
+}
+
+
+static void schema_build_all(void)
+{
+    size_t  i = 0;
+
+    for ( i = 0; i < PB_SCHEMA_NB_MODELS; i++ )
+    {
+        if ( schema_build(&schemas[i]) != 0 )
+        {
+            eprintf("No perfect hash found for the schema %zu", i);
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/**
+ * @file pb_schema_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Schemas mapping the JSON members of the API objects to the fields of the library structures
+ */
+
+#ifndef __PB_SCHEMA_PROT_H__
+#define __PB_SCHEMA_PROT_H__
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+#include <json-glib/json-glib.h>      // JsonNode
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct pb_arena_s pb_arena_t;
+
+
+/**
+ * @def PB_SCHEMA_MAX_SLOTS
+ * Maximum number of slots of the perfect hash of a schema
+ */
+#define PB_SCHEMA_MAX_SLOTS     0x100
+
+
+/**
+ * @enum pb_schema_model_e
+ * @brief Models described by a schema
+ */
+typedef enum pb_schema_model_e {
+    PB_SCHEMA_USER,          ///< pb_user_t
+    PB_SCHEMA_PHONE,          ///< pb_phone_t
+    PB_SCHEMA_BROWSER,          ///< pb_browser_t (and every device which is not a phone)
+    PB_SCHEMA_PUSH,          ///< pb_push_t
+    PB_SCHEMA_NB_MODELS          ///< Number of models
+} pb_schema_model_t;
+
+
+/**
+ * @enum pb_schema_type_e
+ * @brief Types of the fields
+ */
+typedef enum pb_schema_type_e {
+    PB_SCHEMA_BOOL,          ///< unsigned char
+    PB_SCHEMA_SHORT,          ///< short
+    PB_SCHEMA_INT,          ///< int
+    PB_SCHEMA_DOUBLE,          ///< double
+    PB_SCHEMA_STR,          ///< char *, copied on the heap (or in the arena given to pb_schema_fill)
+    PB_SCHEMA_CONST_STR          ///< const char *, owned by the JSON node
+} pb_schema_type_t;
+
+
+/**
+ * @struct pb_schema_field_s
+ * @brief Field of a structure filled from a JSON member
+ */
+typedef struct pb_schema_field_s {
+    const char *name;          ///< Name of the JSON member (and of the field)
+    size_t offset;          ///< Offset of the field in the structure
+    pb_schema_type_t type;          ///< Type of the field
+} pb_schema_field_t;
+
+
+/**
+ * @struct pb_schema_s
+ * @brief Fields of a model and their perfect hash
+ */
+typedef struct pb_schema_s {
+    const pb_schema_field_t *fields;          ///< Fields of the model
+    size_t nb_fields;          ///< Number of fields
+    uint32_t seed;          ///< Seed of the hash giving a different slot to every field
+    size_t mask;          ///< Number of slots minus one
+    unsigned char slots[PB_SCHEMA_MAX_SLOTS];          ///< Index of the field plus one (0 if the slot is empty)
+} pb_schema_t;
+
+
+/**
+ * @brief      Get the field of a model named after a JSON member
+ * @details    The member is resolved with one probe of the perfect hash of the schema.
+ *
+ * @param[in]  model  The model
+ * @param[in]  name   The name of the member
+ *
+ * @return     The field, or NULL if the model has no such field
+ */
+const pb_schema_field_t* pb_schema_lookup(pb_schema_model_t model, const char *name);
+
+/**
+ * @brief      Fill the field of a structure named after a JSON member
+ * @details    Members which are not values (objects, arrays) and members unknown to the model are ignored.
+ *
+ * @param[in]  model        The model of the structure
+ * @param      object       The structure
+ * @param[in]  member_name  The name of the member
+ * @param      member_node  The member
+ * @param      arena        Arena in which the strings are copied (NULL to copy them on the heap)
+ */
+void pb_schema_fill(pb_schema_model_t model, void *object, const char *member_name, JsonNode *member_node, pb_arena_t *arena);
+
+/**
+ * @brief      Copy the fields of a structure into another one
+ * @details    The strings are duplicated (PB_SCHEMA_CONST_STR ones are shared with the source).
+ *
+ * @param[in]  model  The model of the structures
+ * @param      dst    The destination
+ * @param[in]  src    The source
+ * @param      arena  Arena in which the strings are copied (NULL to copy them on the heap)
+ *
+ * @return     On success: zero
+ * @return     On error (out of memory): non-zero integer, the strings already copied stay in dst
+ */
+int pb_schema_copy(pb_schema_model_t model, void *dst, const void *src, pb_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_SCHEMA_PROT_H__
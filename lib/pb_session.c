@@ -7,6 +7,7 @@
 #include <curl/curl.h>      // curl_global_init
 
 #include "pb_utils.h" // eprintf
+#include "pb_mime_prot.h" // pb_mime_term
 
 
 int pb_init(void)
@@ -23,5 +24,6 @@ int pb_init(void)
 
 void pb_term(void)
 {
+    pb_mime_term();
     curl_global_cleanup();
 }
@@ -0,0 +1,178 @@
+/**
+ * @file pb_sha1.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <string.h>          // memcpy, memset
+
+#include "pb_sha1_prot.h"         // pb_sha1_t, PB_SHA1_DIGEST_SIZE
+
+
+#define ROTL(x, n)      (((x) << (n)) | ((x) >> (32 - (n))))
+
+
+/**
+ * @brief      Hash one block of 64 bytes
+ */
+static void sha1_block(uint32_t *state, const unsigned char *block);
+
+
+void pb_sha1_init(pb_sha1_t *ctx)
+{
+    static const uint32_t init[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+
+    memcpy(ctx->state, init, sizeof(init) );
+    ctx->length = 0;
+    ctx->block_len = 0;
+}
+
+
+void pb_sha1_update(pb_sha1_t   *ctx,
+                    const void  *data,
+                    size_t      size
+                    )
+{
+    const unsigned char *p = data;
+    size_t              len = 0;
+
+    ctx->length += size;
+
+    // Complete the pending block
+    if ( ctx->block_len > 0 )
+    {
+        len = (size < 64 - ctx->block_len) ? size : 64 - ctx->block_len;
+        memcpy(ctx->block + ctx->block_len, p, len);
+        ctx->block_len += len;
+        p += len;
+        size -= len;
+
+        if ( ctx->block_len < 64 )
+        {
+            return;
+        }
+
+        sha1_block(ctx->state, ctx->block);
+        ctx->block_len = 0;
+    }
+
+    // Full blocks are hashed in place
+    for ( ; size >= 64; p += 64, size -= 64 )
+    {
+        sha1_block(ctx->state, p);
+    }
+
+    memcpy(ctx->block, p, size);
+    ctx->block_len = size;
+}
+
+
+void pb_sha1_final(pb_sha1_t       *ctx,
+                   unsigned char   *digest
+                   )
+{
+    uint64_t    bits = ctx->length * 8;
+    size_t      i = 0;
+
+    ctx->block[ctx->block_len++] = 0x80;
+
+    if ( ctx->block_len > 56 )
+    {
+        memset(ctx->block + ctx->block_len, 0, 64 - ctx->block_len);
+        sha1_block(ctx->state, ctx->block);
+        ctx->block_len = 0;
+    }
+
+    memset(ctx->block + ctx->block_len, 0, 56 - ctx->block_len);
+
+    for ( i = 0; i < 8; i++ )
+    {
+        ctx->block[63 - i] = (unsigned char) (bits >> (8 * i));
+    }
+
+    sha1_block(ctx->state, ctx->block);
+
+    for ( i = 0; i < 5; i++ )
+    {
+        digest[4 * i] = (unsigned char) (ctx->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char) (ctx->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char) (ctx->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char) ctx->state[i];
+    }
+}
+
+
+void pb_sha1(const void    *data,
+             size_t        size,
+             unsigned char *digest
+             )
+{
+    pb_sha1_t   ctx;
+
+    pb_sha1_init(&ctx);
+    pb_sha1_update(&ctx, data, size);
+    pb_sha1_final(&ctx, digest);
+}
+
+
+static void sha1_block(uint32_t            *state,
+                       const unsigned char *block
+                       )
+{
+    uint32_t    w[80];
+    uint32_t    a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    uint32_t    f = 0;
+    uint32_t    k = 0;
+    uint32_t    t = 0;
+    size_t      i = 0;
+
+    for ( i = 0; i < 16; i++ )
+    {
+        w[i] = ((uint32_t) block[4 * i] << 24) | ((uint32_t) block[4 * i + 1] << 16) |
+               ((uint32_t) block[4 * i + 2] << 8) | (uint32_t) block[4 * i + 3];
+    }
+
+    for ( i = 16; i < 80; i++ )
+    {
+        w[i] = ROTL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    for ( i = 0; i < 80; i++ )
+    {
+        if ( i < 20 )
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        }
+        else if ( i < 40 )
+        {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        }
+        else if ( i < 60 )
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+
+        t = ROTL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROTL(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
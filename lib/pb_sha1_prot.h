@@ -0,0 +1,70 @@
+/**
+ * @file pb_sha1_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  SHA-1 digests of the WebSocket handshake
+ */
+
+#ifndef __PB_SHA1_PROT_H__
+#define __PB_SHA1_PROT_H__
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t, uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PB_SHA1_DIGEST_SIZE
+ * Size of a SHA-1 digest in bytes
+ */
+#define PB_SHA1_DIGEST_SIZE     20
+
+
+/**
+ * @struct pb_sha1_s
+ * @brief Running SHA-1 computation
+ */
+typedef struct pb_sha1_s {
+    uint32_t state[5];          ///< Intermediate hash
+    uint64_t length;          ///< Number of bytes hashed
+    unsigned char block[64];          ///< Pending block
+    size_t block_len;          ///< Number of bytes in the pending block
+} pb_sha1_t;
+
+
+/**
+ * @brief      Start a SHA-1 computation
+ */
+void pb_sha1_init(pb_sha1_t *ctx);
+
+/**
+ * @brief      Hash more data
+ */
+void pb_sha1_update(pb_sha1_t *ctx, const void *data, size_t size);
+
+/**
+ * @brief      End a SHA-1 computation
+ *
+ * @param      ctx     The computation
+ * @param[out] digest  The digest (PB_SHA1_DIGEST_SIZE bytes)
+ */
+void pb_sha1_final(pb_sha1_t *ctx, unsigned char *digest);
+
+/**
+ * @brief      Hash a buffer
+ *
+ * @param[in]  data    The data
+ * @param[in]  size    The size of the data
+ * @param[out] digest  The digest (PB_SHA1_DIGEST_SIZE bytes)
+ */
+void pb_sha1(const void *data, size_t size, unsigned char *digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_SHA1_PROT_H__
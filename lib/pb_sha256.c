@@ -0,0 +1,229 @@
+/**
+ * @file pb_sha256.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <string.h>          // memcpy
+#include <fcntl.h>           // open, O_RDONLY
+#include <unistd.h>          // close
+#include <sys/mman.h>        // mmap, munmap, madvise
+#include <sys/stat.h>        // fstat
+
+#include "pb_utils.h"             // eprintf
+#include "pb_sha256_prot.h"       // pb_sha256_t, PB_SHA256_DIGEST_SIZE
+
+
+/**
+ * @brief Round constants (FIPS 180-4)
+ */
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+
+
+/**
+ * @brief      Hash one block of 64 bytes
+ */
+static void sha256_block(uint32_t *state, const unsigned char *block);
+
+
+void pb_sha256_init(pb_sha256_t *ctx)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(ctx->state, init, sizeof(init) );
+    ctx->length = 0;
+    ctx->block_len = 0;
+}
+
+
+void pb_sha256_update(pb_sha256_t *ctx,
+                      const void  *data,
+                      size_t      size
+                      )
+{
+    const unsigned char *p = data;
+    size_t              len = 0;
+
+    ctx->length += size;
+
+    // Complete the pending block
+    if ( ctx->block_len > 0 )
+    {
+        len = (size < 64 - ctx->block_len) ? size : 64 - ctx->block_len;
+        memcpy(ctx->block + ctx->block_len, p, len);
+        ctx->block_len += len;
+        p += len;
+        size -= len;
+
+        if ( ctx->block_len < 64 )
+        {
+            return;
+        }
+
+        sha256_block(ctx->state, ctx->block);
+        ctx->block_len = 0;
+    }
+
+    // Full blocks are hashed in place
+    for ( ; size >= 64; p += 64, size -= 64 )
+    {
+        sha256_block(ctx->state, p);
+    }
+
+    memcpy(ctx->block, p, size);
+    ctx->block_len = size;
+}
+
+
+void pb_sha256_final(pb_sha256_t     *ctx,
+                     unsigned char   *digest
+                     )
+{
+    uint64_t    bits = ctx->length * 8;
+    size_t      i = 0;
+
+    ctx->block[ctx->block_len++] = 0x80;
+
+    if ( ctx->block_len > 56 )
+    {
+        memset(ctx->block + ctx->block_len, 0, 64 - ctx->block_len);
+        sha256_block(ctx->state, ctx->block);
+        ctx->block_len = 0;
+    }
+
+    memset(ctx->block + ctx->block_len, 0, 56 - ctx->block_len);
+
+    for ( i = 0; i < 8; i++ )
+    {
+        ctx->block[63 - i] = (unsigned char) (bits >> (8 * i));
+    }
+
+    sha256_block(ctx->state, ctx->block);
+
+    for ( i = 0; i < 8; i++ )
+    {
+        digest[4 * i] = (unsigned char) (ctx->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char) (ctx->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char) (ctx->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char) ctx->state[i];
+    }
+}
+
+
+void pb_sha256(const void    *data,
+               size_t        size,
+               unsigned char *digest
+               )
+{
+    pb_sha256_t ctx;
+
+    pb_sha256_init(&ctx);
+    pb_sha256_update(&ctx, data, size);
+    pb_sha256_final(&ctx, digest);
+}
+
+
+int pb_sha256_file(const char    *path,
+                   unsigned char *digest
+                   )
+{
+    int         fd = -1;
+    struct stat st;
+    void        *map = NULL;
+
+    if ( (! path) || ((fd = open(path, O_RDONLY)) < 0) )
+    {
+        eprintf("Cannot open %s", (path) ? path : "(null)");
+        return -1;
+    }
+
+    if ( fstat(fd, &st) != 0 )
+    {
+        close(fd);
+        return -1;
+    }
+
+    if ( st.st_size == 0 )
+    {
+        close(fd);
+        pb_sha256(NULL, 0, digest);
+        return 0;
+    }
+
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if ( map == MAP_FAILED )
+    {
+        eprintf("Cannot map %s", path);
+        return -1;
+    }
+
+    madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+    pb_sha256(map, (size_t) st.st_size, digest);
+    munmap(map, (size_t) st.st_size);
+
+    return 0;
+}
+
+
+static void sha256_block(uint32_t            *state,
+                         const unsigned char *block
+                         )
+{
+    uint32_t    w[64];
+    uint32_t    a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t    e = state[4], f = state[5], g = state[6], h = state[7];
+    uint32_t    t1 = 0;
+    uint32_t    t2 = 0;
+    size_t      i = 0;
+
+    for ( i = 0; i < 16; i++ )
+    {
+        w[i] = ((uint32_t) block[4 * i] << 24) | ((uint32_t) block[4 * i + 1] << 16) |
+               ((uint32_t) block[4 * i + 2] << 8) | (uint32_t) block[4 * i + 3];
+    }
+
+    for ( i = 16; i < 64; i++ )
+    {
+        w[i] = (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+               (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+    }
+
+    for ( i = 0; i < 64; i++ )
+    {
+        t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file pb_sha256_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  SHA-256 digests of the uploaded contents
+ */
+
+#ifndef __PB_SHA256_PROT_H__
+#define __PB_SHA256_PROT_H__
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t, uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PB_SHA256_DIGEST_SIZE
+ * Size of a SHA-256 digest in bytes
+ */
+#define PB_SHA256_DIGEST_SIZE   32
+
+
+/**
+ * @struct pb_sha256_s
+ * @brief Running SHA-256 computation
+ */
+typedef struct pb_sha256_s {
+    uint32_t state[8];          ///< Intermediate hash
+    uint64_t length;          ///< Number of bytes hashed
+    unsigned char block[64];          ///< Pending block
+    size_t block_len;          ///< Number of bytes in the pending block
+} pb_sha256_t;
+
+
+/**
+ * @brief      Start a SHA-256 computation
+ */
+void pb_sha256_init(pb_sha256_t *ctx);
+
+/**
+ * @brief      Hash more data
+ */
+void pb_sha256_update(pb_sha256_t *ctx, const void *data, size_t size);
+
+/**
+ * @brief      End a SHA-256 computation
+ *
+ * @param      ctx     The computation
+ * @param[out] digest  The digest (PB_SHA256_DIGEST_SIZE bytes)
+ */
+void pb_sha256_final(pb_sha256_t *ctx, unsigned char *digest);
+
+/**
+ * @brief      Hash a buffer
+ *
+ * @param[in]  data    The data
+ * @param[in]  size    The size of the data
+ * @param[out] digest  The digest (PB_SHA256_DIGEST_SIZE bytes)
+ */
+void pb_sha256(const void *data, size_t size, unsigned char *digest);
+
+/**
+ * @brief      Hash a file, read once through a mapping
+ *
+ * @param[in]  path    The path of the file
+ * @param[out] digest  The digest (PB_SHA256_DIGEST_SIZE bytes)
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_sha256_file(const char *path, unsigned char *digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_SHA256_PROT_H__
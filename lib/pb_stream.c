@@ -0,0 +1,1329 @@
+/**
+ * @file pb_stream.c
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Client of the real-time event stream (WebSocket, RFC 6455)
+ */
+
+#include <stdlib.h>          // calloc, realloc, free, rand
+#include <string.h>          // memcpy, memmove, strlen, strncmp, strcmp, strstr
+#include <strings.h>         // strncasecmp
+#include <stdio.h>           // snprintf
+#include <errno.h>           // errno, EINTR
+#include <fcntl.h>           // open, O_RDONLY
+#include <unistd.h>          // read, write, close, pipe
+#include <poll.h>            // poll, struct pollfd, POLLIN, POLLOUT
+#include <pthread.h>         // pthread_create, pthread_join, pthread_mutex_lock, pthread_mutex_unlock
+#include <curl/curl.h>       // curl_easy_init, curl_easy_setopt, curl_easy_perform, curl_easy_getinfo,
+                             // curl_easy_send, curl_easy_recv, curl_easy_cleanup
+#include <json-glib/json-glib.h>    // JsonParser, JsonNode, JsonObject, JsonGenerator
+
+#include "pb_utils.h"             // iprintf, eprintf, gprintf, pb_free
+#include "pb_sha1_prot.h"         // pb_sha1_t, PB_SHA1_DIGEST_SIZE
+#include "pb_stream_priv.h"       // pb_stream_t, pb_stream_frame_t, PB_STREAM_URL, STREAM_*
+#include "pushbullet.h"           // pb_user_get_config, pb_config_get_stream_url, pb_config_get_token_key
+
+
+/**
+ * @brief      Fill a buffer with random bytes
+ */
+static void _random_bytes(unsigned char *buf, size_t size);
+
+/**
+ * @brief      Encode in base64
+ *
+ * @param[in]  in    The data to encode
+ * @param[in]  size  The size of the data
+ * @param[out] out   The encoded string (4 * ((size + 2) / 3) + 1 bytes)
+ */
+static void _base64_encode(const unsigned char *in, size_t size, char *out);
+
+/**
+ * @brief      Find a header in the response to the handshake
+ *
+ * @param[in]  response  The response
+ * @param[in]  end       The end of its headers (the empty line)
+ * @param[in]  name      The name of the header
+ * @param[out] len       The length of the value
+ *
+ * @return     The value (not NUL-terminated), NULL if the header is missing
+ */
+static const char* _find_header(const char *response, const char *end, const char *name, size_t *len);
+
+/**
+ * @brief      Check the response to the handshake: status, Upgrade, Connection and Sec-WebSocket-Accept (RFC 6455, 4.1)
+ *
+ * @param[in]  response  The response
+ * @param[in]  end       The end of its headers (the empty line)
+ * @param[in]  key       The Sec-WebSocket-Key sent
+ *
+ * @return     0 if the server accepts the WebSocket, -1 otherwise
+ */
+static int _check_handshake(const char *response, const char *end, const char *key);
+
+/**
+ * @brief      Open the connection and do the WebSocket handshake
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int _connect(pb_stream_t *stream);
+
+/**
+ * @brief      Close the connection
+ */
+static void _disconnect(pb_stream_t *stream);
+
+/**
+ * @brief      Send all the bytes on the connection
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int _send_all(pb_stream_t *stream, const char *data, size_t size);
+
+/**
+ * @brief      Send a masked control frame
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int _send_frame(pb_stream_t *stream, pb_stream_opcode_t opcode, const char *payload, size_t size);
+
+/**
+ * @brief      Receive the available bytes at the end of the receive buffer
+ *
+ * @return     1 if bytes have been received, 0 if none is available, -1 if the connection is closed
+ */
+static int _recv(pb_stream_t *stream);
+
+/**
+ * @brief      Decode a frame at the beginning of a buffer
+ *
+ * @return     The size of the frame, 0 if the frame is not complete, -1 if the frame is invalid
+ */
+static ssize_t _decode_frame(char *buf, size_t size, pb_stream_frame_t *frame);
+
+/**
+ * @brief      Handle the complete frames of the receive buffer
+ *
+ * @return     0 if went well, -1 if the connection has to be closed
+ */
+static int _handle_frames(pb_stream_t *stream);
+
+/**
+ * @brief      Handle a frame
+ *
+ * @return     0 if went well, -1 if the connection has to be closed
+ */
+static int _handle_frame(pb_stream_t *stream, const pb_stream_frame_t *frame);
+
+/**
+ * @brief      Parse a message and call the callback of its event
+ */
+static void _dispatch_message(pb_stream_t *stream, const char *data, size_t size);
+
+/**
+ * @brief      Call the callback of an event
+ */
+static void _dispatch_event(pb_stream_t *stream, pb_stream_event_t event, const char *subtype, const char *data);
+
+/**
+ * @brief      Run the pending synchronizations and dispatch the pending tickles
+ */
+static void _run_pending(pb_stream_t *stream);
+
+/**
+ * @brief      Give the pushes more recent than the watermark to the synchronization callback
+ */
+static int _sync_pushes_page(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata);
+
+/**
+ * @brief      Read the messages until the connection is lost or the stream is stopped
+ */
+static void _read_stream(pb_stream_t *stream);
+
+/**
+ * @brief      Wait before the next attempt to reconnect, and connect
+ *
+ * @return     0 if connected, -1 if the stream is stopped
+ */
+static int _reconnect(pb_stream_t *stream);
+
+/**
+ * @brief      Thread reading the stream
+ */
+static void* _stream_thread(void *arg);
+
+/**
+ * @brief      Free a stream whose thread is stopped
+ */
+static void _free(pb_stream_t *stream);
+
+
+pb_stream_t* pb_stream_new(pb_user_t *user)
+{
+    pb_stream_t *stream = NULL;
+
+    if ( (! user) || ((stream = calloc(1, sizeof(pb_stream_t))) == NULL) )
+    {
+        return (NULL);
+    }
+
+    pb_user_ref(user);
+    stream->user = user;
+    stream->sock = CURL_SOCKET_BAD;
+    stream->wakeup[0] = -1;
+    stream->wakeup[1] = -1;
+    atomic_init(&stream->stopping, 0);
+    pthread_mutex_init(&stream->mtx, NULL);
+
+    // Increase the reference
+    pb_refcount_init(&stream->ref);
+
+    return (stream);
+}
+
+
+int pb_stream_ref(pb_stream_t* stream)
+{
+    if ( ! stream )
+    {
+        return -1;
+    }
+
+    pb_refcount_inc(&stream->ref);
+
+    return 0;
+}
+
+
+int pb_stream_unref(pb_stream_t* stream)
+{
+    if ( ! stream )
+    {
+        return -1;
+    }
+
+    if ( pb_refcount_dec(&stream->ref) )
+    {
+        // Dropped from a callback: the thread cannot join itself, it frees the stream when it returns
+        if ( stream->started && pthread_equal(pthread_self(), stream->thread) )
+        {
+            atomic_store(&stream->stopping, 1);
+            stream->released = 1;
+            pthread_detach(stream->thread);
+            return 0;
+        }
+
+        pb_stream_stop(stream);
+        _free(stream);
+    }
+
+    return 0;
+}
+
+
+int pb_stream_set_callback(pb_stream_t*         stream,
+                           pb_stream_event_t    event,
+                           pb_stream_cb         cb,
+                           void                 *userdata
+                           )
+{
+    if ( (! stream) || (event >= PB_STREAM_NB_EVENTS) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&stream->mtx);
+
+    stream->callbacks[event].cb = cb;
+    stream->callbacks[event].userdata = userdata;
+
+    pthread_mutex_unlock(&stream->mtx);
+
+    return 0;
+}
+
+
+int pb_stream_sync_pushes(pb_stream_t*  stream,
+                          double        watermark,
+                          pb_pushes_cb  cb,
+                          void          *userdata
+                          )
+{
+    if ( (! stream) || stream->started )
+    {
+        return -1;
+    }
+
+    stream->watermark = watermark;
+    stream->delivered_low = 0;
+    stream->delivered_high = 0;
+    stream->pushes_cb = cb;
+    stream->pushes_userdata = userdata;
+
+    return 0;
+}
+
+
+int pb_stream_sync_devices(pb_stream_t*    stream,
+                           unsigned char   enable
+                           )
+{
+    if ( (! stream) || stream->started )
+    {
+        return -1;
+    }
+
+    stream->sync_devices = (enable) ? 1 : 0;
+
+    return 0;
+}
+
+
+double pb_stream_get_watermark(pb_stream_t* stream)
+{
+    double watermark = 0;
+
+    if ( stream )
+    {
+        pthread_mutex_lock(&stream->mtx);
+
+        watermark = stream->watermark;
+
+        pthread_mutex_unlock(&stream->mtx);
+    }
+
+    return (watermark);
+}
+
+
+int pb_stream_start(pb_stream_t* stream)
+{
+    if ( (! stream) || stream->started )
+    {
+        return -1;
+    }
+
+    if ( pipe(stream->wakeup) != 0 )
+    {
+        eprintf("Cannot create the wake-up pipe of the stream");
+        return -1;
+    }
+
+    atomic_store(&stream->stopping, 0);
+    stream->backoff_ms = STREAM_BACKOFF_MIN_MS;
+
+    if ( _connect(stream) != 0 )
+    {
+        close(stream->wakeup[0]);
+        close(stream->wakeup[1]);
+        stream->wakeup[0] = -1;
+        stream->wakeup[1] = -1;
+        return -1;
+    }
+
+    // The thread waits for the mutex: its identifier and started are set before its first callback
+    pthread_mutex_lock(&stream->mtx);
+
+    if ( pthread_create(&stream->thread, NULL, _stream_thread, stream) != 0 )
+    {
+        pthread_mutex_unlock(&stream->mtx);
+        eprintf("Cannot create the stream thread");
+        _disconnect(stream);
+        close(stream->wakeup[0]);
+        close(stream->wakeup[1]);
+        stream->wakeup[0] = -1;
+        stream->wakeup[1] = -1;
+        return -1;
+    }
+
+    stream->started = 1;
+
+    pthread_mutex_unlock(&stream->mtx);
+
+    return 0;
+}
+
+
+int pb_stream_stop(pb_stream_t* stream)
+{
+    if ( ! stream )
+    {
+        return -1;
+    }
+
+    if ( ! stream->started )
+    {
+        return 0;
+    }
+
+    // The thread may be waiting for the next message: wake it up
+    atomic_store(&stream->stopping, 1);
+
+    if ( write(stream->wakeup[1], "", 1) != 1 )
+    {
+        eprintf("Cannot wake up the stream thread");
+    }
+
+    // Called from a callback: the thread stops when the callback returns, it is joined by the next stop
+    if ( pthread_equal(pthread_self(), stream->thread) )
+    {
+        return 0;
+    }
+
+    pthread_join(stream->thread, NULL);
+
+    close(stream->wakeup[0]);
+    close(stream->wakeup[1]);
+    stream->wakeup[0] = -1;
+    stream->wakeup[1] = -1;
+    stream->started = 0;
+
+    return 0;
+}
+
+
+static void _random_bytes(unsigned char   *buf,
+                          size_t          size
+                          )
+{
+    size_t  i = 0;
+    int     fd = open("/dev/urandom", O_RDONLY);
+
+    if ( (fd < 0) || (read(fd, buf, size) != (ssize_t) size) )
+    {
+        for ( i = 0; i < size; i++ )
+        {
+            buf[i] = (unsigned char) rand();
+        }
+    }
+
+    if ( fd >= 0 )
+    {
+        close(fd);
+    }
+}
+
+
+static void _base64_encode(const unsigned char    *in,
+                           size_t                 size,
+                           char                   *out
+                           )
+{
+    static const char   alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t              i = 0;
+    uint32_t            n = 0;
+
+    for ( i = 0; i < size; i += 3 )
+    {
+        n = (uint32_t) in[i] << 16;
+        n |= (i + 1 < size) ? (uint32_t) in[i + 1] << 8 : 0;
+        n |= (i + 2 < size) ? (uint32_t) in[i + 2] : 0;
+
+        *out++ = alphabet[(n >> 18) & 0x3F];
+        *out++ = alphabet[(n >> 12) & 0x3F];
+        *out++ = (i + 1 < size) ? alphabet[(n >> 6) & 0x3F] : '=';
+        *out++ = (i + 2 < size) ? alphabet[n & 0x3F] : '=';
+    }
+
+    *out = '\0';
+}
+
+
+static const char* _find_header(const char   *response,
+                                const char   *end,
+                                const char   *name,
+                                size_t       *len
+                                )
+{
+    size_t      name_len = strlen(name);
+    const char  *line = strstr(response, "\r\n");
+    const char  *eol = NULL;
+    const char  *value = NULL;
+
+    // The status line is skipped, every header line ends with CRLF up to the empty line
+    for ( ; line && (line < end); line = eol )
+    {
+        line += 2;
+        eol = strstr(line, "\r\n");
+
+        if ( (strncasecmp(line, name, name_len) != 0) || (line[name_len] != ':') )
+        {
+            continue;
+        }
+
+        for ( value = line + name_len + 1; (*value == ' ') || (*value == '\t'); value++ );
+        for ( *len = eol - value; (*len > 0) && ((value[*len - 1] == ' ') || (value[*len - 1] == '\t')); (*len)-- );
+
+        return value;
+    }
+
+    return NULL;
+}
+
+
+static int _check_handshake(const char   *response,
+                            const char   *end,
+                            const char   *key
+                            )
+{
+    pb_sha1_t       ctx;
+    unsigned char   digest[PB_SHA1_DIGEST_SIZE];
+    char            accept[4 * ((PB_SHA1_DIGEST_SIZE + 2) / 3) + 1];
+    const char      *value = NULL;
+    const char      *token = NULL;
+    size_t          len = 0;
+    size_t          token_len = 0;
+    size_t          len_trimmed = 0;
+    int             upgrade = 0;
+
+    if ( (strncmp(response, "HTTP/1.1 101", 12) != 0) || ((response[12] != ' ') && (response[12] != '\r')) )
+    {
+        eprintf("The server refuses the WebSocket upgrade");
+        return -1;
+    }
+
+    value = _find_header(response, end, "Upgrade", &len);
+
+    if ( (! value) || (len != strlen("websocket")) || (strncasecmp(value, "websocket", len) != 0) )
+    {
+        eprintf("The server does not upgrade to the WebSocket protocol");
+        return -1;
+    }
+
+    // Connection is a list of tokens, one of them is Upgrade
+    value = _find_header(response, end, "Connection", &len);
+
+    for ( token = value; value && (token < value + len) && (! upgrade); token += token_len + 1 )
+    {
+        for ( ; (token < value + len) && ((*token == ' ') || (*token == '\t')); token++ );
+        for ( token_len = 0; (token + token_len < value + len) && (token[token_len] != ','); token_len++ );
+
+        for ( len_trimmed = token_len; (len_trimmed > 0) && ((token[len_trimmed - 1] == ' ') || (token[len_trimmed - 1] == '\t')); len_trimmed-- );
+
+        upgrade = (len_trimmed == strlen("Upgrade")) && (strncasecmp(token, "Upgrade", len_trimmed) == 0);
+    }
+
+    if ( ! upgrade )
+    {
+        eprintf("The server does not upgrade the connection");
+        return -1;
+    }
+
+    // Sec-WebSocket-Accept = base64(SHA-1(key + GUID)): the server has read our key
+    pb_sha1_init(&ctx);
+    pb_sha1_update(&ctx, key, strlen(key) );
+    pb_sha1_update(&ctx, STREAM_WEBSOCKET_GUID, strlen(STREAM_WEBSOCKET_GUID) );
+    pb_sha1_final(&ctx, digest);
+    _base64_encode(digest, sizeof(digest), accept);
+
+    value = _find_header(response, end, "Sec-WebSocket-Accept", &len);
+
+    if ( (! value) || (len != strlen(accept)) || (strncmp(value, accept, len) != 0) )
+    {
+        eprintf("The Sec-WebSocket-Accept of the server does not match the key");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int _connect(pb_stream_t *stream)
+{
+    pb_config_t         *config = pb_user_get_config(stream->user);
+    char                *stream_url = pb_config_get_stream_url(config);
+    const char          *token = pb_config_get_token_key(config);
+    const char          *authority = NULL;
+    const char          *path = NULL;
+    const char          *end = NULL;
+    char                url[MAX_SIZE_STREAM_URL];
+    char                connect_url[MAX_SIZE_STREAM_URL];
+    char                request[MAX_SIZE_STREAM_URL + 0x100];
+    unsigned char       nonce[16];
+    char                key[25];
+    struct pollfd       pfd;
+    long                sock = -1;
+    int                 len = 0;
+    int                 ret = 0;
+    CURLcode            res = CURLE_OK;
+
+    // The configuration gives a copy: it is kept for the whole connection
+    len = snprintf(url, sizeof(url), "%s", (stream_url) ? stream_url : PB_STREAM_URL);
+    pb_free(stream_url);
+    token = (token) ? token : "";
+
+    if ( len >= (int) sizeof(url) )
+    {
+        eprintf("The stream URL is too long");
+        return -1;
+    }
+
+    // libcurl only opens the connection (TLS for wss://): the WebSocket protocol is spoken over it
+    if ( strncmp(url, "wss://", 6) == 0 )
+    {
+        authority = url + 6;
+        len = snprintf(connect_url, sizeof(connect_url), "https://");
+    }
+    else if ( strncmp(url, "ws://", 5) == 0 )
+    {
+        authority = url + 5;
+        len = snprintf(connect_url, sizeof(connect_url), "http://");
+    }
+    else
+    {
+        eprintf("Unsupported stream URL %s", url);
+        return -1;
+    }
+
+    path = strchr(authority, '/');
+    end = (path) ? path : authority + strlen(authority);
+
+    len += snprintf(connect_url + len, sizeof(connect_url) - len, "%.*s/", (int) (end - authority), authority);
+    _random_bytes(nonce, sizeof(nonce) );
+    _base64_encode(nonce, sizeof(nonce), key);
+
+    ret = snprintf(request, sizeof(request),
+                   "GET %s%s HTTP/1.1\r\n"
+                   "Host: %.*s\r\n"
+                   "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: %s\r\n"
+                   "Sec-WebSocket-Version: 13\r\n"
+                   "\r\n",
+                   (path) ? path : "/", token, (int) (end - authority), authority, key);
+
+    if ( (len >= (int) sizeof(connect_url)) || (ret >= (int) sizeof(request)) )
+    {
+        eprintf("The stream URL is too long");
+        return -1;
+    }
+
+    if ( (stream->curl = curl_easy_init()) == NULL )
+    {
+        eprintf("curl_easy_init() could not be initiated.");
+        return -1;
+    }
+
+    curl_easy_setopt(stream->curl, CURLOPT_URL, connect_url);
+    curl_easy_setopt(stream->curl, CURLOPT_CONNECT_ONLY, 1L);
+    curl_easy_setopt(stream->curl, CURLOPT_CONNECTTIMEOUT_MS, (long) STREAM_HANDSHAKE_TIMEOUT_MS);
+
+    if ( pb_config_get_proxy(config) )
+    {
+        curl_easy_setopt(stream->curl, CURLOPT_PROXY, pb_config_get_proxy(config) );
+        curl_easy_setopt(stream->curl, CURLOPT_HTTPPROXYTUNNEL, 1L);
+    }
+
+    if ( (res = curl_easy_perform(stream->curl)) != CURLE_OK )
+    {
+        eprintf("curl_easy_perform() failed: %s", curl_easy_strerror(res) );
+        _disconnect(stream);
+        return -1;
+    }
+
+    curl_easy_getinfo(stream->curl, CURLINFO_ACTIVESOCKET, &sock);
+    stream->sock = (curl_socket_t) sock;
+
+    if ( _send_all(stream, request, (size_t) ret) != 0 )
+    {
+        _disconnect(stream);
+        return -1;
+    }
+
+    // Read the response of the handshake: the bytes following it are the first frames
+    pfd.fd = stream->sock;
+    pfd.events = POLLIN;
+    end = NULL;
+
+    while ( ! end )
+    {
+        ret = _recv(stream);
+
+        if ( ret < 0 )
+        {
+            break;
+        }
+
+        if ( ret > 0 )
+        {
+            stream->buffer[stream->buffer_length] = '\0';
+            end = strstr(stream->buffer, "\r\n\r\n");
+        }
+        else if ( (stream->buffer_length >= STREAM_BUFFER_SIZE) || (poll(&pfd, 1, STREAM_HANDSHAKE_TIMEOUT_MS) <= 0) )
+        {
+            break;
+        }
+    }
+
+    if ( (! end) || (_check_handshake(stream->buffer, end, key) != 0) )
+    {
+        eprintf("The WebSocket handshake with %s failed", url);
+        _disconnect(stream);
+        return -1;
+    }
+
+    end += 4;
+    stream->buffer_length -= end - stream->buffer;
+    memmove(stream->buffer, end, stream->buffer_length);
+
+    #ifdef __TRACES__
+    gprintf("Connected to the stream %s", url);
+    #endif
+
+    return 0;
+}
+
+
+static void _disconnect(pb_stream_t *stream)
+{
+    if ( stream->curl )
+    {
+        curl_easy_cleanup(stream->curl);
+        stream->curl = NULL;
+    }
+
+    stream->sock = CURL_SOCKET_BAD;
+
+    pb_free(stream->buffer);
+    stream->buffer_size = 0;
+    stream->buffer_length = 0;
+
+    pb_free(stream->message);
+    stream->message_length = 0;
+}
+
+
+static int _send_all(pb_stream_t  *stream,
+                     const char   *data,
+                     size_t       size
+                     )
+{
+    struct pollfd   pfd = { .fd = stream->sock, .events = POLLOUT };
+    size_t          sent = 0;
+    CURLcode        res = CURLE_OK;
+
+    while ( size > 0 )
+    {
+        res = curl_easy_send(stream->curl, data, size, &sent);
+
+        if ( res == CURLE_AGAIN )
+        {
+            if ( poll(&pfd, 1, STREAM_HANDSHAKE_TIMEOUT_MS) <= 0 )
+            {
+                eprintf("Cannot send on the stream");
+                return -1;
+            }
+        }
+        else if ( res != CURLE_OK )
+        {
+            eprintf("curl_easy_send() failed: %s", curl_easy_strerror(res) );
+            return -1;
+        }
+        else
+        {
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    return 0;
+}
+
+
+static int _send_frame(pb_stream_t          *stream,
+                       pb_stream_opcode_t   opcode,
+                       const char           *payload,
+                       size_t               size
+                       )
+{
+    char        frame[STREAM_MAX_HEADER + 125];
+    size_t      i = 0;
+
+    // Control frames carry at most 125 bytes
+    size = (size > 125) ? 125 : size;
+
+    // The frames of a client are always masked
+    frame[0] = (char) (0x80 | opcode);
+    frame[1] = (char) (0x80 | size);
+    _random_bytes((unsigned char *) &frame[2], 4);
+
+    for ( i = 0; i < size; i++ )
+    {
+        frame[6 + i] = payload[i] ^ frame[2 + (i & 3)];
+    }
+
+    return _send_all(stream, frame, 6 + size);
+}
+
+
+static int _recv(pb_stream_t *stream)
+{
+    char        *buffer = NULL;
+    size_t      size = 0;
+    size_t      received = 0;
+    CURLcode    res = CURLE_OK;
+
+    // Keep room for a NUL character
+    if ( stream->buffer_length + 1 >= stream->buffer_size )
+    {
+        if ( stream->buffer_size >= STREAM_MAX_BUFFER_SIZE )
+        {
+            eprintf("The stream message is too big");
+            return -1;
+        }
+
+        // The last step is clamped: the largest frame accepted by _decode_frame has to fit
+        size = (stream->buffer_size) ? stream->buffer_size * 2 : STREAM_BUFFER_SIZE;
+        size = (size > STREAM_MAX_BUFFER_SIZE) ? STREAM_MAX_BUFFER_SIZE : size;
+
+        if ( (buffer = realloc(stream->buffer, size)) == NULL )
+        {
+            eprintf("Not enough memory to receive the stream");
+            return -1;
+        }
+
+        stream->buffer = buffer;
+        stream->buffer_size = size;
+    }
+
+    res = curl_easy_recv(stream->curl, stream->buffer + stream->buffer_length,
+                         stream->buffer_size - stream->buffer_length - 1, &received);
+
+    if ( res == CURLE_AGAIN )
+    {
+        return 0;
+    }
+
+    if ( (res != CURLE_OK) || (received == 0) )
+    {
+        #ifdef __TRACES__
+        eprintf("The stream is closed: %s", curl_easy_strerror(res) );
+        #endif
+        return -1;
+    }
+
+    stream->buffer_length += received;
+
+    return 1;
+}
+
+
+static ssize_t _decode_frame(char                 *buf,
+                             size_t               size,
+                             pb_stream_frame_t    *frame
+                             )
+{
+    const unsigned char *b = (const unsigned char *) buf;
+    size_t              header = 2;
+    uint64_t            length = 0;
+    size_t              i = 0;
+    char                *mask = NULL;
+
+    if ( size < 2 )
+    {
+        return 0;
+    }
+
+    length = b[1] & 0x7F;
+
+    if ( length == 126 )
+    {
+        header += 2;
+    }
+    else if ( length == 127 )
+    {
+        header += 8;
+    }
+
+    header += (b[1] & 0x80) ? 4 : 0;
+
+    if ( size < header )
+    {
+        return 0;
+    }
+
+    if ( length >= 126 )
+    {
+        for ( length = 0, i = 2; i < ((b[1] & 0x7F) == 126 ? 4u : 10u); i++ )
+        {
+            length = (length << 8) | b[i];
+        }
+    }
+
+    if ( length > STREAM_MAX_MESSAGE )
+    {
+        eprintf("The stream frame is too big (%llu bytes)", (unsigned long long) length);
+        return -1;
+    }
+
+    if ( size < header + length )
+    {
+        return 0;
+    }
+
+    frame->fin = b[0] >> 7;
+    frame->opcode = b[0] & 0x0F;
+    frame->payload = buf + header;
+    frame->length = length;
+
+    // The server should not mask its frames, but it costs nothing to accept them
+    if ( b[1] & 0x80 )
+    {
+        mask = buf + header - 4;
+
+        for ( i = 0; i < length; i++ )
+        {
+            frame->payload[i] ^= mask[i & 3];
+        }
+    }
+
+    return (ssize_t) (header + length);
+}
+
+
+static int _handle_frames(pb_stream_t *stream)
+{
+    pb_stream_frame_t   frame;
+    size_t              offset = 0;
+    ssize_t             len = 0;
+    int                 ret = 0;
+
+    while ( (ret == 0) && ((len = _decode_frame(stream->buffer + offset, stream->buffer_length - offset, &frame)) > 0) )
+    {
+        ret = _handle_frame(stream, &frame);
+        offset += (size_t) len;
+    }
+
+    stream->buffer_length -= offset;
+    memmove(stream->buffer, stream->buffer + offset, stream->buffer_length);
+
+    return (len < 0) ? -1 : ret;
+}
+
+
+static int _handle_frame(pb_stream_t                *stream,
+                         const pb_stream_frame_t    *frame
+                         )
+{
+    char    *message = NULL;
+
+    switch ( frame->opcode )
+    {
+        case STREAM_OP_TEXT:
+        case STREAM_OP_BINARY:
+        case STREAM_OP_CONTINUATION:
+            if ( (frame->opcode == STREAM_OP_CONTINUATION) != (stream->message != NULL) )
+            {
+                eprintf("Unexpected stream frame (opcode %u)", frame->opcode);
+                return -1;
+            }
+
+            // Most messages come in a single frame: they are parsed straight from the receive buffer
+            if ( frame->fin && (! stream->message) )
+            {
+                _dispatch_message(stream, frame->payload, frame->length);
+                return 0;
+            }
+
+            if ( stream->message_length + frame->length > STREAM_MAX_MESSAGE )
+            {
+                eprintf("The stream message is too big");
+                return -1;
+            }
+
+            if ( (message = realloc(stream->message, stream->message_length + frame->length + 1)) == NULL )
+            {
+                eprintf("Not enough memory to receive the stream");
+                return -1;
+            }
+
+            memcpy(message + stream->message_length, frame->payload, frame->length);
+            stream->message = message;
+            stream->message_length += frame->length;
+
+            if ( frame->fin )
+            {
+                _dispatch_message(stream, stream->message, stream->message_length);
+                pb_free(stream->message);
+                stream->message_length = 0;
+            }
+            return 0;
+
+        case STREAM_OP_PING:
+            return _send_frame(stream, STREAM_OP_PONG, frame->payload, frame->length);
+
+        case STREAM_OP_PONG:
+            return 0;
+
+        case STREAM_OP_CLOSE:
+            // Echo the status code of the server
+            _send_frame(stream, STREAM_OP_CLOSE, frame->payload, (frame->length >= 2) ? 2 : 0);
+            return -1;
+
+        default:
+            eprintf("Unknown stream opcode %u", frame->opcode);
+            return -1;
+    }
+}
+
+
+static void _dispatch_message(pb_stream_t    *stream,
+                              const char     *data,
+                              size_t         size
+                              )
+{
+    JsonParser      *parser = json_parser_new();
+    JsonNode        *root = NULL;
+    JsonObject      *obj = NULL;
+    JsonObject      *push = NULL;
+    JsonGenerator   *gen = NULL;
+    gchar           *push_data = NULL;
+    const char      *type = NULL;
+    const char      *subtype = NULL;
+
+    if ( (! json_parser_load_from_data(parser, data, size, NULL)) ||
+         ((root = json_parser_get_root(parser)) == NULL) || (! JSON_NODE_HOLDS_OBJECT(root)) )
+    {
+        eprintf("Impossible to parse the stream message");
+    }
+    else
+    {
+        obj = json_node_get_object(root);
+        type = (json_object_has_member(obj, "type")) ? json_object_get_string_member(obj, "type") : NULL;
+
+        if ( ! type )
+        {
+            eprintf("The stream message has no type");
+        }
+        else if ( strcmp(type, "nop") == 0 )
+        {
+            _dispatch_event(stream, PB_STREAM_EVENT_NOP, NULL, NULL);
+        }
+        else if ( strcmp(type, "tickle") == 0 )
+        {
+            subtype = (json_object_has_member(obj, "subtype")) ? json_object_get_string_member(obj, "subtype") : NULL;
+
+            // The tickles received together are coalesced: they are dispatched once, after the synchronization
+            if ( subtype && (strcmp(subtype, "push") == 0) )
+            {
+                stream->tickles |= STREAM_SYNC_PUSHES;
+            }
+            else if ( subtype && (strcmp(subtype, "device") == 0) )
+            {
+                stream->tickles |= STREAM_SYNC_DEVICES;
+            }
+            else
+            {
+                _dispatch_event(stream, PB_STREAM_EVENT_TICKLE, subtype, NULL);
+            }
+        }
+        else if ( (strcmp(type, "push") == 0) && json_object_has_member(obj, "push") &&
+                  JSON_NODE_HOLDS_OBJECT(json_object_get_member(obj, "push")) )
+        {
+            push = json_object_get_object_member(obj, "push");
+            subtype = (json_object_has_member(push, "type")) ? json_object_get_string_member(push, "type") : NULL;
+
+            gen = json_generator_new();
+            json_generator_set_root(gen, json_object_get_member(obj, "push") );
+            push_data = json_generator_to_data(gen, NULL);
+
+            _dispatch_event(stream, PB_STREAM_EVENT_PUSH, subtype, push_data);
+
+            g_free(push_data);
+            g_object_unref(gen);
+        }
+        else
+        {
+            #ifdef __TRACES__
+            iprintf("Stream message of type %s ignored", type);
+            #endif
+        }
+    }
+
+    g_object_unref(parser);
+}
+
+
+static void _dispatch_event(pb_stream_t          *stream,
+                            pb_stream_event_t    event,
+                            const char           *subtype,
+                            const char           *data
+                            )
+{
+    pb_stream_callback_t    callback;
+
+    // Nothing is dispatched once the stream is stopped (or released by a callback)
+    if ( atomic_load(&stream->stopping) )
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&stream->mtx);
+
+    callback = stream->callbacks[event];
+
+    pthread_mutex_unlock(&stream->mtx);
+
+    // The callback is called without the lock: it can change the callbacks
+    if ( callback.cb )
+    {
+        callback.cb(event, subtype, data, callback.userdata);
+    }
+}
+
+
+static void _run_pending(pb_stream_t *stream)
+{
+    double          watermark = stream->watermark;
+    http_code_t     res = HTTP_OK;
+
+    stream->pending |= stream->tickles;
+
+    // A failed synchronization stays pending: it is retried with the next messages
+    if ( (stream->pending & STREAM_SYNC_PUSHES) && stream->pushes_cb )
+    {
+        if ( (res = pb_pushes_sync(stream->user, &watermark, _sync_pushes_page, stream)) == HTTP_OK )
+        {
+            pthread_mutex_lock(&stream->mtx);
+
+            stream->watermark = watermark;
+
+            pthread_mutex_unlock(&stream->mtx);
+
+            stream->delivered_low = 0;
+            stream->delivered_high = 0;
+            stream->pending &= ~STREAM_SYNC_PUSHES;
+        }
+        else
+        {
+            eprintf("The synchronization of the pushes failed (%d)", res);
+        }
+    }
+    else
+    {
+        stream->pending &= ~STREAM_SYNC_PUSHES;
+    }
+
+    if ( (stream->pending & STREAM_SYNC_DEVICES) && stream->sync_devices )
+    {
+        if ( (res = pb_user_sync_devices(stream->user)) == HTTP_OK )
+        {
+            stream->pending &= ~STREAM_SYNC_DEVICES;
+        }
+        else
+        {
+            eprintf("The synchronization of the devices failed (%d)", res);
+        }
+    }
+    else
+    {
+        stream->pending &= ~STREAM_SYNC_DEVICES;
+    }
+
+    if ( stream->tickles & STREAM_SYNC_PUSHES )
+    {
+        _dispatch_event(stream, PB_STREAM_EVENT_TICKLE, "push", NULL);
+    }
+
+    if ( stream->tickles & STREAM_SYNC_DEVICES )
+    {
+        _dispatch_event(stream, PB_STREAM_EVENT_TICKLE, "device", NULL);
+    }
+
+    stream->tickles = 0;
+}
+
+
+static int _sync_pushes_page(const pb_push_t *const *pushes,
+                             size_t                 nb_pushes,
+                             void                   *userdata
+                             )
+{
+    pb_stream_t         *stream = (pb_stream_t *) userdata;
+    const pb_push_t     **fresh = NULL;
+    size_t              nb_fresh = 0;
+    size_t              i = 0;
+    int                 ret = 0;
+    double              modified = 0;
+
+    if ( (fresh = malloc(nb_pushes * sizeof(pb_push_t *))) == NULL )
+    {
+        eprintf("Not enough memory to synchronize %zu pushes", nb_pushes);
+        return (1);
+    }
+
+    // A push already given at the same modification (seen before a reconnection for example) is not given again.
+    // The pages come from the most recent modification to the oldest one: every push between the bounds given by the
+    // failed attempts of the catch-up has been given, and a push modified since then is above them.
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        modified = pb_push_get_modified(pushes[i]);
+
+        if ( (modified > stream->watermark) &&
+             ((modified < stream->delivered_low) || (modified > stream->delivered_high)) )
+        {
+            fresh[nb_fresh++] = pushes[i];
+        }
+    }
+
+    if ( nb_fresh > 0 )
+    {
+        ret = stream->pushes_cb(fresh, nb_fresh, stream->pushes_userdata);
+    }
+
+    // Kept until the watermark is raised, when the whole catch-up has succeeded
+    for ( i = 0; i < nb_fresh; i++ )
+    {
+        modified = pb_push_get_modified(fresh[i]);
+
+        if ( (stream->delivered_high == 0) || (modified < stream->delivered_low) )
+        {
+            stream->delivered_low = modified;
+        }
+
+        if ( modified > stream->delivered_high )
+        {
+            stream->delivered_high = modified;
+        }
+    }
+
+    free(fresh);
+
+    return (ret);
+}
+
+
+static void _read_stream(pb_stream_t *stream)
+{
+    struct pollfd   pfds[2];
+    int             ret = 0;
+
+    pfds[0].fd = stream->sock;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = stream->wakeup[0];
+    pfds[1].events = POLLIN;
+
+    // The catch-up is done before the first messages, which may have come with the response of the handshake
+    stream->pending = STREAM_SYNC_PUSHES | STREAM_SYNC_DEVICES;
+    _run_pending(stream);
+    _dispatch_event(stream, PB_STREAM_EVENT_CONNECTED, NULL, NULL);
+
+    ret = _handle_frames(stream);
+    _run_pending(stream);
+
+    while ( (ret == 0) && (! atomic_load(&stream->stopping)) )
+    {
+        ret = poll(pfds, 2, STREAM_NOP_TIMEOUT_MS);
+
+        if ( ret == 0 )
+        {
+            eprintf("No message on the stream for %d ms", STREAM_NOP_TIMEOUT_MS);
+            ret = -1;
+        }
+        else if ( (ret > 0) && (! (pfds[1].revents & POLLIN)) )
+        {
+            // Read until libcurl has nothing left: TLS may keep decrypted bytes the socket does not show
+            while ( (ret = _recv(stream)) > 0 )
+            {
+                // A connection that works starts a new series of attempts
+                stream->backoff_ms = STREAM_BACKOFF_MIN_MS;
+
+                if ( _handle_frames(stream) != 0 )
+                {
+                    ret = -1;
+                    break;
+                }
+            }
+
+            _run_pending(stream);
+        }
+        else
+        {
+            // Woken up by pb_stream_stop, or interrupted by a signal
+            ret = ( (ret > 0) || (errno == EINTR) ) ? 0 : -1;
+        }
+    }
+
+    if ( atomic_load(&stream->stopping) )
+    {
+        // Normal closure
+        _send_frame(stream, STREAM_OP_CLOSE, "\x03\xE8", 2);
+    }
+
+    _disconnect(stream);
+}
+
+
+static int _reconnect(pb_stream_t *stream)
+{
+    struct pollfd   pfd = { .fd = stream->wakeup[0], .events = POLLIN };
+    unsigned char   jitter = 0;
+    int             delay = 0;
+
+    while ( ! atomic_load(&stream->stopping) )
+    {
+        // Between half and all of the backoff, so that the clients do not reconnect all together
+        _random_bytes(&jitter, sizeof(jitter) );
+        delay = (int) (stream->backoff_ms / 2 + (stream->backoff_ms / 2) * jitter / 255);
+
+        #ifdef __TRACES__
+        iprintf("Reconnecting to the stream in %d ms", delay);
+        #endif
+
+        // Woken up by pb_stream_stop
+        if ( poll(&pfd, 1, delay) > 0 )
+        {
+            break;
+        }
+
+        stream->backoff_ms = (stream->backoff_ms * 2 > STREAM_BACKOFF_MAX_MS) ? STREAM_BACKOFF_MAX_MS : stream->backoff_ms * 2;
+
+        if ( _connect(stream) == 0 )
+        {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+static void* _stream_thread(void *arg)
+{
+    pb_stream_t     *stream = (pb_stream_t *) arg;
+
+    // Wait for pb_stream_start to publish the thread
+    pthread_mutex_lock(&stream->mtx);
+    pthread_mutex_unlock(&stream->mtx);
+
+    do
+    {
+        _read_stream(stream);
+
+        _dispatch_event(stream, PB_STREAM_EVENT_DISCONNECTED, NULL, NULL);
+    }
+    while ( _reconnect(stream) == 0 );
+
+    // The last reference has been dropped by a callback of this thread
+    if ( stream->released )
+    {
+        _free(stream);
+    }
+
+    return (NULL);
+}
+
+
+static void _free(pb_stream_t *stream)
+{
+    if ( stream->wakeup[0] >= 0 )
+    {
+        close(stream->wakeup[0]);
+        close(stream->wakeup[1]);
+    }
+
+    pb_user_unref(stream->user);
+    pthread_mutex_destroy(&stream->mtx);
+    free(stream);
+}
@@ -0,0 +1,174 @@
+/**
+ * @file pb_stream_priv.h
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#ifndef __PB_STREAM_PRIV__
+#define __PB_STREAM_PRIV__
+
+#include <stdint.h>         // uint8_t, uint64_t
+#include <pthread.h>        // pthread_t, pthread_mutex_t
+#include <stdatomic.h>      // atomic_uchar
+#include <curl/curl.h>      // CURL, curl_socket_t
+
+#include "pushbullet.h"     // pb_user_t, pb_stream_cb, pb_pushes_cb, PB_STREAM_NB_EVENTS
+#include "pb_refcount_prot.h"   // pb_refcount_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def PB_STREAM_URL
+ * URL of the Pushbullet event stream (the token key is appended)
+ */
+#define PB_STREAM_URL               "wss://stream.pushbullet.com/websocket/"
+
+/**
+ * @def MAX_SIZE_STREAM_URL
+ * Maximum size of the URL of the stream
+ */
+#define MAX_SIZE_STREAM_URL         0x400
+
+/**
+ * @def STREAM_NOP_TIMEOUT_MS
+ * The server sends a nop every 30 seconds: the connection is considered lost after three missed ones
+ */
+#define STREAM_NOP_TIMEOUT_MS       90000
+
+/**
+ * @def STREAM_BUFFER_SIZE
+ * Initial size of the receive buffer (and maximum size of the handshake response)
+ */
+#define STREAM_BUFFER_SIZE          0x1000
+
+/**
+ * @def STREAM_MAX_MESSAGE
+ * Maximum size of a message (a bigger one closes the connection)
+ */
+#define STREAM_MAX_MESSAGE          0x100000
+
+/**
+ * @def STREAM_HANDSHAKE_TIMEOUT_MS
+ * Maximum time waited for the response to the WebSocket handshake
+ */
+#define STREAM_HANDSHAKE_TIMEOUT_MS 10000
+
+/**
+ * @def STREAM_WEBSOCKET_GUID
+ * Appended to the Sec-WebSocket-Key to compute the Sec-WebSocket-Accept (RFC 6455, 1.3)
+ */
+#define STREAM_WEBSOCKET_GUID       "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/**
+ * @def STREAM_BACKOFF_MIN_MS
+ * Delay before the first attempt to reconnect
+ */
+#define STREAM_BACKOFF_MIN_MS       1000
+
+/**
+ * @def STREAM_BACKOFF_MAX_MS
+ * Maximum delay between two attempts to reconnect
+ */
+#define STREAM_BACKOFF_MAX_MS       60000
+
+/**
+ * @def STREAM_SYNC_PUSHES
+ * The pushes have to be synchronized (or a push tickle has to be dispatched)
+ */
+#define STREAM_SYNC_PUSHES          0x1
+
+/**
+ * @def STREAM_SYNC_DEVICES
+ * The devices have to be synchronized (or a device tickle has to be dispatched)
+ */
+#define STREAM_SYNC_DEVICES         0x2
+
+/**
+ * @def STREAM_MAX_HEADER
+ * Maximum size of the header of a frame
+ */
+#define STREAM_MAX_HEADER           14
+
+/**
+ * @def STREAM_MAX_BUFFER_SIZE
+ * Maximum size of the receive buffer: a frame of the maximum size and a NUL character
+ */
+#define STREAM_MAX_BUFFER_SIZE      (STREAM_MAX_MESSAGE + STREAM_MAX_HEADER + 1)
+
+
+/**
+ * @brief WebSocket opcodes
+ */
+typedef enum pb_stream_opcode_e {
+    STREAM_OP_CONTINUATION = 0x0,             ///< Continuation of a fragmented message
+    STREAM_OP_TEXT = 0x1,             ///< Text message
+    STREAM_OP_BINARY = 0x2,             ///< Binary message
+    STREAM_OP_CLOSE = 0x8,             ///< Close of the connection
+    STREAM_OP_PING = 0x9,             ///< Ping
+    STREAM_OP_PONG = 0xA             ///< Pong
+} pb_stream_opcode_t;
+
+
+/**
+ * @struct pb_stream_frame_s
+ * @brief Frame decoded from the receive buffer
+ */
+typedef struct pb_stream_frame_s {
+    uint8_t fin;          ///< Last frame of the message?
+    uint8_t opcode;          ///< Opcode (pb_stream_opcode_t)
+    char *payload;          ///< Payload (unmasked, inside the receive buffer)
+    uint64_t length;          ///< Length of the payload
+} pb_stream_frame_t;
+
+
+/**
+ * @struct pb_stream_callback_s
+ * @brief Callback of an event
+ */
+typedef struct pb_stream_callback_s {
+    pb_stream_cb cb;          ///< Callback (may be NULL)
+    void *userdata;          ///< User data given to cb
+} pb_stream_callback_t;
+
+
+/**
+ * @struct pb_stream_s
+ * @brief Connection to the real-time event stream
+ */
+typedef struct pb_stream_s {
+    pb_user_t *user;          ///< User whose events are streamed
+    CURL *curl;          ///< Connection (CURLOPT_CONNECT_ONLY), NULL when not connected
+    curl_socket_t sock;          ///< Socket of the connection
+    pb_stream_callback_t callbacks[PB_STREAM_NB_EVENTS];          ///< Callback of each event
+    pb_pushes_cb pushes_cb;          ///< Callback receiving the synchronized pushes (NULL if the pushes are not synchronized)
+    void *pushes_userdata;          ///< User data given to pushes_cb
+    double watermark;          ///< Largest modification of the pushes given to pushes_cb
+    double delivered_low;          ///< Smallest modification given to pushes_cb by the failed attempts of the catch-up
+    double delivered_high;          ///< Largest one (0 when no push has been given since the watermark was raised)
+    unsigned char sync_devices;          ///< Are the devices of the user synchronized?
+    unsigned char pending;          ///< Synchronizations to run before the next messages (STREAM_SYNC_*)
+    unsigned char tickles;          ///< Tickles received and not dispatched yet (STREAM_SYNC_*)
+    unsigned int backoff_ms;          ///< Delay before the next attempt to reconnect
+    pthread_t thread;          ///< Thread reading the stream
+    unsigned char started;          ///< Has the thread been started (and not joined yet)?
+    atomic_uchar stopping;          ///< Has pb_stream_stop been called? (read by the thread, written by any thread)
+    unsigned char released;          ///< Has the last reference been dropped on the thread? (it frees the stream)
+    int wakeup[2];          ///< Pipe waking up the thread when the stream is stopped
+    char *buffer;          ///< Bytes received and not decoded yet
+    size_t buffer_size;          ///< Size of buffer
+    size_t buffer_length;          ///< Number of bytes in buffer
+    char *message;          ///< Fragmented message being reassembled
+    size_t message_length;          ///< Length of message
+    pthread_mutex_t mtx;          ///< Mutex for THREAD-SAFE
+    pb_refcount_t ref;          ///< Reference counter
+} pb_stream_t;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PB_STREAM_PRIV__
@@ -0,0 +1,516 @@
+/**
+ * @file pb_upload_cache.c
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#include <stdio.h>           // fopen, fgets, fprintf, fclose, rename, remove, snprintf, sscanf
+#include <stdlib.h>          // calloc, malloc, free
+#include <string.h>          // memcmp, memcpy, strdup, strcmp, strlen
+#include <time.h>            // time
+#include <pthread.h>         // pthread_mutex_init, pthread_mutex_lock, pthread_mutex_unlock, pthread_mutex_destroy
+
+#include "pb_utils.h"                 // iprintf, eprintf, pb_free
+#include "pb_upload_cache_priv.h"     // pb_upload_cache_t, pb_upload_entry_t, UPLOAD_CACHE_MIN_SLOTS, UPLOAD_CACHE_TTL
+#include "pb_upload_cache_prot.h"     // pb_upload_cache_lookup, pb_upload_cache_insert
+
+
+/**
+ * @brief      Get the slot holding the digest, or the empty slot where it would be inserted
+ */
+static pb_upload_entry_t* cache_find_slot(const pb_upload_cache_t *cache, const unsigned char *digest);
+
+/**
+ * @brief      Remove an entry from memory
+ */
+static void cache_remove(pb_upload_cache_t *cache, pb_upload_entry_t *entry);
+
+/**
+ * @brief      Remove the expired entries from memory
+ */
+static void cache_purge(pb_upload_cache_t *cache, time_t now);
+
+/**
+ * @brief      Set an entry in memory
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int cache_set(pb_upload_cache_t *cache, const unsigned char *digest, time_t expiry, const char *file_url, const char *file_type);
+
+/**
+ * @brief      Write an entry as a line of the cache file
+ */
+static void cache_write_entry(FILE *f, const pb_upload_entry_t *entry);
+
+/**
+ * @brief      Read the cache file
+ */
+static void cache_load(pb_upload_cache_t *cache);
+
+/**
+ * @brief      Rewrite the cache file with the live entries only (the mutex is held)
+ *
+ * @return     0 if went well, otherwise there is an error
+ */
+static int cache_compact(pb_upload_cache_t *cache);
+
+
+pb_upload_cache_t* pb_upload_cache_new(const char    *path,
+                                       long          ttl
+                                       )
+{
+    pb_upload_cache_t* cache = calloc(1, sizeof(pb_upload_cache_t));
+
+    if ( cache )
+    {
+        cache->slots = calloc(UPLOAD_CACHE_MIN_SLOTS, sizeof(pb_upload_entry_t) );
+        cache->path = (path) ? strdup(path) : NULL;
+
+        if ( (! cache->slots) || (path && (! cache->path)) )
+        {
+            pb_free(cache->slots);
+            pb_free(cache->path);
+            free(cache);
+            return (NULL);
+        }
+
+        cache->nb_slots = UPLOAD_CACHE_MIN_SLOTS;
+        cache->ttl = (ttl > 0) ? ttl : UPLOAD_CACHE_TTL;
+        pthread_mutex_init(&cache->mtx, NULL);
+
+        // Increase the reference
+        pb_refcount_init(&cache->ref);
+
+        cache_load(cache);
+    }
+
+    return cache;
+}
+
+
+int pb_upload_cache_ref(pb_upload_cache_t* cache)
+{
+    if ( ! cache )
+    {
+        return -1;
+    }
+
+    pb_refcount_inc(&cache->ref);
+    return 0;
+}
+
+
+int pb_upload_cache_unref(pb_upload_cache_t* cache)
+{
+    size_t  i = 0;
+
+    if ( ! cache )
+    {
+        return -1;
+    }
+
+    if ( pb_refcount_dec(&cache->ref) )
+    {
+        for ( i = 0; i < cache->nb_slots; i++ )
+        {
+            pb_free(cache->slots[i].file_url);
+            pb_free(cache->slots[i].file_type);
+        }
+
+        pb_free(cache->slots);
+        pb_free(cache->path);
+        pthread_mutex_destroy(&cache->mtx);
+        free(cache);
+    }
+
+    return 0;
+}
+
+
+size_t pb_upload_cache_get_number(pb_upload_cache_t* cache)
+{
+    size_t  nb = 0;
+
+    if ( cache )
+    {
+        pthread_mutex_lock(&cache->mtx);
+        nb = cache->nb_entries;
+        pthread_mutex_unlock(&cache->mtx);
+    }
+
+    return nb;
+}
+
+
+int pb_upload_cache_save(pb_upload_cache_t* cache)
+{
+    int     ret = -1;
+
+    if ( (! cache) || (! cache->path) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->mtx);
+    ret = cache_compact(cache);
+    pthread_mutex_unlock(&cache->mtx);
+
+    return ret;
+}
+
+
+int pb_upload_cache_lookup(pb_upload_cache_t     *cache,
+                           const unsigned char   *digest,
+                           char                  **file_url,
+                           char                  **file_type
+                           )
+{
+    pb_upload_entry_t   *entry = NULL;
+    int                 ret = 1;
+
+    if ( (! cache) || (! digest) || (! file_url) || (! file_type) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->mtx);
+
+    entry = cache_find_slot(cache, digest);
+
+    // An expired entry is dropped when it is met
+    if ( entry->file_url && (entry->expiry <= time(NULL)) )
+    {
+        cache_remove(cache, entry);
+    }
+    else if ( entry->file_url )
+    {
+        *file_url = strdup(entry->file_url);
+        *file_type = (entry->file_type) ? strdup(entry->file_type) : NULL;
+
+        if ( *file_url )
+        {
+            ret = 0;
+        }
+        else
+        {
+            pb_free(*file_type);
+            ret = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->mtx);
+
+    return ret;
+}
+
+
+int pb_upload_cache_insert(pb_upload_cache_t     *cache,
+                           const unsigned char   *digest,
+                           const char            *file_url,
+                           const char            *file_type
+                           )
+{
+    FILE    *f = NULL;
+    time_t  now = time(NULL);
+    int     ret = -1;
+
+    if ( (! cache) || (! digest) || (! file_url) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->mtx);
+
+    ret = cache_set(cache, digest, now + cache->ttl, file_url, file_type);
+
+    // The cache file is a log: the new entry is appended
+    if ( (ret == 0) && cache->path )
+    {
+        if ( (f = fopen(cache->path, "a")) == NULL )
+        {
+            eprintf("Cannot open the upload cache %s", cache->path);
+        }
+        else
+        {
+            cache_write_entry(f, cache_find_slot(cache, digest) );
+            fclose(f);
+            cache->nb_lines++;
+        }
+
+        // Compacted once most of the log is dead: the file stays within twice the live entries
+        if ( cache->nb_lines > 2 * cache->nb_entries + UPLOAD_CACHE_COMPACT_MIN )
+        {
+            cache_compact(cache);
+        }
+    }
+
+    pthread_mutex_unlock(&cache->mtx);
+
+    return ret;
+}
+
+
+static pb_upload_entry_t* cache_find_slot(const pb_upload_cache_t   *cache,
+                                          const unsigned char       *digest
+                                          )
+{
+    size_t  mask = cache->nb_slots - 1;
+    size_t  i = 0;
+
+    // The digest is already uniformly distributed
+    memcpy(&i, digest, sizeof(i) );
+
+    for ( i &= mask; cache->slots[i].file_url; i = (i + 1) & mask )
+    {
+        if ( memcmp(cache->slots[i].digest, digest, PB_SHA256_DIGEST_SIZE) == 0 )
+        {
+            break;
+        }
+    }
+
+    return &cache->slots[i];
+}
+
+
+static void cache_remove(pb_upload_cache_t   *cache,
+                         pb_upload_entry_t   *entry
+                         )
+{
+    size_t  mask = cache->nb_slots - 1;
+    size_t  i = (size_t) (entry - cache->slots);
+    size_t  j = 0;
+    size_t  k = 0;
+
+    pb_free(entry->file_url);
+    pb_free(entry->file_type);
+    cache->nb_entries--;
+
+    // Backward-shift deletion: no tombstone is left in the table
+    for ( j = (i + 1) & mask; cache->slots[j].file_url; j = (j + 1) & mask )
+    {
+        memcpy(&k, cache->slots[j].digest, sizeof(k) );
+        k &= mask;
+
+        if ( (j > i) ? ((k <= i) || (k > j)) : ((k <= i) && (k > j)) )
+        {
+            cache->slots[i] = cache->slots[j];
+            cache->slots[j].file_url = NULL;
+            cache->slots[j].file_type = NULL;
+            i = j;
+        }
+    }
+}
+
+
+static void cache_purge(pb_upload_cache_t    *cache,
+                        time_t               now
+                        )
+{
+    size_t  i = 0;
+
+    // A removal may shift a later entry into the current slot: it is checked again
+    while ( i < cache->nb_slots )
+    {
+        if ( cache->slots[i].file_url && (cache->slots[i].expiry <= now) )
+        {
+            cache_remove(cache, &cache->slots[i]);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+
+static int cache_set(pb_upload_cache_t   *cache,
+                     const unsigned char *digest,
+                     time_t              expiry,
+                     const char          *file_url,
+                     const char          *file_type
+                     )
+{
+    pb_upload_entry_t   *old = cache->slots;
+    size_t              old_nb = cache->nb_slots;
+    pb_upload_entry_t   *entry = NULL;
+    char                *url = NULL;
+    char                *type = NULL;
+    size_t              i = 0;
+
+    // The expired entries make room before the table grows
+    if ( (cache->nb_entries + 1) * 2 > cache->nb_slots )
+    {
+        cache_purge(cache, time(NULL) );
+    }
+
+    // Keep the load factor under one half
+    if ( (cache->nb_entries + 1) * 2 > cache->nb_slots )
+    {
+        if ( (cache->slots = calloc(old_nb * 2, sizeof(pb_upload_entry_t))) == NULL )
+        {
+            cache->slots = old;
+            return -1;
+        }
+
+        cache->nb_slots = old_nb * 2;
+
+        for ( i = 0; i < old_nb; i++ )
+        {
+            if ( old[i].file_url )
+            {
+                *cache_find_slot(cache, old[i].digest) = old[i];
+            }
+        }
+
+        free(old);
+    }
+
+    url = strdup(file_url);
+    type = (file_type) ? strdup(file_type) : NULL;
+
+    if ( (! url) || (file_type && (! type)) )
+    {
+        pb_free(url);
+        pb_free(type);
+        return -1;
+    }
+
+    entry = cache_find_slot(cache, digest);
+
+    if ( entry->file_url )
+    {
+        pb_free(entry->file_url);
+        pb_free(entry->file_type);
+    }
+    else
+    {
+        memcpy(entry->digest, digest, PB_SHA256_DIGEST_SIZE);
+        cache->nb_entries++;
+    }
+
+    entry->expiry = expiry;
+    entry->file_url = url;
+    entry->file_type = type;
+
+    return 0;
+}
+
+
+static void cache_write_entry(FILE                      *f,
+                              const pb_upload_entry_t   *entry
+                              )
+{
+    size_t  i = 0;
+
+    for ( i = 0; i < PB_SHA256_DIGEST_SIZE; i++ )
+    {
+        fprintf(f, "%02x", entry->digest[i]);
+    }
+
+    fprintf(f, " %lld %s %s\n", (long long) entry->expiry, (entry->file_type) ? entry->file_type : "-", entry->file_url);
+}
+
+
+static void cache_load(pb_upload_cache_t *cache)
+{
+    char            line[UPLOAD_CACHE_MAX_LINE];
+    char            hex[2 * PB_SHA256_DIGEST_SIZE + 1];
+    char            type[UPLOAD_CACHE_MAX_LINE];
+    char            url[UPLOAD_CACHE_MAX_LINE];
+    unsigned char   digest[PB_SHA256_DIGEST_SIZE];
+    unsigned int    byte = 0;
+    long long       expiry = 0;
+    time_t          now = time(NULL);
+    size_t          i = 0;
+    FILE            *f = NULL;
+
+    if ( (! cache->path) || ((f = fopen(cache->path, "r")) == NULL) )
+    {
+        return;
+    }
+
+    // Later lines replace the earlier ones
+    while ( fgets(line, sizeof(line), f) )
+    {
+        cache->nb_lines++;
+
+        if ( (sscanf(line, "%64s %lld %4095s %4095s", hex, &expiry, type, url) != 4) ||
+             (strlen(hex) != 2 * PB_SHA256_DIGEST_SIZE) || ((time_t) expiry <= now) )
+        {
+            continue;
+        }
+
+        for ( i = 0; i < PB_SHA256_DIGEST_SIZE; i++ )
+        {
+            if ( sscanf(&hex[2 * i], "%2x", &byte) != 1 )
+            {
+                break;
+            }
+
+            digest[i] = (unsigned char) byte;
+        }
+
+        if ( i == PB_SHA256_DIGEST_SIZE )
+        {
+            cache_set(cache, digest, (time_t) expiry, url, (strcmp(type, "-") != 0) ? type : NULL);
+        }
+    }
+
+    fclose(f);
+
+    #ifdef __TRACES__
+    iprintf("%zu uploads in the cache %s", cache->nb_entries, cache->path);
+    #endif
+}
+
+
+static int cache_compact(pb_upload_cache_t *cache)
+{
+    char    *tmp_path = NULL;
+    size_t  len = strlen(cache->path) + sizeof(".tmp");
+    size_t  nb_lines = 0;
+    size_t  i = 0;
+    time_t  now = time(NULL);
+    FILE    *f = NULL;
+    int     ret = -1;
+
+    if ( (tmp_path = malloc(len)) == NULL )
+    {
+        return -1;
+    }
+
+    snprintf(tmp_path, len, "%s.tmp", cache->path);
+
+    if ( (f = fopen(tmp_path, "w")) == NULL )
+    {
+        eprintf("Cannot open %s", tmp_path);
+    }
+    else
+    {
+        // Only the live entries are kept
+        for ( i = 0; i < cache->nb_slots; i++ )
+        {
+            if ( cache->slots[i].file_url && (cache->slots[i].expiry > now) )
+            {
+                cache_write_entry(f, &cache->slots[i]);
+                nb_lines++;
+            }
+        }
+
+        ret = (fclose(f) == 0) ? rename(tmp_path, cache->path) : -1;
+
+        if ( ret != 0 )
+        {
+            eprintf("Cannot write the upload cache %s", cache->path);
+            remove(tmp_path);
+        }
+        else
+        {
+            cache->nb_lines = nb_lines;
+        }
+    }
+
+    free(tmp_path);
+
+    return ret;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file pb_upload_cache_priv.h
+ * @author hbuyse
+ * @date 19/10/2026
+ */
+
+#ifndef __PB_UPLOAD_CACHE_PRIV__
+#define __PB_UPLOAD_CACHE_PRIV__
+
+#include <time.h>           // time_t
+#include <pthread.h>        // pthread_mutex_t
+
+#include "pb_sha256_prot.h"     // PB_SHA256_DIGEST_SIZE
+#include "pb_refcount_prot.h"   // pb_refcount_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @def UPLOAD_CACHE_MIN_SLOTS
+ * Initial number of slots of the cache (power of two)
+ */
+#define UPLOAD_CACHE_MIN_SLOTS      64
+
+/**
+ * @def UPLOAD_CACHE_TTL
+ * Default lifetime of an entry (in seconds)
+ */
+#define UPLOAD_CACHE_TTL            86400
+
+/**
+ * @def UPLOAD_CACHE_COMPACT_MIN
+ * Number of dead lines (expired or replaced entries) from which the cache file is compacted
+ */
+#define UPLOAD_CACHE_COMPACT_MIN    256
+
+/**
+ * @def UPLOAD_CACHE_MAX_LINE
+ * Maximum size of a line of the cache file
+ */
+#define UPLOAD_CACHE_MAX_LINE       0x1000
+
+
+/**
+ * @struct pb_upload_entry_s
+ * @brief Uploaded content
+ */
+typedef struct pb_upload_entry_s {
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];          ///< SHA-256 of the content
+    time_t expiry;          ///< Time after which the entry is not used anymore
+    char *file_url;          ///< URL of the uploaded file (NULL for an empty slot)
+    char *file_type;          ///< MIME type of the uploaded file (may be NULL)
+} pb_upload_entry_t;
+
+
+/**
+ * @struct pb_upload_cache_s
+ * @brief Cache of the uploaded contents, indexed by their SHA-256
+ * @details Each new entry is appended to the cache file; \a pb_upload_cache_save rewrites it without the expired
+ *          and replaced entries, which is also done once UPLOAD_CACHE_COMPACT_MIN lines of the file are dead.
+ */
+typedef struct pb_upload_cache_s {
+    char *path;          ///< Path of the cache file (NULL for a cache in memory only)
+    long ttl;          ///< Lifetime of a new entry (in seconds)
+    pb_upload_entry_t *slots;          ///< Open-addressing table
+    size_t nb_slots;          ///< Number of slots (power of two)
+    size_t nb_entries;          ///< Number of entries
+    size_t nb_lines;          ///< Number of lines of the cache file
+    pthread_mutex_t mtx;          ///< Mutex for THREAD-SAFE
+    pb_refcount_t ref;          ///< Reference counter
+} pb_upload_cache_t;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PB_UPLOAD_CACHE_PRIV__
@@ -0,0 +1,48 @@
+/**
+ * @file pb_upload_cache_prot.h
+ * @author hbuyse
+ * @date 19/10/2026
+ *
+ * @brief  Cache of the uploaded contents used by the file pushes
+ */
+
+#ifndef __PB_UPLOAD_CACHE_PROT_H__
+#define __PB_UPLOAD_CACHE_PROT_H__
+
+#include "pushbullet.h"     // pb_upload_cache_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief      Find an uploaded content
+ *
+ * @param      cache      The cache
+ * @param[in]  digest     The SHA-256 of the content
+ * @param[out] file_url   The URL of the uploaded file (to free)
+ * @param[out] file_type  The MIME type of the uploaded file (to free, may be NULL)
+ *
+ * @return     0 if the content has already been uploaded, 1 if not, -1 on error
+ */
+int pb_upload_cache_lookup(pb_upload_cache_t *cache, const unsigned char *digest, char **file_url, char **file_type);
+
+/**
+ * @brief      Remember an uploaded content
+ *
+ * @param      cache      The cache
+ * @param[in]  digest     The SHA-256 of the content
+ * @param[in]  file_url   The URL of the uploaded file
+ * @param[in]  file_type  The MIME type of the uploaded file (may be NULL)
+ *
+ * @return     On success: 0
+ * @return     On error: non-zero integer
+ */
+int pb_upload_cache_insert(pb_upload_cache_t *cache, const unsigned char *digest, const char *file_url, const char *file_type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif          // __PB_UPLOAD_CACHE_PROT_H__
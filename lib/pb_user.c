@@ -10,14 +10,20 @@
 #include <sys/types.h>          // struct stat, stat, S_ISREG
 #include <sys/stat.h>          // struct stat, stat, S_ISREG
 #include <unistd.h>          // struct stat, stat, S_ISREG
+#include <sched.h>           // sched_yield
+#include <time.h>            // clock_gettime, CLOCK_MONOTONIC, struct timespec
+#include <stdatomic.h>       // atomic_load, atomic_exchange, atomic_fetch_add, atomic_fetch_sub
+#include <pthread.h>         // pthread_mutex_init, pthread_mutex_lock, pthread_mutex_unlock, pthread_mutex_destroy
 
 #include <json-glib/json-glib.h>          // json_object, json_tokener_parse, json_object_get_string, json_object_object_foreach,
                                 // json_object_get_int
 
-#include "pb_user_priv.h"        // pb_user_t, MAX_SIZE_BUF, JSON_ASSOCIATE_BOOL, JSON_ASSOCIATE_STR, JSON_ASSOCIATE_INT, JSON_ASSOCIATE_DOUBLE
+#include "pb_user_priv.h"        // pb_user_t, MAX_SIZE_BUF
+#include "pb_schema_prot.h"       // pb_schema_fill, PB_SCHEMA_USER
 #include "pb_user_prot.h"          // pb_requests_get
 #include "pb_config_prot.h"          // pb_config_t
 #include "pb_devices_prot.h"        // pb_devices_get_number_active
+#include "pb_devices_cache_prot.h"  // pb_devices_cache_read, pb_devices_cache_write
 #include "pb_requests_prot.h"       // pb_requests_get
 #include "pb_utils.h"          // pb_requests_get
 #include "pushbullet.h"         // pb_config_t, pb_config_get_token_key
@@ -34,14 +40,88 @@ static void _dump_user_info(const pb_user_t);
 static void user_json_to_flat(JsonObject*, const gchar*, JsonNode *, gpointer);
 
 
+/**
+ * @brief      Publish a new list of devices and release the previous one once no reader can take it anymore
+ * @details    Must be called with devices_mtx locked.
+ *
+ * @param      user     The user
+ * @param      devices  The new list (its reference is given to the user)
+ */
+static void user_publish_devices(pb_user_t *user, pb_devices_t *devices);
+
+
+/**
+ * @brief      Get a time some milliseconds after another one
+ *
+ * @param[in]  time  The time
+ * @param[in]  ms    The number of milliseconds
+ *
+ * @return     The time plus ms
+ */
+static struct timespec user_time_add_ms(struct timespec time, long ms);
+
+
+/**
+ * @brief      Compare two times
+ *
+ * @return     Negative integer if a is before b, zero if they are equal, positive integer otherwise
+ */
+static int user_time_cmp(const struct timespec *a, const struct timespec *b);
+
+
+/**
+ * @brief      Tell if the list of devices is younger than its lifetime
+ * @details    Must be called with refresh_mtx locked.
+ *
+ * @param[in]  user  The user
+ *
+ * @return     Non-zero integer if the list does not have to be refreshed
+ */
+static int user_devices_fresh(const pb_user_t *user);
+
+
+/**
+ * @brief      Thread refreshing the devices of the user each time their lifetime expires
+ */
+static void* user_refresher_thread(void *arg);
+
+
+/**
+ * @brief      Thread revalidating the devices loaded from the cache
+ */
+static void* user_revalidator_thread(void *arg);
+
+
+/**
+ * @brief      Save the devices in the cache of the user, if any
+ * @details    Must be called with devices_mtx locked.
+ *
+ * @param[in]  user     The user
+ * @param[in]  devices  The devices just published
+ */
+static void user_save_devices(const pb_user_t *user, const pb_devices_t *devices);
+
+
 pb_user_t* pb_user_new(void)
 {
     pb_user_t* u = calloc(1, sizeof(pb_user_t));
 
+    pthread_condattr_t attr;
+
     if (u)
     {
+        pthread_mutex_init(&u->devices_mtx, NULL);
+        pthread_mutex_init(&u->refresh_mtx, NULL);
+        pthread_cond_init(&u->refresh_done, NULL);
+
+        // The refresher waits for a deadline on the same clock as the refreshes
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&u->refresher_wakeup, &attr);
+        pthread_condattr_destroy(&attr);
+
         // Increase the reference counter
-        u->ref++;
+        pb_refcount_init(&u->ref);
     }
 
     return u;
@@ -50,7 +130,7 @@ pb_user_t* pb_user_new(void)
 
 int pb_user_get_ref(const pb_user_t* p_user)
 {
-    return (p_user) ? p_user->ref : -1;
+    return (p_user) ? pb_refcount_get(&p_user->ref) : -1;
 }
 
 
@@ -61,7 +141,7 @@ int pb_user_ref(pb_user_t* p_user)
         return -1;
     }
 
-    p_user->ref++;
+    pb_refcount_inc(&p_user->ref);
     return 0;
 }
 
@@ -73,8 +153,15 @@ int pb_user_unref(pb_user_t* p_user)
         return -1;
     }
 
-    if (--p_user->ref <= 0)
+    if ( pb_refcount_dec(&p_user->ref) )
     {
+        pb_user_stop_devices_refresher(p_user);
+
+        if ( p_user->revalidator_started )
+        {
+            pthread_join(p_user->revalidator, NULL);
+        }
+
         /* Do not remove user->token_key because it causes a munmap_chunk since the token_key is given as an argument of
          * the program.
          * The free() function frees the memory space pointed to by ptr, which must have been returned by a previous
@@ -93,7 +180,14 @@ int pb_user_unref(pb_user_t* p_user)
         pb_free(p_user->image_url);
         pb_free(p_user->name);
         pb_config_unref(p_user->config);
-        pb_devices_unref(p_user->devices);
+        pb_devices_unref(atomic_load(&p_user->devices) );
+        pb_validators_clear(&p_user->me_validators);
+        pb_validators_clear(&p_user->devices_validators);
+        pb_free(p_user->devices_cache_path);
+        pthread_mutex_destroy(&p_user->devices_mtx);
+        pthread_cond_destroy(&p_user->refresher_wakeup);
+        pthread_cond_destroy(&p_user->refresh_done);
+        pthread_mutex_destroy(&p_user->refresh_mtx);
 
         free(p_user);
     }
@@ -126,6 +220,12 @@ char* pb_user_get_iden(const pb_user_t* p_user)
 }
 
 
+size_t pb_user_get_max_upload_size(const pb_user_t* p_user)
+{
+    return (p_user && (p_user->max_upload_size > 0)) ? (size_t) p_user->max_upload_size : 0;
+}
+
+
 int pb_user_set_config(pb_user_t* p_user,
                        pb_config_t* p_config)
 {
@@ -156,10 +256,17 @@ http_code_t pb_user_get_info(pb_user_t *p_user)
     JsonNode *root     = NULL;
     JsonObject *obj    = NULL;
     GError* err = NULL;
+    pb_validators_t *validators = NULL;
+
 
+    // Only informations already retrieved can be kept by a 304
+    if ( p_user && p_user->iden )
+    {
+        validators = &p_user->me_validators;
+    }
 
     // Access the API using the token
-    res = pb_requests_get(&result, &result_sz, API_URL_ME, (pb_config_t*) pb_user_get_config(p_user));
+    res = pb_requests_get_conditional(&result, &result_sz, API_URL_ME, (pb_config_t*) pb_user_get_config(p_user), validators);
 
     if ( (res == HTTP_OK) && (json_parser_load_from_data(parser, result, result_sz, NULL)) )
     {
@@ -187,35 +294,320 @@ http_code_t pb_user_retrieve_devices(pb_user_t *user)
     char *result = NULL;
     size_t result_sz = 0;
     unsigned short res = 0;
+    pb_validators_t *validators = NULL;
+    pb_devices_t *devices = NULL;
 
 
-    res = pb_requests_get(&result, &result_sz, API_URL_DEVICES, (pb_config_t*) pb_user_get_config(user));
-
-    // If we do not have a 200 OK, we stop the function and we return the HTTP Status code
-    if ( res == HTTP_OK )
+    if ( ! user )
     {
-        // Create the new list and set it into the 
-        pb_devices_t *devices = pb_devices_new();
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    pthread_mutex_lock(&user->devices_mtx);
 
-        // Free the old list of devices
-        pb_user_unref_devices(user);
+    // Only a list already retrieved can be kept by a 304
+    if ( atomic_load(&user->devices) )
+    {
+        validators = &user->devices_validators;
+    }
 
-        // Set the new list
-        pb_user_set_devices(user, devices);
+    res = pb_requests_get_conditional(&result, &result_sz, API_URL_DEVICES, (pb_config_t*) pb_user_get_config(user), validators);
 
-        // Parse and store the new datas
+    // If we do not have a 200 OK (304 keeps the current list untouched), we stop the function and we return the HTTP Status code
+    if ( (res == HTTP_OK) && ((devices = pb_devices_new()) != NULL) )
+    {
+        // The new list is complete before the readers can see it
         pb_devices_load_devices_from_data(devices, result, result_sz);
+        user_publish_devices(user, devices);
+        user_save_devices(user, devices);
+    }
+
+    pthread_mutex_unlock(&user->devices_mtx);
+
+    pb_free(result);
+
+    return (res);
+}
+
+
+http_code_t pb_user_sync_devices(pb_user_t *user)
+{
+    // CURL results
+    char *result = NULL;
+    size_t result_sz = 0;
+    unsigned short res = 0;
+    char url[MAX_SIZE_URL];
+    pb_devices_t *current = NULL;
+    pb_devices_t *devices = NULL;
+
+
+    if ( ! user )
+    {
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    pthread_mutex_lock(&user->devices_mtx);
+
+    // Without any list, the first synchronization starts from the beginning
+    current = atomic_load(&user->devices);
+
+    snprintf(url, sizeof(url), "%s?modified_after=%.17g", API_URL_DEVICES, pb_devices_get_modified_after(current) );
+
+    res = pb_requests_get(&result, &result_sz, url, (pb_config_t*) pb_user_get_config(user));
+
+    // Only the devices modified since the watermark are sent back: apply them to a copy of the current list, which
+    // may still be read
+    if ( res == HTTP_OK )
+    {
+        devices = (current) ? pb_devices_dup(current) : pb_devices_new();
+
+        if ( devices )
+        {
+            pb_devices_load_devices_from_data(devices, result, result_sz);
+            user_publish_devices(user, devices);
+            user_save_devices(user, devices);
+        }
+        else
+        {
+            eprintf("Not enough memory to copy the devices");
+        }
     }
 
+    pthread_mutex_unlock(&user->devices_mtx);
+
     pb_free(result);
 
     return (res);
 }
 
 
+int pb_user_set_devices_ttl(pb_user_t *user,
+                            long      ttl_ms
+                            )
+{
+    if ( (! user) || (ttl_ms < 0) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&user->refresh_mtx);
+    user->devices_ttl_ms = ttl_ms;
+
+    // The refresher computes its next deadline again
+    pthread_cond_broadcast(&user->refresher_wakeup);
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    return 0;
+}
+
+
+http_code_t pb_user_refresh_devices(pb_user_t *user)
+{
+    http_code_t     res = HTTP_UNKNOWN_CODE;
+    unsigned long   generation = 0;
+    unsigned char   from_cache = 0;
+
+    if ( ! user )
+    {
+        return (HTTP_UNKNOWN_CODE);
+    }
+
+    pthread_mutex_lock(&user->refresh_mtx);
+
+    if ( user->refresh_running )
+    {
+        // Another caller is already fetching the devices: share its request and its result
+        generation = user->refresh_generation;
+
+        while ( user->refresh_generation == generation )
+        {
+            pthread_cond_wait(&user->refresh_done, &user->refresh_mtx);
+        }
+
+        res = user->refresh_res;
+    }
+    else if ( user_devices_fresh(user) )
+    {
+        res = HTTP_NOT_MODIFIED;
+    }
+    else
+    {
+        user->refresh_running = 1;
+        from_cache = user->devices_from_cache;
+        pthread_mutex_unlock(&user->refresh_mtx);
+
+        // The validators of a list loaded from the cache are unknown: only its changes since its watermark are asked
+        res = (from_cache) ? pb_user_sync_devices(user) : pb_user_retrieve_devices(user);
+
+        pthread_mutex_lock(&user->refresh_mtx);
+        clock_gettime(CLOCK_MONOTONIC, &user->devices_checked);
+
+        if ( (res == HTTP_OK) || (res == HTTP_NOT_MODIFIED) )
+        {
+            user->devices_fetched = user->devices_checked;
+            user->devices_from_cache = 0;
+        }
+
+        user->refresh_res = res;
+        user->refresh_running = 0;
+        user->refresh_generation++;
+        pthread_cond_broadcast(&user->refresh_done);
+    }
+
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    return (res);
+}
+
+
+int pb_user_set_devices_cache(pb_user_t   *user,
+                              const char  *path
+                              )
+{
+    char            *copy = NULL;
+    pb_devices_t    *devices = NULL;
+
+    if ( (! user) || (! path) || ((copy = strdup(path)) == NULL) )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&user->devices_mtx);
+
+    pb_free(user->devices_cache_path);
+    user->devices_cache_path = copy;
+
+    // A list already retrieved is more recent than the cache
+    if ( (! atomic_load(&user->devices)) && ((devices = pb_devices_cache_read(path)) != NULL) )
+    {
+        user_publish_devices(user, devices);
+    }
+
+    pthread_mutex_unlock(&user->devices_mtx);
+
+    if ( ! devices )
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&user->refresh_mtx);
+    user->devices_from_cache = 1;
+
+    // The list can be read right away: its revalidation does not hold the caller
+    if ( (! user->revalidator_started) &&
+         (pthread_create(&user->revalidator, NULL, user_revalidator_thread, user) == 0) )
+    {
+        user->revalidator_started = 1;
+    }
+
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    return 0;
+}
+
+
+int pb_user_start_devices_refresher(pb_user_t *user)
+{
+    int res = -1;
+
+    if ( ! user )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&user->refresh_mtx);
+
+    if ( (! user->refresher_started) && (user->devices_ttl_ms > 0) )
+    {
+        user->refresher_stopping = 0;
+
+        if ( pthread_create(&user->refresher, NULL, user_refresher_thread, user) == 0 )
+        {
+            user->refresher_started = 1;
+            res = 0;
+        }
+        else
+        {
+            eprintf("Cannot create the refresher of the devices");
+        }
+    }
+
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    return (res);
+}
+
+
+int pb_user_stop_devices_refresher(pb_user_t *user)
+{
+    if ( ! user )
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&user->refresh_mtx);
+
+    if ( ! user->refresher_started )
+    {
+        pthread_mutex_unlock(&user->refresh_mtx);
+        return 0;
+    }
+
+    // The refresher may be waiting for its next deadline: wake it up
+    user->refresher_stopping = 1;
+    pthread_cond_broadcast(&user->refresher_wakeup);
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    pthread_join(user->refresher, NULL);
+
+    pthread_mutex_lock(&user->refresh_mtx);
+    user->refresher_started = 0;
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    return 0;
+}
+
+
 pb_devices_t* pb_user_get_devices(const pb_user_t* p_user)
 {
-    return ( p_user ) ? p_user->devices : NULL;
+    return ( p_user ) ? atomic_load(&p_user->devices) : NULL;
+}
+
+
+pb_devices_t* pb_user_acquire_devices(const pb_user_t* p_user)
+{
+    pb_user_t       *user = (pb_user_t *) p_user;
+    pb_devices_t    *devices = NULL;
+    unsigned int    epoch = 0;
+
+    if ( ! user )
+    {
+        return (NULL);
+    }
+
+    // While the reader is counted, the list it loads cannot be released by a refresh. It is counted in the epoch
+    // which is still the current one once counted: a publication flipping the epoch before waits for it.
+    for ( ;; )
+    {
+        epoch = atomic_load(&user->devices_epoch);
+        atomic_fetch_add(&user->devices_readers[epoch], 1);
+
+        if ( atomic_load(&user->devices_epoch) == epoch )
+        {
+            break;
+        }
+
+        atomic_fetch_sub(&user->devices_readers[epoch], 1);
+    }
+
+    if ( (devices = atomic_load(&user->devices)) != NULL )
+    {
+        pb_devices_ref(devices);
+    }
+
+    atomic_fetch_sub(&user->devices_readers[epoch], 1);
+
+    return devices;
 }
 
 
@@ -227,27 +619,181 @@ int pb_user_set_devices(pb_user_t* p_user,
         return -1;
     }
 
-    p_user->devices = p_devices;
+    pthread_mutex_lock(&p_user->devices_mtx);
+    user_publish_devices(p_user, p_devices);
+    pthread_mutex_unlock(&p_user->devices_mtx);
+
     return 0;
 }
 
 
 size_t pb_user_get_number_active_devices(const pb_user_t *p_user)
 {
-    return (p_user) ? pb_devices_get_number_active(p_user->devices) : 0;
+    pb_devices_t    *devices = pb_user_acquire_devices(p_user);
+    ssize_t         nb = pb_devices_get_number_active(devices);
+
+    pb_devices_unref(devices);
+
+    return (nb > 0) ? (size_t) nb : 0;
 }
 
 
 const char* pb_user_get_device_iden_from_name(const pb_user_t *p_user,
                                               const char* nickname)
 {
-    return (p_user && nickname) ? pb_devices_get_iden_from_name(p_user->devices, nickname) : NULL;
+    pb_devices_t    *devices = pb_user_acquire_devices(p_user);
+    const char      *iden = pb_devices_get_iden_from_name(devices, nickname);
+
+    // The reference of the user keeps the list, and the identification, until the next refresh
+    pb_devices_unref(devices);
+
+    return iden;
 }
 
 
-int pb_user_unref_devices(const pb_user_t *p_user)
+char* pb_user_dup_device_iden_from_name(const pb_user_t *p_user,
+                                        const char* nickname)
 {
-    return (p_user) ? pb_devices_unref(p_user->devices) : -1;
+    pb_devices_t    *devices = pb_user_acquire_devices(p_user);
+    const char      *iden = pb_devices_get_iden_from_name(devices, nickname);
+    char            *copy = NULL;
+
+    // The identification belongs to the snapshot: it is copied before the snapshot can be released by a refresh
+    if ( iden && ((copy = strdup(iden)) == NULL) )
+    {
+        eprintf("Not enough memory to copy the identification of %s", nickname);
+    }
+
+    pb_devices_unref(devices);
+
+    return copy;
+}
+
+
+static void user_publish_devices(pb_user_t       *user,
+                                 pb_devices_t    *devices
+                                 )
+{
+    pb_devices_t    *old = atomic_exchange(&user->devices, devices);
+    unsigned int    epoch = atomic_load(&user->devices_epoch);
+
+    // The new readers are counted in the other epoch and load the new list: only the readers of the old epoch can
+    // have loaded the old one, and they are not replaced by new ones while they are waited for
+    atomic_store(&user->devices_epoch, epoch ^ 1);
+
+    // Grace period: a reader which loaded the old list has taken its reference once it is not counted anymore
+    while ( atomic_load(&user->devices_readers[epoch]) != 0 )
+    {
+        sched_yield();
+    }
+
+    pb_devices_unref(old);
+}
+
+
+static struct timespec user_time_add_ms(struct timespec time,
+                                        long            ms
+                                        )
+{
+    time.tv_sec += ms / 1000;
+    time.tv_nsec += (ms % 1000) * 1000000;
+
+    if ( time.tv_nsec >= 1000000000 )
+    {
+        time.tv_sec++;
+        time.tv_nsec -= 1000000000;
+    }
+
+    return (time);
+}
+
+
+static int user_time_cmp(const struct timespec  *a,
+                         const struct timespec  *b
+                         )
+{
+    if ( a->tv_sec != b->tv_sec )
+    {
+        return (a->tv_sec < b->tv_sec) ? -1 : 1;
+    }
+
+    return (a->tv_nsec < b->tv_nsec) ? -1 : (a->tv_nsec > b->tv_nsec);
+}
+
+
+static int user_devices_fresh(const pb_user_t *user)
+{
+    struct timespec now;
+    struct timespec expiry;
+
+    // Without any lifetime or any list, the devices are always refreshed
+    if ( (user->devices_ttl_ms <= 0) || (! atomic_load(&user->devices)) ||
+         ((user->devices_fetched.tv_sec == 0) && (user->devices_fetched.tv_nsec == 0)) )
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    expiry = user_time_add_ms(user->devices_fetched, user->devices_ttl_ms);
+
+    return user_time_cmp(&now, &expiry) < 0;
+}
+
+
+static void* user_refresher_thread(void *arg)
+{
+    pb_user_t       *user = (pb_user_t *) arg;
+    struct timespec deadline;
+    struct timespec now;
+
+    pthread_mutex_lock(&user->refresh_mtx);
+
+    while ( ! user->refresher_stopping )
+    {
+        if ( user->devices_ttl_ms <= 0 )
+        {
+            // No lifetime anymore: nothing to do until it is set again or the refresher is stopped
+            pthread_cond_wait(&user->refresher_wakeup, &user->refresh_mtx);
+            continue;
+        }
+
+        // A failed refresh is retried after a whole lifetime too, not in a loop
+        deadline = user_time_add_ms(user->devices_checked, user->devices_ttl_ms);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if ( user_time_cmp(&now, &deadline) < 0 )
+        {
+            pthread_cond_timedwait(&user->refresher_wakeup, &user->refresh_mtx, &deadline);
+            continue;
+        }
+
+        pthread_mutex_unlock(&user->refresh_mtx);
+        (void) pb_user_refresh_devices(user);
+        pthread_mutex_lock(&user->refresh_mtx);
+    }
+
+    pthread_mutex_unlock(&user->refresh_mtx);
+
+    return (NULL);
+}
+
+
+static void* user_revalidator_thread(void *arg)
+{
+    (void) pb_user_refresh_devices( (pb_user_t *) arg);
+
+    return (NULL);
+}
+
+
+static void user_save_devices(const pb_user_t        *user,
+                              const pb_devices_t     *devices
+                              )
+{
+    if ( user->devices_cache_path && (pb_devices_cache_write(user->devices_cache_path, devices) != 0) )
+    {
+        eprintf("Cannot save the devices in %s", user->devices_cache_path);
+    }
 }
 
 
@@ -272,18 +818,5 @@ static void user_json_to_flat(JsonObject *object __attribute__((unused)),
                           gpointer userdata
                           )
 {
-    pb_user_t* user = (pb_user_t*) userdata;
-
-    if (JSON_NODE_HOLDS_VALUE(member_node))
-    {
-        JSON_ASSOCIATE_INT(user, active);
-        JSON_ASSOCIATE_DOUBLE(user, created);
-        JSON_ASSOCIATE_DOUBLE(user, modified);
-        JSON_ASSOCIATE_STR(user, email);
-        JSON_ASSOCIATE_STR(user, email_normalized);
-        JSON_ASSOCIATE_STR(user, iden);
-        JSON_ASSOCIATE_STR(user, image_url);
-        JSON_ASSOCIATE_STR(user, name);
-        JSON_ASSOCIATE_INT(user, max_upload_size);    
-    }
+    pb_schema_fill(PB_SCHEMA_USER, userdata, member_name, member_node, NULL);
 }
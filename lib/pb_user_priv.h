@@ -8,6 +8,14 @@
 #define __PB_USER_PRIV__
 
 
+#include <time.h>                    // struct timespec
+#include <stdatomic.h>               // atomic_uint, _Atomic
+#include <pthread.h>                 // pthread_t, pthread_mutex_t, pthread_cond_t
+
+#include "pushbullet.h"             // http_code_t
+#include "pb_requests_prot.h"       // pb_validators_t, MAX_SIZE_URL
+#include "pb_refcount_prot.h"       // pb_refcount_t
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,30 +31,6 @@ typedef struct pb_devices_s pb_devices_t;
 #define     MAX_SIZE_BUF 0x1000
 
 
-/**
- * @def        JSON_ASSOCIATE_BOOL
- * @def        JSON_ASSOCIATE_STR
- * @def        JSON_ASSOCIATE_INT
- * @def        JSON_ASSOCIATE_DOUBLE
- * @brief      Macro to associate a key in a structure
- *
- * @param      var   The pointer we fill
- * @param      k     The JSON key
- */
-#define     JSON_ASSOCIATE_BOOL(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var->k = json_node_get_boolean(member_node); } while(0)
-
-#define     JSON_ASSOCIATE_STR(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var->k = json_node_dup_string(member_node); } while(0)
-
-#define     JSON_ASSOCIATE_INT(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var->k = json_node_get_int(member_node); } while(0)
-
-#define     JSON_ASSOCIATE_DOUBLE(var, k)          \
-    do { if ( strcmp(member_name, # k) == 0 ) var->k = json_node_get_double(member_node); } while(0)
-
-
-
 /**
  * @struct pb_user_s
  * @brief Contains the user informations.
@@ -62,8 +46,29 @@ typedef struct pb_user_s {
     char *name;           ///< The user's name
     int max_upload_size;          ///< The maximum size of a file the user can upload in bytes
     pb_config_t *config;            ///< Configuration from the config file
-    pb_devices_t *devices;          ///< The list of active devices
-    int32_t     ref;          ///< Reference count
+    _Atomic(pb_devices_t *) devices;          ///< The list of active devices (replaced as a whole by an atomic swap)
+    atomic_uint devices_readers[2];          ///< Number of readers taking a reference on the list of devices, by epoch
+    atomic_uint devices_epoch;          ///< Epoch of the new readers (0 or 1), flipped by each publication of the list
+    pthread_mutex_t devices_mtx;          ///< Mutex serializing the refreshes of the list of devices
+    pb_validators_t me_validators;          ///< Validators of the last user informations retrieved
+    pb_validators_t devices_validators;          ///< Validators of the last list of devices retrieved
+    long devices_ttl_ms;          ///< Lifetime of the list of devices (0: every refresh sends a request)
+    struct timespec devices_fetched;          ///< End of the last successful refresh of the devices (CLOCK_MONOTONIC)
+    struct timespec devices_checked;          ///< End of the last refresh of the devices, successful or not (CLOCK_MONOTONIC)
+    pthread_mutex_t refresh_mtx;          ///< Mutex of the single-flight gate and of the refresher
+    pthread_cond_t refresh_done;          ///< Signaled when the refresh in flight ends
+    unsigned char refresh_running;          ///< Is a refresh of the devices in flight?
+    unsigned long refresh_generation;          ///< Number of refreshes ended (the waiters wait for it to change)
+    http_code_t refresh_res;          ///< Result of the last refresh ended, shared with its waiters
+    pthread_t refresher;          ///< Thread refreshing the devices in the background
+    pthread_cond_t refresher_wakeup;          ///< Wakes the refresher up when it is stopped (CLOCK_MONOTONIC)
+    unsigned char refresher_started;          ///< Has the refresher been started (and not joined yet)?
+    unsigned char refresher_stopping;          ///< Has pb_user_stop_devices_refresher been called?
+    char *devices_cache_path;          ///< Path of the cache in which the devices are saved after each refresh (may be NULL)
+    unsigned char devices_from_cache;          ///< Does the list come from the cache and still have to be revalidated?
+    pthread_t revalidator;          ///< Thread revalidating the list loaded from the cache
+    unsigned char revalidator_started;          ///< Has the revalidator been started (and not joined yet)?
+    pb_refcount_t ref;          ///< Reference count
 } pb_user_t;
 
 
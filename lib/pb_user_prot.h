@@ -22,8 +22,6 @@ int pb_user_get_ref(const pb_user_t *p_user);
 int pb_user_set_devices(pb_user_t* p_user, pb_devices_t* p_devices);
 
 
-int pb_user_unref_devices(const pb_user_t *p_user);
-
 #ifdef __cplusplus
 }
 #endif
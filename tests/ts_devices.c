@@ -1,13 +1,17 @@
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <json-glib/json-glib.h>
 
 #include <sys/types.h>   // open, lseek
 #include <sys/stat.h>   // open
 #include <fcntl.h>   // open
 #include <unistd.h>   // lseek
 #include <stdio.h>
+#include <string.h>   // memset, strlen
 
+#include "lib/pb_device_prot.h"
 #include "lib/pb_devices_prot.h"
+#include "lib/pb_devices_cache_prot.h"
 #include "pushbullet.h"
 
 
@@ -198,6 +202,225 @@ static void test_get_iden_from_name(void)
     }
 }
 
+static void test_apply_changes(void)
+{
+    char* json = NULL;
+    size_t json_len = 0;
+    pb_devices_t* d = pb_devices_new();
+    char renamed[] = "{ \"devices\": [ { \"active\": true, \"iden\": \"helloworld1\", \"modified\": 1600000000.5, "
+                     "\"nickname\": \"Nightly\", \"icon\": \"browser\" } ] }";
+    char deleted[] = "{ \"devices\": [ { \"active\": false, \"iden\": \"helloworld1\", \"modified\": 1600000001.5 } ] }";
+
+    g_assert_cmpfloat( pb_devices_get_modified_after(d), ==, 0 );
+
+    g_assert_cmpint( load_json_from_file(&json, &json_len, "devices/one_active.json"), ==, 0);
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, json, json_len), ==, 0 );
+    g_assert_cmpint( pb_devices_get_number_active(d), ==, 1);
+    g_assert_cmpfloat( pb_devices_get_modified_after(d), ==, 1516970794.313482 );
+
+    // A modified device replaces the known one
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, renamed, sizeof(renamed)), ==, 0 );
+    g_assert_cmpint( pb_devices_get_number_active(d), ==, 1);
+    g_assert_cmpstr( pb_devices_get_iden_from_name(d, "Firefox"), ==, NULL);
+    g_assert_cmpstr( pb_devices_get_iden_from_name(d, "Nightly"), ==, "helloworld1");
+    g_assert_cmpfloat( pb_devices_get_modified_after(d), ==, 1600000000.5 );
+
+    // A deleted device is removed
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, deleted, sizeof(deleted)), ==, 0 );
+    g_assert_cmpint( pb_devices_get_number_active(d), ==, 0);
+    g_assert_null( pb_devices_get_device_from_iden(d, "helloworld1") );
+    g_assert_cmpfloat( pb_devices_get_modified_after(d), ==, 1600000001.5 );
+
+    free(json);
+    pb_devices_unref(d);
+}
+
+static void test_normalized_name(void)
+{
+    pb_devices_t* d = pb_devices_new();
+    char long_name[0x200];
+    char json[0x400];
+    char two[] = "{ \"devices\": [ "
+                 "{ \"active\": true, \"iden\": \"pixel\", \"modified\": 1600000000.5, \"nickname\": \"Pixel 7\", \"icon\": \"phone\" }, "
+                 "{ \"active\": true, \"iden\": \"other\", \"modified\": 1600000000.6, \"nickname\": \"PIXEL  7\", \"icon\": \"phone\" } ] }";
+    char deleted[] = "{ \"devices\": [ { \"active\": false, \"iden\": \"pixel\", \"modified\": 1600000001.5 } ] }";
+
+    g_assert_null( pb_devices_get_iden_from_normalized_name(NULL, "pixel 7") );
+    g_assert_null( pb_devices_get_iden_from_normalized_name(d, NULL) );
+    g_assert_null( pb_devices_get_iden_from_normalized_name(d, "pixel 7") );
+
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, two, sizeof(two)), ==, 0 );
+
+    // The exact lookup is not changed
+    g_assert_null( pb_devices_get_iden_from_name(d, "pixel 7") );
+    g_assert_cmpstr( pb_devices_get_iden_from_name(d, "PIXEL  7"), ==, "other");
+
+    // The first device loaded wins
+    g_assert_cmpstr( pb_devices_get_iden_from_normalized_name(d, "pixel 7"), ==, "pixel");
+    g_assert_cmpstr( pb_devices_get_iden_from_normalized_name(d, "  pIxEl\t \n7 "), ==, "pixel");
+    g_assert_null( pb_devices_get_iden_from_normalized_name(d, "pixel7") );
+
+    // The other device takes the place of a deleted one
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, deleted, sizeof(deleted)), ==, 0 );
+    g_assert_cmpstr( pb_devices_get_iden_from_normalized_name(d, "Pixel 7"), ==, "other");
+
+    // A nickname longer than the buffer of the lookup
+    memset(long_name, 'A', sizeof(long_name) - 1);
+    long_name[sizeof(long_name) - 1] = '\0';
+    g_snprintf(json, sizeof(json), "{ \"devices\": [ { \"active\": true, \"iden\": \"long\", \"modified\": 1600000002.5, "
+               "\"nickname\": \"%s\", \"icon\": \"browser\" } ] }", long_name);
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, json, strlen(json) + 1), ==, 0 );
+    long_name[0] = 'a';
+    g_assert_cmpstr( pb_devices_get_iden_from_normalized_name(d, long_name), ==, "long");
+
+    pb_devices_unref(d);
+}
+
+static void test_index_all_types(void)
+{
+    int i = 0;
+    size_t len = 0;
+    char json[0x4000];
+    char iden[32];
+    char nickname[32];
+    const char *icons[] = {"desktop", "browser", "website", "laptop", "tablet", "phone", "watch", "system", "fridge"};
+    const size_t nb_icons = sizeof(icons) / sizeof(icons[0]);
+    pb_devices_t* d = pb_devices_new();
+
+    // Enough devices to grow the indexes several times
+    len = g_snprintf(json, sizeof(json), "{ \"devices\": [");
+
+    for (i = 0; i < 64; i++)
+    {
+        len += g_snprintf(json + len, sizeof(json) - len, "%s { \"active\": true, \"iden\": \"iden%d\", \"nickname\": \"Device %d\", "
+                          "\"icon\": \"%s\" }", (i) ? "," : "", i, i, icons[i % nb_icons]);
+    }
+
+    len += g_snprintf(json + len, sizeof(json) - len, " ] }");
+
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, json, len), ==, 0 );
+    g_assert_cmpint( pb_devices_get_number_active(d), ==, 64);
+
+    // Every type of device can be found
+    for (i = 0; i < 64; i++)
+    {
+        g_snprintf(iden, sizeof(iden), "iden%d", i);
+        g_snprintf(nickname, sizeof(nickname), "Device %d", i);
+        g_assert_cmpstr( pb_devices_get_iden_from_name(d, nickname), ==, iden);
+        g_assert_nonnull( pb_devices_get_device_from_iden(d, iden) );
+    }
+
+    // The removal of a device does not hide the others
+    for (i = 0; i < 64; i += 2)
+    {
+        g_snprintf(iden, sizeof(iden), "iden%d", i);
+        g_assert_cmpint( pb_devices_remove_device(d, iden), ==, 0 );
+    }
+
+    g_assert_cmpint( pb_devices_get_number_active(d), ==, 32);
+
+    // The remaining devices keep their order
+    for (i = 0; i < 32; i++)
+    {
+        g_snprintf(iden, sizeof(iden), "iden%d", 2 * i + 1);
+        g_assert_cmpstr( pb_device_get_iden(pb_devices_get_device_at(d, i)), ==, iden);
+    }
+
+    g_assert_null( pb_devices_get_device_at(d, 32) );
+
+    for (i = 0; i < 64; i++)
+    {
+        g_snprintf(iden, sizeof(iden), "iden%d", i);
+        g_snprintf(nickname, sizeof(nickname), "Device %d", i);
+        g_assert_cmpstr( pb_devices_get_iden_from_name(d, nickname), ==, (i % 2) ? iden : NULL);
+    }
+
+    g_assert_null( pb_devices_get_iden_from_name(NULL, "Device 1") );
+
+    pb_devices_unref(d);
+}
+
+static void test_query(void)
+{
+    char json[] = "{ \"devices\": [ "
+                  "{ \"active\": true, \"iden\": \"iden1\", \"icon\": \"phone\", \"has_sms\": true, \"has_mms\": true }, "
+                  "{ \"active\": true, \"iden\": \"iden2\", \"icon\": \"browser\" }, "
+                  "{ \"active\": true, \"iden\": \"iden3\", \"icon\": \"phone\", \"has_sms\": false }, "
+                  "{ \"active\": true, \"iden\": \"iden4\", \"icon\": \"laptop\" }, "
+                  "{ \"active\": true, \"iden\": \"iden5\", \"icon\": \"phone\", \"has_sms\": true } ] }";
+    pb_devices_t* d = pb_devices_new();
+    pb_device_t* matches[8];
+
+    g_assert_cmpuint( pb_devices_query(NULL, 0, 0, matches, 8), ==, 0 );
+    g_assert_cmpuint( pb_devices_query(d, 0, 0, matches, 8), ==, 0 );
+
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, json, sizeof(json)), ==, 0 );
+    g_assert_cmpuint( pb_devices_query(d, 0, PB_DEVICES_ACTIVE, NULL, 0), ==, 5 );
+
+    // All the phones with has_sms, in the order of the list
+    g_assert_cmpuint( pb_devices_query(d, PB_DEVICES_TYPE(ICON_PHONE), PB_DEVICES_HAS_SMS, matches, 8), ==, 2 );
+    g_assert_cmpstr( pb_device_get_iden(matches[0]), ==, "iden1" );
+    g_assert_cmpstr( pb_device_get_iden(matches[1]), ==, "iden5" );
+
+    // Several types
+    g_assert_cmpuint( pb_devices_query(d, PB_DEVICES_TYPE(ICON_BROWSER) | PB_DEVICES_TYPE(ICON_LAPTOP), 0, matches, 8), ==, 2 );
+    g_assert_cmpstr( pb_device_get_iden(matches[0]), ==, "iden2" );
+    g_assert_cmpstr( pb_device_get_iden(matches[1]), ==, "iden4" );
+
+    // Only max devices are stored, all of them are counted
+    g_assert_cmpuint( pb_devices_query(d, PB_DEVICES_TYPE(ICON_PHONE), 0, matches, 1), ==, 3 );
+    g_assert_cmpstr( pb_device_get_iden(matches[0]), ==, "iden1" );
+
+    // The indexes follow the removals
+    g_assert_cmpint( pb_devices_remove_device(d, "iden1"), ==, 0 );
+    g_assert_cmpuint( pb_devices_query(d, PB_DEVICES_TYPE(ICON_PHONE), PB_DEVICES_HAS_SMS, matches, 8), ==, 1 );
+    g_assert_cmpstr( pb_device_get_iden(matches[0]), ==, "iden5" );
+    g_assert_cmpuint( pb_devices_query(d, 0, PB_DEVICES_HAS_MMS, matches, 8), ==, 0 );
+
+    pb_devices_unref(d);
+}
+
+static void test_cache(void)
+{
+    char json[] = "{ \"devices\": [ { \"active\": true, \"iden\": \"iden1\", \"modified\": 1600000000.5, "
+                  "\"nickname\": \"Pixel\", \"icon\": \"phone\", \"has_sms\": true }, "
+                  "{ \"active\": true, \"iden\": \"iden2\", \"modified\": 1600000001.5, "
+                  "\"nickname\": \"Firefox\", \"icon\": \"browser\" } ] }";
+    const char *path = "devices_cache.bin";
+    pb_devices_t* d = pb_devices_new();
+    pb_devices_t* c = NULL;
+    FILE *f = NULL;
+
+    g_assert_cmpint( pb_devices_load_devices_from_data(d, json, sizeof(json)), ==, 0 );
+    g_assert_cmpint( pb_devices_cache_write(path, d), ==, 0 );
+
+    // The list is loaded back in the same order, with its watermark
+    c = pb_devices_cache_read(path);
+    g_assert_nonnull( c );
+    g_assert_cmpint( pb_devices_get_number_active(c), ==, 2 );
+    g_assert_cmpfloat( pb_devices_get_modified_after(c), ==, 1600000001.5 );
+    g_assert_cmpstr( pb_device_get_iden(pb_devices_get_device_at(c, 0)), ==, "iden1" );
+    g_assert_cmpint( pb_device_get_type(pb_devices_get_device_at(c, 0)), ==, ICON_PHONE );
+    g_assert_cmpint( pb_device_get_type(pb_devices_get_device_at(c, 1)), ==, ICON_BROWSER );
+    g_assert_cmpfloat( pb_device_get_modified(pb_devices_get_device_at(c, 1)), ==, 1600000001.5 );
+    g_assert_cmpstr( pb_devices_get_iden_from_name(c, "Firefox"), ==, "iden2" );
+    pb_devices_unref(c);
+
+    // A corrupted cache is refused
+    f = fopen(path, "r+b");
+    g_assert_nonnull( f );
+    fseek(f, -1, SEEK_END);
+    fputc('x', f);
+    fclose(f);
+    g_assert_null( pb_devices_cache_read(path) );
+
+    g_assert_null( pb_devices_cache_read("no_such_cache.bin") );
+    g_assert_cmpint( pb_devices_cache_write(NULL, d), !=, 0 );
+
+    remove(path);
+    pb_devices_unref(d);
+}
+
 int main (int argc, char *argv[])
 {
     g_test_init (&argc, &argv, NULL);
@@ -209,6 +432,11 @@ int main (int argc, char *argv[])
     g_test_add_func("/devices/load-devices-from-string", test_load_devices_from_string);
     g_test_add_func("/devices/get-number-active", test_get_nb_device_active);
     g_test_add_func("/devices/get-iden-from-name", test_get_iden_from_name);
+    g_test_add_func("/devices/apply-changes", test_apply_changes);
+    g_test_add_func("/devices/normalized-name", test_normalized_name);
+    g_test_add_func("/devices/index-all-types", test_index_all_types);
+    g_test_add_func("/devices/query", test_query);
+    g_test_add_func("/devices/cache", test_cache);
 
     return g_test_run ();
 }
@@ -0,0 +1,89 @@
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "lib/pb_json_prot.h"
+#include "pushbullet.h"
+
+
+static void test_empty_object(void)
+{
+    pb_json_writer_t w;
+
+    pb_json_writer_init(&w, NULL, 0);
+    pb_json_object_begin(&w);
+    pb_json_add_string(&w, "title", NULL);
+    pb_json_object_end(&w);
+
+    g_assert_cmpstr( pb_json_writer_get_data(&w), ==, "{}" );
+    g_assert_cmpuint( pb_json_writer_get_length(&w), ==, 2 );
+
+    pb_json_writer_release(&w);
+}
+
+static void test_flat_object(void)
+{
+    pb_json_writer_t w;
+    char buf[128];
+
+    pb_json_writer_init(&w, buf, sizeof(buf));
+    pb_json_object_begin(&w);
+    pb_json_add_string(&w, "type", "note");
+    pb_json_add_string(&w, "title", "Hello");
+    pb_json_add_string(&w, "body", NULL);
+    pb_json_add_string(&w, "device_iden", "helloworld1");
+    pb_json_object_end(&w);
+
+    g_assert( pb_json_writer_get_data(&w) == buf );
+    g_assert_cmpstr( buf, ==, "{\"type\":\"note\",\"title\":\"Hello\",\"device_iden\":\"helloworld1\"}" );
+
+    pb_json_writer_release(&w);
+}
+
+static void test_escaping(void)
+{
+    pb_json_writer_t w;
+
+    pb_json_writer_init(&w, NULL, 0);
+    pb_json_object_begin(&w);
+    pb_json_add_string(&w, "body", "a\"b\\c\nd\te\x01 \xc3\xa9");
+    pb_json_object_end(&w);
+
+    g_assert_cmpstr( pb_json_writer_get_data(&w), ==, "{\"body\":\"a\\\"b\\\\c\\nd\\te\\u0001 \xc3\xa9\"}" );
+
+    pb_json_writer_release(&w);
+}
+
+static void test_spill_to_heap(void)
+{
+    pb_json_writer_t w;
+    char buf[8];
+    char body[1024];
+
+    memset(body, 'x', sizeof(body) - 1);
+    body[sizeof(body) - 1] = '\0';
+
+    pb_json_writer_init(&w, buf, sizeof(buf));
+    pb_json_object_begin(&w);
+    pb_json_add_string(&w, "body", body);
+    pb_json_object_end(&w);
+
+    g_assert( pb_json_writer_get_data(&w) != buf );
+    g_assert_cmpuint( pb_json_writer_get_length(&w), ==, strlen("{\"body\":\"\"}") + sizeof(body) - 1 );
+    g_assert_cmpuint( strlen(pb_json_writer_get_data(&w)), ==, pb_json_writer_get_length(&w) );
+
+    pb_json_writer_release(&w);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func("/json/empty-object", test_empty_object);
+    g_test_add_func("/json/flat-object", test_flat_object);
+    g_test_add_func("/json/escaping", test_escaping);
+    g_test_add_func("/json/spill-to-heap", test_spill_to_heap);
+
+    return g_test_run ();
+}
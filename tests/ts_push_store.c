@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "lib/pb_pushes_priv.h"
+#include "pushbullet.h"
+
+
+static pb_push_t make_push(const char *iden, double modified, unsigned char active)
+{
+    pb_push_t push;
+
+    memset(&push, 0, sizeof(push) );
+    push.active = active;
+    push.iden = iden;
+    push.modified = modified;
+    push.created = modified;
+    push.type = "note";
+    push.title = "Title";
+    push.body = "Body";
+
+    return push;
+}
+
+static int store_has(pb_push_store_t *store, const char *iden)
+{
+    const pb_push_t *push = pb_push_store_lookup(store, iden);
+
+    if ( push )
+    {
+        g_assert_cmpint( pb_push_store_release(store, push), ==, 0 );
+    }
+
+    return (push != NULL);
+}
+
+static void assert_title(pb_push_store_t *store, const char *iden, const char *title)
+{
+    const pb_push_t *push = pb_push_store_lookup(store, iden);
+
+    g_assert( push != NULL );
+    g_assert_cmpstr( pb_push_get_title(push), ==, title );
+    g_assert_cmpint( pb_push_store_release(store, push), ==, 0 );
+}
+
+static int count_cb(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata)
+{
+    size_t i = 0;
+    double *last = userdata;
+
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        g_assert_cmpfloat( pb_push_get_modified(pushes[i]), >=, *last );
+        *last = pb_push_get_modified(pushes[i]);
+    }
+
+    return 0;
+}
+
+static void test_apply_lookup(void)
+{
+    pb_push_store_t *store = pb_push_store_new(0);
+    pb_push_t push = make_push("iden0", 10, 1);
+    char iden[] = "iden1";
+    const pb_push_t *stored = NULL;
+
+    g_assert( store != NULL );
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+
+    push = make_push(iden, 20, 1);
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+
+    // The store keeps its own copy
+    iden[0] = 'X';
+    stored = pb_push_store_lookup(store, "iden1");
+    g_assert( stored != NULL );
+    g_assert_cmpstr( pb_push_get_iden(stored), ==, "iden1" );
+    g_assert_cmpstr( pb_push_get_title(stored), ==, "Title" );
+    g_assert( pb_push_get_sender_name(stored) == NULL );
+    g_assert_cmpint( pb_push_store_release(store, stored), ==, 0 );
+    g_assert_cmpuint( pb_push_store_get_number(store), ==, 2 );
+
+    // An older version is ignored, a newer one replaces the push
+    push = make_push("iden0", 5, 0);
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    g_assert( store_has(store, "iden0") );
+
+    push = make_push("iden0", 15, 1);
+    push.title = "New title";
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    assert_title(store, "iden0", "New title");
+    g_assert_cmpuint( pb_push_store_get_number(store), ==, 2 );
+
+    // An inactive push is a deleted push
+    push = make_push("iden0", 30, 0);
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    g_assert( ! store_has(store, "iden0") );
+    g_assert( store_has(store, "iden1") );
+    g_assert_cmpuint( pb_push_store_get_number(store), ==, 1 );
+
+    pb_push_store_unref(store);
+}
+
+static void test_range(void)
+{
+    pb_push_store_t *store = pb_push_store_new(0);
+    char iden[32];
+    pb_push_t push;
+    double last = 0;
+    size_t i = 0;
+
+    // Out of order and enough pushes to grow the indexes
+    for ( i = 0; i < 500; i++ )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        push = make_push(iden, (double) ((i * 7919) % 500), 1);
+        g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    }
+
+    g_assert_cmpuint( pb_push_store_get_number(store), ==, 500 );
+    g_assert_cmpuint( pb_push_store_range(store, 0, 0, count_cb, &last), ==, 499 );
+    g_assert_cmpfloat( last, ==, 499 );
+
+    last = 0;
+    g_assert_cmpuint( pb_push_store_range(store, 99, 200, count_cb, &last), ==, 100 );
+    g_assert_cmpfloat( last, ==, 199 );
+
+    // Delete half of them
+    for ( i = 0; i < 500; i += 2 )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        push = make_push(iden, 1000, 0);
+        g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    }
+
+    g_assert_cmpuint( pb_push_store_get_number(store), ==, 250 );
+
+    for ( i = 0; i < 500; i++ )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        g_assert( store_has(store, iden) == (i % 2 == 1) );
+    }
+
+    pb_push_store_unref(store);
+}
+
+static void test_lookup_held(void)
+{
+    pb_push_store_t *store = pb_push_store_new(0);
+    pb_push_t push = make_push("iden0", 10, 1);
+    const pb_push_t *held = NULL;
+
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    held = pb_push_store_lookup(store, "iden0");
+    g_assert( held != NULL );
+
+    // Replaced then deleted while it is held: the push given stays the same
+    push = make_push("iden0", 20, 1);
+    push.title = "New title";
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    push = make_push("iden0", 30, 0);
+    g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+
+    g_assert( ! store_has(store, "iden0") );
+    g_assert_cmpstr( pb_push_get_title(held), ==, "Title" );
+    g_assert_cmpfloat( pb_push_get_modified(held), ==, 10 );
+    g_assert_cmpint( pb_push_store_release(store, held), ==, 0 );
+
+    pb_push_store_unref(store);
+}
+
+typedef struct {
+    pb_push_store_t *store;
+    size_t nb_pushes;
+    int stop;
+} reentrant_t;
+
+static int reentrant_cb(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata)
+{
+    reentrant_t *r = userdata;
+    pb_push_t push = make_push(pb_push_get_iden(pushes[0]), 1000, 0);
+
+    // The store is not locked during the callback: the pushes given stay valid even when deleted
+    g_assert( store_has(r->store, pb_push_get_iden(pushes[0])) );
+    g_assert_cmpint( pb_push_store_apply(r->store, &push), ==, 0 );
+    g_assert_cmpstr( pb_push_get_title(pushes[0]), ==, "Title" );
+
+    r->nb_pushes += nb_pushes;
+
+    return r->stop;
+}
+
+static void test_range_reentrant(void)
+{
+    reentrant_t r = { .store = pb_push_store_new(0), .nb_pushes = 0, .stop = 0 };
+    char iden[32];
+    pb_push_t push;
+    size_t i = 0;
+
+    for ( i = 0; i < 200; i++ )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        push = make_push(iden, (double) (i + 1), 1);
+        g_assert_cmpint( pb_push_store_apply(r.store, &push), ==, 0 );
+    }
+
+    // Each batch deletes its first push
+    g_assert_cmpuint( pb_push_store_range(r.store, 0, 0, reentrant_cb, &r), ==, 200 );
+    g_assert_cmpuint( r.nb_pushes, ==, 200 );
+    g_assert_cmpuint( pb_push_store_get_number(r.store), <, 200 );
+
+    // A non-zero return stops the range after the first batch
+    r.stop = 1;
+    r.nb_pushes = 0;
+    g_assert_cmpuint( pb_push_store_range(r.store, 0, 0, reentrant_cb, &r), <, pb_push_store_get_number(r.store) );
+    g_assert_cmpuint( r.nb_pushes, >, 0 );
+
+    pb_push_store_unref(r.store);
+}
+
+static void test_eviction(void)
+{
+    pb_push_store_t *store = pb_push_store_new(0x10000);
+    char iden[32];
+    pb_push_t push;
+    size_t i = 0;
+
+    for ( i = 0; i < 5000; i++ )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        push = make_push(iden, (double) i, 1);
+        g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+
+        // Keep the first push alive
+        g_assert( store_has(store, "iden0") );
+    }
+
+    g_assert_cmpuint( pb_push_store_get_memory(store), <=, 0x10000 );
+    g_assert_cmpuint( pb_push_store_get_number(store), <, 5000 );
+    g_assert( ! store_has(store, "iden1") );
+    g_assert( store_has(store, "iden4999") );
+
+    pb_push_store_unref(store);
+}
+
+static void test_eviction_scattered(void)
+{
+    pb_push_store_t *store = pb_push_store_new(0x10000);
+    char iden[32];
+    pb_push_t push;
+    size_t i = 0;
+    size_t j = 0;
+
+    for ( i = 0; i < 2000; i++ )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        push = make_push(iden, (double) i, 1);
+        g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+
+        // A few pushes of each chunk stay in use: the chunks are only partly live
+        for ( j = 0; j < i; j += 40 )
+        {
+            g_snprintf(iden, sizeof(iden), "iden%zu", j);
+            (void) store_has(store, iden);
+        }
+
+        g_assert_cmpuint( pb_push_store_get_memory(store), <=, 0x10000 );
+    }
+
+    // Only the live records count against the limit: the partly live chunks do not empty the store
+    g_assert( store_has(store, "iden1999") );
+    g_assert_cmpuint( pb_push_store_get_number(store), >, 200 );
+
+    pb_push_store_unref(store);
+}
+
+static void test_snapshot(void)
+{
+    pb_push_store_t *store = pb_push_store_new(0);
+    pb_push_store_t *loaded = NULL;
+    const pb_push_t *held = NULL;
+    const pb_push_t *other = NULL;
+    gchar *path = g_build_filename(g_get_tmp_dir(), "ts_push_store.snapshot", NULL);
+    char iden[32];
+    pb_push_t push;
+    double last = 0;
+    size_t i = 0;
+    FILE *f = NULL;
+
+    for ( i = 0; i < 100; i++ )
+    {
+        g_snprintf(iden, sizeof(iden), "iden%zu", i);
+        push = make_push(iden, (double) (i * 2), 1);
+        g_assert_cmpint( pb_push_store_apply(store, &push), ==, 0 );
+    }
+
+    g_assert_cmpint( pb_push_store_save(store, path), ==, 0 );
+    pb_push_store_unref(store);
+
+    loaded = pb_push_store_new_from_snapshot(path, 0);
+    g_assert( loaded != NULL );
+    g_assert_cmpuint( pb_push_store_get_number(loaded), ==, 100 );
+    assert_title(loaded, "iden42", "Title");
+    g_assert( ! store_has(loaded, "unknown") );
+
+    // The pushes served from the mapping do not share any buffer
+    held = pb_push_store_lookup(loaded, "iden42");
+    other = pb_push_store_lookup(loaded, "iden43");
+    g_assert_cmpstr( pb_push_get_iden(held), ==, "iden42" );
+    g_assert_cmpstr( pb_push_get_iden(other), ==, "iden43" );
+    g_assert_cmpint( pb_push_store_release(loaded, held), ==, 0 );
+    g_assert_cmpint( pb_push_store_release(loaded, other), ==, 0 );
+
+    // Delete, replace and add on top of the snapshot
+    push = make_push("iden0", 500, 0);
+    g_assert_cmpint( pb_push_store_apply(loaded, &push), ==, 0 );
+    push = make_push("iden1", 51, 1);
+    push.title = "New title";
+    g_assert_cmpint( pb_push_store_apply(loaded, &push), ==, 0 );
+    push = make_push("iden2", 1, 0);
+    g_assert_cmpint( pb_push_store_apply(loaded, &push), ==, 0 );
+    push = make_push("new", 3, 1);
+    g_assert_cmpint( pb_push_store_apply(loaded, &push), ==, 0 );
+
+    g_assert( ! store_has(loaded, "iden0") );
+    g_assert( store_has(loaded, "iden2") );
+    assert_title(loaded, "iden1", "New title");
+    g_assert_cmpuint( pb_push_store_get_number(loaded), ==, 100 );
+
+    // The merge of the snapshot and of the store stays sorted
+    last = 0;
+    g_assert_cmpuint( pb_push_store_range(loaded, 0, 0, count_cb, &last), ==, 100 );
+    g_assert_cmpfloat( last, ==, 198 );
+
+    g_assert_cmpint( pb_push_store_save(loaded, path), ==, 0 );
+    pb_push_store_unref(loaded);
+
+    loaded = pb_push_store_new_from_snapshot(path, 0);
+    g_assert( loaded != NULL );
+    g_assert_cmpuint( pb_push_store_get_number(loaded), ==, 100 );
+    g_assert( ! store_has(loaded, "iden0") );
+    g_assert( store_has(loaded, "new") );
+    assert_title(loaded, "iden1", "New title");
+    pb_push_store_unref(loaded);
+
+    // A corrupted block only hides the pushes it holds
+    f = fopen(path, "r+b");
+    g_assert( f != NULL );
+    fseek(f, -2, SEEK_END);
+    fputc('X', f);
+    fclose(f);
+    loaded = pb_push_store_new_from_snapshot(path, 0);
+    g_assert( loaded != NULL );
+    g_assert( ! store_has(loaded, "iden99") );
+    assert_title(loaded, "iden10", "Title");
+    last = 0;
+    g_assert_cmpuint( pb_push_store_range(loaded, 0, 0, count_cb, &last), <, 100 );
+    pb_push_store_unref(loaded);
+
+    // A corrupted hash index is refused
+    f = fopen(path, "r+b");
+    g_assert( f != NULL );
+    fseek(f, 100, SEEK_SET);
+    fputc('X', f);
+    fclose(f);
+    g_assert( pb_push_store_new_from_snapshot(path, 0) == NULL );
+
+    remove(path);
+    g_free(path);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func("/push-store/apply-lookup", test_apply_lookup);
+    g_test_add_func("/push-store/range", test_range);
+    g_test_add_func("/push-store/lookup-held", test_lookup_held);
+    g_test_add_func("/push-store/range-reentrant", test_range_reentrant);
+    g_test_add_func("/push-store/eviction", test_eviction);
+    g_test_add_func("/push-store/eviction-scattered", test_eviction_scattered);
+    g_test_add_func("/push-store/snapshot", test_snapshot);
+
+    return g_test_run ();
+}
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "lib/pb_pushes_prot.h"
+#include "lib/pb_mime_prot.h"
+#include "lib/pb_user_priv.h"
+#include "pushbullet.h"
+
+
+static void test_file_from_buffer(void)
+{
+    const char content[] = "Hello, world!";
+    const void *data = NULL;
+    size_t size = 0;
+    pb_file_t *file = NULL;
+
+    g_assert_null( pb_file_new_from_buffer(NULL, 0, "hello.txt", NULL, NULL, NULL) );
+    g_assert_null( pb_file_new_from_buffer(content, sizeof(content), NULL, NULL, NULL, NULL) );
+
+    file = pb_file_new_from_buffer(content, sizeof(content), "hello.txt", "text/plain", "Title", NULL);
+    g_assert_nonnull( file );
+
+    // The content is read from the caller memory, it is not copied
+    data = pb_file_get_data(file, &size);
+    g_assert( data == content );
+    g_assert_cmpuint( size, ==, sizeof(content) );
+
+    g_assert_null( pb_file_get_filepath(file) );
+    g_assert_cmpstr( pb_file_get_filename(file), ==, "hello.txt" );
+    g_assert_cmpstr( pb_file_get_filetype(file), ==, "text/plain" );
+    g_assert_null( pb_file_get_url(file) );
+
+    pb_file_free(file);
+}
+
+static void test_buffer_type(void)
+{
+    gchar *content = NULL;
+    gsize size = 0;
+    char *type = NULL;
+
+    g_assert_null( pb_mime_get_buffer_type(NULL, 0) );
+
+    g_assert_true( g_file_get_contents("volley.png", &content, &size, NULL) );
+
+    type = pb_mime_get_buffer_type(content, size);
+    g_assert_cmpstr( type, ==, "image/png" );
+    free(type);
+
+    // The same content detected from its path
+    type = pb_mime_get_file_type("volley.png");
+    g_assert_cmpstr( type, ==, "image/png" );
+    free(type);
+
+    g_free(content);
+}
+
+typedef struct {
+    int nb_calls;
+    size_t size;
+    size_t max_upload_size;
+    int cancel;
+    const char *replacement;
+} hook_t;
+
+static int upload_hook(pb_file_t *file, size_t size, size_t max_upload_size, void *userdata)
+{
+    hook_t *h = userdata;
+
+    h->nb_calls++;
+    h->size = size;
+    h->max_upload_size = max_upload_size;
+
+    if ( h->replacement )
+    {
+        g_assert_cmpint( pb_file_set_data(file, h->replacement, strlen(h->replacement), "text/plain"), ==, 0 );
+    }
+
+    return h->cancel;
+}
+
+static void test_upload_hook(void)
+{
+    const char content[] = "Hello, world!";
+    const char *small = "Hi!";
+    const void *data = NULL;
+    size_t size = 0;
+    char result[0x100];
+    size_t result_sz = sizeof(result);
+    hook_t hook = { .nb_calls = 0 };
+    pb_user_t *user = pb_user_new();
+    pb_config_t *config = pb_config_new();
+    pb_file_t *file = NULL;
+
+    // Nothing listens there: a request would fail, whatever happens the test stays offline
+    pb_config_set_api_url(config, "http://127.0.0.1:1/v2/");
+    pb_config_set_proxy(config, NULL);
+    pb_user_set_config(user, config);
+    user->max_upload_size = 8;
+
+    // Too large, and no hook to shrink it
+    file = pb_file_new_from_buffer(content, sizeof(content), "hello.txt", "text/plain", NULL, NULL);
+    g_assert_cmpint( pb_push_file(result, &result_sz, file, NULL, user), ==, HTTP_PAYLOAD_TOO_LARGE );
+    pb_file_free(file);
+
+    // The hook cancels the push
+    hook.cancel = 1;
+    g_assert_cmpint( pb_config_set_upload_hook(config, upload_hook, &hook), ==, 0 );
+    file = pb_file_new_from_buffer(content, sizeof(content), "hello.txt", "text/plain", NULL, NULL);
+    g_assert_cmpint( pb_push_file(result, &result_sz, file, NULL, user), ==, HTTP_UNKNOWN_CODE );
+    g_assert_cmpint( hook.nb_calls, ==, 1 );
+    g_assert_cmpuint( hook.size, ==, sizeof(content) );
+    g_assert_cmpuint( hook.max_upload_size, ==, 8 );
+    pb_file_free(file);
+
+    // The hook replaces the content with a smaller one: the size check passes, only the upload itself fails
+    hook.cancel = 0;
+    hook.replacement = small;
+    file = pb_file_new_from_buffer(content, sizeof(content), "hello.txt", "text/plain", NULL, NULL);
+    g_assert_cmpint( pb_push_file(result, &result_sz, file, NULL, user), !=, HTTP_PAYLOAD_TOO_LARGE );
+    g_assert_cmpint( hook.nb_calls, ==, 2 );
+    data = pb_file_get_data(file, &size);
+    g_assert( data == small );
+    g_assert_cmpuint( size, ==, strlen(small) );
+    pb_file_free(file);
+
+    pb_config_unref(config);
+    pb_user_unref(user);
+}
+
+#define MAX_PAGES 4
+
+typedef struct {
+    int listen_fd;
+    const char *pages[MAX_PAGES];          // Bodies sent back, in the order of the requests (NULL: 500)
+    unsigned int slow_ms[MAX_PAGES];          // Delay before each answer
+    char requests[MAX_PAGES][0x400];          // Request lines received
+    int nb_requests;
+} pushes_server_t;
+
+static void* pushes_server(void *arg)
+{
+    pushes_server_t *server = arg;
+    int fd = -1;
+    int i = 0;
+    size_t len = 0;
+    ssize_t n = 0;
+    char request[0x1000];
+    char response[0x1000];
+    struct pollfd pfd;
+
+    // Until the test shuts the socket down
+    while ( (fd = accept(server->listen_fd, NULL, NULL)) >= 0 )
+    {
+        len = 0;
+        request[0] = '\0';
+
+        while ( (strstr(request, "\r\n\r\n") == NULL) && ((n = read(fd, request + len, sizeof(request) - len - 1)) > 0) )
+        {
+            len += (size_t) n;
+            request[len] = '\0';
+        }
+
+        i = server->nb_requests;
+        g_assert_cmpint( i, <, MAX_PAGES );
+        g_snprintf(server->requests[i], sizeof(server->requests[i]), "%.*s", (int) strcspn(request, "\r"), request);
+
+        if ( server->pages[i] )
+        {
+            g_snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                       "Content-Length: %zu\r\nConnection: close\r\n\r\n%s", strlen(server->pages[i]), server->pages[i]);
+        }
+        else
+        {
+            g_snprintf(response, sizeof(response), "HTTP/1.1 500 Internal Server Error\r\n"
+                       "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        }
+
+        __atomic_store_n(&server->nb_requests, i + 1, __ATOMIC_SEQ_CST);
+
+        // A client aborting the request closes the connection before the answer
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+
+        if ( poll(&pfd, 1, server->slow_ms[i]) == 0 )
+        {
+            g_assert_cmpint( send(fd, response, strlen(response), MSG_NOSIGNAL), ==, (ssize_t) strlen(response) );
+        }
+
+        // The client closes the connection once it has read the answer
+        while ( read(fd, request, sizeof(request)) > 0 );
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static pb_user_t* pushes_server_start(pushes_server_t *server, pthread_t *thread)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    char url[64];
+    pb_user_t *user = pb_user_new();
+    pb_config_t *config = pb_config_new();
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(server->listen_fd, MAX_PAGES), ==, 0 );
+    g_assert_cmpint( getsockname(server->listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "http://127.0.0.1:%d/v2/", ntohs(addr.sin_port) );
+
+    pb_config_set_api_url(config, url);
+    pb_user_set_config(user, config);
+    pb_config_unref(config);
+    pthread_create(thread, NULL, pushes_server, server);
+
+    return user;
+}
+
+static void pushes_server_stop(pushes_server_t *server, pthread_t thread, pb_user_t *user)
+{
+    shutdown(server->listen_fd, SHUT_RDWR);
+    pthread_join(thread, NULL);
+    close(server->listen_fd);
+    pb_user_unref(user);
+}
+
+typedef struct {
+    char idens[0x100];
+    int nb_pages;
+    int stop_at;
+} pushes_seen_t;
+
+static int on_pushes(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata)
+{
+    pushes_seen_t *seen = userdata;
+    size_t i = 0;
+
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        strcat(seen->idens, pb_push_get_iden(pushes[i]) );
+    }
+
+    return (++seen->nb_pages == seen->stop_at);
+}
+
+static void test_retrieve_pages(void)
+{
+    pushes_server_t server = {
+        .pages = { "{\"pushes\": [{\"iden\": \"a\", \"modified\": 3}, {\"iden\": \"b\", \"modified\": 2}], \"cursor\": \"c1\"}",
+                   "{\"pushes\": [{\"iden\": \"c\", \"modified\": 1}]}" },
+    };
+    pushes_seen_t seen = { .idens = "", .nb_pages = 0, .stop_at = 0 };
+    pthread_t thread;
+    pb_user_t *user = pushes_server_start(&server, &thread);
+
+    g_assert_cmpint( pb_pushes_retrieve(user, 0, 2, on_pushes, &seen), ==, HTTP_OK );
+
+    // The cursor of the first page is followed until the last one
+    g_assert_cmpint( seen.nb_pages, ==, 2 );
+    g_assert_cmpstr( seen.idens, ==, "abc" );
+    g_assert_cmpint( server.nb_requests, ==, 2 );
+    g_assert( strstr(server.requests[0], "GET /v2/pushes?modified_after=0&limit=2 ") != NULL );
+    g_assert( strstr(server.requests[1], "&limit=2&cursor=c1 ") != NULL );
+
+    pushes_server_stop(&server, thread, user);
+}
+
+static void test_retrieve_stop(void)
+{
+    pushes_server_t server = {
+        .pages = { "{\"pushes\": [{\"iden\": \"a\", \"modified\": 2}], \"cursor\": \"c1\"}",
+                   "{\"pushes\": [{\"iden\": \"b\", \"modified\": 1}]}" },
+        .slow_ms = { 0, 5000 },
+    };
+    pushes_seen_t seen = { .idens = "", .nb_pages = 0, .stop_at = 1 };
+    pthread_t thread;
+    pb_user_t *user = pushes_server_start(&server, &thread);
+    struct timespec start;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    g_assert_cmpint( pb_pushes_retrieve(user, 0, 1, on_pushes, &seen), ==, HTTP_OK );
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Stopped by the callback: the slow next page is aborted, not given
+    g_assert_cmpint( seen.nb_pages, ==, 1 );
+    g_assert_cmpstr( seen.idens, ==, "a" );
+    g_assert_cmpint( (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000, <, 2000 );
+
+    pushes_server_stop(&server, thread, user);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    pb_init();
+
+    g_test_add_func("/pushes/file-from-buffer", test_file_from_buffer);
+    g_test_add_func("/pushes/buffer-type", test_buffer_type);
+    g_test_add_func("/pushes/upload-hook", test_upload_hook);
+    g_test_add_func("/pushes/retrieve-pages", test_retrieve_pages);
+    g_test_add_func("/pushes/retrieve-stop", test_retrieve_stop);
+
+    int ret = g_test_run ();
+
+    pb_term();
+
+    return ret;
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "lib/pb_requests_priv.h"
+#include "lib/pb_requests_prot.h"
+#include "pushbullet.h"
+
+
+static int read_request(int fd, char *request, size_t size)
+{
+    size_t len = 0;
+    ssize_t n = 0;
+
+    request[0] = '\0';
+
+    while ( (strstr(request, "\r\n\r\n") == NULL) && ((n = read(fd, request + len, size - len - 1)) > 0) )
+    {
+        len += (size_t) n;
+        request[len] = '\0';
+    }
+
+    return (len > 0) ? 0 : -1;
+}
+
+static void* mock_server(void *arg)
+{
+    int listen_fd = *(int *) arg;
+    int fd = -1;
+    char request[0x1000];
+    const char *full = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: application/json\r\n"
+                       "ETag: \"v1\"\r\n"
+                       "Last-Modified: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+                       "Content-Length: 15\r\n"
+                       "Connection: close\r\n"
+                       "\r\n"
+                       "{\"name\": \"me\"}\n";
+    const char *not_modified = "HTTP/1.1 304 Not Modified\r\n"
+                               "ETag: \"v1\"\r\n"
+                               "Connection: close\r\n"
+                               "\r\n";
+
+    // The first request is not conditional
+    fd = accept(listen_fd, NULL, NULL);
+    g_assert_cmpint( read_request(fd, request, sizeof(request)), ==, 0 );
+    g_assert( strstr(request, "If-None-Match") == NULL );
+    g_assert_cmpint( write(fd, full, strlen(full)), ==, (ssize_t) strlen(full) );
+    close(fd);
+
+    // The second one sends back the validators
+    fd = accept(listen_fd, NULL, NULL);
+    g_assert_cmpint( read_request(fd, request, sizeof(request)), ==, 0 );
+    g_assert( strstr(request, "If-None-Match: \"v1\"\r\n") != NULL );
+    g_assert( strstr(request, "If-Modified-Since: Mon, 19 Oct 2026 10:00:00 GMT\r\n") != NULL );
+    g_assert_cmpint( write(fd, not_modified, strlen(not_modified)), ==, (ssize_t) strlen(not_modified) );
+    close(fd);
+
+    return NULL;
+}
+
+static void test_conditional_get(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    pthread_t server;
+    char url[64];
+    char *result = NULL;
+    size_t result_sz = 0;
+    pb_config_t *config = pb_config_new();
+    pb_validators_t validators = { .etag = NULL, .last_modified = NULL };
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(listen_fd, 1), ==, 0 );
+    g_assert_cmpint( getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "http://127.0.0.1:%d/v2/users/me", ntohs(addr.sin_port) );
+
+    pb_config_set_proxy(config, NULL);
+    pthread_create(&server, NULL, mock_server, &listen_fd);
+
+    g_assert_cmpint( pb_requests_get_conditional(&result, &result_sz, url, config, &validators), ==, HTTP_OK );
+    g_assert_cmpstr( result, ==, "{\"name\": \"me\"}\n" );
+    g_assert_cmpstr( validators.etag, ==, "\"v1\"" );
+    g_assert_cmpstr( validators.last_modified, ==, "Mon, 19 Oct 2026 10:00:00 GMT" );
+    g_free(result);
+    result = NULL;
+    result_sz = 0;
+
+    // Nothing to download nor to parse
+    g_assert_cmpint( pb_requests_get_conditional(&result, &result_sz, url, config, &validators), ==, HTTP_NOT_MODIFIED );
+    g_assert( result == NULL );
+    g_assert_cmpuint( result_sz, ==, 0 );
+    g_assert_cmpstr( validators.etag, ==, "\"v1\"" );
+
+    pthread_join(server, NULL);
+
+    pb_validators_clear(&validators);
+    g_assert( validators.etag == NULL );
+    pb_config_unref(config);
+    close(listen_fd);
+}
+
+typedef struct {
+    int nb_calls;
+    size_t sent;
+    size_t total;
+    double rate;
+    int abort;
+} progress_t;
+
+static int on_progress(size_t sent, size_t total, double rate, void *userdata)
+{
+    progress_t *p = userdata;
+
+    p->nb_calls++;
+    p->sent = sent;
+    p->total = total;
+    p->rate = rate;
+
+    return p->abort;
+}
+
+static void at(struct timespec *now, long ms)
+{
+    now->tv_sec = 10 + ms / 1000;
+    now->tv_nsec = (ms % 1000) * 1000000;
+}
+
+static void test_progress(void)
+{
+    progress_t p = { 0 };
+    struct progress_struct_s ps = { .cb = on_progress, .userdata = &p };
+    struct timespec now;
+
+    at(&ps.last_time, 0);
+
+    // Too close to the previous report
+    at(&now, 100);
+    g_assert_cmpint( pb_requests_report_progress(&ps, 100, 1000, &now), ==, 0 );
+    g_assert_cmpint( p.nb_calls, ==, 0 );
+
+    at(&now, 250);
+    g_assert_cmpint( pb_requests_report_progress(&ps, 500, 1000, &now), ==, 0 );
+    g_assert_cmpint( p.nb_calls, ==, 1 );
+    g_assert_cmpuint( p.sent, ==, 500 );
+    g_assert_cmpuint( p.total, ==, 1000 );
+    g_assert_cmpfloat( p.rate, ==, 2000 );
+
+    // The upload is rewound: the rate starts again from the beginning of the new attempt
+    at(&now, 500);
+    g_assert_cmpint( pb_requests_report_progress(&ps, 100, 1000, &now), ==, 0 );
+    g_assert_cmpint( p.nb_calls, ==, 2 );
+    g_assert_cmpuint( p.sent, ==, 100 );
+    g_assert_cmpfloat( p.rate, ==, 400 );
+
+    // The end is reported right away, once
+    at(&now, 750);
+    g_assert_cmpint( pb_requests_report_progress(&ps, 1000, 1000, &now), ==, 0 );
+    g_assert_cmpint( p.nb_calls, ==, 3 );
+    g_assert_cmpfloat( p.rate, ==, 3600 );
+
+    at(&now, 1500);
+    g_assert_cmpint( pb_requests_report_progress(&ps, 1000, 1000, &now), ==, 0 );
+    g_assert_cmpint( p.nb_calls, ==, 3 );
+
+    // The callback aborts the upload
+    memset(&ps, 0, sizeof(ps) );
+    ps.cb = on_progress;
+    ps.userdata = &p;
+    p.abort = 1;
+    at(&ps.last_time, 0);
+    at(&now, 250);
+    g_assert_cmpint( pb_requests_report_progress(&ps, 10, 0, &now), !=, 0 );
+    g_assert_cmpint( p.nb_calls, ==, 4 );
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    pb_init();
+
+    g_test_add_func("/requests/conditional-get", test_conditional_get);
+    g_test_add_func("/requests/progress", test_progress);
+
+    int ret = g_test_run ();
+
+    pb_term();
+
+    return ret;
+}
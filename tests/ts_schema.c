@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <json-glib/json-glib.h>
+
+#include "lib/pb_schema_prot.h"
+#include "lib/pb_arena_prot.h"
+#include "lib/pb_device_priv.h"
+#include "pushbullet.h"
+
+
+static void test_lookup(void)
+{
+    const pb_schema_field_t *field = NULL;
+
+    field = pb_schema_lookup(PB_SCHEMA_PHONE, "has_sms");
+    g_assert_nonnull( field );
+    g_assert_cmpstr( field->name, ==, "has_sms" );
+    g_assert_cmpint( field->type, ==, PB_SCHEMA_BOOL );
+
+    field = pb_schema_lookup(PB_SCHEMA_PUSH, "receiver_email_normalized");
+    g_assert_nonnull( field );
+    g_assert_cmpint( field->type, ==, PB_SCHEMA_CONST_STR );
+
+    // The browsers do not have the fields of the phones
+    g_assert_null( pb_schema_lookup(PB_SCHEMA_BROWSER, "has_sms") );
+    g_assert_null( pb_schema_lookup(PB_SCHEMA_USER, "pushable") );
+    g_assert_null( pb_schema_lookup(PB_SCHEMA_USER, "") );
+    g_assert_null( pb_schema_lookup(PB_SCHEMA_NB_MODELS, "iden") );
+    g_assert_null( pb_schema_lookup(PB_SCHEMA_USER, NULL) );
+}
+
+typedef struct {
+    pb_arena_t arena;
+    pb_browser_t browser;
+} filled_t;
+
+static void fill_browser(JsonObject *object __attribute__((unused)), const gchar *member_name, JsonNode *member_node,
+                         gpointer userdata)
+{
+    filled_t *filled = userdata;
+
+    pb_schema_fill(PB_SCHEMA_BROWSER, &filled->browser, member_name, member_node, &filled->arena);
+}
+
+static void test_fill(void)
+{
+    const char json[] = "{ \"active\": true, \"iden\": \"helloworld1\", \"modified\": 1494948688.5, \"nickname\": \"Firefox\", "
+                        "\"app_version\": 42, \"pushable\": true, \"fingerprint\": { \"android_id\": \"0\" } }";
+    JsonParser *parser = json_parser_new();
+    filled_t filled;
+
+    memset(&filled, 0, sizeof(filled) );
+    pb_arena_init(&filled.arena, 0);
+
+    g_assert_true( json_parser_load_from_data(parser, json, sizeof(json) - 1, NULL) );
+    json_object_foreach_member(json_node_get_object(json_parser_get_root(parser)), fill_browser, &filled);
+    g_object_unref(parser);
+
+    // The strings are copied in the arena: they outlive the parser
+    g_assert_cmpint( filled.browser.active, ==, 1 );
+    g_assert_cmpstr( filled.browser.iden, ==, "helloworld1" );
+    g_assert_cmpfloat( filled.browser.modified, ==, 1494948688.5 );
+    g_assert_cmpstr( filled.browser.nickname, ==, "Firefox" );
+    g_assert_cmpint( filled.browser.app_version, ==, 42 );
+
+    pb_arena_clear(&filled.arena);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func("/schema/lookup", test_lookup);
+    g_test_add_func("/schema/fill", test_fill);
+
+    return g_test_run ();
+}
@@ -0,0 +1,771 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "lib/pb_sha1_prot.h"
+#include "pushbullet.h"
+
+
+typedef struct {
+    int nb_nops;
+    int nb_tickles;
+    int nb_pushes;
+    int nb_connected;
+    char push_type[32];
+    char tickle_subtype[32];
+    int nb_disconnected;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+} events_t;
+
+static events_t events = { .mtx = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+
+static void on_event(pb_stream_event_t event, const char *subtype, const char *data, void *userdata)
+{
+    events_t *e = userdata;
+
+    pthread_mutex_lock(&e->mtx);
+
+    switch ( event )
+    {
+        case PB_STREAM_EVENT_NOP:
+            e->nb_nops++;
+            break;
+
+        case PB_STREAM_EVENT_TICKLE:
+            e->nb_tickles++;
+            g_strlcpy(e->tickle_subtype, subtype, sizeof(e->tickle_subtype) );
+            break;
+
+        case PB_STREAM_EVENT_PUSH:
+            g_assert( data != NULL );
+            g_assert( strstr(data, "Hello") != NULL );
+            e->nb_pushes++;
+            g_strlcpy(e->push_type, subtype, sizeof(e->push_type) );
+            break;
+
+        case PB_STREAM_EVENT_CONNECTED:
+            e->nb_connected++;
+            break;
+
+        default:
+            e->nb_disconnected++;
+            break;
+    }
+
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->mtx);
+}
+
+static size_t make_frame(unsigned char *buf, int fin, int opcode, const char *payload)
+{
+    size_t len = strlen(payload);
+
+    buf[0] = (unsigned char) ((fin ? 0x80 : 0) | opcode);
+    buf[1] = (unsigned char) len;
+    memcpy(buf + 2, payload, len);
+
+    return 2 + len;
+}
+
+static void send_frame(int fd, int fin, int opcode, const char *payload)
+{
+    unsigned char buf[128];
+    size_t len = make_frame(buf, fin, opcode, payload);
+
+    g_assert_cmpint( write(fd, buf, len), ==, (ssize_t) len );
+}
+
+static int read_handshake(int listen_fd, char *request, size_t size)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    size_t len = 0;
+    ssize_t n = 0;
+
+    g_assert( fd >= 0 );
+    request[0] = '\0';
+
+    while ( (strstr(request, "\r\n\r\n") == NULL) && ((n = read(fd, request + len, size - len - 1)) > 0) )
+    {
+        len += (size_t) n;
+        request[len] = '\0';
+    }
+
+    // The token key is the last element of the path
+    g_assert( strncmp(request, "GET /websocket/mock-token HTTP/1.1\r\n", 36) == 0 );
+    g_assert( strstr(request, "Upgrade: websocket\r\n") != NULL );
+    g_assert( strstr(request, "Sec-WebSocket-Key: ") != NULL );
+
+    return fd;
+}
+
+static void websocket_accept(const char *request, char *accept, size_t size)
+{
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    guint8 digest[20];
+    gsize digest_len = sizeof(digest);
+    const char *key = strstr(request, "Sec-WebSocket-Key: ") + strlen("Sec-WebSocket-Key: ");
+    gchar *encoded = NULL;
+
+    // RFC 6455, 4.2.2: base64(SHA-1(key + GUID))
+    g_checksum_update(checksum, (const guchar *) key, strstr(key, "\r\n") - key);
+    g_checksum_update(checksum, (const guchar *) "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", -1);
+    g_checksum_get_digest(checksum, digest, &digest_len);
+    encoded = g_base64_encode(digest, digest_len);
+    g_strlcpy(accept, encoded, size);
+
+    g_free(encoded);
+    g_checksum_free(checksum);
+}
+
+static int accept_client(int listen_fd)
+{
+    char request[0x1000];
+    char accept[32];
+    char response[0x100];
+    int fd = read_handshake(listen_fd, request, sizeof(request) );
+
+    websocket_accept(request, accept, sizeof(accept) );
+    g_snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\n"
+                                           "Upgrade: websocket\r\n"
+                                           "Connection: Upgrade\r\n"
+                                           "Sec-WebSocket-Accept: %s\r\n"
+                                           "\r\n", accept);
+
+    g_assert_cmpint( write(fd, response, strlen(response)), ==, (ssize_t) strlen(response) );
+
+    return fd;
+}
+
+static void* mock_server(void *arg)
+{
+    int listen_fd = *(int *) arg;
+    int fd = accept_client(listen_fd);
+    unsigned char buf[256];
+    size_t len = 0;
+    ssize_t n = 0;
+    unsigned char pong[6 + 4];
+
+    // The first frame comes right after the response of the handshake
+    send_frame(fd, 1, 0x1, "{\"type\": \"nop\"}");
+
+    // Tickles received together are dispatched once
+    len = make_frame(buf, 1, 0x1, "{\"type\": \"tickle\", \"subtype\": \"push\"}");
+    len += make_frame(buf + len, 1, 0x1, "{\"type\": \"tickle\", \"subtype\": \"push\"}");
+    len += make_frame(buf + len, 1, 0x1, "{\"type\": \"tickle\", \"subtype\": \"device\"}");
+    g_assert_cmpint( write(fd, buf, len), ==, (ssize_t) len );
+
+    // A fragmented push
+    send_frame(fd, 0, 0x1, "{\"type\": \"push\", \"push\": {\"type\": \"mirror\",");
+    send_frame(fd, 1, 0x0, " \"title\": \"Hello\"}}");
+
+    // The ping is answered with a masked pong carrying the same payload
+    send_frame(fd, 1, 0x9, "ping");
+    len = 0;
+
+    while ( (len < sizeof(pong)) && ((n = read(fd, pong + len, sizeof(pong) - len)) > 0) )
+    {
+        len += (size_t) n;
+    }
+
+    g_assert_cmpuint( len, ==, sizeof(pong) );
+    g_assert_cmpint( pong[0], ==, 0x8A );
+    g_assert_cmpint( pong[1], ==, 0x80 | 4 );
+    g_assert_cmpint( pong[6] ^ pong[2], ==, 'p' );
+    g_assert_cmpint( pong[9] ^ pong[5], ==, 'g' );
+
+    // The connection drops without any close frame: the client reconnects
+    close(fd);
+
+    fd = accept_client(listen_fd);
+    send_frame(fd, 1, 0x1, "{\"type\": \"nop\"}");
+
+    // The client closes the connection when it is stopped
+    g_assert_cmpint( read(fd, buf, 2), ==, 2 );
+    g_assert_cmpint( buf[0], ==, 0x88 );
+
+    close(fd);
+
+    return NULL;
+}
+
+static void test_mock_server(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    pthread_t server;
+    char url[64];
+    char *stream_url = NULL;
+    pb_config_t *config = pb_config_new();
+    pb_user_t *user = pb_user_new();
+    pb_stream_t *stream = NULL;
+    pb_stream_event_t event;
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(listen_fd, 1), ==, 0 );
+    g_assert_cmpint( getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "ws://127.0.0.1:%d/websocket/", ntohs(addr.sin_port) );
+
+    pb_config_set_proxy(config, NULL);
+    pb_config_set_token_key(config, "mock-token");
+    g_assert_cmpint( pb_config_set_stream_url(config, url), ==, 0 );
+    stream_url = pb_config_get_stream_url(config);
+    g_assert_cmpstr( stream_url, ==, url );
+    free(stream_url);
+    pb_user_set_config(user, config);
+
+    stream = pb_stream_new(user);
+    g_assert( stream != NULL );
+
+    for ( event = PB_STREAM_EVENT_NOP; event < PB_STREAM_NB_EVENTS; event++ )
+    {
+        g_assert_cmpint( pb_stream_set_callback(stream, event, on_event, &events), ==, 0 );
+    }
+
+    g_assert_cmpint( pb_stream_set_callback(stream, PB_STREAM_NB_EVENTS, on_event, &events), !=, 0 );
+
+    pthread_create(&server, NULL, mock_server, &listen_fd);
+    g_assert_cmpint( pb_stream_start(stream), ==, 0 );
+
+    // Wait for the second connection and its first message
+    pthread_mutex_lock(&events.mtx);
+
+    while ( events.nb_nops < 2 )
+    {
+        pthread_cond_wait(&events.cond, &events.mtx);
+    }
+
+    pthread_mutex_unlock(&events.mtx);
+
+    g_assert_cmpint( pb_stream_stop(stream), ==, 0 );
+    pthread_join(server, NULL);
+
+    g_assert_cmpint( events.nb_connected, ==, 2 );
+    g_assert_cmpint( events.nb_disconnected, ==, 1 );
+
+    g_assert_cmpint( events.nb_nops, ==, 2 );
+    g_assert_cmpint( events.nb_tickles, ==, 2 );
+    g_assert_cmpstr( events.tickle_subtype, ==, "device" );
+    g_assert_cmpint( events.nb_pushes, ==, 1 );
+    g_assert_cmpstr( events.push_type, ==, "mirror" );
+
+    pb_stream_unref(stream);
+    pb_user_unref(user);
+    pb_config_unref(config);
+    close(listen_fd);
+}
+
+static void* large_server(void *arg)
+{
+    int listen_fd = *(int *) arg;
+    int fd = accept_client(listen_fd);
+    size_t length = 0x100000;
+    unsigned char *frame = malloc(10 + length);
+    const char *nop = "{\"type\": \"nop\"}";
+    unsigned char buf[2];
+    size_t i = 0;
+
+    // A message of the maximum size, padded with blanks, with a 64-bit length
+    frame[0] = 0x81;
+    frame[1] = 127;
+
+    for ( i = 0; i < 8; i++ )
+    {
+        frame[2 + i] = (unsigned char) (length >> (8 * (7 - i)));
+    }
+
+    memset(frame + 10, ' ', length);
+    memcpy(frame + 10, nop, strlen(nop) );
+    g_assert_cmpint( write(fd, frame, 10 + length), ==, (ssize_t) (10 + length) );
+    send_frame(fd, 1, 0x1, nop);
+
+    g_assert_cmpint( read(fd, buf, 2), ==, 2 );
+    g_assert_cmpint( buf[0], ==, 0x88 );
+
+    free(frame);
+    close(fd);
+
+    return NULL;
+}
+
+static void test_large_message(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    pthread_t server;
+    char url[64];
+    pb_config_t *config = pb_config_new();
+    pb_user_t *user = pb_user_new();
+    pb_stream_t *stream = NULL;
+    events_t e = { .mtx = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(listen_fd, 1), ==, 0 );
+    g_assert_cmpint( getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "ws://127.0.0.1:%d/websocket/", ntohs(addr.sin_port) );
+
+    pb_config_set_proxy(config, NULL);
+    pb_config_set_token_key(config, "mock-token");
+    pb_config_set_stream_url(config, url);
+    pb_user_set_config(user, config);
+
+    stream = pb_stream_new(user);
+    g_assert( stream != NULL );
+    g_assert_cmpint( pb_stream_set_callback(stream, PB_STREAM_EVENT_NOP, on_event, &e), ==, 0 );
+    g_assert_cmpint( pb_stream_set_callback(stream, PB_STREAM_EVENT_DISCONNECTED, on_event, &e), ==, 0 );
+
+    pthread_create(&server, NULL, large_server, &listen_fd);
+    g_assert_cmpint( pb_stream_start(stream), ==, 0 );
+
+    // The largest message fits in the receive buffer: the connection is kept
+    pthread_mutex_lock(&e.mtx);
+
+    while ( e.nb_nops < 2 )
+    {
+        pthread_cond_wait(&e.cond, &e.mtx);
+    }
+
+    pthread_mutex_unlock(&e.mtx);
+
+    g_assert_cmpint( pb_stream_stop(stream), ==, 0 );
+    pthread_join(server, NULL);
+
+    g_assert_cmpint( e.nb_disconnected, ==, 0 );
+
+    pb_stream_unref(stream);
+    pb_user_unref(user);
+    pb_config_unref(config);
+    close(listen_fd);
+}
+
+static void release_on_nop(pb_stream_event_t event, const char *subtype, const char *data, void *userdata)
+{
+    (void) event;
+    (void) subtype;
+    (void) data;
+
+    // The last reference is dropped on the stream thread
+    g_assert_cmpint( pb_stream_unref(userdata), ==, 0 );
+}
+
+static void* release_server(void *arg)
+{
+    int listen_fd = *(int *) arg;
+    int fd = accept_client(listen_fd);
+    unsigned char buf[2];
+
+    send_frame(fd, 1, 0x1, "{\"type\": \"nop\"}");
+    send_frame(fd, 1, 0x1, "{\"type\": \"nop\"}");
+
+    // The stream is closed by its thread once the callback returns
+    g_assert_cmpint( read(fd, buf, 2), ==, 2 );
+    g_assert_cmpint( buf[0], ==, 0x88 );
+
+    close(fd);
+
+    return NULL;
+}
+
+static void test_release_in_callback(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    pthread_t server;
+    char url[64];
+    pb_config_t *config = pb_config_new();
+    pb_user_t *user = pb_user_new();
+    pb_stream_t *stream = NULL;
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(listen_fd, 1), ==, 0 );
+    g_assert_cmpint( getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "ws://127.0.0.1:%d/websocket/", ntohs(addr.sin_port) );
+
+    pb_config_set_proxy(config, NULL);
+    pb_config_set_token_key(config, "mock-token");
+    pb_config_set_stream_url(config, url);
+    pb_user_set_config(user, config);
+
+    stream = pb_stream_new(user);
+    g_assert( stream != NULL );
+    g_assert_cmpint( pb_stream_set_callback(stream, PB_STREAM_EVENT_NOP, release_on_nop, stream), ==, 0 );
+
+    pthread_create(&server, NULL, release_server, &listen_fd);
+    g_assert_cmpint( pb_stream_start(stream), ==, 0 );
+
+    // The only reference belongs to the callback now: the stream is not touched anymore here
+    pthread_join(server, NULL);
+
+    pb_user_unref(user);
+    pb_config_unref(config);
+    close(listen_fd);
+}
+
+typedef struct {
+    int listen_fd;
+    const char *pages[4];          // Bodies sent back, in the order of the requests (NULL: 500)
+    int nb_requests;
+} api_server_t;
+
+static void* api_server(void *arg)
+{
+    api_server_t *server = arg;
+    int fd = -1;
+    size_t len = 0;
+    ssize_t n = 0;
+    char request[0x1000];
+    char response[0x1000];
+    const char *page = NULL;
+
+    // Until the test shuts the socket down
+    while ( (fd = accept(server->listen_fd, NULL, NULL)) >= 0 )
+    {
+        len = 0;
+        request[0] = '\0';
+
+        while ( (strstr(request, "\r\n\r\n") == NULL) && ((n = read(fd, request + len, sizeof(request) - len - 1)) > 0) )
+        {
+            len += (size_t) n;
+            request[len] = '\0';
+        }
+
+        g_assert( strncmp(request, "GET /v2/pushes?modified_after=0", 31) == 0 );
+        g_assert_cmpint( server->nb_requests, <, 4 );
+        page = server->pages[server->nb_requests++];
+
+        if ( page )
+        {
+            g_snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                       "Content-Length: %zu\r\nConnection: close\r\n\r\n%s", strlen(page), page);
+        }
+        else
+        {
+            g_snprintf(response, sizeof(response), "HTTP/1.1 500 Internal Server Error\r\n"
+                       "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        }
+
+        g_assert_cmpint( write(fd, response, strlen(response)), ==, (ssize_t) strlen(response) );
+        close(fd);
+    }
+
+    return NULL;
+}
+
+typedef struct {
+    char idens[32];
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+} synced_t;
+
+static int on_pushes(const pb_push_t *const *pushes, size_t nb_pushes, void *userdata)
+{
+    synced_t *synced = userdata;
+    size_t i = 0;
+
+    pthread_mutex_lock(&synced->mtx);
+
+    for ( i = 0; i < nb_pushes; i++ )
+    {
+        g_assert_cmpuint( strlen(synced->idens), <, sizeof(synced->idens) - 1 );
+        strcat(synced->idens, pb_push_get_iden(pushes[i]) );
+    }
+
+    pthread_cond_broadcast(&synced->cond);
+    pthread_mutex_unlock(&synced->mtx);
+
+    return 0;
+}
+
+static void* catch_up_server(void *arg)
+{
+    int listen_fd = *(int *) arg;
+    int fd = accept_client(listen_fd);
+    unsigned char buf[2];
+
+    // The messages after the failed catch-up retry it
+    send_frame(fd, 1, 0x1, "{\"type\": \"nop\"}");
+
+    g_assert_cmpint( read(fd, buf, 2), ==, 2 );
+    g_assert_cmpint( buf[0], ==, 0x88 );
+
+    close(fd);
+
+    return NULL;
+}
+
+static int listen_local(char *url, size_t size, const char *format)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(listen_fd, 4), ==, 0 );
+    g_assert_cmpint( getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, size, format, ntohs(addr.sin_port) );
+
+    return listen_fd;
+}
+
+static void test_catch_up_retry(void)
+{
+    const char *first = "{\"pushes\": [{\"iden\": \"a\", \"modified\": 3}, {\"iden\": \"b\", \"modified\": 2}], \"cursor\": \"c1\"}";
+    api_server_t api = { .pages = { first, NULL, first, "{\"pushes\": [{\"iden\": \"c\", \"modified\": 1}]}" } };
+    synced_t synced = { .idens = "", .mtx = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+    int listen_fd = -1;
+    pthread_t server;
+    pthread_t api_thread;
+    char url[64];
+    pb_config_t *config = pb_config_new();
+    pb_user_t *user = pb_user_new();
+    pb_stream_t *stream = NULL;
+
+    listen_fd = listen_local(url, sizeof(url), "ws://127.0.0.1:%d/websocket/");
+    pb_config_set_stream_url(config, url);
+    api.listen_fd = listen_local(url, sizeof(url), "http://127.0.0.1:%d/v2/");
+    pb_config_set_api_url(config, url);
+    pb_config_set_proxy(config, NULL);
+    pb_config_set_token_key(config, "mock-token");
+    pb_user_set_config(user, config);
+
+    stream = pb_stream_new(user);
+    g_assert( stream != NULL );
+    g_assert_cmpint( pb_stream_sync_pushes(stream, 0, on_pushes, &synced), ==, 0 );
+
+    pthread_create(&api_thread, NULL, api_server, &api);
+    pthread_create(&server, NULL, catch_up_server, &listen_fd);
+    g_assert_cmpint( pb_stream_start(stream), ==, 0 );
+
+    // The second page fails the first catch-up: its retry does not give the first page again
+    pthread_mutex_lock(&synced.mtx);
+
+    while ( strchr(synced.idens, 'c') == NULL )
+    {
+        pthread_cond_wait(&synced.cond, &synced.mtx);
+    }
+
+    pthread_mutex_unlock(&synced.mtx);
+
+    g_assert_cmpstr( synced.idens, ==, "abc" );
+    g_assert_cmpint( api.nb_requests, ==, 4 );
+
+    // Raised once the whole catch-up has succeeded
+    while ( pb_stream_get_watermark(stream) < 3 )
+    {
+        usleep(1000);
+    }
+
+    g_assert_cmpfloat( pb_stream_get_watermark(stream), ==, 3 );
+
+    g_assert_cmpint( pb_stream_stop(stream), ==, 0 );
+    pthread_join(server, NULL);
+    shutdown(api.listen_fd, SHUT_RDWR);
+    pthread_join(api_thread, NULL);
+
+    pb_stream_unref(stream);
+    pb_user_unref(user);
+    pb_config_unref(config);
+    close(listen_fd);
+    close(api.listen_fd);
+}
+
+static void test_sha1(void)
+{
+    unsigned char digest[PB_SHA1_DIGEST_SIZE];
+    char hex[2 * PB_SHA1_DIGEST_SIZE + 1];
+    const char *msg = "dGhlIHNhbXBsZSBub25jZQ==258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    pb_sha1_t ctx;
+    size_t i = 0;
+
+    pb_sha1("abc", 3, digest);
+
+    for ( i = 0; i < PB_SHA1_DIGEST_SIZE; i++ )
+    {
+        g_snprintf(&hex[2 * i], 3, "%02x", digest[i]);
+    }
+
+    g_assert_cmpstr( hex, ==, "a9993e364706816aba3e25717850c26c9cd0d89d" );
+
+    // The key of RFC 6455 (1.3), fed byte per byte: its accept is s3pPLMBiTxaQ9kYGzzhZRbK+xOo=
+    pb_sha1_init(&ctx);
+
+    for ( i = 0; msg[i]; i++ )
+    {
+        pb_sha1_update(&ctx, &msg[i], 1);
+    }
+
+    pb_sha1_final(&ctx, digest);
+
+    for ( i = 0; i < PB_SHA1_DIGEST_SIZE; i++ )
+    {
+        g_snprintf(&hex[2 * i], 3, "%02x", digest[i]);
+    }
+
+    g_assert_cmpstr( hex, ==, "b37a4f2cc0624f1690f64606cf385945b2bec4ea" );
+}
+
+#define NB_BAD_HANDSHAKES 4
+
+static void* bad_handshake_server(void *arg)
+{
+    int listen_fd = *(int *) arg;
+    char request[0x1000];
+    char accept[32];
+    char response[0x100];
+    int fd = -1;
+    int i = 0;
+
+    for ( i = 0; i < NB_BAD_HANDSHAKES; i++ )
+    {
+        fd = read_handshake(listen_fd, request, sizeof(request) );
+        websocket_accept(request, accept, sizeof(accept) );
+
+        switch ( i )
+        {
+            // The accept of another key
+            case 0:
+                g_strlcpy(response, "HTTP/1.1 101 Switching Protocols\r\n"
+                                    "Upgrade: websocket\r\n"
+                                    "Connection: Upgrade\r\n"
+                                    "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"
+                                    "\r\n", sizeof(response) );
+                break;
+
+            case 1:
+                g_snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\n"
+                                                       "Connection: Upgrade\r\n"
+                                                       "Sec-WebSocket-Accept: %s\r\n"
+                                                       "\r\n", accept);
+                break;
+
+            case 2:
+                g_snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\n"
+                                                       "Upgrade: websocket\r\n"
+                                                       "Connection: keep-alive\r\n"
+                                                       "Sec-WebSocket-Accept: %s\r\n"
+                                                       "\r\n", accept);
+                break;
+
+            default:
+                g_snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\n"
+                                                       "Upgrade: websocket\r\n"
+                                                       "Connection: Upgrade\r\n"
+                                                       "Sec-WebSocket-Accept: %s\r\n"
+                                                       "\r\n", accept);
+                break;
+        }
+
+        g_assert_cmpint( write(fd, response, strlen(response)), ==, (ssize_t) strlen(response) );
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static void test_bad_handshake(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    pthread_t server;
+    char url[64];
+    pb_config_t *config = pb_config_new();
+    pb_user_t *user = pb_user_new();
+    pb_stream_t *stream = NULL;
+    int i = 0;
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(listen_fd, 1), ==, 0 );
+    g_assert_cmpint( getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "ws://127.0.0.1:%d/websocket/", ntohs(addr.sin_port) );
+
+    pb_config_set_proxy(config, NULL);
+    pb_config_set_token_key(config, "mock-token");
+    pb_config_set_stream_url(config, url);
+    pb_user_set_config(user, config);
+
+    pthread_create(&server, NULL, bad_handshake_server, &listen_fd);
+
+    // Every response that does not accept this very handshake fails the connection
+    for ( i = 0; i < NB_BAD_HANDSHAKES; i++ )
+    {
+        stream = pb_stream_new(user);
+        g_assert( stream != NULL );
+        g_assert_cmpint( pb_stream_start(stream), !=, 0 );
+        g_assert_cmpint( pb_stream_stop(stream), ==, 0 );
+        pb_stream_unref(stream);
+    }
+
+    pthread_join(server, NULL);
+
+    pb_user_unref(user);
+    pb_config_unref(config);
+    close(listen_fd);
+}
+
+static void test_bad_url(void)
+{
+    pb_config_t *config = pb_config_new();
+    pb_user_t *user = pb_user_new();
+    pb_stream_t *stream = NULL;
+
+    pb_config_set_stream_url(config, "ftp://127.0.0.1/");
+    pb_user_set_config(user, config);
+
+    stream = pb_stream_new(user);
+    g_assert( stream != NULL );
+    g_assert_cmpint( pb_stream_start(stream), !=, 0 );
+    g_assert_cmpint( pb_stream_stop(stream), ==, 0 );
+
+    pb_stream_unref(stream);
+    pb_user_unref(user);
+    pb_config_unref(config);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    pb_init();
+
+    g_test_add_func("/stream/mock-server", test_mock_server);
+    g_test_add_func("/stream/large-message", test_large_message);
+    g_test_add_func("/stream/release-in-callback", test_release_in_callback);
+    g_test_add_func("/stream/catch-up-retry", test_catch_up_retry);
+    g_test_add_func("/stream/sha1", test_sha1);
+    g_test_add_func("/stream/bad-handshake", test_bad_handshake);
+    g_test_add_func("/stream/bad-url", test_bad_url);
+
+    int ret = g_test_run ();
+
+    pb_term();
+
+    return ret;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "lib/pb_sha256_prot.h"
+#include "lib/pb_upload_cache_prot.h"
+#include "pushbullet.h"
+
+
+static void to_hex(const unsigned char *digest, char *hex)
+{
+    size_t i = 0;
+
+    for ( i = 0; i < PB_SHA256_DIGEST_SIZE; i++ )
+    {
+        g_snprintf(&hex[2 * i], 3, "%02x", digest[i]);
+    }
+}
+
+static void test_sha256(void)
+{
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];
+    char hex[2 * PB_SHA256_DIGEST_SIZE + 1];
+    const char *msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    pb_sha256_t ctx;
+    size_t i = 0;
+
+    pb_sha256("", 0, digest);
+    to_hex(digest, hex);
+    g_assert_cmpstr( hex, ==, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" );
+
+    pb_sha256("abc", 3, digest);
+    to_hex(digest, hex);
+    g_assert_cmpstr( hex, ==, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" );
+
+    // Feeding the message byte per byte gives the same digest
+    pb_sha256_init(&ctx);
+
+    for ( i = 0; msg[i]; i++ )
+    {
+        pb_sha256_update(&ctx, &msg[i], 1);
+    }
+
+    pb_sha256_final(&ctx, digest);
+    to_hex(digest, hex);
+    g_assert_cmpstr( hex, ==, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" );
+}
+
+static void test_insert_lookup(void)
+{
+    pb_upload_cache_t *cache = pb_upload_cache_new(NULL, 0);
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];
+    char *url = NULL;
+    char *type = NULL;
+    char name[16];
+    int i = 0;
+
+    g_assert( cache != NULL );
+
+    pb_sha256("content", 7, digest);
+    g_assert_cmpint( pb_upload_cache_lookup(cache, digest, &url, &type), ==, 1 );
+    g_assert_cmpint( pb_upload_cache_insert(cache, digest, "https://example.com/a", "image/png"), ==, 0 );
+    g_assert_cmpint( pb_upload_cache_lookup(cache, digest, &url, &type), ==, 0 );
+    g_assert_cmpstr( url, ==, "https://example.com/a" );
+    g_assert_cmpstr( type, ==, "image/png" );
+    g_free(url);
+    g_free(type);
+
+    // Enough entries to grow the index
+    for ( i = 0; i < 200; i++ )
+    {
+        g_snprintf(name, sizeof(name), "content%d", i);
+        pb_sha256(name, strlen(name), digest);
+        g_assert_cmpint( pb_upload_cache_insert(cache, digest, name, NULL), ==, 0 );
+    }
+
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 201 );
+
+    for ( i = 0; i < 200; i++ )
+    {
+        g_snprintf(name, sizeof(name), "content%d", i);
+        pb_sha256(name, strlen(name), digest);
+        g_assert_cmpint( pb_upload_cache_lookup(cache, digest, &url, &type), ==, 0 );
+        g_assert_cmpstr( url, ==, name );
+        g_assert( type == NULL );
+        g_free(url);
+    }
+
+    pb_upload_cache_unref(cache);
+}
+
+static void test_persistence(void)
+{
+    gchar *path = g_build_filename(g_get_tmp_dir(), "ts_upload_cache.log", NULL);
+    pb_upload_cache_t *cache = NULL;
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];
+    unsigned char other[PB_SHA256_DIGEST_SIZE];
+    unsigned char expired[PB_SHA256_DIGEST_SIZE];
+    char *url = NULL;
+    char *type = NULL;
+    FILE *f = NULL;
+
+    remove(path);
+
+    cache = pb_upload_cache_new(path, 0);
+    g_assert( cache != NULL );
+    pb_sha256("first", 5, digest);
+    pb_sha256("second", 6, other);
+    g_assert_cmpint( pb_upload_cache_insert(cache, digest, "https://example.com/old", NULL), ==, 0 );
+    g_assert_cmpint( pb_upload_cache_insert(cache, digest, "https://example.com/new", "text/plain"), ==, 0 );
+    g_assert_cmpint( pb_upload_cache_insert(cache, other, "https://example.com/other", NULL), ==, 0 );
+    pb_upload_cache_unref(cache);
+
+    // The last line of an entry wins
+    cache = pb_upload_cache_new(path, 0);
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 2 );
+    g_assert_cmpint( pb_upload_cache_lookup(cache, digest, &url, &type), ==, 0 );
+    g_assert_cmpstr( url, ==, "https://example.com/new" );
+    g_assert_cmpstr( type, ==, "text/plain" );
+    g_free(url);
+    g_free(type);
+
+    pb_upload_cache_unref(cache);
+
+    // An expired line is skipped when the cache is loaded
+    f = fopen(path, "a");
+    g_assert( f != NULL );
+    fprintf(f, "%064d %lld - https://example.com/expired\n", 0, (long long) time(NULL) - 1);
+    fclose(f);
+
+    memset(expired, 0, sizeof(expired) );
+    cache = pb_upload_cache_new(path, 0);
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 2 );
+    g_assert_cmpint( pb_upload_cache_lookup(cache, expired, &url, &type), ==, 1 );
+
+    // The compaction keeps the live entries only
+    g_assert_cmpint( pb_upload_cache_save(cache), ==, 0 );
+    pb_upload_cache_unref(cache);
+
+    cache = pb_upload_cache_new(path, 0);
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 2 );
+    g_assert_cmpint( pb_upload_cache_lookup(cache, expired, &url, &type), ==, 1 );
+    g_assert_cmpint( pb_upload_cache_lookup(cache, other, &url, &type), ==, 0 );
+    g_assert_cmpstr( url, ==, "https://example.com/other" );
+    g_free(url);
+    pb_upload_cache_unref(cache);
+
+    remove(path);
+    g_free(path);
+}
+
+static void test_expiry(void)
+{
+    pb_upload_cache_t *cache = pb_upload_cache_new(NULL, 1);
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];
+    char *url = NULL;
+    char *type = NULL;
+    char name[16];
+    int i = 0;
+
+    for ( i = 0; i < 20; i++ )
+    {
+        g_snprintf(name, sizeof(name), "content%d", i);
+        pb_sha256(name, strlen(name), digest);
+        g_assert_cmpint( pb_upload_cache_insert(cache, digest, name, NULL), ==, 0 );
+    }
+
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 20 );
+    sleep(2);
+
+    // An expired entry met by a lookup is dropped
+    g_assert_cmpint( pb_upload_cache_lookup(cache, digest, &url, &type), ==, 1 );
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 19 );
+
+    // The expired entries are dropped before the table grows
+    for ( i = 0; i < 40; i++ )
+    {
+        g_snprintf(name, sizeof(name), "new%d", i);
+        pb_sha256(name, strlen(name), digest);
+        g_assert_cmpint( pb_upload_cache_insert(cache, digest, name, NULL), ==, 0 );
+    }
+
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), <, 59 );
+
+    for ( i = 0; i < 40; i++ )
+    {
+        g_snprintf(name, sizeof(name), "new%d", i);
+        pb_sha256(name, strlen(name), digest);
+        g_assert_cmpint( pb_upload_cache_lookup(cache, digest, &url, &type), ==, 0 );
+        g_assert_cmpstr( url, ==, name );
+        g_free(url);
+    }
+
+    pb_upload_cache_unref(cache);
+}
+
+static void test_compaction(void)
+{
+    gchar *path = g_build_filename(g_get_tmp_dir(), "ts_upload_cache_compaction.log", NULL);
+    pb_upload_cache_t *cache = NULL;
+    unsigned char digest[PB_SHA256_DIGEST_SIZE];
+    char url[64];
+    char line[0x200];
+    int nb_lines = 0;
+    int i = 0;
+    FILE *f = NULL;
+
+    remove(path);
+
+    // The same content uploaded again and again: a line per upload, a single live entry
+    cache = pb_upload_cache_new(path, 0);
+    pb_sha256("content", 7, digest);
+
+    for ( i = 0; i < 2000; i++ )
+    {
+        g_snprintf(url, sizeof(url), "https://example.com/%d", i);
+        g_assert_cmpint( pb_upload_cache_insert(cache, digest, url, NULL), ==, 0 );
+    }
+
+    pb_upload_cache_unref(cache);
+
+    f = fopen(path, "r");
+    g_assert( f != NULL );
+
+    while ( fgets(line, sizeof(line), f) )
+    {
+        nb_lines++;
+    }
+
+    fclose(f);
+    g_assert_cmpint( nb_lines, <, 1000 );
+
+    // The last entry is kept
+    cache = pb_upload_cache_new(path, 0);
+    g_assert_cmpuint( pb_upload_cache_get_number(cache), ==, 1 );
+    pb_upload_cache_unref(cache);
+
+    remove(path);
+    g_free(path);
+}
+
+int main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func("/upload-cache/sha256", test_sha256);
+    g_test_add_func("/upload-cache/insert-lookup", test_insert_lookup);
+    g_test_add_func("/upload-cache/persistence", test_persistence);
+    g_test_add_func("/upload-cache/expiry", test_expiry);
+    g_test_add_func("/upload-cache/compaction", test_compaction);
+
+    return g_test_run ();
+}
@@ -1,10 +1,18 @@
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
 
 #include "lib/pb_user_priv.h"
 #include "lib/pb_user_prot.h"
+#include "lib/pb_devices_prot.h"
 #include "pushbullet.h"
 
 static void test_empty_user(void)
@@ -73,6 +81,248 @@ static void test_get_devices(void)
     pb_user_unref(u);
 }
 
+static void test_snapshot_devices(void)
+{
+    pb_user_t* u = pb_user_new();
+    pb_devices_t* d1 = pb_devices_new();
+    pb_devices_t* d2 = pb_devices_new();
+    pb_devices_t* s = NULL;
+
+    g_assert_null( pb_user_acquire_devices(NULL) );
+    g_assert_null( pb_user_acquire_devices(u) );
+
+    pb_user_set_devices(u, d1);
+    s = pb_user_acquire_devices(u);
+    g_assert( s == d1 );
+
+    // The snapshot outlives the list it was taken from
+    pb_user_set_devices(u, d2);
+    g_assert( pb_user_get_devices(u) == d2 );
+    g_assert_null( pb_devices_get_iden_from_name(s, "Phone") );
+    g_assert_cmpint( pb_devices_unref(s), ==, 0 );
+
+    pb_user_unref(u);
+}
+
+static void test_device_iden_copy(void)
+{
+    pb_user_t* u = pb_user_new();
+    pb_devices_t* d1 = pb_devices_new();
+    pb_devices_t* d2 = pb_devices_new();
+    char json[] = "{ \"devices\": [ { \"active\": true, \"iden\": \"helloworld1\", \"modified\": 1600000000.5, "
+                  "\"nickname\": \"Firefox\", \"icon\": \"browser\" } ] }";
+    char* iden = NULL;
+
+    g_assert_cmpint( pb_devices_load_devices_from_data(d1, json, sizeof(json)), ==, 0 );
+    pb_user_set_devices(u, d1);
+
+    g_assert_null( pb_user_dup_device_iden_from_name(u, "Nightly") );
+    iden = pb_user_dup_device_iden_from_name(u, "Firefox");
+    g_assert_cmpstr( iden, ==, "helloworld1" );
+
+    // A refresh releases the list the identification was found in: the copy is still readable
+    pb_user_set_devices(u, d2);
+    g_assert_null( pb_devices_get_iden_from_name(pb_user_get_devices(u), "Firefox") );
+    g_assert_cmpstr( iden, ==, "helloworld1" );
+    free(iden);
+
+    pb_user_unref(u);
+}
+
+#define NB_READERS 4
+
+typedef struct {
+    pb_user_t *user;
+    int stop;
+    long nb_reads;
+} readers_t;
+
+static void* read_devices(void *arg)
+{
+    readers_t *readers = arg;
+
+    // Steady readers: a publication of the list is not held back by the readers coming after it
+    while ( ! __atomic_load_n(&readers->stop, __ATOMIC_SEQ_CST) )
+    {
+        pb_devices_unref(pb_user_acquire_devices(readers->user) );
+        __atomic_add_fetch(&readers->nb_reads, 1, __ATOMIC_SEQ_CST);
+    }
+
+    return NULL;
+}
+
+static void test_publish_under_readers(void)
+{
+    readers_t readers = { .user = pb_user_new(), .stop = 0, .nb_reads = 0 };
+    pthread_t threads[NB_READERS];
+    int i = 0;
+
+    pb_user_set_devices(readers.user, pb_devices_new() );
+
+    for ( i = 0; i < NB_READERS; ++i )
+    {
+        pthread_create(&threads[i], NULL, read_devices, &readers);
+    }
+
+    // The list is published while the readers are running
+    while ( __atomic_load_n(&readers.nb_reads, __ATOMIC_SEQ_CST) < NB_READERS )
+    {
+        sched_yield();
+    }
+
+    for ( i = 0; i < 1000; ++i )
+    {
+        g_assert_cmpint( pb_user_set_devices(readers.user, pb_devices_new() ), ==, 0 );
+    }
+
+    __atomic_store_n(&readers.stop, 1, __ATOMIC_SEQ_CST);
+
+    for ( i = 0; i < NB_READERS; ++i )
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pb_user_unref(readers.user);
+}
+
+static void test_devices_refresher(void)
+{
+    pb_user_t* u = pb_user_new();
+
+    g_assert_cmpint( pb_user_refresh_devices(NULL), ==, HTTP_UNKNOWN_CODE );
+    g_assert_cmpint( pb_user_set_devices_ttl(NULL, 1000), !=, 0 );
+    g_assert_cmpint( pb_user_set_devices_ttl(u, -1), !=, 0 );
+
+    // Without any lifetime, there is nothing to refresh in the background
+    g_assert_cmpint( pb_user_start_devices_refresher(NULL), !=, 0 );
+    g_assert_cmpint( pb_user_start_devices_refresher(u), !=, 0 );
+    g_assert_cmpint( pb_user_stop_devices_refresher(NULL), !=, 0 );
+    g_assert_cmpint( pb_user_stop_devices_refresher(u), ==, 0 );
+
+    pb_user_unref(u);
+}
+
+#define NB_REFRESHERS 8
+
+typedef struct {
+    int listen_fd;
+    int nb_requests;
+} devices_server_t;
+
+static void* devices_server(void *arg)
+{
+    devices_server_t *server = arg;
+    int fd = -1;
+    size_t len = 0;
+    ssize_t n = 0;
+    char request[0x1000];
+    const char *response = "HTTP/1.1 200 OK\r\n"
+                           "Content-Type: application/json\r\n"
+                           "Content-Length: 15\r\n"
+                           "Connection: close\r\n"
+                           "\r\n"
+                           "{\"devices\": []}";
+
+    // Until the test shuts the socket down
+    while ( (fd = accept(server->listen_fd, NULL, NULL)) >= 0 )
+    {
+        len = 0;
+        request[0] = '\0';
+
+        while ( (strstr(request, "\r\n\r\n") == NULL) && ((n = read(fd, request + len, sizeof(request) - len - 1)) > 0) )
+        {
+            len += (size_t) n;
+            request[len] = '\0';
+        }
+
+        g_assert( strncmp(request, "GET /v2/devices ", strlen("GET /v2/devices ")) == 0 );
+        __atomic_add_fetch(&server->nb_requests, 1, __ATOMIC_SEQ_CST);
+
+        // A slow answer: the other callers arrive while the request is running
+        usleep(100000);
+        g_assert_cmpint( write(fd, response, strlen(response)), ==, (ssize_t) strlen(response) );
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static void* refresh_devices(void *arg)
+{
+    return GINT_TO_POINTER(pb_user_refresh_devices(arg));
+}
+
+static void test_devices_single_flight(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    devices_server_t server = { .listen_fd = socket(AF_INET, SOCK_STREAM, 0), .nb_requests = 0 };
+    pthread_t server_thread;
+    pthread_t callers[NB_REFRESHERS];
+    char url[64];
+    char *api_url = NULL;
+    pb_user_t *u = pb_user_new();
+    pb_config_t *config = pb_config_new();
+    void *res = NULL;
+    int i = 0;
+
+    memset(&addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint( bind(server.listen_fd, (struct sockaddr *) &addr, sizeof(addr)), ==, 0 );
+    g_assert_cmpint( listen(server.listen_fd, NB_REFRESHERS), ==, 0 );
+    g_assert_cmpint( getsockname(server.listen_fd, (struct sockaddr *) &addr, &addr_len), ==, 0 );
+    g_snprintf(url, sizeof(url), "http://127.0.0.1:%d/v2/", ntohs(addr.sin_port) );
+
+    g_assert_cmpint( pb_config_set_api_url(config, url), ==, 0 );
+    api_url = pb_config_get_api_url(config);
+    g_assert_cmpstr( api_url, ==, url );
+    free(api_url);
+    pb_user_set_config(u, config);
+    pb_config_unref(config);
+    g_assert_cmpint( pb_user_set_devices_ttl(u, 60000), ==, 0 );
+    pthread_create(&server_thread, NULL, devices_server, &server);
+
+    // The callers share a single request
+    for ( i = 0; i < NB_REFRESHERS; ++i )
+    {
+        pthread_create(&callers[i], NULL, refresh_devices, u);
+    }
+
+    for ( i = 0; i < NB_REFRESHERS; ++i )
+    {
+        pthread_join(callers[i], &res);
+        g_assert( (GPOINTER_TO_INT(res) == HTTP_OK) || (GPOINTER_TO_INT(res) == HTTP_NOT_MODIFIED) );
+    }
+
+    g_assert_cmpint( __atomic_load_n(&server.nb_requests, __ATOMIC_SEQ_CST), ==, 1 );
+    g_assert_nonnull( pb_user_get_devices(u) );
+
+    // Within the lifetime of the list, nothing is requested
+    g_assert_cmpint( pb_user_refresh_devices(u), ==, HTTP_NOT_MODIFIED );
+    g_assert_cmpint( __atomic_load_n(&server.nb_requests, __ATOMIC_SEQ_CST), ==, 1 );
+
+    shutdown(server.listen_fd, SHUT_RDWR);
+    pthread_join(server_thread, NULL);
+    close(server.listen_fd);
+
+    pb_user_unref(u);
+}
+
+static void test_devices_cache(void)
+{
+    pb_user_t* u = pb_user_new();
+
+    g_assert_cmpint( pb_user_set_devices_cache(NULL, "devices.cache"), !=, 0 );
+    g_assert_cmpint( pb_user_set_devices_cache(u, NULL), !=, 0 );
+
+    // Without any cache, the devices stay to be retrieved
+    g_assert_cmpint( pb_user_set_devices_cache(u, "no_such_devices.cache"), ==, 0 );
+    g_assert_null( pb_user_get_devices(u) );
+
+    pb_user_unref(u);
+}
+
 // http_code_t pb_user_get_info(pb_user_t *p_user);
 // pb_device_t* pb_user_get_devices_list(const pb_user_t* p_user);
 
@@ -82,6 +332,12 @@ int main (int argc, char *argv[])
 
     g_test_add_func("/user/empty-user", test_empty_user);
     g_test_add_func("/user/config-to-user", test_config_to_user);
+    g_test_add_func("/user/snapshot-devices", test_snapshot_devices);
+    g_test_add_func("/user/device-iden-copy", test_device_iden_copy);
+    g_test_add_func("/user/publish-under-readers", test_publish_under_readers);
+    g_test_add_func("/user/devices-refresher", test_devices_refresher);
+    g_test_add_func("/user/devices-single-flight", test_devices_single_flight);
+    g_test_add_func("/user/devices-cache", test_devices_cache);
     // g_test_add_func("/user/get-user-info", test_get_user_info);
 
     return g_test_run ();